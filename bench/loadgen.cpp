@@ -0,0 +1,426 @@
+// 聊天室HTTP接口端到端压测工具
+//
+// 注册并登录N个模拟用户、创建房间，然后按配置的比例发送
+// /api/rooms/send、/api/rooms/messages 和 /api/rooms 请求。
+//
+// 两种模式：
+//   --rate R         开环模式，按固定速率R(请求/秒)调度请求。延迟从请求"计划发出"的时间算起，
+//                    服务器变慢导致请求排队时，排队时间也计入延迟（修正协调遗漏）。
+//   --concurrency C  闭环模式，C个并发连接依次发送请求。
+//
+// 示例: chat_loadgen --users 50 --rooms 5 --rate 2000 --duration 30 --mix 20:70:10
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// 压测配置
+struct LoadConfig {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int users = 20;
+    int rooms = 4;
+    int duration_seconds = 10;
+    double rate = 0;              // 大于0时为开环模式
+    int concurrency = 16;         // 闭环模式的并发数，开环模式下为工作线程数
+    int mix_send = 20;            // 请求比例
+    int mix_messages = 70;
+    int mix_rooms = 10;
+    int history_limit = 50;
+    bool json_output = false;
+};
+
+// 高精度延迟直方图：每个2的幂区间细分为32个桶，相对误差约3%
+class LatencyRecorder {
+private:
+    static const int kSubBuckets = 32;
+    static const int kOctaves = 40;
+    std::vector<uint64_t> buckets;
+    uint64_t total = 0;
+    uint64_t max_ns = 0;
+
+    static int indexFor(uint64_t ns) {
+        if (ns < kSubBuckets) {
+            return (int)ns;
+        }
+        int msb = 63 - __builtin_clzll(ns);
+        int shift = msb - 5;
+        return (shift + 1) * kSubBuckets + (int)((ns >> shift) & (kSubBuckets - 1));
+    }
+
+    static uint64_t valueFor(int index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        int shift = index / kSubBuckets - 1;
+        uint64_t sub = index % kSubBuckets;
+        return ((kSubBuckets + sub) << shift) + (1ull << shift) / 2;
+    }
+
+public:
+    LatencyRecorder() : buckets(kSubBuckets * kOctaves, 0) {}
+
+    void record(uint64_t ns) {
+        int index = std::min(indexFor(ns), (int)buckets.size() - 1);
+        buckets[index]++;
+        total++;
+        max_ns = std::max(max_ns, ns);
+    }
+
+    void merge(const LatencyRecorder& other) {
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        total += other.total;
+        max_ns = std::max(max_ns, other.max_ns);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_ns; }
+
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t target = (uint64_t)std::ceil(p / 100.0 * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            seen += buckets[i];
+            if (seen >= target) {
+                return std::min(valueFor((int)i), max_ns);
+            }
+        }
+        return max_ns;
+    }
+};
+
+// 请求类型
+enum RequestKind { KIND_SEND, KIND_MESSAGES, KIND_ROOMS, KIND_COUNT };
+static const char* const kKindNames[KIND_COUNT] = {"/api/rooms/send", "/api/rooms/messages", "/api/rooms"};
+
+// 单个工作线程的统计
+struct WorkerStats {
+    LatencyRecorder latency[KIND_COUNT];
+    uint64_t errors[KIND_COUNT] = {0};
+};
+
+// 发送一个HTTP请求并读取完整响应（服务器使用Connection: close）
+static bool httpRequest(const LoadConfig& config, const std::string& method, const std::string& path,
+                        const std::string& token, const std::string& body, int& status, std::string& response_body) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct timeval timeout = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    inet_pton(AF_INET, config.host.c_str(), &address.sin_addr);
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return false;
+    }
+
+    std::string request = method + " " + path + " HTTP/1.1\r\n"
+                          "Host: " + config.host + "\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: " + std::to_string(body.length()) + "\r\n";
+    if (!token.empty()) {
+        request += "Authorization: Bearer " + token + "\r\n";
+    }
+    request += "Connection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < request.length()) {
+        ssize_t n = write(fd, request.data() + sent, request.length() - sent);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        sent += n;
+    }
+
+    std::string response;
+    char buffer[16384];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, n);
+    }
+    close(fd);
+
+    if (response.compare(0, 5, "HTTP/") != 0 || response.length() < 12) {
+        return false;
+    }
+    status = std::atoi(response.c_str() + 9);
+    size_t header_end = response.find("\r\n\r\n");
+    response_body = header_end == std::string::npos ? "" : response.substr(header_end + 4);
+    return true;
+}
+
+// 发送JSON请求并解析响应，返回success字段
+static bool apiCall(const LoadConfig& config, const std::string& path, const std::string& token,
+                    const json& body, json& result) {
+    int status = 0;
+    std::string response_body;
+    if (!httpRequest(config, "POST", path, token, body.dump(), status, response_body) || status != 200) {
+        return false;
+    }
+    try {
+        result = json::parse(response_body);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return result.value("success", false);
+}
+
+// 注册并登录模拟用户，创建压测房间
+static bool prepare(const LoadConfig& config, std::vector<std::string>& tokens, std::vector<int>& room_ids) {
+    std::string run_id = std::to_string(std::chrono::system_clock::now().time_since_epoch().count() % 1000000);
+    for (int i = 0; i < config.users; ++i) {
+        std::string username = "lg" + run_id + "_" + std::to_string(i);
+        json result;
+        apiCall(config, "/api/register", "", {{"username", username}, {"password", "loadgen"},
+                                              {"email", username + "@loadgen.local"}}, result);
+        if (!apiCall(config, "/api/login", "", {{"username", username}, {"password", "loadgen"}}, result)) {
+            std::cerr << "登录模拟用户失败: " << username << std::endl;
+            return false;
+        }
+        tokens.push_back(result["token"]);
+    }
+
+    for (int i = 0; i < config.rooms; ++i) {
+        json result;
+        if (!apiCall(config, "/api/rooms/create", tokens[0],
+                     {{"name", "loadgen-" + run_id + "-" + std::to_string(i)}, {"description", "压测房间"}}, result)) {
+            std::cerr << "创建压测房间失败" << std::endl;
+            return false;
+        }
+        room_ids.push_back(result["room_id"]);
+    }
+    return true;
+}
+
+// 执行一次随机请求
+static bool issueRequest(const LoadConfig& config, RequestKind kind, const std::string& token, int room_id,
+                         std::mt19937& rng) {
+    int status = 0;
+    std::string response_body;
+    bool ok = false;
+    switch (kind) {
+        case KIND_SEND: {
+            json body = {{"room_id", room_id},
+                         {"message", "压测消息 load test message #" + std::to_string(rng() % 100000)}};
+            ok = httpRequest(config, "POST", kKindNames[kind], token, body.dump(), status, response_body);
+            break;
+        }
+        case KIND_MESSAGES: {
+            json body = {{"room_id", room_id}, {"limit", config.history_limit}};
+            ok = httpRequest(config, "POST", kKindNames[kind], token, body.dump(), status, response_body);
+            break;
+        }
+        default:
+            ok = httpRequest(config, "GET", kKindNames[kind], token, "", status, response_body);
+            break;
+    }
+    // 只检查success字段，避免为每个响应做完整的JSON解析
+    return ok && status == 200 && (response_body.find("\"success\":true") != std::string::npos ||
+                                   response_body.find("\"success\": true") != std::string::npos);
+}
+
+static RequestKind pickKind(const LoadConfig& config, std::mt19937& rng) {
+    int total = config.mix_send + config.mix_messages + config.mix_rooms;
+    int r = (int)(rng() % total);
+    if (r < config.mix_send) {
+        return KIND_SEND;
+    }
+    if (r < config.mix_send + config.mix_messages) {
+        return KIND_MESSAGES;
+    }
+    return KIND_ROOMS;
+}
+
+static void printUsage() {
+    std::cout << "用法: chat_loadgen [选项]\n"
+              << "  --host HOST          服务器地址 (默认127.0.0.1)\n"
+              << "  --port PORT          服务器端口 (默认8080)\n"
+              << "  --users N            模拟用户数 (默认20)\n"
+              << "  --rooms N            压测房间数 (默认4)\n"
+              << "  --duration SEC       压测时长 (默认10)\n"
+              << "  --rate RPS           开环模式的目标速率\n"
+              << "  --concurrency N      闭环并发数/开环工作线程数 (默认16)\n"
+              << "  --mix S:M:R          send:messages:rooms 请求比例 (默认20:70:10)\n"
+              << "  --limit N            拉取历史消息的条数 (默认50)\n"
+              << "  --json               以JSON格式输出结果\n";
+}
+
+static bool parseArgs(int argc, char** argv, LoadConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--host") config.host = next();
+        else if (arg == "--port") config.port = std::stoi(next());
+        else if (arg == "--users") config.users = std::max(1, std::stoi(next()));
+        else if (arg == "--rooms") config.rooms = std::max(1, std::stoi(next()));
+        else if (arg == "--duration") config.duration_seconds = std::max(1, std::stoi(next()));
+        else if (arg == "--rate") config.rate = std::stod(next());
+        else if (arg == "--concurrency") config.concurrency = std::max(1, std::stoi(next()));
+        else if (arg == "--limit") config.history_limit = std::stoi(next());
+        else if (arg == "--json") config.json_output = true;
+        else if (arg == "--mix") {
+            std::string mix = next();
+            if (sscanf(mix.c_str(), "%d:%d:%d", &config.mix_send, &config.mix_messages, &config.mix_rooms) != 3 ||
+                config.mix_send + config.mix_messages + config.mix_rooms <= 0) {
+                std::cerr << "无效的请求比例: " << mix << std::endl;
+                return false;
+            }
+        } else {
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    LoadConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        return 1;
+    }
+
+    std::vector<std::string> tokens;
+    std::vector<int> room_ids;
+    if (!prepare(config, tokens, room_ids)) {
+        return 1;
+    }
+    if (!config.json_output) {
+        std::cout << "已准备 " << tokens.size() << " 个用户、" << room_ids.size() << " 个房间，开始"
+                  << (config.rate > 0 ? "开环" : "闭环") << "压测 " << config.duration_seconds << " 秒" << std::endl;
+    }
+
+    std::vector<WorkerStats> stats(config.concurrency);
+    std::atomic<uint64_t> next_index(0);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::seconds(config.duration_seconds);
+
+    auto worker = [&](int worker_id) {
+        std::mt19937 rng(worker_id * 7919 + 1);
+        WorkerStats& local = stats[worker_id];
+        while (true) {
+            Clock::time_point intended;
+            if (config.rate > 0) {
+                // 开环：领取下一个调度时刻，延迟从计划时刻算起
+                uint64_t index = next_index.fetch_add(1);
+                intended = start + std::chrono::nanoseconds((uint64_t)(index * 1e9 / config.rate));
+                if (intended >= end) {
+                    break;
+                }
+                std::this_thread::sleep_until(intended);
+            } else {
+                intended = Clock::now();
+                if (intended >= end) {
+                    break;
+                }
+            }
+
+            RequestKind kind = pickKind(config, rng);
+            const std::string& token = tokens[rng() % tokens.size()];
+            int room_id = room_ids[rng() % room_ids.size()];
+            bool ok = issueRequest(config, kind, token, room_id, rng);
+
+            uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - intended).count();
+            local.latency[kind].record(latency);
+            if (!ok) {
+                local.errors[kind]++;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < config.concurrency; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // 汇总结果
+    LatencyRecorder all;
+    LatencyRecorder per_kind[KIND_COUNT];
+    uint64_t errors[KIND_COUNT] = {0};
+    uint64_t total_errors = 0;
+    for (const auto& worker_stats : stats) {
+        for (int k = 0; k < KIND_COUNT; ++k) {
+            per_kind[k].merge(worker_stats.latency[k]);
+            all.merge(worker_stats.latency[k]);
+            errors[k] += worker_stats.errors[k];
+            total_errors += worker_stats.errors[k];
+        }
+    }
+
+    auto summarize = [&](const LatencyRecorder& recorder, uint64_t error_count) {
+        return json{{"requests", recorder.count()},
+                    {"errors", error_count},
+                    {"throughput", recorder.count() / elapsed},
+                    {"p50_ms", recorder.percentile(50) / 1e6},
+                    {"p99_ms", recorder.percentile(99) / 1e6},
+                    {"p999_ms", recorder.percentile(99.9) / 1e6},
+                    {"max_ms", recorder.max() / 1e6}};
+    };
+
+    json report;
+    report["mode"] = config.rate > 0 ? "open" : "closed";
+    report["target_rate"] = config.rate;
+    report["concurrency"] = config.concurrency;
+    report["elapsed_seconds"] = elapsed;
+    report["total"] = summarize(all, total_errors);
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        report["routes"][kKindNames[k]] = summarize(per_kind[k], errors[k]);
+    }
+
+    if (config.json_output) {
+        std::cout << report.dump(2) << std::endl;
+        return 0;
+    }
+
+    printf("\n%-22s %10s %8s %12s %10s %10s %10s %10s\n", "route", "requests", "errors", "req/s",
+           "p50(ms)", "p99(ms)", "p999(ms)", "max(ms)");
+    auto printRow = [&](const std::string& name, const json& row) {
+        printf("%-22s %10llu %8llu %12.1f %10.2f %10.2f %10.2f %10.2f\n", name.c_str(),
+               (unsigned long long)row["requests"].get<uint64_t>(), (unsigned long long)row["errors"].get<uint64_t>(),
+               row["throughput"].get<double>(), row["p50_ms"].get<double>(), row["p99_ms"].get<double>(),
+               row["p999_ms"].get<double>(), row["max_ms"].get<double>());
+    };
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        printRow(kKindNames[k], report["routes"][kKindNames[k]]);
+    }
+    printRow("total", report["total"]);
+    if (config.rate > 0) {
+        printf("\n开环模式：延迟从计划发出时间算起，已修正协调遗漏\n");
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+# 把static/和templates/下的文件编译为constexpr字节数组，生成内嵌资源表
+# 用法: cmake -DSOURCE_DIR=<项目目录> -DOUTPUT=<生成的.cpp> -P embed_assets.cmake
+# 每个资源同时生成ETag（内容SHA1的前16位）、响应类型，以及比原文小时的gzip压缩版本
+
+if(NOT SOURCE_DIR OR NOT OUTPUT)
+    message(FATAL_ERROR "需要指定SOURCE_DIR和OUTPUT")
+endif()
+
+get_filename_component(OUTPUT_DIR ${OUTPUT} DIRECTORY)
+set(WORK_DIR ${OUTPUT_DIR}/embed_assets_tmp)
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+file(GLOB_RECURSE ASSET_FILES RELATIVE ${SOURCE_DIR}
+    ${SOURCE_DIR}/static/*
+    ${SOURCE_DIR}/templates/*)
+list(SORT ASSET_FILES)
+
+# 按扩展名推断响应类型
+function(asset_content_type path out)
+    get_filename_component(ext ${path} EXT)
+    string(TOLOWER "${ext}" ext)
+    if(ext MATCHES "\\.html?$")
+        set(type "text/html; charset=utf-8")
+    elseif(ext MATCHES "\\.css$")
+        set(type "text/css; charset=utf-8")
+    elseif(ext MATCHES "\\.js$")
+        set(type "application/javascript; charset=utf-8")
+    elseif(ext MATCHES "\\.json$")
+        set(type "application/json")
+    elseif(ext MATCHES "\\.svg$")
+        set(type "image/svg+xml")
+    elseif(ext MATCHES "\\.png$")
+        set(type "image/png")
+    elseif(ext MATCHES "\\.jpe?g$")
+        set(type "image/jpeg")
+    elseif(ext MATCHES "\\.gif$")
+        set(type "image/gif")
+    elseif(ext MATCHES "\\.ico$")
+        set(type "image/x-icon")
+    else()
+        set(type "application/octet-stream")
+    endif()
+    set(${out} "${type}" PARENT_SCOPE)
+endfunction()
+
+# 十六进制字符串转为C数组初始化列表
+function(hex_to_array hex out)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    # 每行32个字节
+    string(REGEX REPLACE "((0x[0-9a-f][0-9a-f],){32})" "\\1\n    " bytes "${bytes}")
+    set(${out} "${bytes}" PARENT_SCOPE)
+endfunction()
+
+set(ARRAYS "")
+set(ENTRIES "")
+set(INDEX 0)
+foreach(asset ${ASSET_FILES})
+    set(path ${SOURCE_DIR}/${asset})
+    file(SIZE ${path} size)
+    file(SHA1 ${path} sha1)
+    string(SUBSTRING ${sha1} 0 16 etag)
+    asset_content_type(${asset} content_type)
+
+    set(data "nullptr")
+    if(size GREATER 0)
+        file(READ ${path} hex HEX)
+        hex_to_array("${hex}" bytes)
+        string(APPEND ARRAYS "constexpr unsigned char kAsset${INDEX}[] = {\n    ${bytes}\n};\n")
+        set(data "kAsset${INDEX}")
+    endif()
+
+    # 固定MTIME使生成结果只取决于文件内容
+    set(gzip_data "nullptr")
+    set(gzip_size 0)
+    if(size GREATER 256 AND NOT CMAKE_VERSION VERSION_LESS 3.18)
+        set(gz ${WORK_DIR}/asset${INDEX}.gz)
+        file(ARCHIVE_CREATE OUTPUT ${gz} PATHS ${path} FORMAT raw COMPRESSION GZip MTIME 0)
+        file(SIZE ${gz} compressed)
+        if(compressed LESS size)
+            file(READ ${gz} gz_hex HEX)
+            hex_to_array("${gz_hex}" gz_bytes)
+            string(APPEND ARRAYS "constexpr unsigned char kAsset${INDEX}Gzip[] = {\n    ${gz_bytes}\n};\n")
+            set(gzip_data "kAsset${INDEX}Gzip")
+            set(gzip_size ${compressed})
+        endif()
+    endif()
+
+    string(APPEND ENTRIES "    {\"${asset}\", ${data}, ${size}, ${gzip_data}, ${gzip_size}, \"${content_type}\", \"\\\"${etag}\\\"\"},\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+if(INDEX EQUAL 0)
+    # 空数组不合法，放一个不会被匹配的占位项
+    set(ENTRIES "    {\"\", nullptr, 0, nullptr, 0, \"\", \"\"},\n")
+endif()
+
+set(CONTENT "// 由cmake/embed_assets.cmake生成，不要手动修改\n\n#include \"include/embedded_assets.h\"\n\nnamespace {\n\n${ARRAYS}\n} // namespace\n\nconstexpr EmbeddedAsset kEmbeddedAssets[] = {\n${ENTRIES}};\n\nconstexpr size_t kEmbeddedAssetCount = ${INDEX};\n")
+
+# 内容不变时不改写文件，避免重新编译
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} OLD_CONTENT)
+endif()
+if(NOT "${OLD_CONTENT}" STREQUAL "${CONTENT}")
+    file(WRITE ${OUTPUT} "${CONTENT}")
+endif()
+file(REMOVE_RECURSE ${WORK_DIR})
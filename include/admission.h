@@ -0,0 +1,124 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// 请求优先级，发送消息优先于历史消息拉取
+enum RequestPriority {
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,
+    PRIORITY_LEVELS
+};
+
+// 令牌桶参数，rate_per_second为0时不限制
+struct RateLimit {
+    double rate_per_second;
+    double burst;
+};
+
+// 准入控制配置
+struct AdmissionConfig {
+    RateLimit per_user = {20, 40};          // 每个令牌（同一用户的多个登录令牌各自计算）
+    RateLimit per_ip = {50, 100};           // 每个客户端IP
+    int max_connections = 1024;             // 同时保持的连接数上限，超出时接受后立即返回503
+    int max_concurrent = 64;                // 同时执行的请求数上限
+    double low_priority_share = 0.75;       // 低优先级请求最多占用的并发比例，其余留给发送等请求
+    int queue_timeout_ms[PRIORITY_LEVELS] = {2000, 1000, 200};  // 各优先级排队等待的最长时间
+};
+
+// 按键哈希分片的令牌桶表
+// 每个分片一把锁，不同键的请求大多落在不同分片上；分片内的桶过多时清理已经回满的桶（等价于新桶）。
+class TokenBucketTable {
+private:
+    static const size_t kShards = 64;
+    static const size_t kSweepThreshold = 1024;
+
+    struct Bucket {
+        double tokens;
+        uint64_t updated_ns;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+        size_t sweep_at = kSweepThreshold;   // 桶数达到该值时清理；清理后设为剩余桶数的两倍，清理的开销均摊到每次插入
+    };
+
+    RateLimit limit;
+    Shard shards[kShards];
+
+    void sweep(Shard& shard, uint64_t now_ns);
+
+public:
+    explicit TokenBucketTable(const RateLimit& limit) : limit(limit) {}
+
+    // 取一个令牌；桶已空时返回false，并给出至少需要等待的毫秒数
+    bool take(const std::string& key, uint64_t now_ns, uint64_t& retry_after_ms);
+};
+
+// 全局并发限制，按优先级排队
+// 不阻塞调用线程：未饱和且没有排队者时只做一次CAS；饱和时由调用者（反应器）把请求放进自己的队列，
+// 这里只记录各优先级的排队数，名额释放后排队者按优先级重试，超过排队期限的请求被拒绝。
+class ConcurrencyLimiter {
+private:
+    int ceilings[PRIORITY_LEVELS];
+    int timeouts_ms[PRIORITY_LEVELS];
+    std::atomic<int> inflight;
+    std::atomic<int> waiting[PRIORITY_LEVELS];
+    std::atomic<int> waiting_total;
+
+    bool tryAcquire(int ceiling);
+
+public:
+    explicit ConcurrencyLimiter(const AdmissionConfig& config);
+
+    // 新到达的请求：没有任何排队者且未饱和时占用名额
+    bool acquire(RequestPriority priority);
+
+    // 排队中的请求：没有更高优先级的排队者且未饱和时占用名额
+    bool acquireQueued(RequestPriority priority);
+
+    // 请求进入或离开（获得名额或超时）排队
+    void enqueue(RequestPriority priority);
+    void dequeue(RequestPriority priority);
+
+    // 归还名额，返回是否有排队者需要重试
+    bool release();
+
+    int queueTimeoutMs(RequestPriority priority) const { return timeouts_ms[priority]; }
+};
+
+// 准入控制：限流、并发限制和过载丢弃
+class AdmissionController {
+private:
+    AdmissionConfig config;
+    TokenBucketTable user_buckets;
+    TokenBucketTable ip_buckets;
+    ConcurrencyLimiter limiter;
+
+public:
+    explicit AdmissionController(const AdmissionConfig& config);
+
+    // 按IP和令牌限流；超限时返回false，并给出建议的重试秒数
+    // 在反应器上调用，不访问存储：按用户限流的键是令牌本身的哈希，令牌不需要先解析为用户名，
+    // 大量随机令牌的请求由按IP的配额限制，不会在准入前引起存储查询。
+    bool allowRequest(const std::string& client_ip, const std::string& token, int& retry_after_seconds);
+
+    // 获取执行名额，不阻塞；成功后必须调用release()。失败时调用者可以enqueue()后排队，
+    // 在名额释放时用acquireQueued()重试，获得名额或放弃时dequeue()
+    bool acquire(RequestPriority priority) { return limiter.acquire(priority); }
+    bool acquireQueued(RequestPriority priority) { return limiter.acquireQueued(priority); }
+    void enqueue(RequestPriority priority) { limiter.enqueue(priority); }
+    void dequeue(RequestPriority priority) { limiter.dequeue(priority); }
+    int queueTimeoutMs(RequestPriority priority) const { return limiter.queueTimeoutMs(priority); }
+
+    // 归还名额，返回true表示有请求在排队，应通知排队的反应器重试
+    bool release() { return limiter.release(); }
+};
+
+#endif // ADMISSION_H
@@ -0,0 +1,100 @@
+#ifndef ATTACHMENT_STORE_H
+#define ATTACHMENT_STORE_H
+
+#include "sha256.h"
+#include "worker_pool.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+// 附件存储配置
+struct AttachmentConfig {
+    std::string directory = "data/attachments";   // 存储根目录
+    uint64_t max_bytes = 32ull << 20;              // 单个附件的大小上限
+    size_t chunk_bytes = 64 << 10;                 // 上传时攒够该大小再写盘，也是每个进行中上传的缓冲区大小
+    int commit_threads = 2;                        // 执行提交（同步临时文件并改名）的后台线程数
+};
+
+// 附件元信息，id为内容的SHA-256（64位小写十六进制）
+struct AttachmentInfo {
+    std::string id;
+    uint64_t size = 0;
+    std::string content_type;
+};
+
+class AttachmentStore;
+
+// 进行中的上传：数据攒成固定大小的块写入临时文件，同时增量计算SHA-256
+// 未提交就销毁时删除临时文件
+class AttachmentUpload {
+public:
+    ~AttachmentUpload();
+
+    // 追加数据，超过大小上限或写盘失败时返回false
+    bool write(const char* data, size_t len);
+
+    uint64_t size() const { return total; }
+
+private:
+    friend class AttachmentStore;
+    AttachmentUpload(const std::string& temp_path, int fd, size_t chunk_bytes, uint64_t max_bytes,
+                     const std::string& content_type);
+
+    bool flushChunk();
+
+    std::string temp_path;
+    int fd;
+    Sha256 hash;
+    std::vector<char> chunk;
+    size_t chunk_used;
+    uint64_t total;
+    uint64_t max_bytes;
+    std::string content_type;
+    bool failed;
+};
+
+// 按内容寻址的附件存储
+// 文件保存在 <目录>/objects/<id前两位>/<id>，内容类型保存在同名的.type文件中。
+// 上传先写入 <目录>/tmp 下的临时文件，完成后按摘要改名到最终位置；相同内容只保存一份。
+class AttachmentStore {
+public:
+    AttachmentStore();
+
+    // 创建目录并清理上次遗留的临时文件
+    bool open(const AttachmentConfig& attachment_config);
+
+    bool enabled() const { return opened; }
+    const AttachmentConfig& getConfig() const { return config; }
+
+    // 开始一个上传，失败返回nullptr
+    std::unique_ptr<AttachmentUpload> beginUpload(const std::string& content_type);
+
+    // 完成上传：同步临时文件后改名为内容地址，内容已存在时丢弃临时文件
+    bool commit(AttachmentUpload& upload, AttachmentInfo& info);
+
+    // 在后台线程上执行commit，done交回调用线程的事件循环执行，反应器不等待大文件落盘
+    typedef std::function<void(bool ok, const AttachmentInfo& info)> CommitCallback;
+    void commitAsync(std::shared_ptr<AttachmentUpload> upload, CommitCallback done);
+
+    // 附件是否存在
+    bool exists(const std::string& id) const;
+
+    // 以只读方式打开附件并填写元信息，返回文件描述符（由调用者关闭），失败返回-1
+    int openForRead(const std::string& id, AttachmentInfo& info) const;
+
+    // id是否为合法的SHA-256十六进制串，防止拼出存储目录之外的路径
+    static bool isValidId(const std::string& id);
+
+private:
+    AttachmentConfig config;
+    bool opened;
+    std::atomic<uint64_t> next_upload;
+    WorkerPool committers;
+
+    std::string objectPath(const std::string& id) const;
+};
+
+#endif // ATTACHMENT_STORE_H
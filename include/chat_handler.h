@@ -3,50 +3,95 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include "storage.h"
+#include "search_index.h"
+#include "room_fanout.h"
+#include "presence.h"
+#include "read_cursors.h"
+#include "attachment_store.h"
+#include "request_coalescer.h"
+#include "content_filter.h"
 #include <unordered_map>
 #include <mutex>
-#include <hiredis/hiredis.h>
-#include <mysql/mysql.h>
+#include <chrono>
 
-// 消息结构体
-struct ChatMessage {
-    std::string username;
-    std::string content;
-    std::string timestamp;
+// 搜索结果
+struct SearchResult {
+    int room_id;
+    ChatMessage message;
 };
 
-// 聊天室结构体
-struct ChatRoom {
-    int id;
-    std::string name;
-    std::string description;
-    std::string creator;
-    std::string created_at;
+// 发送消息的结果，失败时客户端据此给出不同的提示
+enum SendResult {
+    SEND_OK,
+    SEND_INVALID_TOKEN,   // 令牌无效或已过期
+    SEND_INVALID_TEXT,    // 内容不是合法的UTF-8
+    SEND_FILTERED,        // 内容包含敏感词且过滤器配置为拒绝
+    SEND_FAILED           // 房间不存在或存储写入失败
+};
+
+// 多房间同步中一个房间的结果
+struct RoomSyncResult {
+    int room_id = 0;
+    bool ok = false;       // 读取失败时为false；不存在的房间与没有新消息的房间一样返回空页
+    MessagePage page;      // 序号大于客户端last_seq的消息
 };
 
 class ChatHandler {
 private:
-    // Redis连接
-    redisContext* redis_context;
-    // MySQL连接
-    MYSQL* mysql_connection;
-    
-    // 用户令牌映射
-    std::unordered_map<std::string, std::string> user_tokens;
-    std::mutex tokens_mutex;
+    // 存储后端
+    std::unique_ptr<Storage> storage;
+    
+    // 房间消息全文索引
+    SearchIndex search_index;
+    
+    // 房间新消息推送（长轮询）
+    RoomFanout fanout;
+    
+    // 房间在线用户，由发送、拉取消息和心跳更新
+    PresenceTracker presence;
+    
+    // 用户在各房间的已读位置，定期批量写回存储
+    ReadCursorTable read_cursors;
+    
+    // 消息附件，按内容寻址保存在本地磁盘
+    AttachmentStore attachments;
+    
+    // 历史消息读取：同一房间、同一游标的并发读取合并为一次，房间有新消息时失效
+    RequestCoalescer history_reads;
+    
+    // 发送前的敏感词过滤，词表修改后在后台重新编译
+    ContentFilter content_filter;
+    
+    // 房间列表的版本，用于同步接口判断客户端的房间列表是否过期；
+    // 本实例创建、删除房间时立即失效，其他实例的修改在几秒内反映出来
+    std::mutex room_list_mutex;
+    std::string room_list_version;
+    std::chrono::steady_clock::time_point room_list_loaded;
+    bool room_list_valid = false;
+    uint64_t room_list_generation = 0;
+    void invalidateRoomList();
+
+    // 发送流水线每批最多合并的消息数
+    static const size_t kSendBatchSize = 128;
 
     // 创建用户会话令牌
     std::string createToken(const std::string& username);
     
+    // 在事件循环线程上经发送流水线合批写入，否则直接写入
+    void submitAppend(RoomAppend append);
+    
 public:
     ChatHandler();
     ~ChatHandler();
 
-    // 初始化连接
-    bool initialize(const std::string& redis_host, int redis_port, 
-                    const std::string& mysql_host, int mysql_port,
-                    const std::string& mysql_user, const std::string& mysql_password,
-                    const std::string& mysql_db);
+    // 使用给定的存储后端初始化
+    bool initialize(std::unique_ptr<Storage> backend);
+    
+    // 启用跨实例的新消息推送通道，多个实例共享同一存储时使用
+    bool enableFanoutTransport(std::unique_ptr<FanoutTransport> transport);
 
     // 验证用户令牌
     bool validateToken(const std::string& token, std::string& username);
@@ -57,8 +102,8 @@ public:
     // 用户登录
     bool loginUser(const std::string& username, const std::string& password, std::string& token);
     
-    // 发送消息
-    bool sendMessage(const std::string& token, const std::string& message);
+    // 发送消息，内容不是合法的UTF-8时拒绝；启用敏感词过滤时命中的消息被拒绝或替换后发送（以下各发送方法相同）
+    SendResult sendMessage(const std::string& token, const std::string& message);
     
     // 获取消息历史
     std::vector<ChatMessage> getMessages(const std::string& token, int limit);
@@ -73,13 +118,97 @@ public:
     // 获取房间列表
     std::vector<ChatRoom> getRooms();
     
+    // 用户在各房间的未读消息数：房间最新序号减去已读位置
+    bool getUnreadCounts(const std::string& username, const std::vector<int>& room_ids,
+                         std::unordered_map<int, int>& counts);
+    
     // 发送房间消息
-    bool sendRoomMessage(const std::string& token, int room_id, const std::string& message);
+    SendResult sendRoomMessage(const std::string& token, int room_id, const std::string& message);
     
     // 获取房间消息
     std::vector<ChatMessage> getRoomMessages(const std::string& token, int room_id, int limit);
     
-    // 关闭连接
+    // 按消息序号分页获取房间消息
+    // before_seq > 0: 返回序号小于before_seq的最近limit条消息（向前翻页）
+    // after_seq > 0:  返回序号大于after_seq的最早limit条消息（增量拉取）
+    // 两者都为0时返回最新的limit条消息
+    bool getRoomMessagesPage(const std::string& token, int room_id, int before_seq, int after_seq,
+                             int limit, MessagePage& page);
+    
+    // 以下为发送和拉取消息热点路径的异步版本，结果通过回调返回
+    // 存储后端支持时不阻塞调用线程，回调可能在方法返回之后才在同一事件循环线程上执行
+    void validateTokenAsync(const std::string& token, std::function<void(bool ok, const std::string& username)> done);
+    // attachments为消息引用的附件ID，须是已经上传的附件
+    void sendRoomMessageAsync(const std::string& token, int room_id, const std::string& message,
+                              const std::vector<std::string>& attachment_ids, std::function<void(SendResult result)> done);
+    // 批量发送，messages为(room_id, 内容)；seqs与messages一一对应，发送失败的消息序号为0
+    void sendRoomMessagesAsync(const std::string& token, const std::vector<std::pair<int, std::string>>& messages,
+                               std::function<void(bool ok, const std::vector<int>& seqs)> done);
+    void getRoomMessagesPageAsync(const std::string& token, int room_id, int before_seq, int after_seq, int limit,
+                                  std::function<void(bool ok, MessagePage& page)> done);
+    // 与getRoomMessagesPageAsync相同，但同一房间、同一游标和条数的并发请求共享一次存储读取：
+    // 由发起读取的请求调用一次render把消息页序列化为响应内容，所有等待者得到同一份内容
+    void getRoomMessagesSharedAsync(const std::string& token, int room_id, int before_seq, int after_seq, int limit,
+                                    std::function<std::string(MessagePage& page)> render,
+                                    std::function<void(bool ok, const RequestCoalescer::Result& content)> done);
+    
+    // 多房间同步：cursors为(room_id, last_seq)，一次取回各房间序号大于last_seq的消息（每个房间至多limit条），
+    // last_seq为0时取最新的limit条。各房间的读取同时发出，存储后端支持时在同一连接上流水线执行。
+    void syncRoomsAsync(const std::string& token, const std::vector<std::pair<int, int>>& cursors, int limit,
+                        std::function<void(bool ok, const std::string& username,
+                                           std::vector<RoomSyncResult>& results)> done);
+    
+    // 房间列表的版本（房间ID、名称、描述和创建者的摘要），列表变化时改变
+    std::string roomListVersion();
+    
+    // 历史消息读取结果的保留时间（毫秒），0表示只合并同时在途的读取
+    void setHistoryCacheWindow(int window_ms) { history_reads.setCacheWindow(window_ms); }
+    
+    // 长轮询：有序号大于after_seq的消息时立即返回，否则等待新消息或timeout_ms超时（返回空页）
+    // 新消息唤醒或超时时done可能在其他线程上调用
+    void waitRoomMessagesAsync(const std::string& token, int room_id, int after_seq, int limit, int timeout_ms,
+                               std::function<void(bool ok, MessagePage& page)> done);
+    
+    // 房间心跳，leaving为true时表示离开房间
+    void heartbeatAsync(const std::string& token, int room_id, bool leaving, std::function<void(bool ok)> done);
+    
+    // 查询房间在线人数和在线用户（每个房间至多max_users个）
+    void getRoomPresenceAsync(const std::string& token, const std::vector<int>& room_ids, size_t max_users,
+                              std::function<void(bool ok, const std::vector<RoomPresence>& rooms)> done);
+    
+    // 把房间标记为已读到seq，seq <= 0时标记到最新消息；last_read为标记后的已读位置
+    void markRoomReadAsync(const std::string& token, int room_id, int seq,
+                           std::function<void(bool ok, int last_read)> done);
+    
+    // 启用附件上传和下载
+    bool enableAttachments(const AttachmentConfig& config);
+    
+    // 启用敏感词过滤，词表无法读取时返回false
+    bool enableContentFilter(const ContentFilterConfig& config);
+    
+    // 开始上传附件，附件未启用时返回nullptr；令牌由调用者经validateTokenAsync在接收数据的同时校验
+    std::unique_ptr<AttachmentUpload> beginAttachmentUpload(const std::string& content_type);
+    
+    // 上传的数据接收完毕，在后台线程上保存附件，done在调用线程的事件循环上收到info（id为内容的SHA-256）
+    void commitAttachmentAsync(std::shared_ptr<AttachmentUpload> upload, AttachmentStore::CommitCallback done);
+    
+    // 打开附件用于下载，返回文件描述符（由调用者关闭），令牌无效或附件不存在时返回-1
+    int openAttachment(const std::string& token, const std::string& id, AttachmentInfo& info);
+    
+    // 附件是否已经上传
+    bool hasAttachment(const std::string& id) const { return attachments.exists(id); }
+    
+    // 单个附件的大小上限，附件未启用时为0
+    uint64_t maxAttachmentBytes() const { return attachments.enabled() ? attachments.getConfig().max_bytes : 0; }
+    
+    // 搜索房间消息，room_id为0时搜索所有房间
+    bool searchRoomMessages(const std::string& token, const std::string& query, int room_id, int limit,
+                            std::vector<SearchResult>& results);
+    
+    // 从已有历史消息并行重建全文索引，每个线程负责一部分房间
+    bool rebuildSearchIndex(int thread_count);
+    
+    // 关闭存储后端
     void close();
 };
 
@@ -4,6 +4,8 @@
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <memory>
+#include "server.h"
 
 // API请求处理器
 class ApiClient {
@@ -23,8 +25,9 @@ public:
     // 处理获取消息请求
     static std::string handleGetMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
     
-    // 处理聊天页面请求
+    // 聊天页面和房间页面，内联房间列表和最近消息
     static std::string handleChatPage(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
+    static std::string handleRoomPage(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
 
     // 房间相关API
     // 创建房间请求
@@ -36,14 +39,57 @@ public:
     // 获取房间列表
     static std::string handleGetRooms(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
     
-    // 发送房间消息
-    static std::string handleSendRoomMessage(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
+    // 发送房间消息（异步，通过respond返回响应）
+    static void handleSendRoomMessage(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond);
     
-    // 获取房间消息历史
-    static std::string handleGetRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
+    // 批量发送房间消息（异步，通过respond返回响应）
+    static void handleSendRoomMessageBatch(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                           std::function<void(const std::string&)> respond);
     
-    // 处理房间页面请求
-    static std::string handleRoomPage(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
+    // 获取房间消息历史（异步，通过respond返回响应）
+    static void handleGetRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond);
+    
+    // 长轮询房间新消息（异步，等待期间不占用反应器线程）
+    static void handlePollRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                       std::function<void(const std::string&)> respond);
+    
+    // 房间心跳（异步，通过respond返回响应）
+    static void handleRoomHeartbeat(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                    std::function<void(const std::string&)> respond);
+    
+    // 标记房间已读（异步，通过respond返回响应）
+    static void handleMarkRoomRead(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                   std::function<void(const std::string&)> respond);
+    
+    // 查询房间在线用户（异步，通过respond返回响应）
+    static void handleGetRoomPresence(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond);
+    
+    // 多房间同步：一次请求取回所有已加入房间的新消息和房间列表的变化（异步，通过respond返回响应）
+    static void handleSync(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                           std::function<void(const std::string&)> respond);
+    
+    // 一次同步请求最多包含的房间数
+    static const size_t kMaxSyncRooms = 100;
+    
+    // 拉取消息（历史消息、长轮询和同步）时每个房间一次最多返回的条数
+    static constexpr int kMaxPageLimit = 100;
+    
+    // 搜索房间消息
+    static std::string handleSearchMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
+    
+    // 上传附件（流式），请求体为文件内容，Content-Type为文件类型
+    static std::unique_ptr<UploadSink> handleUploadAttachment(const std::unordered_map<std::string, std::string>& headers,
+                                                              std::string& error);
+    
+    // 下载附件 /api/attachments?id=...，令牌取自Authorization头或Cookie
+    static void handleDownloadAttachment(const std::unordered_map<std::string, std::string>& headers, FileResponse& file);
+    
+    // 导出请求追踪（Chrome trace_event JSON）/debug/trace，只允许来自本机（127.0.0.0/8）的请求；
+    // 采样率由启动参数--trace-sample设置
+    static std::string handleTraceDump(const std::unordered_map<std::string, std::string>& headers, const std::string& body);
 };
 
 #endif // CLIENT_H
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// 命中敏感词时的处理方式
+enum ContentFilterAction {
+    FILTER_REJECT,   // 拒绝发送
+    FILTER_MASK      // 把命中的每个字符替换为'*'后发送
+};
+
+// 敏感词过滤配置
+struct ContentFilterConfig {
+    std::string words_path;                  // 词表文件，每行一个词，忽略空行和#开头的行
+    ContentFilterAction action = FILTER_MASK;
+    int reload_interval_seconds = 5;         // 检查词表文件修改时间的间隔，0表示不自动重新加载
+};
+
+// 由词表编译出的Aho-Corasick自动机，构建后只读，可被多个线程同时使用
+// 按UTF-8字节匹配，中文词不需要分词；ASCII字母不区分大小写。
+// 转移表为双数组：状态s经字节c转移到t = base[s] + c，当且仅当check[t] == s；
+// 每个状态的转移和失配信息存放在一起，匹配时每个字节通常只访问一两个缓存行。
+class WordAutomaton {
+public:
+    // 编译词表，重复的词和空词被忽略
+    explicit WordAutomaton(const std::vector<std::string>& words);
+
+    // 是否包含任何敏感词
+    bool contains(const std::string& text) const;
+
+    // 把命中的部分按字符替换为'*'写入masked，返回是否有命中；没有命中时masked不变
+    bool mask(const std::string& text, std::string& masked) const;
+
+    size_t wordCount() const { return word_count; }
+    size_t arraySize() const { return units.size(); }   // 双数组的长度
+
+private:
+    // 一个位置上的状态，16字节，转移和失配所需的字段在同一缓存行内
+    struct Unit {
+        int32_t base;       // 子状态的起始位置
+        int32_t check;      // 父状态，-1表示空位
+        int32_t fail;       // 失配时转到的状态
+        uint32_t out_len;   // 以该状态结尾的最长敏感词的字节数（含经失配链可达的词），0表示没有
+    };
+
+    std::vector<Unit> units;   // 按位置下标
+    size_t word_count = 0;
+
+    // 从状态s读入字节c后的状态
+    int32_t step(int32_t s, unsigned char c) const;
+
+    // 对每个命中调用on_match(结束位置, 长度)，on_match返回false时停止
+    template <typename OnMatch>
+    void scan(const std::string& text, OnMatch on_match) const;
+};
+
+// 消息内容过滤器
+// 词表在后台线程上编译，完成后原子地替换当前自动机；正在过滤的消息继续使用旧自动机，不会阻塞发送。
+class ContentFilter {
+public:
+    ContentFilter();
+    ~ContentFilter();
+
+    // 加载词表并启动重新加载线程；词表无法读取时返回false
+    bool start(const ContentFilterConfig& filter_config);
+    void stop();
+
+    // 是否已启用
+    bool enabled() const { return std::atomic_load(&automaton) != nullptr; }
+
+    // 过滤消息内容：没有命中时返回true且text不变；命中时按配置拒绝（返回false）或替换（返回true）
+    bool apply(std::string& text) const;
+
+    // 立即重新加载词表，在调用线程上编译；读取失败时保留当前自动机
+    bool reload();
+
+    // 直接使用给定的词表，供基准测试和不使用文件的场合
+    void setWords(const std::vector<std::string>& words, ContentFilterAction action);
+
+private:
+    ContentFilterConfig config;
+    std::shared_ptr<const WordAutomaton> automaton;   // 只通过std::atomic_load/atomic_store访问
+    std::atomic<int> action;
+
+    std::mutex reload_mutex;       // 保证同一时间只有一次重新加载
+    int64_t loaded_mtime_ns = 0;   // 已加载词表文件的修改时间和大小
+    int64_t loaded_size = 0;
+
+    std::thread watcher;
+    std::atomic<bool> running;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+
+    // 读取词表文件
+    static bool readWords(const std::string& path, std::vector<std::string>& words);
+
+    // 词表文件修改后重新加载
+    void run();
+};
+
+#endif // CONTENT_FILTER_H
@@ -0,0 +1,34 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <string>
+#include <cstddef>
+
+// 编译进程序的页面和静态资源，由cmake/embed_assets.cmake在构建时从static/和templates/生成
+struct EmbeddedAsset {
+    const char* path;                 // 相对项目目录的路径，如"templates/index.html"
+    const unsigned char* data;
+    size_t size;
+    const unsigned char* gzip_data;   // 没有压缩版本时为nullptr
+    size_t gzip_size;
+    const char* content_type;
+    const char* etag;                 // 带引号的ETag
+};
+
+extern const EmbeddedAsset kEmbeddedAssets[];
+extern const size_t kEmbeddedAssetCount;
+
+// 按路径查找内嵌资源，不存在时返回nullptr
+const EmbeddedAsset* findEmbeddedAsset(const std::string& path);
+
+// 设置后从该目录读取资源而不使用内嵌版本，开发时修改页面无需重新编译；空字符串恢复内嵌资源
+void setAssetOverrideDirectory(const std::string& directory);
+const std::string& assetOverrideDirectory();
+
+// 从覆盖目录读取资源，路径中含".."或文件不存在时返回false
+bool readAssetFromDisk(const std::string& path, std::string& content);
+
+// 按扩展名推断响应类型
+std::string assetContentType(const std::string& path);
+
+#endif // EMBEDDED_ASSETS_H
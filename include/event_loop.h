@@ -0,0 +1,46 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <functional>
+#include <cstdint>
+
+// 反应器线程上的事件循环，供需要非阻塞I/O的组件（如异步Redis连接）注册自己的文件描述符
+// 所有方法只能在事件循环所在的线程上调用，回调也在该线程上执行。
+class EventLoop {
+public:
+    // 参数为就绪的epoll事件（EPOLLIN/EPOLLOUT/EPOLLERR/EPOLLHUP）
+    typedef std::function<void(uint32_t events)> IoCallback;
+
+    virtual ~EventLoop() {}
+
+    // 注册fd或修改其关注的事件，events为0时保持注册但不关注任何事件
+    virtual void watch(int fd, uint32_t events, IoCallback callback) = 0;
+
+    // 取消注册，不关闭fd
+    virtual void unwatch(int fd) = 0;
+
+    // 在本轮已就绪的事件全部处理完之后执行task，用于把同一轮内到达的请求合并处理
+    virtual void post(std::function<void()> task) = 0;
+
+    // delay_ms毫秒之后在事件循环线程上执行task，返回的编号用于取消（不会为0）
+    // 定时器由事件循环的时间轮管理，精度为一个刻度（10毫秒），只会推迟不会提前触发。
+    virtual uint64_t runAfter(uint64_t delay_ms, std::function<void()> task) = 0;
+
+    // 取消尚未触发的定时器，已触发或已取消时忽略
+    virtual void cancelTimer(uint64_t id) = 0;
+
+    // 事件循环退出前调用，用于释放绑定在该循环上的资源；按注册的相反顺序执行
+    virtual void onClose(std::function<void()> hook) = 0;
+
+    // 当前线程的事件循环，不在反应器线程上时返回nullptr
+    static EventLoop* current() { return currentSlot(); }
+    static void setCurrent(EventLoop* loop) { currentSlot() = loop; }
+
+private:
+    static EventLoop*& currentSlot() {
+        static thread_local EventLoop* loop = nullptr;
+        return loop;
+    }
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,36 @@
+#ifndef LOOP_MAILBOX_H
+#define LOOP_MAILBOX_H
+
+#include "event_loop.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 事件循环的信箱：其他线程（如组提交线程）把回调交回事件循环线程执行
+// 每个事件循环一个实例，投递后写eventfd唤醒事件循环，同一次唤醒取走的回调按投递顺序执行。
+// 投递方持有shared_ptr；事件循环退出时信箱关闭，之后投递的回调不再执行。
+class LoopMailbox {
+private:
+    std::mutex mutex;
+    std::vector<std::function<void()>> tasks;
+    EventLoop* loop;
+    int event_fd;
+    bool closed;
+
+    explicit LoopMailbox(EventLoop* loop);
+
+    void drain();
+    void close();
+
+public:
+    ~LoopMailbox();
+
+    // 可以在任意线程上调用；返回false表示事件循环已经退出，task未被接收
+    bool post(std::function<void()> task);
+
+    // 当前线程事件循环的信箱，首次使用时创建；不在事件循环线程上或事件循环正在退出时返回nullptr
+    static std::shared_ptr<LoopMailbox> forCurrentLoop();
+};
+
+#endif // LOOP_MAILBOX_H
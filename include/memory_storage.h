@@ -0,0 +1,134 @@
+#ifndef MEMORY_STORAGE_H
+#define MEMORY_STORAGE_H
+
+#include "storage.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <functional>
+
+// 按键哈希分片的并发哈希表，每个分片一把锁，不同分片上的操作互不阻塞
+template <typename Value>
+class ShardedMap {
+private:
+    static const size_t kShards = 64;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Value> map;
+    };
+
+    Shard shards[kShards];
+
+    Shard& shardFor(const std::string& key) {
+        return shards[std::hash<std::string>()(key) % kShards];
+    }
+
+public:
+    // 键已存在时返回false
+    bool insert(const std::string& key, const Value& value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.emplace(key, value).second;
+    }
+
+    void set(const std::string& key, const Value& value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.map[key] = value;
+    }
+
+    // 逐个访问所有键，访问期间持有所在分片的锁
+    template <typename Visitor>
+    void forEachKey(Visitor visit) {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& entry : shard.map) {
+                visit(entry.first);
+            }
+        }
+    }
+
+    bool get(const std::string& key, Value& value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+};
+
+// 嵌入式内存存储后端
+// 用户和令牌保存在分片哈希表中；每个房间一个只追加的消息数组，消息序号即数组下标+1，
+// 追加时持有房间的写锁，读取时持有读锁，不同房间之间互不影响。
+// 数据只保存在进程内存中，重启后丢失，适合单机部署、开发和测试。
+class MemoryStorage : public Storage {
+private:
+    struct MemoryUser {
+        std::string password;
+        std::string email;
+    };
+
+    struct MemoryRoom {
+        ChatRoom info;
+        std::shared_mutex mutex;
+        std::vector<ChatMessage> messages;
+    };
+
+    ShardedMap<MemoryUser> users;
+    ShardedMap<uint32_t> tokens;   // 令牌 -> 用户编号
+
+    // 房间表读多写少，使用读写锁
+    std::shared_mutex rooms_mutex;
+    std::unordered_map<int, std::shared_ptr<MemoryRoom>> rooms;
+    std::atomic<int> next_room_id;
+
+    // 大厅消息
+    MemoryRoom lobby;
+
+    // 已读位置：用户名 -> (房间ID -> 序号)
+    std::mutex read_cursors_mutex;
+    std::unordered_map<std::string, std::unordered_map<int, int>> read_cursors;
+
+    std::shared_ptr<MemoryRoom> findRoom(int room_id);
+
+public:
+    MemoryStorage();
+
+    const char* name() const override { return "memory"; }
+    bool open() override { return true; }
+    void close() override {}
+
+    bool createUser(const std::string& username, const std::string& password, const std::string& email) override;
+    bool checkUserPassword(const std::string& username, const std::string& password) override;
+    bool listUsernames(std::vector<std::string>& usernames) override;
+
+    bool saveToken(const std::string& token, const std::string& username) override;
+    bool findToken(const std::string& token, std::string& username) override;
+
+    bool createRoom(const std::string& name, const std::string& description, const std::string& creator,
+                    int& room_id) override;
+    bool getRoom(int room_id, ChatRoom& room) override;
+    bool deleteRoom(int room_id) override;
+    std::vector<ChatRoom> listRooms() override;
+
+    bool appendRoomMessage(int room_id, ChatMessage& message) override;
+    bool readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) override;
+    bool scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) override;
+
+    bool loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) override;
+    bool saveReadCursors(const std::vector<ReadCursor>& cursors) override;
+    bool getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) override;
+
+    bool appendLobbyMessage(const ChatMessage& message) override;
+    std::vector<ChatMessage> readLobbyMessages(int limit) override;
+};
+
+#endif // MEMORY_STORAGE_H
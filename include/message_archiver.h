@@ -0,0 +1,81 @@
+#ifndef MESSAGE_ARCHIVER_H
+#define MESSAGE_ARCHIVER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <ctime>
+#include <hiredis/hiredis.h>
+#include <mysql/mysql.h>
+
+// 归档配置
+struct ArchiveConfig {
+    int retention_seconds = 7 * 24 * 3600;  // Redis中保留的消息时间窗口
+    int max_messages_per_room = 1000;       // 每个房间在Redis中最多保留的消息条数
+    int batch_size = 500;                   // 每次批量写入MySQL的消息条数
+    int interval_seconds = 60;              // 两次归档扫描之间的间隔
+    int missing_grace_seconds = 300;        // 序号已分配但消息一直没有写入Redis超过该时间时，视为写入失败并跳过
+};
+
+// 后台消息归档器
+// 将超出时间窗口或超出房间上限的消息从Redis批量迁移到MySQL的messages表，
+// 迁移完成后更新房间的归档水位(room:<id>:archived_seq)并从Redis中删除这些消息。
+class MessageArchiver {
+private:
+    // 归档线程使用独立的连接，不与请求处理线程共享
+    redisContext* redis_context;
+    MYSQL* mysql_connection;
+
+    ArchiveConfig config;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+
+    // 每个房间上一轮归档留下的状态，只在归档线程上访问
+    struct RoomState {
+        time_t unexpired_until = 0;   // 保留窗口内最早的一条消息到期的时间，此前该房间没有因过期需要归档的消息
+        int missing_seq = 0;          // 最近遇到的缺失消息的序号
+        time_t missing_since = 0;     // 第一次发现它缺失的时间
+    };
+    std::unordered_map<int, RoomState> room_states;
+
+    // 归档线程主循环
+    void run();
+
+    // 归档所有房间，返回本轮归档的消息数量
+    int archiveAllRooms();
+
+    // 归档单个房间
+    int archiveRoom(int room_id);
+
+    // 计算需要归档到的序号（包含）
+    int computeArchiveTarget(int room_id, int archived_seq, int count);
+
+    // 序号为seq的消息在Redis中缺失：发送方先INCR取得序号再写入消息，缺失可能只是写入尚未完成。
+    // 缺失超过missing_grace_seconds才返回true，表示可以跳过
+    bool missingExpired(int room_id, int seq);
+
+    // 将[first, last]区间的消息写入MySQL并从Redis删除，遇到仍可能写入的缺失消息时停在它之前；
+    // archived_to为实际归档到的序号
+    bool moveBatch(int room_id, int first, int last, int& archived_to);
+
+public:
+    MessageArchiver();
+    ~MessageArchiver();
+
+    // 建立连接、创建表并启动归档线程
+    bool start(const std::string& redis_host, int redis_port,
+               const std::string& mysql_host, int mysql_port,
+               const std::string& mysql_user, const std::string& mysql_password,
+               const std::string& mysql_db, const ArchiveConfig& archive_config);
+
+    // 停止归档线程并关闭连接
+    void stop();
+};
+
+#endif // MESSAGE_ARCHIVER_H
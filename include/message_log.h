@@ -0,0 +1,237 @@
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include "storage.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// 消息日志配置
+struct MessageLogConfig {
+    std::string directory = "data/messages";   // 日志根目录，每个房间一个子目录
+    uint64_t segment_bytes = 64ull << 20;       // 单个段文件达到该大小后封存，新消息写入新段
+    int retention_seconds = 0;                  // 封存超过该时间的段被删除，0表示不按时间清理
+    uint64_t max_room_bytes = 0;                // 每个房间保留的日志总大小上限，0表示不限制
+    int compaction_interval_seconds = 60;       // 两次清理扫描之间的间隔
+};
+
+// 日志文件描述符，最后一个引用释放时关闭
+struct LogFile {
+    int fd;
+    explicit LogFile(int fd) : fd(fd) {}
+    ~LogFile();
+};
+
+// 日志段：一个.log数据文件和封存时写出的.idx索引文件，文件名为段内第一条消息的序号
+// 活动段（每个房间最后一个段）追加写入，读取时使用pread；
+// 封存段写出.idx偏移索引并以只读方式mmap，读取时直接访问映射的内存。
+// 段写满后立即切换到新的活动段，封存在组提交线程上完成，完成前旧段仍用pread读取。
+struct LogSegment {
+    int base_seq = 1;
+    std::string path;                 // 文件路径，不含.log/.idx扩展名
+    std::vector<uint64_t> offsets;    // 第i条消息（序号base_seq+i）在文件中的偏移
+    uint64_t size = 0;                // 有效数据长度
+    time_t modified = 0;              // 最后写入时间，用于按时间清理
+    std::shared_ptr<LogFile> file;    // 活动段和封存完成前的段
+    const char* map = nullptr;        // 仅封存完成的段
+    size_t map_size = 0;
+
+    ~LogSegment();
+};
+
+// 组提交：并发的追加请求共享同一次fdatasync
+// 追加者写入数据后调用sync()或syncAsync()，后台线程批量同步自上次以来写过的所有文件，
+// 再一起唤醒等待者并调用异步追加者的回调。
+// fdatasync失败后内核可能已丢弃脏页并清除错误，之后的同步即使成功也不能说明数据落盘，
+// 因此失败是粘滞的：该批及之后的所有提交都报告失败。
+class GroupCommitter {
+private:
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::vector<std::shared_ptr<LogFile>> dirty;
+    std::vector<std::function<bool()>> jobs;                         // 下一批同步之前执行的工作
+    std::vector<std::pair<uint64_t, std::function<void(bool ok)>>> callbacks;  // 提交编号 -> 落盘后的回调
+    uint64_t submitted = 0;
+    uint64_t synced = 0;
+    uint64_t failed_from = 0;   // 第一个同步失败的提交编号，0表示没有失败
+    bool running = false;
+    std::thread worker;
+
+    void run();
+    bool succeeded(uint64_t ticket) const { return failed_from == 0 || ticket < failed_from; }
+
+public:
+    void start();
+    void stop();
+
+    // 等待文件中已写入的数据落盘，返回false表示同步失败
+    bool sync(const std::shared_ptr<LogFile>& file);
+    bool sync(const std::vector<std::shared_ptr<LogFile>>& files);
+
+    // 不等待：同步结束后在组提交线程上调用done（未启动时在调用线程上同步后调用），ok表示是否落盘
+    void syncAsync(const std::vector<std::shared_ptr<LogFile>>& files, std::function<void(bool ok)> done);
+
+    // 在组提交线程上、下一批文件同步之前执行job（未启动时在调用线程上执行）；
+    // 之后提交的同步都在job完成后才确认，job返回false时该批按同步失败处理
+    void submit(std::function<bool()> job);
+
+    // 是否发生过同步失败
+    bool failed();
+};
+
+// 分段追加日志消息存储引擎
+class MessageLog {
+private:
+    struct LogRoom {
+        std::shared_mutex mutex;
+        std::string directory;
+        std::deque<std::unique_ptr<LogSegment>> segments;  // 按序号从旧到新，最后一个为活动段
+        int next_seq = 1;
+        bool deleted = false;
+    };
+
+    MessageLogConfig config;
+    std::shared_mutex rooms_mutex;
+    std::unordered_map<int, std::shared_ptr<LogRoom>> rooms;
+    GroupCommitter committer;
+
+    std::atomic<bool> running;
+    std::mutex compaction_mutex;
+    std::condition_variable compaction_cv;
+    std::thread compaction_thread;
+
+    std::shared_ptr<LogRoom> findRoom(int room_id);
+    std::shared_ptr<LogRoom> findOrCreateRoom(int room_id);
+
+    // 启动时恢复房间：封存段只加载索引并映射，只有活动段需要逐条重放校验
+    bool recoverRoom(int room_id, const std::string& directory);
+
+    // 创建新的活动段，目录项由调用者负责落盘
+    bool openActiveSegment(LogRoom& room, int base_seq);
+
+    // 封存活动段：持有房间锁时只切换到新的活动段，目录项落盘、写出索引、数据落盘和映射交给组提交线程
+    bool sealActiveSegment(const std::shared_ptr<LogRoom>& room);
+    bool finishSeal(const std::shared_ptr<LogRoom>& room, int base_seq, const std::shared_ptr<LogFile>& file);
+
+    // 按时间和大小清理过期的封存段
+    void compactRoom(LogRoom& room);
+    void runCompaction();
+
+public:
+    explicit MessageLog(const MessageLogConfig& config);
+    ~MessageLog();
+
+    bool open();
+    void close();
+
+    // 追加消息，分配序号并写回message.seq；返回true时消息已落盘
+    bool append(int room_id, ChatMessage& message);
+
+    // 追加消息但不等待落盘，file返回消息所在的文件；批量追加后调用sync()一次等待全部落盘，
+    // 或调用syncAsync()在落盘后得到通知。同步失败过之后拒绝新的追加
+    bool appendUnsynced(int room_id, ChatMessage& message, std::shared_ptr<LogFile>& file);
+    bool sync(const std::vector<std::shared_ptr<LogFile>>& files);
+    void syncAsync(const std::vector<std::shared_ptr<LogFile>>& files, std::function<void(bool ok)> done);
+
+    bool read(int room_id, int before_seq, int after_seq, int limit, MessagePage& page);
+    // 房间最新消息的序号，没有消息时为0
+    int head(int room_id);
+    bool scan(int room_id, const std::function<void(const ChatMessage&)>& visit);
+    bool removeRoom(int room_id);
+};
+
+// 用消息日志保存房间消息的存储后端装饰器，用户、令牌、房间和大厅消息仍由内层后端保存
+class MessageLogStorage : public Storage {
+private:
+    std::unique_ptr<Storage> inner;
+    MessageLog log;
+    std::string display_name;
+
+    // 已确认存在的房间，启动时从内层后端加载，追加消息时不必在反应器上查询内层后端
+    std::shared_mutex known_rooms_mutex;
+    std::unordered_set<int> known_rooms;
+
+    bool roomExists(int room_id);
+
+public:
+    MessageLogStorage(std::unique_ptr<Storage> inner, const MessageLogConfig& config);
+
+    const char* name() const override { return display_name.c_str(); }
+    bool open() override;
+    void close() override;
+
+    bool createUser(const std::string& username, const std::string& password, const std::string& email) override {
+        return inner->createUser(username, password, email);
+    }
+    bool checkUserPassword(const std::string& username, const std::string& password) override {
+        return inner->checkUserPassword(username, password);
+    }
+
+    bool listUsernames(std::vector<std::string>& usernames) override {
+        return inner->listUsernames(usernames);
+    }
+    bool saveToken(const std::string& token, const std::string& username) override {
+        return inner->saveToken(token, username);
+    }
+    bool findToken(const std::string& token, std::string& username) override {
+        return inner->findToken(token, username);
+    }
+    void findTokenAsync(const std::string& token, TokenCallback done) override {
+        inner->findTokenAsync(token, done);
+    }
+
+    bool createRoom(const std::string& name, const std::string& description, const std::string& creator,
+                    int& room_id) override;
+    bool getRoom(int room_id, ChatRoom& room) override {
+        return inner->getRoom(room_id, room);
+    }
+    bool deleteRoom(int room_id) override;
+    std::vector<ChatRoom> listRooms() override {
+        return inner->listRooms();
+    }
+
+    // 同步追加在调用线程上等待落盘，不应在反应器线程上调用；异步追加的回调在落盘后交回发起的事件循环执行
+    bool appendRoomMessage(int room_id, ChatMessage& message) override;
+    void appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done) override;
+    void appendRoomMessagesAsync(std::vector<RoomAppend> batch) override;
+    bool readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) override {
+        return log.read(room_id, before_seq, after_seq, limit, page);
+    }
+    bool scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) override {
+        return log.scan(room_id, visit);
+    }
+
+    bool loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) override {
+        return inner->loadReadCursors(username, cursors);
+    }
+    bool saveReadCursors(const std::vector<ReadCursor>& cursors) override {
+        return inner->saveReadCursors(cursors);
+    }
+    bool getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) override {
+        heads.clear();
+        for (int room_id : room_ids) {
+            heads.push_back(log.head(room_id));
+        }
+        return true;
+    }
+
+    bool appendLobbyMessage(const ChatMessage& message) override {
+        return inner->appendLobbyMessage(message);
+    }
+    std::vector<ChatMessage> readLobbyMessages(int limit) override {
+        return inner->readLobbyMessages(limit);
+    }
+};
+
+#endif // MESSAGE_LOG_H
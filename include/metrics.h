@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+// 延迟直方图，桶的边界就是导出时的le边界，导出的每个累计桶都是精确计数
+struct LatencyHistogram {
+    static const int kBounds = 16;
+    static const int kBuckets = kBounds + 1;   // 最后一个桶记录超过最大边界的延迟
+
+    // 各桶的上界（纳秒，包含）
+    static const uint64_t kBoundsNs[kBounds];
+
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+
+    // 计算延迟所属的桶：第一个上界不小于latency_ns的桶
+    static int bucketFor(uint64_t latency_ns);
+
+    void record(uint64_t latency_ns) {
+        buckets[bucketFor(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    }
+};
+
+// 服务器运行指标
+// 所有计数器分为kShards个分片：每个线程首次记录时按轮转分到一个分片并一直使用它，记录时只有原子加，不加锁；
+// 导出时再汇总所有分片。线程数（反应器和后台线程合计）不超过分片数时各线程互不竞争，
+// 超过时后分到的线程与先前的线程共用分片，计数仍然准确，只是共用的缓存行会有竞争。
+class Metrics {
+public:
+    static const int kMaxRoutes = 48;
+    static const int kShards = 16;
+
+    // 响应状态码分组
+    enum StatusSlot { STATUS_200, STATUS_206, STATUS_304, STATUS_400, STATUS_401, STATUS_404,
+                      STATUS_413, STATUS_429, STATUS_500, STATUS_503, STATUS_504, STATUS_OTHER, STATUS_SLOTS };
+
+    // 后端调用类型
+    enum BackendOp { REDIS_GET, REDIS_SET, REDIS_MGET, REDIS_INCR, REDIS_DEL, REDIS_OTHER,
+                     MYSQL_SELECT, MYSQL_INSERT, MYSQL_DELETE, MYSQL_OTHER, BACKEND_OPS };
+
+    // 预留的路由编号：静态文件和未匹配的请求
+    static const int ROUTE_STATIC = 0;
+    static const int ROUTE_NOT_FOUND = 1;
+
+    // 注册路由，返回路由编号；超出上限时返回ROUTE_NOT_FOUND
+    static int registerRoute(const std::string& route);
+
+    // 记录一次HTTP请求
+    static void recordRequest(int route_id, int status, uint64_t latency_ns);
+
+    // 当前正在处理的连接数
+    static void connectionOpened();
+    static void connectionClosed();
+
+    // 根据命令名/SQL语句的首个单词确定后端调用类型
+    static BackendOp redisOp(const char* command);
+    static BackendOp mysqlOp(const char* query);
+
+    // 记录一次后端调用
+    static void recordBackendCall(BackendOp op, uint64_t latency_ns, bool error);
+
+    // 以Prometheus文本格式导出
+    static std::string renderPrometheus();
+
+    // 单调时钟，纳秒
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif // METRICS_H
@@ -0,0 +1,94 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "user_table.h"
+
+// 在线状态配置
+struct PresenceConfig {
+    int ttl_seconds = 60;   // 最后一次活动或心跳之后保持在线的时间
+};
+
+// 房间的在线情况
+struct RoomPresence {
+    int room_id = 0;
+    size_t online = 0;
+    std::vector<std::string> users;   // 最多返回请求的数量
+};
+
+// 房间在线用户跟踪，只保存在内存中，不写存储
+// 每个房间的在线成员是以用户编号（见UserTable）为下标的位图；
+// 成员的过期时间按秒放入时间轮，每个成员在轮上最多一项：重复的心跳只更新过期时间，
+// 轮到该项时发现过期时间已推后就移到新的槽位，因此频繁的心跳不会产生额外的插入。
+class PresenceTracker {
+public:
+    PresenceTracker();
+    ~PresenceTracker();
+
+    // 启动时间轮线程
+    void start(const PresenceConfig& presence_config);
+    void stop();
+
+    // 用户在房间中有活动（发送、拉取消息或心跳）
+    void touch(int room_id, const std::string& username) { touch(room_id, UserTable::intern(username)); }
+    void touch(int room_id, uint32_t user_id);
+
+    // 用户离开房间
+    void leave(int room_id, const std::string& username);
+
+    // 房间在线人数和至多max_users个在线用户名
+    RoomPresence query(int room_id, size_t max_users);
+
+    // 房间在线人数
+    size_t onlineCount(int room_id);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // 一个房间的在线成员
+    struct RoomMembers {
+        std::vector<uint64_t> bits;                    // 第i位表示编号为i的用户在线
+        std::unordered_map<uint32_t, uint32_t> expires; // 用户编号 -> 过期的时间轮刻度
+        size_t online = 0;
+    };
+
+    // 按房间分片，每个分片有自己的锁和时间轮；时间轮的项为(房间, 用户编号)
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<int, RoomMembers> rooms;
+        std::vector<std::vector<std::pair<int, uint32_t>>> wheel;
+        uint32_t current_tick = 0;   // 已处理到的刻度
+    };
+    static const size_t kShardCount = 64;
+
+    PresenceConfig config;
+    Shard shards[kShardCount];
+    Clock::time_point epoch;
+
+    std::thread ticker;
+    std::atomic<bool> running;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+
+    Shard& shardFor(int room_id) { return shards[(unsigned int)room_id % kShardCount]; }
+    uint32_t nowTick() const;
+
+    // 从房间中移除成员，调用者持有分片锁
+    void removeMember(Shard& shard, int room_id, uint32_t user_id);
+
+    // 推进分片的时间轮到now_tick，处理到期的项
+    void advance(Shard& shard, uint32_t now_tick);
+
+    // 时间轮线程主循环
+    void run();
+};
+
+#endif // PRESENCE_H
@@ -0,0 +1,71 @@
+#ifndef READ_CURSORS_H
+#define READ_CURSORS_H
+
+#include "storage.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// 已读位置配置
+struct ReadCursorConfig {
+    int flush_interval_ms = 1000;   // 把修改过的已读位置批量写回存储的间隔
+};
+
+// 用户在各房间的已读位置，在内存中维护并定期批量写回存储
+// 标记已读只修改内存并记下脏项，后台线程每隔flush_interval_ms把所有脏项合并为一次saveReadCursors，
+// 同一位置在一个间隔内的多次修改只写一次。用户的已读位置在第一次查询时从存储加载。
+class ReadCursorTable {
+public:
+    ReadCursorTable();
+    ~ReadCursorTable();
+
+    // 启动写回线程，storage须在stop()之前保持有效
+    void start(Storage* backend, const ReadCursorConfig& cursor_config);
+
+    // 写回剩余的脏项并停止
+    void stop();
+
+    // 把已读位置前移到seq，返回前移后的位置
+    int markRead(const std::string& username, int room_id, int seq);
+
+    // 用户在各房间的已读位置，首次查询时从存储加载
+    bool getCursors(const std::string& username, std::unordered_map<int, int>& cursors);
+
+private:
+    struct UserCursors {
+        std::unordered_map<int, int> seqs;
+        std::unordered_set<int> dirty;   // 尚未写回的房间
+        bool loaded = false;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, UserCursors> users;
+        std::unordered_set<std::string> dirty_users;
+    };
+    static const size_t kShardCount = 64;
+
+    Storage* storage;
+    ReadCursorConfig config;
+    Shard shards[kShardCount];
+
+    std::thread flusher;
+    std::atomic<bool> running;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+
+    Shard& shardFor(const std::string& username) {
+        return shards[std::hash<std::string>()(username) % kShardCount];
+    }
+
+    // 取出全部脏项并写回，失败的项重新标记为脏
+    void flush();
+    void run();
+};
+
+#endif // READ_CURSORS_H
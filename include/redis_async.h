@@ -0,0 +1,56 @@
+#ifndef REDIS_ASYNC_H
+#define REDIS_ASYNC_H
+
+#include "event_loop.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+
+// 绑定到一个事件循环的非阻塞Redis连接
+// 命令发出后立即返回，回复由事件循环读到后回调；一个连接上可以同时有任意多条命令在途（管线化）。
+// 只能在所属事件循环的线程上使用。
+class RedisAsyncClient {
+public:
+    // reply为nullptr表示连接断开或命令未能执行；回复对象在回调返回后释放
+    typedef std::function<void(redisReply* reply)> ReplyCallback;
+
+    RedisAsyncClient(EventLoop* loop, const std::string& host, int port);
+    ~RedisAsyncClient();
+
+    // 发送命令，连接不可用时返回false且不会调用callback
+    bool command(ReplyCallback callback, int argc, const char** argv, const size_t* argvlen);
+    bool command(ReplyCallback callback, const std::vector<std::string>& args);
+
+    // 在途命令数
+    size_t pending() const { return in_flight; }
+
+    // 当前线程事件循环上的连接，首次使用时建立，事件循环退出时释放；不在事件循环线程上时返回nullptr
+    static RedisAsyncClient* forCurrentLoop(const std::string& host, int port);
+
+private:
+    EventLoop* loop;
+    std::string host;
+    int port;
+    redisAsyncContext* context;
+    int fd;
+    uint32_t events;
+    size_t in_flight;
+
+    bool connect();
+    void setEvents(uint32_t add, uint32_t remove);
+
+    // hiredis事件适配器回调
+    static void addRead(void* privdata);
+    static void delRead(void* privdata);
+    static void addWrite(void* privdata);
+    static void delWrite(void* privdata);
+    static void cleanup(void* privdata);
+
+    static void onConnect(const redisAsyncContext* context, int status);
+    static void onDisconnect(const redisAsyncContext* context, int status);
+    static void onReply(redisAsyncContext* context, void* reply, void* privdata);
+};
+
+#endif // REDIS_ASYNC_H
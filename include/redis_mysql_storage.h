@@ -0,0 +1,134 @@
+#ifndef REDIS_MYSQL_STORAGE_H
+#define REDIS_MYSQL_STORAGE_H
+
+#include "storage.h"
+#include "worker_pool.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include <condition_variable>
+#include <hiredis/hiredis.h>
+#include <mysql/mysql.h>
+
+// 带耗时统计的Redis/MySQL调用，参数与返回值同hiredis/libmysqlclient的对应函数
+redisReply* redisCommandTimed(redisContext* context, const char* format, ...);
+redisReply* redisCommandArgvTimed(redisContext* context, int argc, const char** argv, const size_t* argvlen);
+int mysqlQueryTimed(MYSQL* mysql, const char* query);
+int mysqlRealQueryTimed(MYSQL* mysql, const char* query, unsigned long length);
+
+// Redis+MySQL连接参数
+struct RedisMysqlConfig {
+    std::string redis_host = "127.0.0.1";
+    int redis_port = 6379;
+    std::string mysql_host = "127.0.0.1";
+    int mysql_port = 3306;
+    std::string mysql_user;
+    std::string mysql_password;
+    std::string mysql_db;
+    int pool_size = 8;  // 连接池大小，即可同时执行的请求数
+};
+
+// Redis+MySQL存储后端
+// 用户和房间保存在MySQL，令牌和最近的房间消息保存在Redis，较早的消息由MessageArchiver迁移到MySQL的messages表。
+// hiredis和libmysqlclient的连接都不是线程安全的，每次操作从连接池中借用一对独占的连接。
+// 异步接口在反应器线程上使用该线程独占的非阻塞Redis连接，不占用连接池；
+// 其中少数仍需查询MySQL的情况（未缓存的房间、已归档的消息）交给后台线程，完成后交回反应器。
+class RedisMysqlStorage : public Storage {
+private:
+    struct Connection {
+        redisContext* redis = nullptr;
+        MYSQL* mysql = nullptr;
+    };
+
+    // 借用连接，析构时归还
+    class Lease {
+    public:
+        Lease(RedisMysqlStorage& storage) : storage(storage), connection(storage.acquire()) {}
+        ~Lease() { storage.release(connection); }
+        redisContext* redis() const { return connection->redis; }
+        MYSQL* mysql() const { return connection->mysql; }
+    private:
+        RedisMysqlStorage& storage;
+        Connection* connection;
+    };
+
+    RedisMysqlConfig config;
+    std::vector<Connection> connections;
+    std::vector<Connection*> idle;
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+
+    Connection* acquire();
+    void release(Connection* connection);
+
+    // 建立一对连接
+    bool connect(Connection& connection);
+
+    // 异步接口中执行MySQL查询的后台线程，线程数与连接池大小相同
+    WorkerPool blocking;
+
+    // 已确认存在的房间，启动时加载，发送消息时不必每次查询MySQL；建房时加入，删除房间时移除
+    std::shared_mutex known_rooms_mutex;
+    std::unordered_set<int> known_rooms;
+
+    bool isKnownRoom(int room_id);
+    bool roomExists(MYSQL* mysql, int room_id);
+
+    // 批量写入已确认存在的房间的消息
+    void appendKnownRoomMessages(std::vector<RoomAppend> batch);
+
+    // 从MySQL读取已归档的房间消息[first, last]
+    bool getArchivedMessages(MYSQL* mysql, int room_id, int first, int last, std::vector<ChatMessage>& messages);
+    // 从MySQL读取已归档的指定序号的消息
+    bool getArchivedMessages(MYSQL* mysql, int room_id, const std::vector<int>& seqs, std::vector<ChatMessage>& messages);
+    // 执行归档消息查询（列依次为seq, username, content, created_at, attachments），结果追加到messages
+    bool queryArchivedMessages(MYSQL* mysql, const std::string& query, std::vector<ChatMessage>& messages);
+
+public:
+    explicit RedisMysqlStorage(const RedisMysqlConfig& config);
+    ~RedisMysqlStorage() override;
+
+    const char* name() const override { return "redis+mysql"; }
+    bool open() override;
+    void close() override;
+
+    bool createUser(const std::string& username, const std::string& password, const std::string& email) override;
+    bool checkUserPassword(const std::string& username, const std::string& password) override;
+    bool listUsernames(std::vector<std::string>& usernames) override;
+
+    bool saveToken(const std::string& token, const std::string& username) override;
+    bool findToken(const std::string& token, std::string& username) override;
+
+    bool createRoom(const std::string& name, const std::string& description, const std::string& creator,
+                    int& room_id) override;
+    bool getRoom(int room_id, ChatRoom& room) override;
+    bool deleteRoom(int room_id) override;
+    std::vector<ChatRoom> listRooms() override;
+
+    bool appendRoomMessage(int room_id, ChatMessage& message) override;
+    bool readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) override;
+    // 已归档的序号用一次MySQL IN查询，其余用一次MGET
+    bool readRoomMessagesBySeq(int room_id, const std::vector<int>& seqs, std::vector<ChatMessage>& messages) override;
+    bool scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) override;
+
+    // 已读位置保存在Redis哈希user:<用户名>:read_cursors中；房间最新序号即room:<id>:message_count
+    bool loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) override;
+    bool saveReadCursors(const std::vector<ReadCursor>& cursors) override;
+    bool getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) override;
+
+    bool appendLobbyMessage(const ChatMessage& message) override;
+    std::vector<ChatMessage> readLobbyMessages(int limit) override;
+
+    // 在反应器线程上经由该线程的非阻塞Redis连接执行，否则退回同步实现
+    void findTokenAsync(const std::string& token, TokenCallback done) override;
+    void appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done) override;
+    void readRoomMessagesAsync(int room_id, int before_seq, int after_seq, int limit, PageCallback done) override;
+    void getRoomHeadsAsync(const std::vector<int>& room_ids, HeadsCallback done) override;
+
+    // 整批消息用一个Lua脚本在一次往返中分配序号并写入；单条追加也走这一路径
+    void appendRoomMessagesAsync(std::vector<RoomAppend> batch) override;
+};
+
+#endif // REDIS_MYSQL_STORAGE_H
@@ -0,0 +1,60 @@
+#ifndef REDIS_PUBSUB_H
+#define REDIS_PUBSUB_H
+
+#include "room_fanout.h"
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <hiredis/hiredis.h>
+
+// 基于Redis发布/订阅的跨实例消息通道
+// 每个房间一个频道(room:<id>:live)，消息内容为"实例标识:序号:消息记录"，实例忽略自己发布的消息。
+// 后台线程持有两条连接：订阅连接只订阅本实例需要的房间，订阅集合变化时只发送增减的部分；
+// 发布连接把排队的消息以管线方式一次写出。连接断开后自动重连并恢复订阅。
+class RedisPubSub : public FanoutTransport {
+public:
+    RedisPubSub(const std::string& host, int port);
+    ~RedisPubSub();
+
+    bool start(MessageCallback on_message) override;
+    void stop() override;
+
+    void publish(int room_id, const ChatMessage& message) override;
+    void subscribe(int room_id) override;
+    void unsubscribe(int room_id) override;
+
+private:
+    std::string host;
+    int port;
+    std::string origin;   // 本实例的标识
+    MessageCallback callback;
+
+    // 以下由请求线程修改，后台线程取走
+    std::mutex mutex;
+    std::unordered_set<int> wanted;                         // 需要订阅的房间
+    bool wanted_changed;
+    std::vector<std::pair<int, std::string>> outbox;        // 待发布的(房间, 内容)
+
+    // 以下只由后台线程访问
+    redisContext* subscriber;
+    redisContext* publisher;
+    std::unordered_set<int> subscribed;
+
+    std::thread worker;
+    std::atomic<bool> running;
+    int wake_fd;   // eventfd，有新的订阅变化或待发布消息时唤醒后台线程
+
+    void wake();
+    void run();
+    bool connectSubscriber();
+    void syncSubscriptions();
+    bool readSubscriber();
+    void flushOutbox();
+    void handleReply(redisReply* reply);
+};
+
+#endif // REDIS_PUBSUB_H
@@ -0,0 +1,72 @@
+#ifndef REQUEST_COALESCER_H
+#define REQUEST_COALESCER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// 合并相同的并发读取（single-flight）
+// 同一个键同时只有一次读取在途，读取期间到达的相同请求挂在它上面，完成后共享同一份结果。
+// 结果可以在完成后保留cache_window_ms毫秒，期间到达的相同请求直接使用；
+// 数据变化时按分组（如房间）失效，之后的请求不再使用失效前开始的读取或缓存的结果。
+class RequestCoalescer {
+public:
+    // 读取结果，通常是已经序列化好的响应内容，由所有等待者共享
+    typedef std::shared_ptr<const std::string> Result;
+    typedef std::function<void(bool ok, const Result& result)> Callback;
+
+    // 执行一次读取，完成时调用finish（可以在任意线程上）
+    typedef std::function<void(bool ok, Result result)> FetchDone;
+    typedef std::function<void(FetchDone finish)> Fetch;
+
+    explicit RequestCoalescer(int cache_window_ms = 0);
+
+    // 结果保留的时间，0表示只合并在途的读取
+    void setCacheWindow(int cache_window_ms);
+
+    // 读取group分组中键为key的数据：有在途的相同读取时等待它，有未过期的结果时直接返回，否则调用fetch
+    // done在读取完成的线程上调用（命中缓存时在调用者线程上）
+    void run(int group, const std::string& key, Fetch fetch, Callback done);
+
+    // 分组中的数据已变化
+    void invalidate(int group);
+
+    // 实际执行的读取次数和合并掉的请求数
+    uint64_t fetchCount() const { return fetches.load(std::memory_order_relaxed); }
+    uint64_t sharedCount() const { return shared.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        bool completed = false;
+        Result result;
+        Clock::time_point expires;
+        std::vector<Callback> waiters;
+    };
+    typedef std::unordered_map<std::string, std::shared_ptr<Entry>> Group;
+
+    // 按分组加锁，不同房间的请求互不影响
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<int, Group> groups;
+    };
+    static const size_t kShardCount = 64;
+
+    std::atomic<int> cache_window_ms;
+    Shard shards[kShardCount];
+    std::atomic<uint64_t> fetches;
+    std::atomic<uint64_t> shared;
+
+    Shard& shardFor(int group) { return shards[(unsigned int)group % kShardCount]; }
+
+    // 读取完成：唤醒等待者，成功时按配置保留结果
+    void complete(int group, const std::string& key, const std::shared_ptr<Entry>& entry, bool ok, Result result);
+};
+
+#endif // REQUEST_COALESCER_H
@@ -0,0 +1,130 @@
+#ifndef ROOM_FANOUT_H
+#define ROOM_FANOUT_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "storage.h"
+#include "timer_wheel.h"
+
+// 在多个服务器实例之间转发房间新消息的通道（如Redis发布/订阅）
+// RoomFanout只订阅本实例上有人等待的房间，所有方法都不应阻塞调用线程。
+class FanoutTransport {
+public:
+    // 收到其他实例发布的消息
+    typedef std::function<void(int room_id, const ChatMessage& message)> MessageCallback;
+
+    virtual ~FanoutTransport() {}
+
+    // 启动通道，on_message可能在通道自己的线程上调用
+    virtual bool start(MessageCallback on_message) = 0;
+    virtual void stop() = 0;
+
+    // 广播本实例写入的新消息
+    virtual void publish(int room_id, const ChatMessage& message) = 0;
+
+    // 开始/停止接收某个房间的消息
+    virtual void subscribe(int room_id) = 0;
+    virtual void unsubscribe(int room_id) = 0;
+};
+
+// 房间消息推送配置
+struct FanoutConfig {
+    int idle_unsubscribe_seconds = 30;  // 房间最后一个等待者离开后保持订阅的时间，避免长轮询重连时反复订阅
+    int sweep_interval_ms = 200;        // 检查空闲订阅的间隔，等待超时由时间轮按到期时间触发
+};
+
+// 房间新消息推送
+// 长轮询请求在这里等待房间的新消息；本实例写入的消息直接唤醒等待者，
+// 其他实例写入的消息经FanoutTransport到达。房间的订阅随等待者的出现和离开增量调整。
+class RoomFanout {
+public:
+    // 等待结束时调用：messages为紧接在after_seq之后的新消息；
+    // 超时或新消息与after_seq不连续（中间有消息尚未到达）时为空，调用者应重新从存储读取
+    typedef std::function<void(const std::vector<ChatMessage>& messages)> WaitCallback;
+
+    struct Waiter;
+    typedef std::shared_ptr<Waiter> WaitHandle;
+
+    RoomFanout();
+    ~RoomFanout();
+
+    // 启动超时检查线程（推进等待超时的时间轮并退订空闲房间）
+    void start(const FanoutConfig& fanout_config);
+    void stop();
+
+    // 设置跨实例通道，须在start()之后、开始处理请求之前调用；为空时只在本实例内推送
+    bool setTransport(std::unique_ptr<FanoutTransport> fanout_transport);
+
+    // 其他实例的新消息到达时额外调用，用于更新本地缓存（如全文索引）
+    void setRemoteMessageCallback(FanoutTransport::MessageCallback callback);
+
+    // 本实例写入了新消息：唤醒等待者并广播给其他实例
+    void publish(int room_id, const ChatMessage& message);
+
+    // 等待房间中序号大于after_seq的新消息，done在任意线程上恰好调用一次（除非等待被取消）
+    WaitHandle wait(int room_id, int after_seq, int timeout_ms, WaitCallback done);
+
+    // 取消等待，done已经或正在被调用时返回false
+    bool cancel(const WaitHandle& handle);
+
+    // 当前等待者数量
+    size_t waiterCount() const { return waiter_count.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // 一个房间的等待者和订阅状态
+    struct RoomWatch {
+        std::vector<WaitHandle> waiters;   // 可能包含已结束的等待者，唤醒或检查时清理
+        size_t active = 0;                 // 尚未结束的等待者数量
+        bool subscribed = false;
+        Clock::time_point idle_since;
+    };
+
+    // 按房间分片加锁，不同房间的发送和等待互不阻塞
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<int, RoomWatch> rooms;
+    };
+    static const size_t kShardCount = 64;
+
+    FanoutConfig config;
+    Shard shards[kShardCount];
+    std::unique_ptr<FanoutTransport> transport;
+    FanoutTransport::MessageCallback remote_callback;
+    std::atomic<size_t> waiter_count;
+
+    // 等待超时：添加和取消都是O(1)，检查线程只处理到期的等待者，不再逐个扫描所有等待者
+    std::mutex timer_mutex;
+    TimerWheel timers;
+    std::vector<WaitHandle> expired;   // 推进时间轮期间收集的到期等待者
+
+    std::thread sweeper;
+    std::atomic<bool> running;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cv;
+
+    Shard& shardFor(int room_id) { return shards[(unsigned int)room_id % kShardCount]; }
+
+    // 唤醒房间中尚未看到该消息的等待者
+    void deliver(int room_id, const ChatMessage& message);
+
+    // 结束等待：抢到结束权的一方更新房间状态并调用done
+    void finish(const WaitHandle& handle, const std::vector<ChatMessage>& messages);
+    bool release(const WaitHandle& handle);
+
+    // 超时检查线程主循环
+    void run();
+    void expireWaiters();
+    void sweepIdleRooms();
+};
+
+#endif // ROOM_FANOUT_H
@@ -0,0 +1,83 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <ctime>
+
+// 搜索命中结果
+struct SearchHit {
+    int room_id;
+    int seq;
+    time_t time;
+};
+
+// 倒排列表：有序的消息序号，已封存部分以varint差值编码，最近追加的少量序号保存在未压缩的尾部
+class PostingList {
+private:
+    std::string data;        // varint差值编码的序号
+    int last_sealed = 0;     // data中最后一个序号
+    int sealed_count = 0;    // data中的序号数量
+    std::vector<int> tail;   // 有序、未压缩的最近序号
+
+    // 将尾部追加到压缩区
+    void seal();
+
+public:
+    static const size_t kTailLimit = 64;
+
+    // 添加序号，允许轻微乱序（并发发送时序号的写入顺序可能与分配顺序不同）
+    void add(int seq);
+
+    // 解码为升序序号列表
+    void decode(std::vector<int>& out) const;
+
+    size_t size() const { return sealed_count + tail.size(); }
+    size_t memoryBytes() const { return data.capacity() + tail.capacity() * sizeof(int); }
+};
+
+// 房间消息全文索引
+// 每个房间维护独立的倒排索引，支持中日韩文本（按字和相邻两字切分）以及英文/数字单词。
+class SearchIndex {
+private:
+    struct RoomIndex {
+        std::mutex mutex;
+        std::unordered_map<std::string, PostingList> postings;
+        std::vector<uint32_t> times;  // 按序号索引的消息时间，用于跨房间按时间排序
+    };
+
+    mutable std::shared_mutex rooms_mutex;
+    std::unordered_map<int, std::shared_ptr<RoomIndex>> rooms;
+
+    std::shared_ptr<RoomIndex> getRoom(int room_id, bool create);
+
+    // 在单个房间中查找同时包含所有词项的消息，返回最新的top_k条
+    void searchRoom(int room_id, RoomIndex& room, const std::vector<std::string>& terms,
+                    size_t top_k, std::vector<SearchHit>& hits);
+
+public:
+    // 切分文本：ASCII字母数字按单词切分并转小写，CJK字符输出单字和相邻两字
+    static std::vector<std::string> tokenize(const std::string& text);
+
+    // 切分查询：CJK连续片段长度大于1时只使用两字词项，减少倒排列表求交的数量
+    static std::vector<std::string> tokenizeQuery(const std::string& query);
+
+    // 索引一条消息
+    void addMessage(int room_id, int seq, const std::string& content, time_t time);
+
+    // 删除房间的全部索引
+    void removeRoom(int room_id);
+
+    // 搜索消息，room_id为0时搜索所有房间，结果按时间从新到旧排列
+    std::vector<SearchHit> search(const std::string& query, int room_id, size_t top_k);
+
+    // 已索引的房间数量
+    size_t roomCount() const;
+};
+
+#endif // SEARCH_INDEX_H
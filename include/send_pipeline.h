@@ -0,0 +1,31 @@
+#ifndef SEND_PIPELINE_H
+#define SEND_PIPELINE_H
+
+#include "storage.h"
+#include "event_loop.h"
+#include <vector>
+#include <cstddef>
+
+// 消息发送流水线：把同一轮事件循环内到达的发送请求合并为一批交给存储后端
+// 每个事件循环一个实例。第一条消息到达时投递一次刷新任务，本轮其余请求处理完后整批写入；
+// 攒够max_batch条时立即写入。后端把一批合并为一次往返（Redis）或一次落盘（消息日志）。
+class SendPipeline {
+private:
+    EventLoop* loop;
+    Storage* storage;
+    size_t max_batch;
+    std::vector<RoomAppend> pending;
+    bool flush_scheduled;
+
+public:
+    SendPipeline(EventLoop* loop, Storage* storage, size_t max_batch);
+
+    void submit(RoomAppend append);
+    void flush();
+
+    // 当前线程事件循环上的流水线，首次使用时创建，事件循环退出时写出剩余消息并释放；
+    // 不在事件循环线程上时返回nullptr
+    static SendPipeline* forCurrentLoop(Storage* storage, size_t max_batch);
+};
+
+#endif // SEND_PIPELINE_H
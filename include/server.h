@@ -3,42 +3,218 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <vector>
 #include <mutex>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <netinet/in.h>
+#include "admission.h"
 
 // 处理HTTP请求的函数类型
+// 请求头中另有服务器填入的method、path（含查询参数）和remote_addr（对端IP），客户端发送的同名请求头被覆盖
 typedef std::function<std::string(const std::unordered_map<std::string, std::string>&, const std::string&)> HttpHandler;
 
+// 异步处理器通过respond返回响应内容，respond可以在处理器返回之后调用，但只能调用一次
+// 请求头和请求体的引用只在处理器返回前有效，需要在之后使用的内容应自行拷贝。
+typedef std::function<void(const std::string& content)> HttpResponder;
+typedef std::function<void(const std::unordered_map<std::string, std::string>&, const std::string&, HttpResponder)>
+    AsyncHttpHandler;
+
+// 流式上传的请求体接收器：请求体按到达的顺序分段交给write，服务器不缓存完整的请求体
+class UploadSink {
+public:
+    virtual ~UploadSink() {}
+
+    // 写入一段请求体，返回false时中止上传
+    virtual bool write(const char* data, size_t len) = 0;
+
+    // write返回false后的响应内容（JSON），为空时返回500
+    virtual std::string abortResponse() const { return std::string(); }
+
+    // 请求体接收完毕，通过respond给出响应内容（JSON）
+    virtual void finish(HttpResponder respond) = 0;
+};
+
+// 根据请求头创建上传接收器，拒绝上传时返回nullptr并在error中给出响应内容（JSON）
+typedef std::function<std::unique_ptr<UploadSink>(const std::unordered_map<std::string, std::string>&, std::string&)>
+    UploadHandler;
+
+// 文件响应：响应头之后用sendfile从fd发送文件内容，服务器负责关闭fd
+struct FileResponse {
+    int fd = -1;                 // 小于0时以status和body作为响应
+    uint64_t size = 0;           // 文件大小，有Range请求头时只发送其中一段
+    std::string content_type;
+    std::string etag;            // 非空时支持If-None-Match条件请求
+    std::string extra_headers;   // 附加的完整响应头行（含\r\n）
+    int status = 200;
+    std::string body;
+};
+typedef std::function<void(const std::unordered_map<std::string, std::string>&, FileResponse&)> FileHttpHandler;
+
+// 连接各阶段的超时（毫秒），0表示不限制；超时的连接收到408响应后被关闭
+struct ConnectionTimeouts {
+    int header_ms = 10000;       // 从建立连接到请求头接收完整，防止慢速发送请求头占住连接
+    int body_idle_ms = 30000;    // 接收请求体期间两次读到数据的最大间隔
+    int write_idle_ms = 30000;   // 发送响应期间两次写出数据的最大间隔，防止不读取响应的客户端
+    int handler_ms = 30000;      // 从交给处理器到给出响应的最长时间，超时返回504并归还执行名额
+    int long_poll_ms = 90000;    // 长轮询路由的处理器期限，应大于客户端可以请求的最长等待时间（60秒）
+};
+
+// 路由匹配结果
+struct RouteMatch {
+    const AsyncHttpHandler* handler = nullptr;
+    int route_id = 0;
+    std::string content_type;
+    RequestPriority priority = PRIORITY_NORMAL;
+    bool long_poll = false;
+};
+
+struct RequestTask;
+struct HttpConnection;
+
+// 多反应器HTTP服务器：每个反应器接受并执行自己的连接；反应器之间不按房间分区，
+// 房间状态由各组件（RoomFanout、PresenceTracker、存储后端）按房间分片加锁共享
 class HttpServer {
 private:
-    int server_fd;
+    // 反应器：一个线程、一个SO_REUSEPORT监听套接字和一个epoll实例，定义见server.cpp
+    struct Reactor;
+
     int port;
-    bool running;
+    int reactor_count;
+    std::atomic<bool> running;
     std::mutex handlers_mutex;
-    std::unordered_map<std::string, HttpHandler> handlers;
-    std::vector<std::thread> worker_threads;
+    std::unordered_map<std::string, AsyncHttpHandler> handlers;  // 同步处理器包装为立即响应的异步处理器
+    std::unordered_map<std::string, int> route_ids;              // 路由在运行指标中的编号
+    std::unordered_map<std::string, std::string> content_types;  // 路由指定的响应类型
+    std::unordered_map<std::string, RequestPriority> priorities; // 路由的准入优先级
+    std::unordered_set<std::string> long_poll_routes;            // 长轮询路由
+    std::unordered_map<std::string, std::string> asset_routes;   // 页面路由 -> 资源路径
+    std::unordered_map<std::string, FileHttpHandler> file_routes; // 文件下载路由
+    struct UploadRoute {
+        UploadHandler handler;
+        uint64_t max_body_bytes = 0;
+    };
+    std::unordered_map<std::string, UploadRoute> upload_routes;  // 流式上传路由
+    std::vector<std::unique_ptr<Reactor>> reactors;
+
+    // 准入控制，未启用时为空
+    std::unique_ptr<AdmissionController> admission;
+    int max_connections = 0;   // 同时保持的连接数上限，0表示不限制
+    std::atomic<int> active_connections{0};
+    ConnectionTimeouts timeouts;
+
+    // 微基准测试需要直接调用内部的解析、路由和响应构建函数
+    friend struct HttpServerBenchAccess;
 
-    // 处理客户端连接
-    void handleClient(int client_fd);
+    // 反应器事件循环
+    void runReactor(Reactor& reactor);
+    void acceptConnections(Reactor& reactor);
+    void readConnection(Reactor& reactor, HttpConnection& conn);
+    void writeConnection(Reactor& reactor, HttpConnection& conn);
+    void closeConnection(Reactor& reactor, int fd);
+    
+    // 重新设置连接当前阶段的超时，timeout_ms为0时只取消原有的超时
+    // 处理器阶段超时返回504，接收请求阶段超时返回408，发送响应阶段超时直接关闭
+    void setDeadline(Reactor& reactor, HttpConnection& conn, int timeout_ms);
+    void expireConnection(Reactor& reactor, int fd, uint64_t conn_id);
+    
+    // 请求头接收完整后检查是否为上传路由，是则把请求体转交给接收器
+    // 返回false表示连接已经进入响应阶段（或已关闭），调用者不能再访问conn
+    bool beginUpload(Reactor& reactor, HttpConnection& conn);
+    bool feedUpload(Reactor& reactor, HttpConnection& conn, const char* data, size_t len);
+    
+    // 不经过处理器直接响应（如上传请求被拒绝）
+    void respondNow(Reactor& reactor, HttpConnection& conn, const std::string& response);
+    
+    // 解析完整的请求并在本反应器上执行
+    void dispatchRequest(Reactor& reactor, HttpConnection& conn);
+    
+    // 执行请求：经过准入控制后调用runTask，名额已满时在本反应器上排队
+    void executeTask(RequestTask* task);
+    
+    // 执行处理器或返回静态文件，得到响应后调用finishTask；holds_slot表示占用了准入控制的执行名额
+    void runTask(RequestTask* task, bool holds_slot);
+    
+    // 排队等待执行名额：获得名额后执行，超过排队期限返回503
+    void admitTask(RequestTask* task);
+    void drainAdmissionQueue(Reactor& reactor);
+    void expireQueuedTask(Reactor& reactor, RequestTask* task);
+    
+    // 归还执行名额，有请求在排队时唤醒排队的反应器重试；可以在任意线程上调用
+    void releaseAdmission();
+    void notifyAdmissionQueues();
+    
+    // 把响应交回接收该请求的反应器，可以在任意线程上调用
+    void finishTask(RequestTask* task);
+    
+    // 取回其他线程上给出的响应
+    void drainCompletions(Reactor& reactor);
+    void completeTask(Reactor& reactor, RequestTask* task);
+    void wakeReactor(Reactor& reactor);
+    
+    // 查找请求对应的路由，调用者需持有handlers_mutex
+    bool resolveRoute(const std::string& method, const std::string& path, RouteMatch& match);
     
     // 解析HTTP请求
     std::unordered_map<std::string, std::string> parseHttpRequest(const std::string& request, std::string& path, std::string& body);
     
-    // 构建HTTP响应
-    std::string buildHttpResponse(const std::string& content_type, const std::string& body);
+    // 构建HTTP响应，extra_headers为附加的完整响应头行（含\r\n）
+    std::string buildHttpResponse(const std::string& content_type, const std::string& body,
+                                  int status = 200, const std::string& extra_headers = "");
+    
+    // 只构建响应头，内容长度为content_length的响应体另行发送
+    std::string buildHttpHeader(const std::string& content_type, uint64_t content_length,
+                                int status = 200, const std::string& extra_headers = "");
     
-    // 静态文件处理
-    std::string handleStaticFile(const std::string& path);
+    // 构建文件响应的响应头，处理If-None-Match和单个区间的Range请求；
+    // length为之后要从文件offset处发送的字节数，为0时不发送文件内容
+    std::string buildFileResponse(const FileResponse& file, const std::unordered_map<std::string, std::string>& headers,
+                                  uint64_t& offset, uint64_t& length);
+    
+    // 构建限流(429)或过载(503)的拒绝响应
+    std::string buildRejectResponse(int status, int retry_after_seconds, const std::string& message);
+    
+    // 构建资源响应：支持If-None-Match条件请求和gzip压缩版本，资源不存在时返回空字符串
+    std::string buildAssetResponse(const std::string& asset_path,
+                                   const std::unordered_map<std::string, std::string>& headers);
 
 public:
-    HttpServer(int port);
+    // reactors为反应器线程数，0表示与CPU核数相同
+    HttpServer(int port, int reactors = 0);
     ~HttpServer();
 
-    // 添加路由处理器
-    void addHandler(const std::string& path, HttpHandler handler);
+    // 添加路由处理器，content_type为空时按路径推断响应类型
+    void addHandler(const std::string& path, HttpHandler handler, const std::string& content_type = "");
+    
+    // 添加异步处理器，处理器可以在等待后端回复期间让出反应器线程
+    void addAsyncHandler(const std::string& path, AsyncHttpHandler handler, const std::string& content_type = "");
+    
+    // 添加页面路由，以asset_path指定的资源（如"templates/index.html"）响应GET请求；
+    // 未匹配任何路由的请求按"static"+路径查找资源
+    void addAssetRoute(const std::string& path, const std::string& asset_path);
+    
+    // 添加流式上传路由（POST）：请求体必须带Content-Length且不超过max_body_bytes，
+    // 边接收边交给handler创建的接收器，每个上传占用的内存与请求体大小无关
+    void addUploadHandler(const std::string& path, UploadHandler handler, uint64_t max_body_bytes);
+    
+    // 添加文件下载路由（GET）：处理器打开文件，服务器处理Range请求并用sendfile发送内容
+    void addFileHandler(const std::string& path, FileHttpHandler handler);
+    
+    // 设置路由的准入优先级，默认为PRIORITY_NORMAL
+    void setRoutePriority(const std::string& path, RequestPriority priority);
+    
+    // 标记长轮询路由：处理器返回后即归还准入控制的执行名额，等待新消息期间不占用并发上限
+    void setRouteLongPoll(const std::string& path);
+    
+    // 设置连接超时，须在start()之前调用
+    void setTimeouts(const ConnectionTimeouts& connection_timeouts);
+    
+    // 启用准入控制，须在start()之前调用
+    void enableAdmission(const AdmissionConfig& config);
     
     // 启动服务器
     bool start();
@@ -0,0 +1,27 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// SHA-256，可以分多次输入数据
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+
+    // 结束计算，返回64位小写十六进制摘要；之后不能再调用update
+    std::string hexDigest();
+
+private:
+    uint32_t state[8];
+    uint64_t total_bytes;
+    unsigned char block[64];
+    size_t block_used;
+
+    void transform(const unsigned char* chunk);
+};
+
+#endif // SHA256_H
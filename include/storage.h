@@ -0,0 +1,158 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <ctime>
+#include <cstdint>
+#include "user_table.h"
+
+// 消息结构体
+struct ChatMessage {
+    int seq = 0;  // 房间内的消息序号，从1开始递增
+    uint32_t user_id = UserTable::kNoUser;  // 发送者，见UserTable；存储记录中仍保存用户名
+    std::string content;
+    std::string timestamp;
+    std::vector<std::string> attachments;  // 引用的附件ID（内容的SHA-256），见AttachmentStore
+
+    const std::string& username() const { return UserTable::name(user_id); }
+};
+
+// 分页查询结果
+struct MessagePage {
+    std::vector<ChatMessage> messages;
+    int prev_cursor = 0;   // 继续向前翻页时使用的before_seq，0表示没有更早的消息
+    int next_cursor = 0;   // 增量拉取新消息时使用的after_seq
+    bool has_more = false; // after_seq查询时是否还有未返回的新消息
+};
+
+// 聊天室结构体
+struct ChatRoom {
+    int id;
+    std::string name;
+    std::string description;
+    uint32_t creator_id = UserTable::kNoUser;  // 创建者，见UserTable
+    std::string created_at;
+
+    const std::string& creator() const { return UserTable::name(creator_id); }
+};
+
+// 消息记录编码/解码（格式: 用户名:内容:时间戳）
+// 带附件的消息在前面加上"\x02附件ID列表\x02"，不带附件的消息保持原格式，已有数据无需迁移
+std::string encodeMessageRecord(const ChatMessage& message);
+bool decodeMessageRecord(const std::string& data, ChatMessage& message);
+
+// 附件ID列表与逗号分隔字符串的转换，用于消息记录和MySQL归档列
+std::string joinAttachmentIds(const std::vector<std::string>& attachments);
+std::vector<std::string> splitAttachmentIds(const std::string& joined);
+
+// 格式化消息时间戳(本地时间 %Y-%m-%d %H:%M:%S)
+std::string formatMessageTimestamp(time_t time);
+
+// 解析消息时间戳，失败返回0
+time_t parseMessageTimestamp(const std::string& timestamp);
+
+// 根据消息总数和游标计算本页的序号区间[first, last]，并填写page中的游标
+// before_seq > 0: 序号小于before_seq的最近limit条消息
+// after_seq > 0:  序号大于after_seq的最早limit条消息
+// 两者都为0时为最新的limit条消息
+// 区间为空时返回false
+bool planMessagePage(int count, int before_seq, int after_seq, int limit, MessagePage& page, int& first, int& last);
+
+// 用户在房间中的已读位置
+struct ReadCursor {
+    std::string username;
+    int room_id = 0;
+    int seq = 0;   // 已读到的消息序号
+};
+
+// 批量追加中的一条房间消息，done在消息写入（分配序号）或失败后调用
+struct RoomAppend {
+    int room_id = 0;
+    ChatMessage message;
+    std::function<void(bool ok, const ChatMessage& message)> done;
+};
+
+// 存储后端接口：用户、会话令牌、房间和消息
+// 所有方法都可能被多个请求线程并发调用，实现必须是线程安全的。
+class Storage {
+public:
+    virtual ~Storage() {}
+
+    // 后端名称，用于日志
+    virtual const char* name() const = 0;
+
+    // 建立连接、创建表结构等
+    virtual bool open() = 0;
+
+    // 释放连接
+    virtual void close() = 0;
+
+    // 用户，用户名已存在时createUser返回false
+    virtual bool createUser(const std::string& username, const std::string& password, const std::string& email) = 0;
+    virtual bool checkUserPassword(const std::string& username, const std::string& password) = 0;
+
+    // 所有用户名，启动时预先登记到UserTable；不支持时返回false，用户名在首次出现时再登记
+    virtual bool listUsernames(std::vector<std::string>& usernames);
+
+    // 会话令牌
+    virtual bool saveToken(const std::string& token, const std::string& username) = 0;
+    virtual bool findToken(const std::string& token, std::string& username) = 0;
+
+    // 房间
+    virtual bool createRoom(const std::string& name, const std::string& description, const std::string& creator,
+                            int& room_id) = 0;
+    // 房间不存在时返回false
+    virtual bool getRoom(int room_id, ChatRoom& room) = 0;
+    // 删除房间及其全部消息
+    virtual bool deleteRoom(int room_id) = 0;
+    // 按创建时间倒序
+    virtual std::vector<ChatRoom> listRooms() = 0;
+
+    // 追加房间消息，分配序号并写回message.seq；房间不存在时返回false
+    virtual bool appendRoomMessage(int room_id, ChatMessage& message) = 0;
+
+    // 按游标读取房间消息，游标含义见planMessagePage
+    virtual bool readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) = 0;
+
+    // 读取房间中序号为seqs（升序）的消息，不存在的消息不出现在结果中，供搜索结果加载消息内容
+    // 默认实现把相近的序号合并为区间，每个区间读取一次；后端能按键批量读取时应重写为一次查询
+    virtual bool readRoomMessagesBySeq(int room_id, const std::vector<int>& seqs, std::vector<ChatMessage>& messages);
+
+    // 按序号顺序遍历房间的全部消息，供重建索引使用
+    virtual bool scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) = 0;
+
+    // 用户在各房间的已读位置（房间ID -> 序号），没有记录的房间不出现
+    virtual bool loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) = 0;
+    // 批量保存已读位置，已保存的位置只前移不后退
+    virtual bool saveReadCursors(const std::vector<ReadCursor>& cursors) = 0;
+
+    // 各房间的最新消息序号，heads与room_ids一一对应，没有消息或不存在的房间为0
+    // 默认实现逐个房间读取最新一条消息，后端有计数器时应重写为一次查询
+    virtual bool getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads);
+
+    // 大厅消息（不属于任何房间的公共聊天）
+    virtual bool appendLobbyMessage(const ChatMessage& message) = 0;
+    // 最新的limit条，新消息在前
+    virtual std::vector<ChatMessage> readLobbyMessages(int limit) = 0;
+
+    // 异步接口，结果通过回调返回，供请求热点路径使用
+    // 默认实现同步执行后立即回调；能在事件循环上做非阻塞I/O的后端可以重写，
+    // 此时方法发出请求后立即返回，回调稍后在同一个事件循环线程上执行。
+    typedef std::function<void(bool ok, const std::string& username)> TokenCallback;
+    typedef std::function<void(bool ok, const ChatMessage& message)> AppendCallback;
+    typedef std::function<void(bool ok, MessagePage& page)> PageCallback;
+    typedef std::function<void(bool ok, const std::vector<int>& heads)> HeadsCallback;
+
+    virtual void findTokenAsync(const std::string& token, TokenCallback done);
+    virtual void appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done);
+    virtual void readRoomMessagesAsync(int room_id, int before_seq, int after_seq, int limit, PageCallback done);
+    virtual void getRoomHeadsAsync(const std::vector<int>& room_ids, HeadsCallback done);
+
+    // 批量追加房间消息，每条消息各自回调；后端可以把整批合并为一次往返或一次落盘
+    virtual void appendRoomMessagesAsync(std::vector<RoomAppend> batch);
+};
+
+#endif // STORAGE_H
@@ -0,0 +1,43 @@
+#ifndef TEMPLATE_ENGINE_H
+#define TEMPLATE_ENGINE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+// 预编译的页面模板
+// 模板文本在加载时解析为文本段和变量段的列表，渲染时按顺序拼接，不再扫描模板文本。
+// {{name}}插入HTML转义后的值，{{{name}}}原样插入（如已经过escapeScriptJson处理的JSON）；
+// 未给出的变量渲染为空字符串。
+class PageTemplate {
+public:
+    typedef std::unordered_map<std::string, std::string> Values;
+
+    // 解析模板文本，标签未闭合或变量名为空时返回false
+    bool compile(const std::string& text);
+
+    std::string render(const Values& values) const;
+
+    // 加载资源路径对应的模板（如"templates/chat.html"），内嵌资源只解析一次；
+    // 指定了资源覆盖目录时每次重新读取和解析，便于开发时修改页面。资源不存在或解析失败时返回空
+    static std::shared_ptr<const PageTemplate> load(const std::string& asset_path);
+
+private:
+    struct Segment {
+        enum Kind { TEXT, ESCAPED, RAW };
+        Kind kind;
+        std::string text;   // 文本段的内容或变量名
+    };
+
+    std::vector<Segment> segments;
+    size_t text_bytes = 0;   // 文本段总长度，渲染时预留空间
+};
+
+// HTML文本和属性值转义
+std::string escapeHtml(const std::string& text);
+
+// 使JSON可以安全地放进<script>元素：转义"<"以免出现"</script>"，以及JS字符串中不允许的U+2028/U+2029
+std::string escapeScriptJson(const std::string& json);
+
+#endif // TEMPLATE_ENGINE_H
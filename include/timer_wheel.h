@@ -0,0 +1,72 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// 分层时间轮：4层、每层256个槽，第0层每槽一个刻度，上一层每槽覆盖下一层一整圈
+// 添加和取消定时器都是O(1)，推进时只处理到期的槽，上层的槽在下层转完一圈时才分散到下层。
+// 定时器节点放在数组里并通过下标链接，取消时按编号直接摘除，大量定时器也不会有额外的分配。
+// 时间轮不加锁，只能在一个线程上使用（如反应器线程），跨线程使用时由调用者加锁。
+class TimerWheel {
+public:
+    typedef uint64_t TimerId;   // 0表示无效
+
+    // tick_ms为刻度长度，now_ms为当前时间（任意起点的单调毫秒数）
+    TimerWheel(uint64_t tick_ms, uint64_t now_ms);
+
+    // delay_ms之后调用callback，返回可用于取消的编号；从最近一次advance的时间算起
+    TimerId schedule(uint64_t delay_ms, std::function<void()> callback);
+
+    // 在deadline_ms（与advance使用同一时钟）之后调用callback，适合推进不及时的场合（如另一个线程负责推进）
+    TimerId scheduleAt(uint64_t deadline_ms, std::function<void()> callback);
+
+    // 取消定时器，已经触发或已取消时返回false
+    bool cancel(TimerId id);
+
+    // 推进到now_ms，依次调用到期的回调；回调中可以添加或取消定时器
+    void advance(uint64_t now_ms);
+
+    // 从最近一次advance的时间算起，距离下一次需要推进的毫秒数（可能提前，不会推迟），没有定时器时返回-1
+    int nextTimeoutMs() const;
+
+    size_t size() const { return count; }
+
+    // 当前时间的毫秒数（steady_clock）
+    static uint64_t nowMs();
+
+private:
+    static const int kLevels = 4;
+    static const int kSlotBits = 8;
+    static const uint32_t kSlots = 1u << kSlotBits;
+    static const uint32_t kSlotMask = kSlots - 1;
+
+    // 节点：前kLevels*kSlots个是各槽的链表头，之后是定时器
+    struct Node {
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        uint32_t generation = 0;   // 节点复用时递增，使旧的TimerId失效
+        bool active = false;
+        uint64_t expires = 0;      // 到期刻度
+        std::function<void()> callback;
+    };
+
+    uint64_t tick_ms;
+    uint64_t current_tick;   // 已处理到的刻度
+    uint64_t current_ms;     // 最近一次推进时的时间
+    size_t count;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_nodes;
+    uint32_t expiring;       // 正在触发的节点的链表头
+
+    uint32_t slotHead(int level, uint32_t index) const { return (uint32_t)level * kSlots + index; }
+    void link(uint32_t head, uint32_t node);
+    void unlink(uint32_t node);
+    void insert(uint32_t node);
+
+    // 把上层槽中的定时器按剩余时间重新分散到下层
+    void cascade(int level);
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include "metrics.h"
+
+// 请求追踪
+// 按采样率选出部分请求，记录它们在各阶段（解析、准入、处理器、令牌验证、Redis/MySQL调用、JSON构建、写出）的耗时，
+// 导出为Chrome trace_event格式，可以用chrome://tracing或Perfetto打开，每个请求显示为一条独立的轨道。
+// 事件记录在每个线程自己的环形缓冲区中，只保留最近的事件；未被采样的请求在每个记录点只有一次判断。
+class Trace {
+public:
+    // 每sample_every个请求追踪一个，0表示关闭（默认）
+    static void setSampleEvery(uint32_t sample_every);
+    static uint32_t sampleEvery() { return sample_every.load(std::memory_order_relaxed); }
+
+    // 为新请求决定是否采样，返回追踪编号，0表示不追踪
+    static uint64_t sampleRequest() {
+        uint32_t every = sample_every.load(std::memory_order_relaxed);
+        return every == 0 ? 0 : nextSample(every);
+    }
+
+    // 当前线程正在为哪个请求工作，异步回调执行前由发起方恢复
+    static uint64_t current() { return t_current; }
+    static void setCurrent(uint64_t trace_id) { t_current = trace_id; }
+
+    // 记录请求的一个阶段，name须是字符串常量；detail为附加说明（如请求路径），可以为空
+    static void span(uint64_t trace_id, const char* name, uint64_t start_ns, uint64_t end_ns,
+                     const std::string& detail = std::string());
+
+    // 以Chrome trace_event JSON格式导出各线程缓冲区中的事件
+    static std::string renderChromeTrace();
+
+    // 导出到文件
+    static bool dumpToFile(const std::string& path);
+
+    // 收到signo信号时把追踪导出到path（文件名后附加时间戳）；
+    // 须在创建任何线程之前调用，信号在所有线程中被屏蔽，由一个专门的线程同步等待
+    static bool installDumpSignal(int signo, const std::string& path);
+
+private:
+    static std::atomic<uint32_t> sample_every;
+    static thread_local uint64_t t_current;
+
+    static uint64_t nextSample(uint32_t every);
+};
+
+// 作用域内的一个阶段：当前线程没有在追踪的请求时，构造和析构各只有一次判断
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name(name), trace_id(Trace::current()), start_ns(0) {
+        if (trace_id) {
+            start_ns = Metrics::nowNs();
+        }
+    }
+
+    ~TraceScope() {
+        if (trace_id) {
+            Trace::span(trace_id, name, start_ns, Metrics::nowNs());
+        }
+    }
+
+private:
+    const char* name;
+    uint64_t trace_id;
+    uint64_t start_ns;
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+// 在回调中恢复发起方的追踪编号，离开作用域时还原
+class TraceContext {
+public:
+    explicit TraceContext(uint64_t trace_id) : saved(Trace::current()) { Trace::setCurrent(trace_id); }
+    ~TraceContext() { Trace::setCurrent(saved); }
+
+private:
+    uint64_t saved;
+
+    TraceContext(const TraceContext&) = delete;
+    TraceContext& operator=(const TraceContext&) = delete;
+};
+
+#endif // TRACE_H
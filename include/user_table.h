@@ -0,0 +1,30 @@
+#ifndef USER_TABLE_H
+#define USER_TABLE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 用户名与32位用户编号的全局映射
+// 内存中的消息、房间信息、令牌和在线状态只保存编号，序列化（JSON响应、存储记录）时才换回用户名。
+// 编号从1开始按首次出现的顺序分配，进程内不变、不回收；0表示空用户名。
+// 查找不加锁：名称按编号存放在只追加的分块数组中，用户名到编号的开放寻址表扩容时整体替换；
+// 只有登记新用户名时才加锁。
+class UserTable {
+public:
+    static const uint32_t kNoUser = 0;
+
+    // 取用户名的编号，尚未登记时分配新编号
+    static uint32_t intern(const std::string& username);
+
+    // 只查找，不登记
+    static bool find(const std::string& username, uint32_t& user_id);
+
+    // 编号对应的用户名，未知编号返回空字符串；返回的引用在进程生命期内有效
+    static const std::string& name(uint32_t user_id);
+
+    // 已登记的用户数
+    static size_t size();
+};
+
+#endif // USER_TABLE_H
@@ -0,0 +1,25 @@
+#ifndef UTF8_JSON_H
+#define UTF8_JSON_H
+
+#include <string>
+#include <cstddef>
+
+// 消息文本的UTF-8校验和JSON字符串转义
+// 运行时按CPU选择实现：支持AVX2时每次处理32字节，否则用SSE2（x86-64的基线）或逐字节的实现。
+// 消息大多是中文，几乎没有需要转义的字符，转义时整段复制不需要转义的字节。
+
+// 是否为合法的UTF-8（拒绝过长编码、代理项和超出U+10FFFF的码点）
+bool isValidUtf8(const char* data, size_t length);
+inline bool isValidUtf8(const std::string& text) { return isValidUtf8(text.data(), text.length()); }
+
+// 把text作为JSON字符串（带引号）追加到out；输出与nlohmann::json::dump()一致：
+// 只转义引号、反斜杠和控制字符，非ASCII字符原样输出
+void appendJsonString(std::string& out, const std::string& text);
+
+// 当前使用的实现："avx2"、"sse2"或"scalar"
+const char* utf8JsonIsa();
+
+// 指定实现，供基准测试和对比测试使用；CPU不支持或名称未知时返回false，实现不变
+bool setUtf8JsonIsa(const char* isa);
+
+#endif // UTF8_JSON_H
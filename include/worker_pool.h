@@ -0,0 +1,37 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+// 阻塞调用的后台线程池：反应器把同步的MySQL查询、大文件落盘等交给后台线程，
+// 完成后经LoopMailbox把回调交回发起调用的事件循环，反应器在此期间继续处理其他连接。
+class WorkerPool {
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    void start(int threads);
+
+    // 执行完已提交的任务后停止
+    void stop();
+
+    // work在后台线程上执行，done随后在调用线程的事件循环上执行；
+    // 不在事件循环线程上或线程池未启动时在调用线程上依次执行work和done
+    void execute(std::function<void()> work, std::function<void()> done);
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool running;
+
+    void run();
+};
+
+#endif // WORKER_POOL_H
@@ -1,12 +1,23 @@
 #include "include/server.h"
 #include "include/chat_handler.h"
+#include "include/redis_mysql_storage.h"
+#include "include/memory_storage.h"
+#include "include/message_log.h"
 #include "include/client.h"
+#include "include/message_archiver.h"
+#include "include/redis_pubsub.h"
+#include "include/metrics.h"
+#include "include/trace.h"
+#include "include/embedded_assets.h"
 #include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <unistd.h>
 #include <limits.h>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
 
 // 处理URL中的查询参数，返回不带参数的基本路径
 std::string removeQueryParams(const std::string& path) {
@@ -17,61 +28,142 @@ std::string removeQueryParams(const std::string& path) {
     return path;
 }
 
-// 添加这个函数来获取正确的资源路径
-std::string getResourcePath(const std::string& relativePath) {
-    // 当前工作目录
-    char cwd[PATH_MAX];
-    getcwd(cwd, sizeof(cwd));
-    std::string workingDir(cwd);
-    
-    // 如果在build目录中运行，则使用上一级目录的资源
-    if (workingDir.find("/build") != std::string::npos) {
-        size_t pos = workingDir.find("/build");
-        return workingDir.substr(0, pos) + relativePath;
-    }
-    
-    // 否则使用当前目录
-    return "." + relativePath;
-}
-
 // 全局聊天处理器实例
 ChatHandler g_chat_handler;
 
-int main() {
+// 后台消息归档器
+MessageArchiver g_message_archiver;
+
+int main(int argc, char* argv[]) {
+    // 存储后端：redis（默认，Redis+MySQL）或 memory（嵌入式内存存储，数据不持久化）
+    // --message-log 指定目录时，房间消息改为保存在该目录下的分段追加日志中
+    std::string storage_type = "redis";
+    std::string message_log_dir;
+    std::string attachment_dir = "data/attachments";
+    int trace_sample = 0;
+    std::string filter_words_path;
+    ContentFilterAction filter_action = FILTER_MASK;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--storage") == 0 && i + 1 < argc) {
+            storage_type = argv[++i];
+        } else if (strcmp(argv[i], "--message-log") == 0 && i + 1 < argc) {
+            message_log_dir = argv[++i];
+        } else if (strcmp(argv[i], "--assets-dir") == 0 && i + 1 < argc) {
+            setAssetOverrideDirectory(argv[++i]);
+        } else if (strcmp(argv[i], "--attachments") == 0 && i + 1 < argc) {
+            attachment_dir = argv[++i];
+        } else if (strcmp(argv[i], "--trace-sample") == 0 && i + 1 < argc) {
+            trace_sample = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter-words") == 0 && i + 1 < argc) {
+            filter_words_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter-action") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "mask") == 0 || strcmp(argv[i + 1], "reject") == 0)) {
+            filter_action = strcmp(argv[++i], "reject") == 0 ? FILTER_REJECT : FILTER_MASK;
+        } else {
+            std::cerr << "用法: " << argv[0] << " [--storage redis|memory] [--message-log 目录] [--assets-dir 项目目录]"
+                      << " [--attachments 目录] [--trace-sample N] [--filter-words 词表文件] [--filter-action mask|reject]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    
     // 输出当前工作目录
     char cwd[PATH_MAX];
     if (getcwd(cwd, sizeof(cwd)) != nullptr) {
         std::cout << "Current working directory: " << cwd << std::endl;
     }
 
+    // 请求追踪：每N个请求采样一个（默认关闭），kill -USR2 导出到当前目录的trace.<时间戳>.json；
+    // 须在创建任何线程之前安装，之后的线程都屏蔽该信号
+    Trace::setSampleEvery(trace_sample > 0 ? (uint32_t)trace_sample : 0);
+    if (!Trace::installDumpSignal(SIGUSR2, "trace")) {
+        std::cerr << "Failed to install trace dump signal" << std::endl;
+    }
+
     // 初始化聊天处理器
-    bool init_success = g_chat_handler.initialize("127.0.0.1", 6379, 
-                                                 "127.0.0.1", 3306,
-                                                 "chatuser", "chatpassword", "chat_room");
+    std::unique_ptr<Storage> storage;
+    if (storage_type == "memory") {
+        storage.reset(new MemoryStorage());
+    } else if (storage_type == "redis") {
+        RedisMysqlConfig storage_config;
+        storage_config.mysql_user = "chatuser";
+        storage_config.mysql_password = "chatpassword";
+        storage_config.mysql_db = "chat_room";
+        storage_config.pool_size = 16;
+        storage.reset(new RedisMysqlStorage(storage_config));
+    } else {
+        std::cerr << "未知的存储后端: " << storage_type << std::endl;
+        return 1;
+    }
+    
+    if (!message_log_dir.empty()) {
+        MessageLogConfig log_config;
+        log_config.directory = message_log_dir;
+        log_config.segment_bytes = 64ull << 20;
+        log_config.retention_seconds = 0;
+        log_config.max_room_bytes = 0;
+        storage.reset(new MessageLogStorage(std::move(storage), log_config));
+    }
+    
+    bool init_success = g_chat_handler.initialize(std::move(storage));
     if (!init_success) {
         std::cerr << "Failed to initialize chat handler" << std::endl;
         return 1;
     }
     
+    // 消息附件保存在本地目录，上传时边接收边写盘
+    AttachmentConfig attachment_config;
+    attachment_config.directory = attachment_dir;
+    attachment_config.max_bytes = 32ull << 20;
+    if (!g_chat_handler.enableAttachments(attachment_config)) {
+        std::cerr << "Failed to open attachment store" << std::endl;
+        return 1;
+    }
+    
+    // 敏感词过滤：指定词表文件时启用，文件修改后5秒内在后台重新编译并替换
+    if (!filter_words_path.empty()) {
+        ContentFilterConfig filter_config;
+        filter_config.words_path = filter_words_path;
+        filter_config.action = filter_action;
+        filter_config.reload_interval_seconds = 5;
+        if (!g_chat_handler.enableContentFilter(filter_config)) {
+            std::cerr << "Failed to load filter word list" << std::endl;
+            return 1;
+        }
+    }
+    
+    // 多个实例共享同一Redis时，新消息经Redis发布/订阅推送给其他实例上长轮询等待的客户端
+    if (storage_type == "redis") {
+        g_chat_handler.enableFanoutTransport(std::unique_ptr<FanoutTransport>(new RedisPubSub("127.0.0.1", 6379)));
+    }
+    
+    // 从已有历史消息重建全文索引，各房间并行处理
+    unsigned int index_threads = std::max(1u, std::thread::hardware_concurrency());
+    g_chat_handler.rebuildSearchIndex((int)index_threads);
+    
+    // 启动消息归档：超过7天或超出每房间1000条的消息迁移到MySQL（仅消息保存在Redis时）
+    if (storage_type == "redis" && message_log_dir.empty()) {
+        ArchiveConfig archive_config;
+        archive_config.retention_seconds = 7 * 24 * 3600;
+        archive_config.max_messages_per_room = 1000;
+        if (!g_message_archiver.start("127.0.0.1", 6379,
+                                      "127.0.0.1", 3306,
+                                      "chatuser", "chatpassword", "chat_room", archive_config)) {
+            std::cerr << "Failed to start message archiver" << std::endl;
+            return 1;
+        }
+    }
+    
     // 创建HTTP服务器
     HttpServer server(8080);
     
     // 添加路由处理
-    // 静态页面
-    server.addHandler("/", [](const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-        std::string filePath = getResourcePath("/templates/index.html");
-        std::ifstream file(filePath);
-        if (!file) {
-            std::cerr << "Error: Could not open index.html file at " << filePath << std::endl;
-            return std::string("<html><body><h1>Error: Index page not found</h1></body></html>");
-        }
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    });
+    // 静态页面，页面和static/下的资源编译在程序中；指定--assets-dir时从该目录读取
+    server.addAssetRoute("/", "templates/index.html");
     
-    server.addHandler("/chat", ApiClient::handleChatPage);
-    server.addHandler("/room", ApiClient::handleRoomPage);
+    // 聊天和房间页面由模板渲染，内联当前用户的房间列表和最近消息
+    server.addHandler("/chat", ApiClient::handleChatPage, "text/html; charset=utf-8");
+    server.addHandler("/room", ApiClient::handleRoomPage, "text/html; charset=utf-8");
     
     // API路由
     server.addHandler("/api/login", ApiClient::handleLogin);
@@ -84,63 +176,63 @@ int main() {
     server.addHandler("/api/rooms", ApiClient::handleGetRooms);
     server.addHandler("/api/rooms/create", ApiClient::handleCreateRoom);
     server.addHandler("/api/rooms/delete", ApiClient::handleDeleteRoom);
-    server.addHandler("/api/rooms/send", ApiClient::handleSendRoomMessage);
-    server.addHandler("/api/rooms/messages", ApiClient::handleGetRoomMessages);
-    
-    // 静态文件处理
-    server.addHandler("/js/", [](const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-        // 提取文件名
-        std::string path = headers.at("path");
-        std::string filename = getResourcePath("/static") + removeQueryParams(path);
-        
-        // 打开文件
-        std::ifstream file(filename);
-        if (!file) {
-            std::cerr << "Error: Could not open file " << filename << std::endl;
-            return std::string("console.error('Failed to load JavaScript file');");
-        }
-        
-        // 读取文件内容
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    });
-    
-    server.addHandler("/css/", [](const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-        // 提取文件名
-        std::string path = headers.at("path");
-        std::string filename = getResourcePath("/static") + removeQueryParams(path);
-        
-        // 打开文件
-        std::ifstream file(filename);
-        if (!file) {
-            std::cerr << "Error: Could not open file " << filename << std::endl;
-            return std::string("/* CSS file not found */");
-        }
-        
-        // 读取文件内容
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    });
-    
-    server.addHandler("/images/", [](const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-        // 提取文件名
-        std::string path = headers.at("path");
-        std::string filename = getResourcePath("/static") + removeQueryParams(path);
-        
-        // 打开文件
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) {
-            std::cerr << "Error: Could not open file " << filename << std::endl;
-            return std::string("Image not found");
-        }
-        
-        // 读取文件内容
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    });
+    server.addAsyncHandler("/api/rooms/send", ApiClient::handleSendRoomMessage);
+    server.addAsyncHandler("/api/rooms/send_batch", ApiClient::handleSendRoomMessageBatch);
+    server.addAsyncHandler("/api/rooms/poll", ApiClient::handlePollRoomMessages);
+    server.addAsyncHandler("/api/rooms/read", ApiClient::handleMarkRoomRead);
+    server.addAsyncHandler("/api/rooms/heartbeat", ApiClient::handleRoomHeartbeat);
+    server.addAsyncHandler("/api/rooms/presence", ApiClient::handleGetRoomPresence);
+    server.addAsyncHandler("/api/rooms/messages", ApiClient::handleGetRoomMessages);
+    server.addAsyncHandler("/api/sync", ApiClient::handleSync);
+    server.addHandler("/api/rooms/search", ApiClient::handleSearchMessages);
+    
+    // 附件上传（流式写盘）和下载（sendfile，支持Range）
+    server.addUploadHandler("/api/attachments/upload", ApiClient::handleUploadAttachment,
+                            g_chat_handler.maxAttachmentBytes());
+    server.addFileHandler("/api/attachments", ApiClient::handleDownloadAttachment);
+    
+    // 运行指标（Prometheus文本格式）
+    server.addHandler("/metrics", [](const std::unordered_map<std::string, std::string>&, const std::string&) {
+        return Metrics::renderPrometheus();
+    }, "text/plain; version=0.0.4");
+    
+    // 请求追踪导出，可用chrome://tracing或Perfetto打开
+    server.addHandler("/debug/trace", ApiClient::handleTraceDump);
+    
+    // 准入控制：按用户和IP限流，限制同时执行的请求数；过载时发送消息优先于历史拉取和搜索
+    server.setRoutePriority("/api/login", PRIORITY_HIGH);
+    server.setRoutePriority("/api/send", PRIORITY_HIGH);
+    server.setRoutePriority("/api/rooms/send", PRIORITY_HIGH);
+    server.setRoutePriority("/api/rooms/send_batch", PRIORITY_HIGH);
+    server.setRouteLongPoll("/api/rooms/poll");
+    server.setRoutePriority("/api/messages", PRIORITY_LOW);
+    server.setRoutePriority("/api/rooms/messages", PRIORITY_LOW);
+    server.setRoutePriority("/api/sync", PRIORITY_LOW);
+    server.setRoutePriority("/api/rooms/search", PRIORITY_LOW);
+    server.setRoutePriority("/api/rooms/read", PRIORITY_LOW);
+    server.setRoutePriority("/api/rooms/heartbeat", PRIORITY_LOW);
+    server.setRoutePriority("/api/rooms/presence", PRIORITY_LOW);
+    server.setRoutePriority("/api/attachments", PRIORITY_LOW);
+    server.setRoutePriority("/debug/trace", PRIORITY_LOW);
+    
+    AdmissionConfig admission_config;
+    admission_config.per_user = {20, 40};
+    admission_config.per_ip = {50, 100};
+    admission_config.max_connections = 1024;
+    admission_config.max_concurrent = 64;
+    server.enableAdmission(admission_config);
+    
+    // 同一房间历史消息的并发读取合并为一次，结果保留100毫秒供紧随其后的相同请求使用
+    g_chat_handler.setHistoryCacheWindow(100);
+    
+    // 连接超时：请求头须在10秒内发完，请求体和响应在30秒内没有进展时断开，处理器30秒内没有响应时返回504
+    ConnectionTimeouts connection_timeouts;
+    connection_timeouts.header_ms = 10000;
+    connection_timeouts.body_idle_ms = 30000;
+    connection_timeouts.write_idle_ms = 30000;
+    connection_timeouts.handler_ms = 30000;
+    connection_timeouts.long_poll_ms = 90000;
+    server.setTimeouts(connection_timeouts);
     
     std::cout << "Starting chat server on port 8080..." << std::endl;
     
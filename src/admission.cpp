@@ -0,0 +1,123 @@
+#include "../include/admission.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void TokenBucketTable::sweep(Shard& shard, uint64_t now_ns) {
+    // 桶在空闲burst/rate秒后回满，此时删除与保留没有区别
+    uint64_t refill_ns = (uint64_t)(limit.burst / limit.rate_per_second * 1e9);
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        if (now_ns - it->second.updated_ns >= refill_ns) {
+            it = shard.buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool TokenBucketTable::take(const std::string& key, uint64_t now_ns, uint64_t& retry_after_ms) {
+    if (limit.rate_per_second <= 0) {
+        return true;
+    }
+
+    Shard& shard = shards[std::hash<std::string>()(key) % kShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.buckets.find(key);
+    if (it == shard.buckets.end()) {
+        if (shard.buckets.size() >= shard.sweep_at) {
+            sweep(shard, now_ns);
+            size_t remaining = shard.buckets.size();
+            shard.sweep_at = remaining * 2 > kSweepThreshold ? remaining * 2 : kSweepThreshold;
+        }
+        it = shard.buckets.emplace(key, Bucket{limit.burst, now_ns}).first;
+    }
+
+    Bucket& bucket = it->second;
+    double elapsed = (double)(now_ns - bucket.updated_ns) / 1e9;
+    bucket.tokens = std::min(limit.burst, bucket.tokens + elapsed * limit.rate_per_second);
+    bucket.updated_ns = now_ns;
+
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return true;
+    }
+
+    retry_after_ms = (uint64_t)std::ceil((1.0 - bucket.tokens) / limit.rate_per_second * 1000.0);
+    return false;
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter(const AdmissionConfig& config) : inflight(0), waiting_total(0) {
+    int limit = std::max(1, config.max_concurrent);
+    ceilings[PRIORITY_HIGH] = limit;
+    ceilings[PRIORITY_NORMAL] = limit;
+    ceilings[PRIORITY_LOW] = std::max(1, (int)(limit * config.low_priority_share));
+    for (int i = 0; i < PRIORITY_LEVELS; ++i) {
+        timeouts_ms[i] = config.queue_timeout_ms[i];
+        waiting[i] = 0;
+    }
+}
+
+bool ConcurrencyLimiter::tryAcquire(int ceiling) {
+    int current = inflight.load();
+    while (current < ceiling) {
+        if (inflight.compare_exchange_weak(current, current + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ConcurrencyLimiter::acquire(RequestPriority priority) {
+    // 有请求在排队时新请求排在它们后面，不插队
+    return waiting_total.load() == 0 && tryAcquire(ceilings[priority]);
+}
+
+bool ConcurrencyLimiter::acquireQueued(RequestPriority priority) {
+    // 有更高优先级的请求在排队时让它们先执行
+    for (int p = 0; p < priority; ++p) {
+        if (waiting[p].load() > 0) {
+            return false;
+        }
+    }
+    return tryAcquire(ceilings[priority]);
+}
+
+void ConcurrencyLimiter::enqueue(RequestPriority priority) {
+    waiting[priority]++;
+    waiting_total++;
+}
+
+void ConcurrencyLimiter::dequeue(RequestPriority priority) {
+    waiting[priority]--;
+    waiting_total--;
+}
+
+bool ConcurrencyLimiter::release() {
+    inflight--;
+    return waiting_total.load() > 0;
+}
+
+AdmissionController::AdmissionController(const AdmissionConfig& config)
+    : config(config), user_buckets(config.per_user), ip_buckets(config.per_ip), limiter(config) {
+}
+
+bool AdmissionController::allowRequest(const std::string& client_ip, const std::string& token,
+                                       int& retry_after_seconds) {
+    uint64_t now_ns = Metrics::nowNs();
+    uint64_t retry_after_ms = 0;
+
+    bool allowed = ip_buckets.take(client_ip, now_ns, retry_after_ms);
+    if (allowed && !token.empty()) {
+        // 桶表中只保存令牌的哈希，不保存令牌本身
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", (unsigned long long)std::hash<std::string>()(token));
+        allowed = user_buckets.take(key, now_ns, retry_after_ms);
+    }
+
+    if (!allowed) {
+        retry_after_seconds = std::max(1, (int)((retry_after_ms + 999) / 1000));
+    }
+    return allowed;
+}
@@ -0,0 +1,253 @@
+#include "../include/attachment_store.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static bool makeDirectories(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); ++pos) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string prefix = path.substr(0, pos);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// 只保留"类型/子类型"部分（去掉参数），不合法时使用application/octet-stream
+static std::string normalizeContentType(const std::string& content_type) {
+    std::string type = content_type.substr(0, content_type.find(';'));
+    while (!type.empty() && type.back() == ' ') {
+        type.pop_back();
+    }
+    size_t slash = type.find('/');
+    bool valid = !type.empty() && type.size() <= 100 && slash != std::string::npos &&
+                 slash > 0 && slash + 1 < type.size();
+    for (char& c : type) {
+        if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 'a';
+        }
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || strchr("/.+-_", c) != nullptr)) {
+            valid = false;
+        }
+    }
+    return valid ? type : "application/octet-stream";
+}
+
+AttachmentUpload::AttachmentUpload(const std::string& temp_path, int fd, size_t chunk_bytes, uint64_t max_bytes,
+                                   const std::string& content_type)
+    : temp_path(temp_path), fd(fd), chunk(chunk_bytes), chunk_used(0), total(0), max_bytes(max_bytes),
+      content_type(content_type), failed(false) {
+}
+
+AttachmentUpload::~AttachmentUpload() {
+    if (fd >= 0) {
+        ::close(fd);
+        unlink(temp_path.c_str());
+    }
+}
+
+bool AttachmentUpload::write(const char* data, size_t len) {
+    if (failed || fd < 0) {
+        return false;
+    }
+    if (total + len > max_bytes) {
+        failed = true;
+        return false;
+    }
+    hash.update(data, len);
+    total += len;
+
+    while (len > 0) {
+        size_t take = std::min(len, chunk.size() - chunk_used);
+        memcpy(chunk.data() + chunk_used, data, take);
+        chunk_used += take;
+        data += take;
+        len -= take;
+        if (chunk_used == chunk.size() && !flushChunk()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AttachmentUpload::flushChunk() {
+    if (chunk_used > 0 && !writeAll(fd, chunk.data(), chunk_used)) {
+        std::cerr << "写入附件临时文件失败: " << strerror(errno) << std::endl;
+        failed = true;
+        return false;
+    }
+    chunk_used = 0;
+    return true;
+}
+
+AttachmentStore::AttachmentStore() : opened(false), next_upload(0) {
+}
+
+bool AttachmentStore::open(const AttachmentConfig& attachment_config) {
+    config = attachment_config;
+    std::string temp_dir = config.directory + "/tmp";
+    if (!makeDirectories(temp_dir) || !makeDirectories(config.directory + "/objects")) {
+        std::cerr << "无法创建附件目录 " << config.directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // 上次进程退出时未完成的上传
+    DIR* dir = opendir(temp_dir.c_str());
+    if (dir != nullptr) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] != '.') {
+                unlink((temp_dir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+
+    opened = true;
+    committers.start(config.commit_threads);
+    std::cout << "附件存储目录: " << config.directory << "，单个附件上限 " << (config.max_bytes >> 20) << "MB"
+              << std::endl;
+    return true;
+}
+
+std::unique_ptr<AttachmentUpload> AttachmentStore::beginUpload(const std::string& content_type) {
+    if (!opened) {
+        return nullptr;
+    }
+    std::string temp_path = config.directory + "/tmp/" + std::to_string(getpid()) + "-" +
+                            std::to_string(next_upload.fetch_add(1));
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "无法创建附件临时文件: " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<AttachmentUpload>(new AttachmentUpload(
+        temp_path, fd, config.chunk_bytes, config.max_bytes, normalizeContentType(content_type)));
+}
+
+bool AttachmentStore::commit(AttachmentUpload& upload, AttachmentInfo& info) {
+    if (upload.failed || upload.fd < 0 || !upload.flushChunk()) {
+        return false;
+    }
+
+    info.id = upload.hash.hexDigest();
+    info.size = upload.total;
+    info.content_type = upload.content_type;
+
+    std::string path = objectPath(info.id);
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        // 相同内容已经保存过，析构时删除临时文件；内容类型以第一次上传为准
+        AttachmentInfo existing;
+        int fd = openForRead(info.id, existing);
+        if (fd >= 0) {
+            ::close(fd);
+            info.content_type = existing.content_type;
+        }
+        return true;
+    }
+
+    if (fdatasync(upload.fd) != 0 || !makeDirectories(path.substr(0, path.rfind('/')))) {
+        std::cerr << "保存附件失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // 先写内容类型再改名，附件文件出现时元信息一定已经存在
+    std::string type_path = path + ".type";
+    int type_fd = ::open(type_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool type_written = type_fd >= 0 && writeAll(type_fd, info.content_type.data(), info.content_type.size());
+    if (type_fd >= 0) {
+        ::close(type_fd);
+    }
+    if (!type_written || rename(upload.temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "保存附件失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    ::close(upload.fd);
+    upload.fd = -1;
+    return true;
+}
+
+void AttachmentStore::commitAsync(std::shared_ptr<AttachmentUpload> upload, CommitCallback done) {
+    std::shared_ptr<AttachmentInfo> info = std::make_shared<AttachmentInfo>();
+    std::shared_ptr<bool> ok = std::make_shared<bool>(false);
+    committers.execute([this, upload, info, ok] {
+        *ok = commit(*upload, *info);
+    }, [done, info, ok] {
+        done(*ok, *info);
+    });
+}
+
+bool AttachmentStore::exists(const std::string& id) const {
+    struct stat st;
+    return opened && isValidId(id) && stat(objectPath(id).c_str(), &st) == 0;
+}
+
+int AttachmentStore::openForRead(const std::string& id, AttachmentInfo& info) const {
+    if (!opened || !isValidId(id)) {
+        return -1;
+    }
+    std::string path = objectPath(id);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    info.id = id;
+    info.size = (uint64_t)st.st_size;
+    info.content_type = "application/octet-stream";
+    int type_fd = ::open((path + ".type").c_str(), O_RDONLY | O_CLOEXEC);
+    if (type_fd >= 0) {
+        char buffer[128];
+        ssize_t n = ::read(type_fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            info.content_type = normalizeContentType(std::string(buffer, n));
+        }
+        ::close(type_fd);
+    }
+    return fd;
+}
+
+bool AttachmentStore::isValidId(const std::string& id) {
+    if (id.size() != 64) {
+        return false;
+    }
+    for (char c : id) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string AttachmentStore::objectPath(const std::string& id) const {
+    return config.directory + "/objects/" + id.substr(0, 2) + "/" + id;
+}
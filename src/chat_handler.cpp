@@ -1,78 +1,69 @@
 #include "../include/chat_handler.h"
+#include "../include/send_pipeline.h"
+#include "../include/trace.h"
+#include "../include/utf8_json.h"
 #include <iostream>
 #include <ctime>
+#include <cstdio>
 #include <random>
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
-ChatHandler::ChatHandler() : redis_context(nullptr), mysql_connection(nullptr) {
+// 房间列表版本的缓存时间，其他实例创建或删除房间后最多这么久反映到同步接口
+static const int kRoomListTtlSeconds = 5;
+
+ChatHandler::ChatHandler() {
 }
 
 ChatHandler::~ChatHandler() {
     close();
 }
 
-bool ChatHandler::initialize(const std::string& redis_host, int redis_port, 
-                            const std::string& mysql_host, int mysql_port,
-                            const std::string& mysql_user, const std::string& mysql_password,
-                            const std::string& mysql_db) {
-    // 连接Redis
-    redis_context = redisConnect(redis_host.c_str(), redis_port);
-    if (redis_context == nullptr || redis_context->err) {
-        if (redis_context) {
-            std::cerr << "Redis connection error: " << redis_context->errstr << std::endl;
-            redisFree(redis_context);
-            redis_context = nullptr;
-        } else {
-            std::cerr << "Redis connection error: can't allocate redis context" << std::endl;
-        }
-        return false;
-    }
-
-    // 连接MySQL
-    mysql_connection = mysql_init(nullptr);
-    if (mysql_connection == nullptr) {
-        std::cerr << "MySQL init failed" << std::endl;
+bool ChatHandler::initialize(std::unique_ptr<Storage> backend) {
+    storage = std::move(backend);
+    if (!storage || !storage->open()) {
+        std::cerr << "存储后端初始化失败" << std::endl;
+        storage.reset();
         return false;
     }
 
-    if (mysql_real_connect(mysql_connection, mysql_host.c_str(), mysql_user.c_str(), 
-                           mysql_password.c_str(), mysql_db.c_str(), mysql_port, nullptr, 0) == nullptr) {
-        std::cerr << "MySQL connection error: " << mysql_error(mysql_connection) << std::endl;
-        mysql_close(mysql_connection);
-        mysql_connection = nullptr;
-        return false;
-    }
-
-    // 创建用户表（如果不存在）
-    const char* create_users_table = 
-        "CREATE TABLE IF NOT EXISTS users ("
-        "id INT AUTO_INCREMENT PRIMARY KEY,"
-        "username VARCHAR(50) NOT NULL UNIQUE,"
-        "password VARCHAR(255) NOT NULL,"
-        "email VARCHAR(100),"
-        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
-        ")";
-
-    if (mysql_query(mysql_connection, create_users_table)) {
-        std::cerr << "Failed to create users table: " << mysql_error(mysql_connection) << std::endl;
-        return false;
+    std::cout << "存储后端: " << storage->name() << std::endl;
+    
+    // 预先登记已有用户，之后的请求只做无锁查找
+    std::vector<std::string> usernames;
+    if (storage->listUsernames(usernames)) {
+        for (const auto& username : usernames) {
+            UserTable::intern(username);
+        }
+        std::cout << "已登记 " << usernames.size() << " 个用户" << std::endl;
     }
-
+    
+    // 其他实例写入的消息经推送通道到达时同样加入全文索引
+    fanout.setRemoteMessageCallback([this](int room_id, const ChatMessage& message) {
+        history_reads.invalidate(room_id);
+        search_index.addMessage(room_id, message.seq, message.content, parseMessageTimestamp(message.timestamp));
+    });
+    fanout.start(FanoutConfig());
+    presence.start(PresenceConfig());
+    read_cursors.start(storage.get(), ReadCursorConfig());
     return true;
 }
 
-void ChatHandler::close() {
-    // 关闭Redis连接
-    if (redis_context) {
-        redisFree(redis_context);
-        redis_context = nullptr;
-    }
+bool ChatHandler::enableFanoutTransport(std::unique_ptr<FanoutTransport> transport) {
+    return fanout.setTransport(std::move(transport));
+}
 
-    // 关闭MySQL连接
-    if (mysql_connection) {
-        mysql_close(mysql_connection);
-        mysql_connection = nullptr;
+void ChatHandler::close() {
+    content_filter.stop();
+    fanout.stop();
+    presence.stop();
+    read_cursors.stop();
+    if (storage) {
+        storage->close();
+        storage.reset();
     }
 }
 
@@ -81,190 +72,76 @@ std::string ChatHandler::createToken(const std::string& username) {
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(0, 15);
-    
+
     const char* hex = "0123456789abcdef";
     std::string token;
-    
+
     for (int i = 0; i < 32; ++i) {
         token += hex[dis(gen)];
     }
-    
-    // 在Redis中缓存令牌
-    std::string key = "token:" + token;
-    redisReply* reply = (redisReply*)redisCommand(redis_context, "SET %s %s", key.c_str(), username.c_str());
-    
-    if (reply == nullptr) {
-        std::cerr << "Failed to set token in Redis" << std::endl;
+
+    if (!storage->saveToken(token, username)) {
         return "";
     }
-    
-    freeReplyObject(reply);
-    
-    // 不再设置过期时间，因为不支持EXPIRE命令
-    
+
     return token;
 }
 
 bool ChatHandler::validateToken(const std::string& token, std::string& username) {
-    // 从Redis中获取令牌对应的用户名
-    std::string key = "token:" + token;
-    redisReply* reply = (redisReply*)redisCommand(redis_context, "GET %s", key.c_str());
-    
-    if (reply == nullptr || reply->type == REDIS_REPLY_NIL) {
-        if (reply) {
-            freeReplyObject(reply);
-        }
-        return false;
-    }
-    
-    username = reply->str;
-    freeReplyObject(reply);
-    
-    // 简单刷新令牌（重新设置，因为没有EXPIRE命令）
-    reply = (redisReply*)redisCommand(redis_context, "SET %s %s", key.c_str(), username.c_str());
-    if (reply) {
-        freeReplyObject(reply);
-    }
-    
-    return true;
+    TraceScope scope("validate token");
+    return storage->findToken(token, username);
 }
 
 bool ChatHandler::registerUser(const std::string& username, const std::string& password, const std::string& email) {
-    // 简单的密码加密（实际应用中应使用更安全的方式）
-    // 在这里就简单使用明文密码作为示例
-    std::string query = "INSERT INTO users (username, password, email) VALUES ('" +
-                        username + "', '" + password + "', '" + email + "')";
-    
-    if (mysql_query(mysql_connection, query.c_str())) {
-        std::cerr << "User registration failed: " << mysql_error(mysql_connection) << std::endl;
+    if (!storage->createUser(username, password, email)) {
         return false;
     }
-    
+    UserTable::intern(username);
     return true;
 }
 
 bool ChatHandler::loginUser(const std::string& username, const std::string& password, std::string& token) {
-    std::string query = "SELECT id FROM users WHERE username = '" + username + "' AND password = '" + password + "'";
-    
-    if (mysql_query(mysql_connection, query.c_str())) {
-        std::cerr << "Login query failed: " << mysql_error(mysql_connection) << std::endl;
+    if (!storage->checkUserPassword(username, password)) {
         return false;
     }
-    
-    MYSQL_RES* result = mysql_store_result(mysql_connection);
-    if (result == nullptr) {
-        std::cerr << "No result from login query" << std::endl;
-        return false;
+
+    token = createToken(username);
+    return !token.empty();
+}
+
+SendResult ChatHandler::sendMessage(const std::string& token, const std::string& message) {
+    // 消息内容在每次输出时都要转义，入库前保证是合法的UTF-8
+    if (!isValidUtf8(message)) {
+        return SEND_INVALID_TEXT;
     }
-    
-    bool success = false;
-    if (mysql_num_rows(result) > 0) {
-        token = createToken(username);
-        success = !token.empty();
+
+    // 敏感词过滤：按配置拒绝或把命中的字符替换为'*'
+    std::string content = message;
+    if (!content_filter.apply(content)) {
+        return SEND_FILTERED;
     }
-    
-    mysql_free_result(result);
-    return success;
-}
 
-bool ChatHandler::sendMessage(const std::string& token, const std::string& message) {
     std::string username;
     if (!validateToken(token, username)) {
-        return false;
+        return SEND_INVALID_TOKEN;
     }
-    
+
     // 创建消息记录
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %H:%M:%S");
-    std::string timestamp = ss.str();
-    
-    // 将消息保存在Redis中
-    std::string message_data = username + ":" + message + ":" + timestamp;
-    
-    // 获取当前消息计数
-    redisReply* count_reply = (redisReply*)redisCommand(redis_context, "GET chat_message_count");
-    int count = 0;
-    if (count_reply != nullptr && count_reply->type == REDIS_REPLY_STRING) {
-        count = std::stoi(count_reply->str);
-        freeReplyObject(count_reply);
-    }
-    
-    // 增加计数
-    count++;
-    
-    // 保存消息
-    std::string message_key = "chat_message:" + std::to_string(count);
-    redisReply* reply = (redisReply*)redisCommand(redis_context, "SET %s %s", 
-                                                 message_key.c_str(), message_data.c_str());
-    
-    if (reply == nullptr) {
-        std::cerr << "Failed to save message" << std::endl;
-        return false;
-    }
-    
-    freeReplyObject(reply);
-    
-    // 更新消息计数
-    reply = (redisReply*)redisCommand(redis_context, "SET chat_message_count %d", count);
-    if (reply != nullptr) {
-        freeReplyObject(reply);
-    }
-    
-    return true;
+    ChatMessage record;
+    record.user_id = UserTable::intern(username);
+    record.content = content;
+    record.timestamp = formatMessageTimestamp(time(nullptr));
+
+    return storage->appendLobbyMessage(record) ? SEND_OK : SEND_FAILED;
 }
 
 std::vector<ChatMessage> ChatHandler::getMessages(const std::string& token, int limit) {
-    std::vector<ChatMessage> messages;
     std::string username;
     if (!validateToken(token, username)) {
-        return messages;
+        return std::vector<ChatMessage>();
     }
-    
-    // 从Redis中获取消息计数
-    redisReply* count_reply = (redisReply*)redisCommand(redis_context, "GET chat_message_count");
-    int total_messages = 0;
-    if (count_reply != nullptr && count_reply->type == REDIS_REPLY_STRING) {
-        total_messages = std::stoi(count_reply->str);
-        freeReplyObject(count_reply);
-    } else {
-        if (count_reply) {
-            freeReplyObject(count_reply);
-        }
-        return messages;
-    }
-    
-    // 计算开始索引，确保不超出范围
-    int start = std::max(1, total_messages - limit + 1);
-    int end = total_messages;
-    
-    // 逆序获取消息，以便最新的消息在前面
-    for (int i = end; i >= start; --i) {
-        std::string key = "chat_message:" + std::to_string(i);
-        redisReply* reply = (redisReply*)redisCommand(redis_context, "GET %s", key.c_str());
-        
-        if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
-            std::string message_data = reply->str;
-            size_t first_colon = message_data.find(':');
-            if (first_colon != std::string::npos) {
-                size_t second_colon = message_data.find(':', first_colon + 1);
-                if (second_colon != std::string::npos) {
-                    ChatMessage msg;
-                    msg.username = message_data.substr(0, first_colon);
-                    msg.content = message_data.substr(first_colon + 1, second_colon - first_colon - 1);
-                    msg.timestamp = message_data.substr(second_colon + 1);
-                    messages.push_back(msg);
-                }
-            }
-        }
-        
-        if (reply) {
-            freeReplyObject(reply);
-        }
-    }
-    
-    return messages;
+
+    return storage->readLobbyMessages(limit);
 }
 
 // 创建房间
@@ -274,43 +151,15 @@ bool ChatHandler::createRoom(const std::string& token, const std::string& name,
         std::cerr << "令牌验证失败" << std::endl;
         return false;
     }
-    
+
     std::cout << "验证令牌成功，用户: " << username << std::endl;
-    
-    // 创建房间表(如果不存在)
-    const char* create_rooms_table = 
-        "CREATE TABLE IF NOT EXISTS rooms ("
-        "id INT AUTO_INCREMENT PRIMARY KEY,"
-        "name VARCHAR(100) NOT NULL,"
-        "description TEXT,"
-        "creator VARCHAR(50) NOT NULL,"
-        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
-        ")";
-    
-    if (mysql_query(mysql_connection, create_rooms_table)) {
-        std::cerr << "创建房间表失败: " << mysql_error(mysql_connection) << std::endl;
-        return false;
-    }
-    
-    std::cout << "检查房间表完成" << std::endl;
-    
-    // 插入新房间
-    std::stringstream ss;
-    ss << "INSERT INTO rooms (name, description, creator) VALUES ('"
-       << name << "', '" << description << "', '" << username << "')";
-    
-    std::string query = ss.str();
-    std::cout << "执行SQL: " << query << std::endl;
-    
-    if (mysql_query(mysql_connection, query.c_str())) {
-        std::cerr << "创建房间失败: " << mysql_error(mysql_connection) << std::endl;
+
+    if (!storage->createRoom(name, description, username, room_id)) {
         return false;
     }
-    
-    // 获取新房间ID
-    room_id = mysql_insert_id(mysql_connection);
+
     std::cout << "房间创建成功，ID: " << room_id << std::endl;
-    
+    invalidateRoomList();
     return true;
 }
 
@@ -320,226 +169,561 @@ bool ChatHandler::deleteRoom(const std::string& token, int room_id) {
     if (!validateToken(token, username)) {
         return false;
     }
-    
+
     // 检查用户是否是房间创建者
-    std::stringstream check_ss;
-    check_ss << "SELECT creator FROM rooms WHERE id = " << room_id;
-    
-    if (mysql_query(mysql_connection, check_ss.str().c_str())) {
-        std::cerr << "查询房间失败: " << mysql_error(mysql_connection) << std::endl;
-        return false;
-    }
-    
-    MYSQL_RES* check_result = mysql_store_result(mysql_connection);
-    if (check_result == nullptr) {
-        std::cerr << "无法获取房间信息" << std::endl;
-        return false;
-    }
-    
-    MYSQL_ROW row = mysql_fetch_row(check_result);
-    if (row == nullptr) {
-        mysql_free_result(check_result);
+    ChatRoom room;
+    if (!storage->getRoom(room_id, room)) {
         std::cerr << "房间不存在" << std::endl;
         return false;
     }
-    
-    std::string creator = row[0];
-    mysql_free_result(check_result);
-    
-    if (creator != username) {
+
+    uint32_t user_id;
+    if (!UserTable::find(username, user_id) || room.creator_id != user_id) {
         std::cerr << "用户无权限删除该房间" << std::endl;
         return false;
     }
-    
-    // 删除房间
-    std::stringstream delete_ss;
-    delete_ss << "DELETE FROM rooms WHERE id = " << room_id;
-    
-    if (mysql_query(mysql_connection, delete_ss.str().c_str())) {
-        std::cerr << "删除房间失败: " << mysql_error(mysql_connection) << std::endl;
+
+    if (!storage->deleteRoom(room_id)) {
         return false;
     }
-    
-    // 删除房间消息
-    std::string room_messages_key = "room:" + std::to_string(room_id) + ":messages";
-    redisCommand(redis_context, "DEL %s", room_messages_key.c_str());
-    
+
+    search_index.removeRoom(room_id);
+    history_reads.invalidate(room_id);
+    invalidateRoomList();
     return true;
 }
 
 // 获取房间列表
 std::vector<ChatRoom> ChatHandler::getRooms() {
-    std::vector<ChatRoom> rooms;
-    
-    // 创建房间表(如果不存在)
-    const char* create_rooms_table = 
-        "CREATE TABLE IF NOT EXISTS rooms ("
-        "id INT AUTO_INCREMENT PRIMARY KEY,"
-        "name VARCHAR(100) NOT NULL,"
-        "description TEXT,"
-        "creator VARCHAR(50) NOT NULL,"
-        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
-        ")";
-    
-    if (mysql_query(mysql_connection, create_rooms_table)) {
-        std::cerr << "检查房间表失败: " << mysql_error(mysql_connection) << std::endl;
-        return rooms;
+    return storage->listRooms();
+}
+
+// 未读消息数由房间最新序号和已读位置相减得到，不扫描消息
+bool ChatHandler::getUnreadCounts(const std::string& username, const std::vector<int>& room_ids,
+                                  std::unordered_map<int, int>& counts) {
+    std::unordered_map<int, int> cursors;
+    std::vector<int> heads;
+    if (!read_cursors.getCursors(username, cursors) || !storage->getRoomHeads(room_ids, heads)) {
+        return false;
     }
-    
-    // 查询所有房间
-    const char* query = "SELECT id, name, description, creator, created_at FROM rooms ORDER BY created_at DESC";
-    
-    if (mysql_query(mysql_connection, query)) {
-        std::cerr << "获取房间列表失败: " << mysql_error(mysql_connection) << std::endl;
-        return rooms;
+
+    for (size_t i = 0; i < room_ids.size(); ++i) {
+        auto it = cursors.find(room_ids[i]);
+        int last_read = it == cursors.end() ? 0 : it->second;
+        counts[room_ids[i]] = std::max(0, heads[i] - last_read);
     }
-    
-    MYSQL_RES* result = mysql_store_result(mysql_connection);
-    if (result == nullptr) {
-        std::cerr << "无法获取房间结果集" << std::endl;
-        return rooms;
+    return true;
+}
+
+// 发送房间消息
+SendResult ChatHandler::sendRoomMessage(const std::string& token, int room_id, const std::string& message) {
+    if (!isValidUtf8(message)) {
+        return SEND_INVALID_TEXT;
     }
-    
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(result))) {
-        ChatRoom room;
-        room.id = std::stoi(row[0]);
-        room.name = row[1];
-        room.description = row[2] ? row[2] : "";
-        room.creator = row[3];
-        room.created_at = row[4];
-        
-        rooms.push_back(room);
+    std::string content = message;
+    if (!content_filter.apply(content)) {
+        return SEND_FILTERED;
     }
-    
-    mysql_free_result(result);
-    return rooms;
+
+    std::string username;
+    if (!validateToken(token, username)) {
+        return SEND_INVALID_TOKEN;
+    }
+
+    // 创建消息记录
+    time_t now = time(nullptr);
+    ChatMessage record;
+    record.user_id = UserTable::intern(username);
+    record.content = content;
+    record.timestamp = formatMessageTimestamp(now);
+
+    // 房间不存在时存储后端返回false
+    if (!storage->appendRoomMessage(room_id, record)) {
+        return SEND_FAILED;
+    }
+
+    // 更新全文索引并推送给等待中的客户端
+    search_index.addMessage(room_id, record.seq, record.content, now);
+    history_reads.invalidate(room_id);
+    fanout.publish(room_id, record);
+    presence.touch(room_id, username);
+    read_cursors.markRead(username, room_id, record.seq);
+
+    return SEND_OK;
 }
 
-// 发送房间消息
-bool ChatHandler::sendRoomMessage(const std::string& token, int room_id, const std::string& message) {
+// 获取房间消息
+std::vector<ChatMessage> ChatHandler::getRoomMessages(const std::string& token, int room_id, int limit) {
+    MessagePage page;
+    if (!getRoomMessagesPage(token, room_id, 0, 0, limit, page)) {
+        return std::vector<ChatMessage>();
+    }
+    return std::move(page.messages);
+}
+
+// 按消息序号分页获取房间消息
+bool ChatHandler::getRoomMessagesPage(const std::string& token, int room_id, int before_seq, int after_seq,
+                                      int limit, MessagePage& page) {
+    page = MessagePage();
+
     std::string username;
     if (!validateToken(token, username)) {
         return false;
     }
-    
-    // 检查房间是否存在
-    std::stringstream check_ss;
-    check_ss << "SELECT id FROM rooms WHERE id = " << room_id;
-    
-    if (mysql_query(mysql_connection, check_ss.str().c_str())) {
-        std::cerr << "查询房间失败: " << mysql_error(mysql_connection) << std::endl;
+
+    if (!storage->readRoomMessages(room_id, before_seq, after_seq, limit, page)) {
         return false;
     }
-    
-    MYSQL_RES* check_result = mysql_store_result(mysql_connection);
-    if (check_result == nullptr || mysql_num_rows(check_result) == 0) {
-        if (check_result) mysql_free_result(check_result);
-        std::cerr << "房间不存在" << std::endl;
-        return false;
+    presence.touch(room_id, username);
+    return true;
+}
+
+void ChatHandler::validateTokenAsync(const std::string& token,
+                                     std::function<void(bool ok, const std::string& username)> done) {
+    storage->findTokenAsync(token, done);
+}
+
+// 异步发送房间消息：令牌查询和消息写入都经由存储后端的异步接口
+void ChatHandler::sendRoomMessageAsync(const std::string& token, int room_id, const std::string& message,
+                                       const std::vector<std::string>& attachment_ids,
+                                       std::function<void(SendResult result)> done) {
+    if (!isValidUtf8(message)) {
+        done(SEND_INVALID_TEXT);
+        return;
+    }
+    std::string content = message;
+    if (!content_filter.apply(content)) {
+        done(SEND_FILTERED);
+        return;
     }
-    
-    mysql_free_result(check_result);
-    
-    // 创建消息记录
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %H:%M:%S");
-    std::string timestamp = ss.str();
-    
-    // 将消息保存在Redis中
-    std::string message_data = username + ":" + message + ":" + timestamp;
-    
-    // 获取当前房间消息计数
-    std::string room_count_key = "room:" + std::to_string(room_id) + ":message_count";
-    redisReply* count_reply = (redisReply*)redisCommand(redis_context, "GET %s", room_count_key.c_str());
-    int count = 0;
-    if (count_reply != nullptr && count_reply->type == REDIS_REPLY_STRING) {
-        count = std::stoi(count_reply->str);
-        freeReplyObject(count_reply);
+
+    storage->findTokenAsync(token, [this, room_id, content, attachment_ids, done](bool ok, const std::string& username) {
+        if (!ok) {
+            done(SEND_INVALID_TOKEN);
+            return;
+        }
+
+        time_t now = time(nullptr);
+        ChatMessage record;
+        record.user_id = UserTable::intern(username);
+        record.content = content;
+        record.timestamp = formatMessageTimestamp(now);
+        record.attachments = attachment_ids;
+
+        RoomAppend append;
+        append.room_id = room_id;
+        append.message = record;
+        append.done = [this, room_id, now, done](bool ok, const ChatMessage& saved) {
+            if (ok) {
+                search_index.addMessage(room_id, saved.seq, saved.content, now);
+                history_reads.invalidate(room_id);
+                fanout.publish(room_id, saved);
+                presence.touch(room_id, saved.user_id);
+                read_cursors.markRead(saved.username(), room_id, saved.seq);
+            }
+            done(ok ? SEND_OK : SEND_FAILED);
+        };
+        submitAppend(std::move(append));
+    });
+}
+
+// 异步批量发送房间消息，与单条发送进入同一条发送流水线
+void ChatHandler::sendRoomMessagesAsync(const std::string& token, const std::vector<std::pair<int, std::string>>& messages,
+                                        std::function<void(bool ok, const std::vector<int>& seqs)> done) {
+    storage->findTokenAsync(token, [this, messages, done](bool ok, const std::string& username) {
+        if (!ok) {
+            done(false, std::vector<int>());
+            return;
+        }
+        if (messages.empty()) {
+            done(true, std::vector<int>());
+            return;
+        }
+
+        // 各条消息的结果汇总后一起返回，失败的消息序号为0
+        struct BatchState {
+            std::vector<int> seqs;
+            size_t remaining;
+        };
+        std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+        state->seqs.assign(messages.size(), 0);
+        state->remaining = messages.size();
+
+        time_t now = time(nullptr);
+        std::string timestamp = formatMessageTimestamp(now);
+        uint32_t user_id = UserTable::intern(username);
+        for (size_t i = 0; i < messages.size(); ++i) {
+            std::string content = messages[i].second;
+            if (!isValidUtf8(content) || !content_filter.apply(content)) {
+                if (--state->remaining == 0) {
+                    done(true, state->seqs);
+                }
+                continue;
+            }
+            RoomAppend append;
+            append.room_id = messages[i].first;
+            append.message.user_id = user_id;
+            append.message.content = std::move(content);
+            append.message.timestamp = timestamp;
+            int room_id = messages[i].first;
+            append.done = [this, state, i, room_id, now, done](bool ok, const ChatMessage& saved) {
+                if (ok) {
+                    state->seqs[i] = saved.seq;
+                    search_index.addMessage(room_id, saved.seq, saved.content, now);
+                    history_reads.invalidate(room_id);
+                    fanout.publish(room_id, saved);
+                    presence.touch(room_id, saved.user_id);
+                    read_cursors.markRead(saved.username(), room_id, saved.seq);
+                }
+                if (--state->remaining == 0) {
+                    done(true, state->seqs);
+                }
+            };
+            submitAppend(std::move(append));
+        }
+    });
+}
+
+void ChatHandler::submitAppend(RoomAppend append) {
+    SendPipeline* pipeline = SendPipeline::forCurrentLoop(storage.get(), kSendBatchSize);
+    if (pipeline) {
+        pipeline->submit(std::move(append));
+        return;
     }
-    
-    // 增加计数
-    count++;
-    
-    // 保存消息
-    std::string room_message_key = "room:" + std::to_string(room_id) + ":message:" + std::to_string(count);
-    redisReply* reply = (redisReply*)redisCommand(redis_context, "SET %s %s", 
-                                                room_message_key.c_str(), message_data.c_str());
-    
-    if (reply == nullptr) {
-        std::cerr << "保存房间消息失败" << std::endl;
-        return false;
+    storage->appendRoomMessageAsync(append.room_id, append.message, append.done);
+}
+
+// 异步按消息序号分页获取房间消息
+void ChatHandler::getRoomMessagesPageAsync(const std::string& token, int room_id, int before_seq, int after_seq,
+                                           int limit, std::function<void(bool ok, MessagePage& page)> done) {
+    storage->findTokenAsync(token, [this, room_id, before_seq, after_seq, limit, done](bool ok,
+                                                                                       const std::string& username) {
+        if (!ok) {
+            MessagePage empty;
+            done(false, empty);
+            return;
+        }
+        storage->readRoomMessagesAsync(room_id, before_seq, after_seq, limit,
+                                       [this, room_id, username, done](bool ok, MessagePage& page) {
+            if (ok) {
+                presence.touch(room_id, username);
+            }
+            done(ok, page);
+        });
+    });
+}
+
+// 合并读取历史消息：令牌和在线状态按请求各自处理，存储读取和序列化按(房间, 游标, 条数)合并
+void ChatHandler::getRoomMessagesSharedAsync(const std::string& token, int room_id, int before_seq, int after_seq,
+                                             int limit, std::function<std::string(MessagePage& page)> render,
+                                             std::function<void(bool ok, const RequestCoalescer::Result& content)> done) {
+    storage->findTokenAsync(token, [this, room_id, before_seq, after_seq, limit, render, done](bool ok,
+                                                                                               const std::string& username) {
+        if (!ok) {
+            done(false, nullptr);
+            return;
+        }
+
+        std::string key = std::to_string(before_seq) + ":" + std::to_string(after_seq) + ":" + std::to_string(limit);
+        RequestCoalescer::Fetch fetch = [this, room_id, before_seq, after_seq, limit,
+                                         render](RequestCoalescer::FetchDone finish) {
+            storage->readRoomMessagesAsync(room_id, before_seq, after_seq, limit, [render, finish](bool ok,
+                                                                                                  MessagePage& page) {
+                if (!ok) {
+                    finish(false, nullptr);
+                    return;
+                }
+                finish(true, std::make_shared<const std::string>(render(page)));
+            });
+        };
+        history_reads.run(room_id, key, fetch, [this, room_id, username, done](bool ok,
+                                                                             const RequestCoalescer::Result& content) {
+            if (ok) {
+                presence.touch(room_id, username);
+            }
+            done(ok, content);
+        });
+    });
+}
+
+// 多房间同步：令牌查询一次，各房间的读取同时发出，全部完成后一起返回
+void ChatHandler::syncRoomsAsync(const std::string& token, const std::vector<std::pair<int, int>>& cursors, int limit,
+                                 std::function<void(bool ok, const std::string& username,
+                                                    std::vector<RoomSyncResult>& results)> done) {
+    storage->findTokenAsync(token, [this, cursors, limit, done](bool ok, const std::string& username) {
+        std::vector<RoomSyncResult> results;
+        if (!ok || cursors.empty()) {
+            done(ok, username, results);
+            return;
+        }
+
+        struct SyncState {
+            std::string username;
+            std::vector<RoomSyncResult> results;
+            size_t remaining;
+        };
+        std::shared_ptr<SyncState> state = std::make_shared<SyncState>();
+        state->username = username;
+        state->results.resize(cursors.size());
+        state->remaining = cursors.size();
+
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            int room_id = cursors[i].first;
+            state->results[i].room_id = room_id;
+            storage->readRoomMessagesAsync(room_id, 0, cursors[i].second, limit,
+                                           [this, state, i, room_id, done](bool ok, MessagePage& page) {
+                if (ok) {
+                    state->results[i].ok = true;
+                    state->results[i].page = std::move(page);
+                    presence.touch(room_id, state->username);
+                }
+                if (--state->remaining == 0) {
+                    done(true, state->username, state->results);
+                }
+            });
+        }
+    });
+}
+
+std::string ChatHandler::roomListVersion() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(room_list_mutex);
+        if (room_list_valid && now - room_list_loaded < std::chrono::seconds(kRoomListTtlSeconds)) {
+            return room_list_version;
+        }
+        generation = room_list_generation;
     }
-    
-    freeReplyObject(reply);
-    
-    // 更新计数
-    reply = (redisReply*)redisCommand(redis_context, "SET %s %d", room_count_key.c_str(), count);
-    
-    if (reply) {
-        freeReplyObject(reply);
+
+    // 在锁外读取房间列表，并发的请求可能各读一次，结果相同
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const std::string& field) {
+        for (unsigned char c : field) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ull;
+    };
+    for (const auto& room : storage->listRooms()) {
+        mix(std::to_string(room.id));
+        mix(room.name);
+        mix(room.description);
+        mix(room.creator());
+    }
+    char version[17];
+    snprintf(version, sizeof(version), "%016llx", (unsigned long long)hash);
+
+    // 读取期间房间列表又失效时不缓存这次的结果
+    std::lock_guard<std::mutex> lock(room_list_mutex);
+    if (generation == room_list_generation) {
+        room_list_version = version;
+        room_list_loaded = now;
+        room_list_valid = true;
+    }
+    return version;
+}
+
+void ChatHandler::invalidateRoomList() {
+    std::lock_guard<std::mutex> lock(room_list_mutex);
+    room_list_valid = false;
+    room_list_generation++;
+}
+
+// 长轮询等待房间新消息：先登记等待再读取存储，两者之间写入的消息也会唤醒等待者
+void ChatHandler::waitRoomMessagesAsync(const std::string& token, int room_id, int after_seq, int limit,
+                                        int timeout_ms, std::function<void(bool ok, MessagePage& page)> done) {
+    storage->findTokenAsync(token, [this, room_id, after_seq, limit, timeout_ms, done](bool ok,
+                                                                                       const std::string& username) {
+        if (!ok) {
+            MessagePage empty;
+            done(false, empty);
+            return;
+        }
+        presence.touch(room_id, username);
+
+        RoomFanout::WaitHandle waiter = fanout.wait(room_id, after_seq, timeout_ms,
+                                                    [after_seq, done](const std::vector<ChatMessage>& messages) {
+            MessagePage page;
+            page.messages = messages;
+            if (messages.empty()) {
+                page.next_cursor = after_seq;
+            } else {
+                page.prev_cursor = messages.front().seq > 1 ? messages.front().seq : 0;
+                page.next_cursor = messages.back().seq;
+            }
+            done(true, page);
+        });
+
+        // 已经有新消息或房间不存在时取消等待直接返回
+        storage->readRoomMessagesAsync(room_id, 0, after_seq, limit, [this, waiter, done](bool ok,
+                                                                                        MessagePage& page) {
+            if ((!ok || !page.messages.empty()) && fanout.cancel(waiter)) {
+                done(ok, page);
+            }
+        });
+    });
+}
+
+// 房间心跳：只更新内存中的在线状态，不访问存储（令牌查询除外）
+void ChatHandler::heartbeatAsync(const std::string& token, int room_id, bool leaving, std::function<void(bool ok)> done) {
+    storage->findTokenAsync(token, [this, room_id, leaving, done](bool ok, const std::string& username) {
+        if (ok) {
+            if (leaving) {
+                presence.leave(room_id, username);
+            } else {
+                presence.touch(room_id, username);
+            }
+        }
+        done(ok);
+    });
+}
+
+// 查询房间在线情况
+void ChatHandler::getRoomPresenceAsync(const std::string& token, const std::vector<int>& room_ids, size_t max_users,
+                                       std::function<void(bool ok, const std::vector<RoomPresence>& rooms)> done) {
+    storage->findTokenAsync(token, [this, room_ids, max_users, done](bool ok, const std::string&) {
+        std::vector<RoomPresence> rooms;
+        if (ok) {
+            rooms.reserve(room_ids.size());
+            for (int room_id : room_ids) {
+                rooms.push_back(presence.query(room_id, max_users));
+            }
+        }
+        done(ok, rooms);
+    });
+}
+
+// 标记房间已读：只修改内存中的已读位置，由后台线程批量写回存储
+void ChatHandler::markRoomReadAsync(const std::string& token, int room_id, int seq,
+                                    std::function<void(bool ok, int last_read)> done) {
+    storage->findTokenAsync(token, [this, room_id, seq, done](bool ok, const std::string& username) {
+        if (!ok) {
+            done(false, 0);
+            return;
+        }
+
+        // 已读位置不超过房间最新序号；房间为空或不存在时没有可标记的消息。最新序号经异步接口读取，不阻塞反应器
+        storage->getRoomHeadsAsync(std::vector<int>(1, room_id),
+                                   [this, username, room_id, seq, done](bool ok, const std::vector<int>& heads) {
+            if (!ok) {
+                done(false, 0);
+                return;
+            }
+            if (heads[0] <= 0) {
+                done(true, 0);
+                return;
+            }
+            int target = seq <= 0 ? heads[0] : std::min(seq, heads[0]);
+            done(true, read_cursors.markRead(username, room_id, target));
+        });
+    });
+}
+
+bool ChatHandler::enableAttachments(const AttachmentConfig& config) {
+    return attachments.open(config);
+}
+
+bool ChatHandler::enableContentFilter(const ContentFilterConfig& config) {
+    return content_filter.start(config);
+}
+
+std::unique_ptr<AttachmentUpload> ChatHandler::beginAttachmentUpload(const std::string& content_type) {
+    return attachments.beginUpload(content_type);
+}
+
+void ChatHandler::commitAttachmentAsync(std::shared_ptr<AttachmentUpload> upload, AttachmentStore::CommitCallback done) {
+    attachments.commitAsync(upload, done);
+}
+
+int ChatHandler::openAttachment(const std::string& token, const std::string& id, AttachmentInfo& info) {
+    std::string username;
+    if (!validateToken(token, username)) {
+        return -1;
     }
-    
-    return true;
+    return attachments.openForRead(id, info);
 }
 
-// 获取房间消息
-std::vector<ChatMessage> ChatHandler::getRoomMessages(const std::string& token, int room_id, int limit) {
-    std::vector<ChatMessage> messages;
-    
+// 搜索房间消息
+bool ChatHandler::searchRoomMessages(const std::string& token, const std::string& query, int room_id, int limit,
+                                     std::vector<SearchResult>& results) {
     std::string username;
     if (!validateToken(token, username)) {
-        return messages;
+        return false;
     }
-    
-    // 获取当前房间消息计数
-    std::string room_count_key = "room:" + std::to_string(room_id) + ":message_count";
-    redisReply* count_reply = (redisReply*)redisCommand(redis_context, "GET %s", room_count_key.c_str());
-    int count = 0;
-    if (count_reply != nullptr && count_reply->type == REDIS_REPLY_STRING) {
-        count = std::stoi(count_reply->str);
-        freeReplyObject(count_reply);
+
+    std::vector<SearchHit> hits = search_index.search(query, room_id, limit > 0 ? limit : 20);
+
+    // 按房间合并命中的序号，每个房间一次批量读取消息内容
+    std::map<int, std::vector<int>> room_seqs;
+    for (const auto& hit : hits) {
+        room_seqs[hit.room_id].push_back(hit.seq);
+    }
+    std::map<std::pair<int, int>, ChatMessage> loaded;
+    for (auto& room_pair : room_seqs) {
+        std::vector<int>& seqs = room_pair.second;
+        std::sort(seqs.begin(), seqs.end());
+        std::vector<ChatMessage> messages;
+        if (!storage->readRoomMessagesBySeq(room_pair.first, seqs, messages)) {
+            continue;
+        }
+        for (auto& message : messages) {
+            int seq = message.seq;
+            loaded[std::make_pair(room_pair.first, seq)] = std::move(message);
+        }
     }
-    
-    // 计算起始索引
-    int start = (count > limit) ? (count - limit + 1) : 1;
-    
-    // 获取消息
-    for (int i = start; i <= count; ++i) {
-        std::string room_message_key = "room:" + std::to_string(room_id) + ":message:" + std::to_string(i);
-        redisReply* reply = (redisReply*)redisCommand(redis_context, "GET %s", room_message_key.c_str());
-        
-        if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
-            std::string message_data = reply->str;
-            freeReplyObject(reply);
-            
-            // 解析消息数据
-            size_t first_colon = message_data.find(':');
-            if (first_colon == std::string::npos) {
-                continue;
-            }
-            
-            size_t second_colon = message_data.find(':', first_colon + 1);
-            if (second_colon == std::string::npos) {
-                continue;
+
+    // 结果保持索引给出的顺序（从新到旧），已被删除或读取失败的消息跳过
+    for (const auto& hit : hits) {
+        auto it = loaded.find(std::make_pair(hit.room_id, hit.seq));
+        if (it == loaded.end()) {
+            continue;
+        }
+        SearchResult result;
+        result.room_id = hit.room_id;
+        result.message = std::move(it->second);
+        results.push_back(std::move(result));
+    }
+
+    return true;
+}
+
+// 并行重建全文索引
+bool ChatHandler::rebuildSearchIndex(int thread_count) {
+    std::vector<ChatRoom> rooms = getRooms();
+    if (rooms.empty()) {
+        return true;
+    }
+
+    thread_count = std::max(1, std::min(thread_count, (int)rooms.size()));
+    std::atomic<size_t> next_room(0);
+    std::atomic<int> indexed_rooms(0);
+    auto start_time = std::chrono::steady_clock::now();
+
+    // 各线程从共享的房间列表中领取任务，存储后端保证并发扫描是安全的
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_room.fetch_add(1)) < rooms.size()) {
+            int room_id = rooms[i].id;
+            bool ok = storage->scanRoomMessages(room_id, [&](const ChatMessage& message) {
+                search_index.addMessage(room_id, message.seq, message.content,
+                                        parseMessageTimestamp(message.timestamp));
+            });
+            if (ok) {
+                indexed_rooms++;
             }
-            
-            std::string msg_username = message_data.substr(0, first_colon);
-            std::string msg_content = message_data.substr(first_colon + 1, second_colon - first_colon - 1);
-            std::string msg_timestamp = message_data.substr(second_colon + 1);
-            
-            ChatMessage message;
-            message.username = msg_username;
-            message.content = msg_content;
-            message.timestamp = msg_timestamp;
-            
-            messages.push_back(message);
-        } else if (reply) {
-            freeReplyObject(reply);
         }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
     }
-    
-    return messages;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "全文索引重建完成: " << indexed_rooms << "/" << rooms.size() << " 个房间，"
+              << thread_count << " 个线程，耗时 " << elapsed.count() << " ms" << std::endl;
+    return indexed_rooms == (int)rooms.size();
 }
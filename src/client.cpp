@@ -1,8 +1,14 @@
 #include "../include/client.h"
 #include "../include/chat_handler.h"
+#include "../include/template_engine.h"
+#include "../include/trace.h"
+#include "../include/utf8_json.h"
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -12,10 +18,10 @@ extern ChatHandler g_chat_handler;
 
 // 引用main.cpp中定义的函数
 extern std::string removeQueryParams(const std::string& path);
-extern std::string getResourcePath(const std::string& relativePath);
 
 // 从请求Body解析JSON
 json parseJsonBody(const std::string& body) {
+    TraceScope scope("parse json");
     try {
         if (body.empty()) {
             std::cout << "警告：请求体为空" << std::endl;
@@ -56,6 +62,223 @@ std::string extractToken(const std::unordered_map<std::string, std::string>& hea
     return "";
 }
 
+// 页面请求由浏览器直接发起，不带Authorization头，令牌取自登录时写入的Cookie
+static std::string extractCookieToken(const std::unordered_map<std::string, std::string>& headers) {
+    auto it = headers.find("Cookie");
+    if (it == headers.end()) {
+        return "";
+    }
+    const std::string& cookies = it->second;
+    size_t pos = 0;
+    while (pos < cookies.length()) {
+        size_t end = cookies.find(';', pos);
+        if (end == std::string::npos) {
+            end = cookies.length();
+        }
+        size_t start = cookies.find_first_not_of(' ', pos);
+        if (start < end && cookies.compare(start, 6, "token=") == 0) {
+            return cookies.substr(start + 6, end - start - 6);
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+// 取URL查询参数，不存在时返回空字符串
+static std::string queryParam(const std::string& path, const std::string& name) {
+    size_t query = path.find('?');
+    while (query != std::string::npos) {
+        size_t start = query + 1;
+        if (path.compare(start, name.length() + 1, name + "=") == 0) {
+            size_t end = path.find('&', start);
+            size_t value_start = start + name.length() + 1;
+            return path.substr(value_start, end == std::string::npos ? std::string::npos : end - value_start);
+        }
+        query = path.find('&', start);
+    }
+    return "";
+}
+
+// 取URL查询参数中的整数，不存在时返回0
+static int queryParamInt(const std::string& path, const std::string& name) {
+    return std::atoi(queryParam(path, name).c_str());
+}
+
+// 房间列表，/api/rooms和页面首屏数据共用
+static json buildRoomsJson(const std::string& username) {
+    TraceScope scope("build rooms json");
+    std::vector<ChatRoom> rooms = g_chat_handler.getRooms();
+    
+    // 未读消息数，查询失败时不返回该字段
+    std::vector<int> room_ids;
+    room_ids.reserve(rooms.size());
+    for (const auto& room : rooms) {
+        room_ids.push_back(room.id);
+    }
+    std::unordered_map<int, int> unread;
+    bool has_unread = g_chat_handler.getUnreadCounts(username, room_ids, unread);
+    
+    // 创建者按用户编号比较，不逐个比较用户名
+    uint32_t user_id = UserTable::kNoUser;
+    UserTable::find(username, user_id);
+    
+    json roomsArray = json::array();
+    for (const auto& room : rooms) {
+        json roomObj;
+        roomObj["id"] = room.id;
+        roomObj["name"] = room.name;
+        roomObj["description"] = room.description;
+        roomObj["creator"] = room.creator();
+        roomObj["created_at"] = room.created_at;
+        // 标记当前用户是否是该房间的创建者
+        roomObj["is_creator"] = (user_id != UserTable::kNoUser && user_id == room.creator_id);
+        if (has_unread) {
+            roomObj["unread"] = unread[room.id];
+        }
+        
+        roomsArray.push_back(roomObj);
+    }
+    return roomsArray;
+}
+
+// 发送结果对应的提示
+static const char* sendResultMessage(SendResult result) {
+    switch (result) {
+        case SEND_OK: return "发送成功";
+        case SEND_INVALID_TOKEN: return "发送失败，请重新登录";
+        case SEND_INVALID_TEXT: return "消息内容不是合法的UTF-8文本";
+        case SEND_FILTERED: return "内容包含敏感词";
+        default: return "发送失败，请稍后重试";
+    }
+}
+
+// 单条房间消息，附件只返回ID，内容通过/api/attachments?id=下载
+static json messageToJson(const ChatMessage& msg) {
+    json messageObj;
+    messageObj["seq"] = msg.seq;
+    messageObj["username"] = msg.username();
+    messageObj["content"] = msg.content;
+    messageObj["timestamp"] = msg.timestamp;
+    if (!msg.attachments.empty()) {
+        messageObj["attachments"] = msg.attachments;
+    }
+    return messageObj;
+}
+
+// 一页房间消息，/api/rooms/messages和页面首屏数据共用
+static void fillMessagePageJson(json& response, const MessagePage& page) {
+    TraceScope scope("build messages json");
+    json messageArray = json::array();
+    for (const auto& msg : page.messages) {
+        messageArray.push_back(messageToJson(msg));
+    }
+    
+    response["messages"] = messageArray;
+    response["prev_cursor"] = page.prev_cursor;
+    response["next_cursor"] = page.next_cursor;
+    response["has_more"] = page.has_more;
+}
+
+// 消息页直接写成JSON文本，不经过json对象：内容的转义整段复制不需要转义的字节。
+// 字段按键名排序，与messageToJson和fillMessagePageJson经dump()输出的内容逐字节相同
+static void appendMessageJson(std::string& out, const ChatMessage& msg) {
+    out += '{';
+    if (!msg.attachments.empty()) {
+        out += "\"attachments\":[";
+        for (size_t i = 0; i < msg.attachments.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            appendJsonString(out, msg.attachments[i]);
+        }
+        out += "],";
+    }
+    out += "\"content\":";
+    appendJsonString(out, msg.content);
+    out += ",\"seq\":";
+    out += std::to_string(msg.seq);
+    out += ",\"timestamp\":";
+    appendJsonString(out, msg.timestamp);
+    out += ",\"username\":";
+    appendJsonString(out, msg.username());
+    out += '}';
+}
+
+// {"has_more":..,"messages":[..],"next_cursor":..,["prev_cursor":..,]"success":true}
+static std::string renderMessagePageJson(const MessagePage& page, bool with_prev_cursor) {
+    TraceScope scope("build messages json");
+    size_t estimate = 96;
+    for (const auto& msg : page.messages) {
+        estimate += msg.content.length() + 96;
+    }
+    std::string out;
+    out.reserve(estimate);
+    out += "{\"has_more\":";
+    out += page.has_more ? "true" : "false";
+    out += ",\"messages\":[";
+    for (size_t i = 0; i < page.messages.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        appendMessageJson(out, page.messages[i]);
+    }
+    out += "],\"next_cursor\":";
+    out += std::to_string(page.next_cursor);
+    if (with_prev_cursor) {
+        out += ",\"prev_cursor\":";
+        out += std::to_string(page.prev_cursor);
+    }
+    out += ",\"success\":true}";
+    return out;
+}
+
+// 渲染页面：已登录时把房间列表和?room_id=指定房间的最近消息内联到页面中，
+// 页面脚本直接使用这些数据，不必在加载后再依次请求/api/rooms和/api/rooms/messages
+static std::string renderPage(const std::string& asset_path, const std::unordered_map<std::string, std::string>& headers) {
+    std::shared_ptr<const PageTemplate> page = PageTemplate::load(asset_path);
+    if (!page) {
+        return "<html><body><h1>Error: Page not found</h1></body></html>";
+    }
+    
+    PageTemplate::Values values;
+    values["username"] = "游客";
+    values["bootstrap"] = "null";
+    
+    std::string token = extractCookieToken(headers);
+    std::string username;
+    if (!token.empty() && g_chat_handler.validateToken(token, username)) {
+        json bootstrap;
+        bootstrap["username"] = username;
+        bootstrap["rooms"] = buildRoomsJson(username);
+        bootstrap["rooms_version"] = g_chat_handler.roomListVersion();
+        bootstrap["room"] = nullptr;
+        
+        auto path_it = headers.find("path");
+        int room_id = path_it == headers.end() ? 0 : queryParamInt(path_it->second, "room_id");
+        MessagePage messages;
+        if (room_id > 0 && g_chat_handler.getRoomMessagesPage(token, room_id, 0, 0, 50, messages)) {
+            json room;
+            room["id"] = room_id;
+            room["success"] = true;
+            fillMessagePageJson(room, messages);
+            bootstrap["room"] = room;
+        }
+        
+        values["username"] = username;
+        values["bootstrap"] = escapeScriptJson(bootstrap.dump());
+    }
+    TraceScope scope("render page");
+    return page->render(values);
+}
+
+std::string ApiClient::handleChatPage(const std::unordered_map<std::string, std::string>& headers, const std::string&) {
+    return renderPage("templates/chat.html", headers);
+}
+
+std::string ApiClient::handleRoomPage(const std::unordered_map<std::string, std::string>& headers, const std::string&) {
+    return renderPage("templates/room.html", headers);
+}
+
 std::string ApiClient::handleLogin(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
     json response;
     json data = parseJsonBody(body);
@@ -154,15 +377,9 @@ std::string ApiClient::handleSendMessage(const std::unordered_map<std::string, s
     }
     
     std::string message = data["message"];
-    bool success = g_chat_handler.sendMessage(token, message);
-    
-    if (success) {
-        response["success"] = true;
-        response["message"] = "发送成功";
-    } else {
-        response["success"] = false;
-        response["message"] = "发送失败，请重新登录";
-    }
+    SendResult result = g_chat_handler.sendMessage(token, message);
+    response["success"] = result == SEND_OK;
+    response["message"] = sendResultMessage(result);
     
     return response.dump();
 }
@@ -184,7 +401,7 @@ std::string ApiClient::handleGetMessages(const std::unordered_map<std::string, s
     json messageArray = json::array();
     for (const auto& msg : messages) {
         json messageObj;
-        messageObj["username"] = msg.username;
+        messageObj["username"] = msg.username();
         messageObj["content"] = msg.content;
         messageObj["timestamp"] = msg.timestamp;
         messageArray.push_back(messageObj);
@@ -196,20 +413,6 @@ std::string ApiClient::handleGetMessages(const std::unordered_map<std::string, s
     return response.dump();
 }
 
-std::string ApiClient::handleChatPage(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-    // 读取聊天页面HTML文件
-    std::string filePath = getResourcePath("/templates/chat.html");
-    std::ifstream file(filePath);
-    if (!file) {
-        std::cerr << "Error: Could not open chat.html at " << filePath << std::endl;
-        return "<html><body><h1>Error: Chat page not found</h1></body></html>";
-    }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
 // 处理创建房间请求
 std::string ApiClient::handleCreateRoom(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
     json response;
@@ -308,37 +511,24 @@ std::string ApiClient::handleGetRooms(const std::unordered_map<std::string, std:
         return response.dump();
     }
     
-    std::vector<ChatRoom> rooms = g_chat_handler.getRooms();
-    
-    json roomsArray = json::array();
-    for (const auto& room : rooms) {
-        json roomObj;
-        roomObj["id"] = room.id;
-        roomObj["name"] = room.name;
-        roomObj["description"] = room.description;
-        roomObj["creator"] = room.creator;
-        roomObj["created_at"] = room.created_at;
-        // 标记当前用户是否是该房间的创建者
-        roomObj["is_creator"] = (username == room.creator);
-        
-        roomsArray.push_back(roomObj);
-    }
-    
     response["success"] = true;
-    response["rooms"] = roomsArray;
+    response["rooms"] = buildRoomsJson(username);
+    response["rooms_version"] = g_chat_handler.roomListVersion();
     
     return response.dump();
 }
 
 // 处理发送房间消息请求
-std::string ApiClient::handleSendRoomMessage(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
+void ApiClient::handleSendRoomMessage(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond) {
     json response;
     
     std::string token = extractToken(headers);
     if (token.empty()) {
         response["success"] = false;
         response["message"] = "无效的令牌";
-        return response.dump();
+        respond(response.dump());
+        return;
     }
     
     json data = parseJsonBody(body);
@@ -346,34 +536,119 @@ std::string ApiClient::handleSendRoomMessage(const std::unordered_map<std::strin
     if (!data.contains("room_id") || !data.contains("message")) {
         response["success"] = false;
         response["message"] = "消息信息不完整";
-        return response.dump();
+        respond(response.dump());
+        return;
     }
     
     int room_id = data["room_id"];
     std::string message = data["message"];
     
-    bool success = g_chat_handler.sendRoomMessage(token, room_id, message);
+    // 可选的附件列表，须是已经上传的附件ID
+    const size_t max_attachments = 10;
+    std::vector<std::string> attachments;
+    if (data.contains("attachments")) {
+        if (!data["attachments"].is_array() || data["attachments"].size() > max_attachments) {
+            response["success"] = false;
+            response["message"] = "每条消息最多" + std::to_string(max_attachments) + "个附件";
+            respond(response.dump());
+            return;
+        }
+        for (const auto& item : data["attachments"]) {
+            if (!item.is_string() || !g_chat_handler.hasAttachment(item.get<std::string>())) {
+                response["success"] = false;
+                response["message"] = "附件不存在";
+                respond(response.dump());
+                return;
+            }
+            attachments.push_back(item.get<std::string>());
+        }
+    }
     
-    if (success) {
-        response["success"] = true;
-        response["message"] = "发送成功";
-    } else {
+    g_chat_handler.sendRoomMessageAsync(token, room_id, message, attachments, [respond](SendResult result) {
+        json response;
+        response["success"] = result == SEND_OK;
+        response["message"] = sendResultMessage(result);
+        respond(response.dump());
+    });
+}
+
+// 处理批量发送房间消息请求
+// messages中每一项为{"room_id":..,"message":..}，或者只是消息内容、使用顶层的room_id
+void ApiClient::handleSendRoomMessageBatch(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                           std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
         response["success"] = false;
-        response["message"] = "发送失败，请重新登录";
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
     }
     
-    return response.dump();
+    json data = parseJsonBody(body);
+    
+    if (!data.contains("messages") || !data["messages"].is_array() || data["messages"].empty()) {
+        response["success"] = false;
+        response["message"] = "消息信息不完整";
+        respond(response.dump());
+        return;
+    }
+    
+    const size_t max_batch = 100;
+    if (data["messages"].size() > max_batch) {
+        response["success"] = false;
+        response["message"] = "单次最多发送" + std::to_string(max_batch) + "条消息";
+        respond(response.dump());
+        return;
+    }
+    
+    int default_room = data.value("room_id", 0);
+    std::vector<std::pair<int, std::string>> messages;
+    for (const auto& item : data["messages"]) {
+        if (item.is_string()) {
+            messages.emplace_back(default_room, item.get<std::string>());
+        } else if (item.is_object() && item.contains("message")) {
+            messages.emplace_back(item.value("room_id", default_room), item["message"].get<std::string>());
+        } else {
+            response["success"] = false;
+            response["message"] = "消息信息不完整";
+            respond(response.dump());
+            return;
+        }
+    }
+    
+    g_chat_handler.sendRoomMessagesAsync(token, messages, [respond](bool success, const std::vector<int>& seqs) {
+        json response;
+        if (success) {
+            json results = json::array();
+            for (int seq : seqs) {
+                json result;
+                result["success"] = seq > 0;
+                result["seq"] = seq;
+                results.push_back(result);
+            }
+            response["success"] = true;
+            response["results"] = results;
+        } else {
+            response["success"] = false;
+            response["message"] = "发送失败，请重新登录";
+        }
+        respond(response.dump());
+    });
 }
 
 // 处理获取房间消息历史请求
-std::string ApiClient::handleGetRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
+void ApiClient::handleGetRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond) {
     json response;
     
     std::string token = extractToken(headers);
     if (token.empty()) {
         response["success"] = false;
         response["message"] = "无效的令牌";
-        return response.dump();
+        respond(response.dump());
+        return;
     }
     
     json data = parseJsonBody(body);
@@ -381,51 +656,553 @@ std::string ApiClient::handleGetRoomMessages(const std::unordered_map<std::strin
     if (!data.contains("room_id")) {
         response["success"] = false;
         response["message"] = "未指定房间ID";
-        return response.dump();
+        respond(response.dump());
+        return;
     }
     
     int room_id = data["room_id"];
     int limit = 50;  // 默认获取50条消息
     
-    if (data.contains("limit")) {
-        limit = data["limit"];
+    // 一次读取的条数有上限，不能一次读出整个房间
+    if (data.contains("limit") && data["limit"].is_number_integer()) {
+        limit = std::max(1, std::min(kMaxPageLimit, data["limit"].get<int>()));
     }
     
-    std::string username;
-    if (!g_chat_handler.validateToken(token, username)) {
+    // 分页游标：before_seq向前翻页，after_seq增量拉取
+    int before_seq = 0;
+    int after_seq = 0;
+    if (data.contains("before_seq") && data["before_seq"].is_number_integer()) {
+        before_seq = data["before_seq"];
+    }
+    if (data.contains("after_seq") && data["after_seq"].is_number_integer()) {
+        after_seq = data["after_seq"];
+    }
+    
+    // 热门房间的大量观众几乎同时拉取同一页，存储读取和JSON序列化只做一次，响应内容共享
+    auto render = [](MessagePage& page) {
+        return renderMessagePageJson(page, true);
+    };
+    g_chat_handler.getRoomMessagesSharedAsync(token, room_id, before_seq, after_seq, limit, render,
+                                              [respond](bool success, const RequestCoalescer::Result& content) {
+        if (!success) {
+            json response;
+            response["success"] = false;
+            response["message"] = "令牌验证失败";
+            respond(response.dump());
+            return;
+        }
+        respond(*content);
+    });
+}
+
+// 处理长轮询新消息请求：没有新消息时挂起，直到有人发送消息或超时
+void ApiClient::handlePollRoomMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                       std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
         response["success"] = false;
-        response["message"] = "令牌验证失败";
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
+    }
+    
+    json data = parseJsonBody(body);
+    
+    if (!data.contains("room_id") || !data["room_id"].is_number_integer()) {
+        response["success"] = false;
+        response["message"] = "未指定房间ID";
+        respond(response.dump());
+        return;
+    }
+    
+    int room_id = data["room_id"];
+    int after_seq = 0;
+    int limit = 50;
+    int timeout_ms = 25000;  // 默认等待25秒，低于常见代理的空闲超时
+    if (data.contains("after_seq") && data["after_seq"].is_number_integer()) {
+        after_seq = data["after_seq"];
+    }
+    if (data.contains("limit") && data["limit"].is_number_integer()) {
+        limit = std::max(1, std::min(kMaxPageLimit, data["limit"].get<int>()));
+    }
+    if (data.contains("timeout_ms") && data["timeout_ms"].is_number_integer()) {
+        timeout_ms = std::max(1000, std::min(60000, data["timeout_ms"].get<int>()));
+    }
+    
+    g_chat_handler.waitRoomMessagesAsync(token, room_id, after_seq, limit, timeout_ms,
+                                         [respond](bool success, MessagePage& page) {
+        json response;
+        if (!success) {
+            response["success"] = false;
+            response["message"] = "获取消息失败";
+            respond(response.dump());
+            return;
+        }
+        
+        respond(renderMessagePageJson(page, false));
+    });
+}
+
+// 处理房间心跳请求
+void ApiClient::handleRoomHeartbeat(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                    std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["success"] = false;
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
+    }
+    
+    json data = parseJsonBody(body);
+    
+    if (!data.contains("room_id") || !data["room_id"].is_number_integer()) {
+        response["success"] = false;
+        response["message"] = "未指定房间ID";
+        respond(response.dump());
+        return;
+    }
+    
+    int room_id = data["room_id"];
+    bool leaving = data.value("leave", false);
+    
+    g_chat_handler.heartbeatAsync(token, room_id, leaving, [respond](bool success) {
+        json response;
+        response["success"] = success;
+        if (!success) {
+            response["message"] = "令牌验证失败";
+        }
+        respond(response.dump());
+    });
+}
+
+// 处理标记房间已读请求，未指定seq时标记到房间最新消息
+void ApiClient::handleMarkRoomRead(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                   std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["success"] = false;
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
+    }
+    
+    json data = parseJsonBody(body);
+    
+    if (!data.contains("room_id") || !data["room_id"].is_number_integer()) {
+        response["success"] = false;
+        response["message"] = "未指定房间ID";
+        respond(response.dump());
+        return;
+    }
+    
+    int room_id = data["room_id"];
+    int seq = 0;
+    if (data.contains("seq") && data["seq"].is_number_integer()) {
+        seq = data["seq"];
+    }
+    
+    g_chat_handler.markRoomReadAsync(token, room_id, seq, [respond, room_id](bool success, int last_read) {
+        json response;
+        response["success"] = success;
+        if (success) {
+            response["room_id"] = room_id;
+            response["last_read"] = last_read;
+        } else {
+            response["message"] = "标记已读失败";
+        }
+        respond(response.dump());
+    });
+}
+
+// 处理房间在线用户查询请求
+// room_id：返回该房间的在线人数和在线用户列表；room_ids：只返回各房间的在线人数
+void ApiClient::handleGetRoomPresence(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                                      std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["success"] = false;
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
+    }
+    
+    json data = parseJsonBody(body);
+    
+    std::vector<int> room_ids;
+    bool single = data.contains("room_id") && data["room_id"].is_number_integer();
+    if (single) {
+        room_ids.push_back(data["room_id"]);
+    } else if (data.contains("room_ids") && data["room_ids"].is_array()) {
+        for (const auto& id : data["room_ids"]) {
+            if (id.is_number_integer()) {
+                room_ids.push_back(id);
+            }
+        }
+    }
+    if (room_ids.empty()) {
+        response["success"] = false;
+        response["message"] = "未指定房间ID";
+        respond(response.dump());
+        return;
+    }
+    
+    size_t max_users = 0;
+    if (single) {
+        int limit = 100;
+        if (data.contains("limit") && data["limit"].is_number_integer()) {
+            limit = std::max(0, std::min(1000, data["limit"].get<int>()));
+        }
+        max_users = limit;
+    }
+    
+    g_chat_handler.getRoomPresenceAsync(token, room_ids, max_users,
+                                        [respond, single](bool success, const std::vector<RoomPresence>& rooms) {
+        json response;
+        if (!success) {
+            response["success"] = false;
+            response["message"] = "令牌验证失败";
+            respond(response.dump());
+            return;
+        }
+        
+        response["success"] = true;
+        if (single) {
+            response["room_id"] = rooms[0].room_id;
+            response["online"] = rooms[0].online;
+            response["users"] = rooms[0].users;
+        } else {
+            json roomArray = json::array();
+            for (const auto& room : rooms) {
+                json roomObj;
+                roomObj["room_id"] = room.room_id;
+                roomObj["online"] = room.online;
+                roomArray.push_back(roomObj);
+            }
+            response["rooms"] = roomArray;
+        }
+        respond(response.dump());
+    });
+}
+
+// 处理多房间同步请求：一次返回各房间的新消息，以及房间列表变化时的新列表
+void ApiClient::handleSync(const std::unordered_map<std::string, std::string>& headers, const std::string& body,
+                           std::function<void(const std::string&)> respond) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["success"] = false;
+        response["message"] = "无效的令牌";
+        respond(response.dump());
+        return;
+    }
+    
+    json data = parseJsonBody(body);
+    
+    // rooms为{"房间ID": last_seq}
+    std::vector<std::pair<int, int>> cursors;
+    if (data.contains("rooms") && data["rooms"].is_object()) {
+        for (auto it = data["rooms"].begin(); it != data["rooms"].end(); ++it) {
+            int room_id = std::atoi(it.key().c_str());
+            if (room_id <= 0 || !it.value().is_number_integer()) {
+                continue;
+            }
+            cursors.push_back(std::make_pair(room_id, std::max(0, it.value().get<int>())));
+        }
+    }
+    if (cursors.size() > kMaxSyncRooms) {
+        response["success"] = false;
+        response["message"] = "同步的房间过多";
+        respond(response.dump());
+        return;
+    }
+    
+    int limit = 50;
+    if (data.contains("limit") && data["limit"].is_number_integer()) {
+        limit = std::max(1, std::min(kMaxPageLimit, data["limit"].get<int>()));
+    }
+    std::string rooms_version;
+    if (data.contains("rooms_version") && data["rooms_version"].is_string()) {
+        rooms_version = data["rooms_version"];
+    }
+    
+    g_chat_handler.syncRoomsAsync(token, cursors, limit, [respond, rooms_version](bool success,
+                                                                                  const std::string& username,
+                                                                                  std::vector<RoomSyncResult>& results) {
+        json response;
+        if (!success) {
+            response["success"] = false;
+            response["message"] = "令牌验证失败";
+            respond(response.dump());
+            return;
+        }
+        
+        // 只返回有新消息的房间，其余房间客户端保持原有的游标
+        json rooms = json::object();
+        for (auto& result : results) {
+            if (result.ok && !result.page.messages.empty()) {
+                json room;
+                fillMessagePageJson(room, result.page);
+                rooms[std::to_string(result.room_id)] = room;
+            }
+        }
+        
+        response["success"] = true;
+        response["rooms"] = rooms;
+        
+        // 房间列表有变化（或客户端尚无版本）时附上完整的新列表，并列出请求中已不存在的房间
+        std::string version = g_chat_handler.roomListVersion();
+        response["rooms_version"] = version;
+        if (version != rooms_version) {
+            json room_list = buildRoomsJson(username);
+            std::unordered_set<int> listed;
+            for (const auto& room : room_list) {
+                listed.insert(room["id"].get<int>());
+            }
+            json removed = json::array();
+            for (const auto& result : results) {
+                if (!listed.count(result.room_id)) {
+                    removed.push_back(result.room_id);
+                }
+            }
+            response["room_list"] = room_list;
+            response["removed_rooms"] = removed;
+        }
+        respond(response.dump());
+    });
+}
+
+// 处理搜索房间消息请求
+std::string ApiClient::handleSearchMessages(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
+    json response;
+    
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["success"] = false;
+        response["message"] = "无效的令牌";
         return response.dump();
     }
     
-    std::vector<ChatMessage> messages = g_chat_handler.getRoomMessages(token, room_id, limit);
+    json data = parseJsonBody(body);
     
-    json messageArray = json::array();
-    for (const auto& msg : messages) {
-        json messageObj;
-        messageObj["username"] = msg.username;
-        messageObj["content"] = msg.content;
-        messageObj["timestamp"] = msg.timestamp;
-        messageArray.push_back(messageObj);
+    if (!data.contains("query") || !data["query"].is_string()) {
+        response["success"] = false;
+        response["message"] = "未指定搜索内容";
+        return response.dump();
+    }
+    
+    std::string query = data["query"];
+    int room_id = 0;  // 默认搜索所有房间
+    int limit = 20;   // 默认返回20条结果
+    
+    if (data.contains("room_id") && data["room_id"].is_number_integer()) {
+        room_id = data["room_id"];
+    }
+    if (data.contains("limit") && data["limit"].is_number_integer()) {
+        limit = std::max(1, std::min(100, data["limit"].get<int>()));
+    }
+    
+    std::vector<SearchResult> results;
+    if (!g_chat_handler.searchRoomMessages(token, query, room_id, limit, results)) {
+        response["success"] = false;
+        response["message"] = "令牌验证失败";
+        return response.dump();
+    }
+    
+    json resultArray = json::array();
+    for (const auto& result : results) {
+        json resultObj;
+        resultObj["room_id"] = result.room_id;
+        resultObj["seq"] = result.message.seq;
+        resultObj["username"] = result.message.username();
+        resultObj["content"] = result.message.content;
+        resultObj["timestamp"] = result.message.timestamp;
+        resultArray.push_back(resultObj);
     }
     
     response["success"] = true;
-    response["messages"] = messageArray;
+    response["results"] = resultArray;
     
     return response.dump();
 }
 
-// 处理房间页面请求
-std::string ApiClient::handleRoomPage(const std::unordered_map<std::string, std::string>& headers, const std::string& body) {
-    // 读取房间页面HTML文件
-    std::string filePath = getResourcePath("/templates/room.html");
-    std::ifstream file(filePath);
-    if (!file) {
-        std::cerr << "Error: Could not open room.html at " << filePath << std::endl;
-        return "<html><body><h1>Error: Room page not found</h1></body></html>";
+// 附件上传的接收器：数据经AttachmentUpload按固定大小的块写入临时文件，接收完毕后在后台线程上保存
+// 令牌在接收请求体的同时异步校验；校验失败时中止接收，接收完毕时校验尚未返回则等它返回后再保存
+class AttachmentUploadSink : public UploadSink {
+public:
+    explicit AttachmentUploadSink(std::unique_ptr<AttachmentUpload> upload) : state(std::make_shared<State>()) {
+        state->upload = std::move(upload);
+    }
+
+    void validate(const std::string& token) {
+        std::shared_ptr<State> current = state;
+        g_chat_handler.validateTokenAsync(token, [current](bool ok, const std::string&) {
+            HttpResponder respond;
+            {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                current->token = ok ? TOKEN_VALID : TOKEN_INVALID;
+                respond.swap(current->respond);
+            }
+            if (respond) {
+                complete(current, respond);
+            }
+        });
     }
+
+    bool write(const char* data, size_t len) override {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->token == TOKEN_INVALID) {
+                return false;
+            }
+        }
+        return state->upload->write(data, len);
+    }
+
+    std::string abortResponse() const override {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->token == TOKEN_INVALID ? invalidTokenResponse() : std::string();
+    }
+
+    void finish(HttpResponder respond) override {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->token == TOKEN_PENDING) {
+                state->respond = respond;
+                return;
+            }
+        }
+        complete(state, respond);
+    }
+
+private:
+    enum TokenState { TOKEN_PENDING, TOKEN_VALID, TOKEN_INVALID };
+
+    // 校验回调可能晚于连接关闭，状态由接收器和回调共享
+    struct State {
+        mutable std::mutex mutex;
+        TokenState token = TOKEN_PENDING;
+        HttpResponder respond;   // 接收完毕时令牌仍在校验中，等校验返回后使用
+        std::shared_ptr<AttachmentUpload> upload;
+    };
+    std::shared_ptr<State> state;
+
+    static std::string invalidTokenResponse() {
+        json response;
+        response["success"] = false;
+        response["message"] = "上传失败，请重新登录";
+        return response.dump();
+    }
+
+    static void complete(const std::shared_ptr<State>& state, HttpResponder respond) {
+        bool valid;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            valid = state->token == TOKEN_VALID;
+        }
+        if (!valid) {
+            respond(invalidTokenResponse());
+            return;
+        }
+
+        g_chat_handler.commitAttachmentAsync(state->upload, [respond](bool ok, const AttachmentInfo& info) {
+            json response;
+            if (ok) {
+                response["success"] = true;
+                response["id"] = info.id;
+                response["size"] = info.size;
+                response["content_type"] = info.content_type;
+            } else {
+                response["success"] = false;
+                response["message"] = "保存附件失败";
+            }
+            respond(response.dump());
+        });
+    }
+};
+
+// 处理附件上传请求，在请求头到达后调用，请求体由返回的接收器接收
+std::unique_ptr<UploadSink> ApiClient::handleUploadAttachment(const std::unordered_map<std::string, std::string>& headers,
+                                                              std::string& error) {
+    json response;
+    response["success"] = false;
     
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        response["message"] = "无效的令牌";
+        error = response.dump();
+        return nullptr;
+    }
+    
+    auto type_it = headers.find("Content-Type");
+    std::string content_type = type_it != headers.end() ? type_it->second : "";
+    std::unique_ptr<AttachmentUpload> upload = g_chat_handler.beginAttachmentUpload(content_type);
+    if (!upload) {
+        response["message"] = "上传失败，请稍后重试";
+        error = response.dump();
+        return nullptr;
+    }
+    AttachmentUploadSink* sink = new AttachmentUploadSink(std::move(upload));
+    sink->validate(token);
+    return std::unique_ptr<UploadSink>(sink);
+}
+
+// 处理附件下载请求
+// 附件由用户上传，只有图片、音视频和PDF允许在页面中直接显示，其他类型一律作为下载文件返回
+void ApiClient::handleDownloadAttachment(const std::unordered_map<std::string, std::string>& headers, FileResponse& file) {
+    std::string token = extractToken(headers);
+    if (token.empty()) {
+        token = extractCookieToken(headers);
+    }
+    if (token.empty()) {
+        file.status = 401;
+        file.body = "{\"success\":false,\"message\":\"无效的令牌\"}";
+        return;
+    }
+    
+    auto path_it = headers.find("path");
+    std::string id = path_it != headers.end() ? queryParam(path_it->second, "id") : "";
+    AttachmentInfo info;
+    file.fd = g_chat_handler.openAttachment(token, id, info);
+    if (file.fd < 0) {
+        file.status = 404;
+        file.body = "{\"success\":false,\"message\":\"附件不存在\"}";
+        return;
+    }
+    
+    file.size = info.size;
+    file.content_type = info.content_type;
+    // 内容由ID唯一确定，不会改变
+    file.etag = "\"" + info.id + "\"";
+    file.extra_headers = "Cache-Control: private, max-age=31536000, immutable\r\n"
+                         "X-Content-Type-Options: nosniff\r\n"
+                         "Content-Security-Policy: sandbox\r\n";
+    const std::string& type = info.content_type;
+    bool inline_type = type == "image/png" || type == "image/jpeg" || type == "image/gif" || type == "image/webp" ||
+                       type.compare(0, 6, "audio/") == 0 || type.compare(0, 6, "video/") == 0 ||
+                       type == "application/pdf";
+    if (!inline_type) {
+        file.extra_headers += "Content-Disposition: attachment; filename=\"" + info.id.substr(0, 16) + "\"\r\n";
+    }
+}
+
+std::string ApiClient::handleTraceDump(const std::unordered_map<std::string, std::string>& headers, const std::string&) {
+    // 追踪中有请求路径和各用户的请求时间，只允许从本机导出
+    auto addr_it = headers.find("remote_addr");
+    if (addr_it == headers.end() || addr_it->second.compare(0, 4, "127.") != 0) {
+        json response;
+        response["success"] = false;
+        response["message"] = "只允许从本机访问";
+        return response.dump();
+    }
+    return Trace::renderChromeTrace();
 }
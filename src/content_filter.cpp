@@ -0,0 +1,374 @@
+#include "../include/content_filter.h"
+#include "../include/utf8_json.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace {
+
+// ASCII字母转为小写，其余字节不变；UTF-8多字节字符的各字节都不小于0x80，不受影响
+struct FoldTable {
+    unsigned char map[256];
+    FoldTable() {
+        for (int c = 0; c < 256; ++c) {
+            map[c] = (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : (unsigned char)c;
+        }
+    }
+};
+const FoldTable kFold;
+
+// 构建用的普通字典树，子节点按字节有序
+struct BuildNode {
+    std::vector<std::pair<unsigned char, int32_t>> children;
+    uint32_t word_len = 0;
+};
+
+bool statFile(const std::string& path, int64_t& mtime_ns, int64_t& size) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    size = (int64_t)st.st_size;
+    return true;
+}
+
+} // namespace
+
+WordAutomaton::WordAutomaton(const std::vector<std::string>& words) {
+    std::vector<BuildNode> trie(1);
+    for (const std::string& word : words) {
+        if (word.empty()) {
+            continue;
+        }
+        int32_t node = 0;
+        for (char ch : word) {
+            unsigned char c = kFold.map[(unsigned char)ch];
+            auto& children = trie[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, (int32_t)0),
+                                       [](const std::pair<unsigned char, int32_t>& a,
+                                          const std::pair<unsigned char, int32_t>& b) { return a.first < b.first; });
+            if (it != children.end() && it->first == c) {
+                node = it->second;
+            } else {
+                int32_t child = (int32_t)trie.size();
+                children.insert(it, std::make_pair(c, child));
+                trie.emplace_back();
+                node = child;
+            }
+        }
+        if (trie[node].word_len == 0) {
+            trie[node].word_len = (uint32_t)word.length();
+            ++word_count;
+        }
+    }
+
+    // 按广度优先顺序为每个节点的子节点找一个base，使各子节点的位置base + c都是空位。
+    // 空位串成双向链表，从第一个子节点可以落在哪些空位上找起，跳过已经占用的位置。
+    std::vector<int32_t> position(trie.size(), 0);
+    std::vector<int32_t> order;
+    order.reserve(trie.size());
+    order.push_back(0);
+    std::vector<int32_t> next_free;
+    std::vector<int32_t> prev_free;
+    int32_t free_head = -1;
+    int32_t free_tail = -1;
+    auto grow = [&](size_t size) {
+        size_t old_size = units.size();
+        units.resize(size, Unit{0, -1, 0, 0});
+        next_free.resize(size, -1);
+        prev_free.resize(size, -1);
+        for (size_t p = std::max<size_t>(old_size, 1); p < size; ++p) {
+            prev_free[p] = free_tail;
+            if (free_tail >= 0) {
+                next_free[free_tail] = (int32_t)p;
+            } else {
+                free_head = (int32_t)p;
+            }
+            free_tail = (int32_t)p;
+        }
+    };
+    auto occupy = [&](int32_t p) {
+        if (prev_free[p] >= 0) {
+            next_free[prev_free[p]] = next_free[p];
+        } else {
+            free_head = next_free[p];
+        }
+        if (next_free[p] >= 0) {
+            prev_free[next_free[p]] = prev_free[p];
+        } else {
+            free_tail = prev_free[p];
+        }
+    };
+    grow(1024);
+    units[0].check = -2;   // 根节点没有父状态
+    int32_t max_base = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const BuildNode& node = trie[order[i]];
+        if (node.children.empty()) {
+            continue;
+        }
+        unsigned char first = node.children.front().first;
+        int32_t base = 0;
+        for (int32_t p = free_head;; p = next_free[p]) {
+            if (p < 0) {
+                // 没有合适的空位，在数组末尾之后放置
+                base = std::max<int32_t>(1, (int32_t)units.size() - first);
+                grow(std::max((size_t)base + 256, units.size() * 2));
+                break;
+            }
+            if (p <= first) {
+                continue;
+            }
+            base = p - first;
+            if ((size_t)base + 256 > units.size()) {
+                grow(std::max((size_t)base + 256, units.size() * 2));
+            }
+            bool fits = true;
+            for (size_t k = 1; k < node.children.size(); ++k) {
+                if (units[base + node.children[k].first].check != -1) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) {
+                break;
+            }
+        }
+
+        int32_t s = position[order[i]];
+        units[s].base = base;
+        max_base = std::max(max_base, base);
+        for (const auto& child : node.children) {
+            int32_t t = base + child.first;
+            units[t].check = s;
+            occupy(t);
+            position[child.second] = t;
+            order.push_back(child.second);
+        }
+    }
+    // 任何状态读入任何字节后的位置都不越界，没有子节点的状态base为0
+    units.resize((size_t)max_base + 256, Unit{0, -1, 0, 0});
+    units.shrink_to_fit();
+
+    // 失配链同样按广度优先计算，较浅的状态先完成
+    for (int32_t node_index : order) {
+        const BuildNode& node = trie[node_index];
+        int32_t s = position[node_index];
+        for (const auto& child : node.children) {
+            int32_t t = position[child.second];
+            int32_t fail = 0;
+            if (s != 0) {
+                fail = step(units[s].fail, child.first);
+            }
+            units[t].fail = fail;
+            units[t].out_len = std::max(trie[child.second].word_len, units[fail].out_len);
+        }
+    }
+}
+
+int32_t WordAutomaton::step(int32_t s, unsigned char c) const {
+    for (;;) {
+        int32_t t = units[s].base + c;
+        if (units[t].check == s) {
+            return t;
+        }
+        if (s == 0) {
+            return 0;
+        }
+        s = units[s].fail;
+    }
+}
+
+template <typename OnMatch>
+void WordAutomaton::scan(const std::string& text, OnMatch on_match) const {
+    int32_t s = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        s = step(s, kFold.map[(unsigned char)text[i]]);
+        uint32_t len = units[s].out_len;
+        if (len != 0 && !on_match(i + 1, len)) {
+            return;
+        }
+    }
+}
+
+bool WordAutomaton::contains(const std::string& text) const {
+    bool found = false;
+    scan(text, [&found](size_t, uint32_t) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool WordAutomaton::mask(const std::string& text, std::string& masked) const {
+    // 每个结束位置只记录最长的词，它覆盖了同一位置结束的较短的词；重叠的区间随时合并
+    std::vector<std::pair<size_t, size_t>> ranges;
+    scan(text, [&ranges](size_t end, uint32_t len) {
+        size_t begin = end - len;
+        while (!ranges.empty() && begin <= ranges.back().second) {
+            begin = std::min(begin, ranges.back().first);
+            ranges.pop_back();
+        }
+        ranges.emplace_back(begin, end);
+        return true;
+    });
+    if (ranges.empty()) {
+        return false;
+    }
+
+    // 词表和消息都是合法的UTF-8，命中的区间总是落在字符边界上，每个字符替换为一个'*'
+    std::string result;
+    result.reserve(text.length());
+    size_t copied = 0;
+    for (const auto& range : ranges) {
+        result.append(text, copied, range.first - copied);
+        for (size_t i = range.first; i < range.second; ++i) {
+            if (((unsigned char)text[i] & 0xC0) != 0x80) {
+                result.push_back('*');
+            }
+        }
+        copied = range.second;
+    }
+    result.append(text, copied, std::string::npos);
+    masked.swap(result);
+    return true;
+}
+
+ContentFilter::ContentFilter() : action(FILTER_MASK), running(false) {
+}
+
+ContentFilter::~ContentFilter() {
+    stop();
+}
+
+bool ContentFilter::start(const ContentFilterConfig& filter_config) {
+    if (running) {
+        return true;
+    }
+    config = filter_config;
+    action = config.action;
+    if (!reload()) {
+        return false;
+    }
+
+    if (config.reload_interval_seconds > 0) {
+        running = true;
+        watcher = std::thread(&ContentFilter::run, this);
+    }
+    return true;
+}
+
+void ContentFilter::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+    }
+    wait_cv.notify_all();
+    if (watcher.joinable()) {
+        watcher.join();
+    }
+}
+
+bool ContentFilter::apply(std::string& text) const {
+    std::shared_ptr<const WordAutomaton> current = std::atomic_load(&automaton);
+    if (!current) {
+        return true;
+    }
+    if (action.load(std::memory_order_relaxed) == FILTER_REJECT) {
+        return !current->contains(text);
+    }
+    std::string masked;
+    if (current->mask(text, masked)) {
+        text.swap(masked);
+    }
+    return true;
+}
+
+bool ContentFilter::readWords(const std::string& path, std::vector<std::string>& words) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    size_t skipped = 0;
+    while (std::getline(file, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+        std::string word = line.substr(begin, end - begin + 1);
+        // 非法的UTF-8词可能从字符中间开始匹配，替换时破坏消息的编码
+        if (!isValidUtf8(word)) {
+            ++skipped;
+            continue;
+        }
+        words.push_back(std::move(word));
+    }
+    if (skipped > 0) {
+        std::cerr << "敏感词表中有" << skipped << "行不是合法的UTF-8，已忽略" << std::endl;
+    }
+    return !file.bad();
+}
+
+bool ContentFilter::reload() {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+
+    int64_t mtime_ns = 0;
+    int64_t size = 0;
+    std::vector<std::string> words;
+    if (!statFile(config.words_path, mtime_ns, size) || !readWords(config.words_path, words)) {
+        std::cerr << "无法读取敏感词表: " << config.words_path << std::endl;
+        return false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::shared_ptr<const WordAutomaton> compiled = std::make_shared<WordAutomaton>(words);
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::atomic_store(&automaton, compiled);
+    loaded_mtime_ns = mtime_ns;
+    loaded_size = size;
+    std::cout << "敏感词表已加载: " << compiled->wordCount() << "个词，双数组长度" << compiled->arraySize()
+              << "，编译用时" << elapsed_ms << "毫秒" << std::endl;
+    return true;
+}
+
+void ContentFilter::setWords(const std::vector<std::string>& words, ContentFilterAction filter_action) {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    action = filter_action;
+    std::atomic_store(&automaton, std::shared_ptr<const WordAutomaton>(std::make_shared<WordAutomaton>(words)));
+}
+
+void ContentFilter::run() {
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_cv.wait_for(lock, std::chrono::seconds(config.reload_interval_seconds), [this] { return !running; });
+        }
+        if (!running) {
+            break;
+        }
+
+        // 文件修改时间或大小变化时重新编译；编译在本线程进行，期间发送消息继续使用旧自动机
+        int64_t mtime_ns = 0;
+        int64_t size = 0;
+        if (!statFile(config.words_path, mtime_ns, size)) {
+            continue;
+        }
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lock(reload_mutex);
+            changed = mtime_ns != loaded_mtime_ns || size != loaded_size;
+        }
+        if (changed) {
+            reload();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#include "../include/embedded_assets.h"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+
+static std::string g_asset_override_dir;
+
+// 资源在程序启动后不再变化，首次查找时建立路径索引
+static const std::unordered_map<std::string, const EmbeddedAsset*>& assetIndex() {
+    static const std::unordered_map<std::string, const EmbeddedAsset*> index = [] {
+        std::unordered_map<std::string, const EmbeddedAsset*> assets;
+        for (size_t i = 0; i < kEmbeddedAssetCount; ++i) {
+            assets[kEmbeddedAssets[i].path] = &kEmbeddedAssets[i];
+        }
+        return assets;
+    }();
+    return index;
+}
+
+const EmbeddedAsset* findEmbeddedAsset(const std::string& path) {
+    const auto& index = assetIndex();
+    auto it = index.find(path);
+    return it == index.end() ? nullptr : it->second;
+}
+
+void setAssetOverrideDirectory(const std::string& directory) {
+    g_asset_override_dir = directory;
+}
+
+const std::string& assetOverrideDirectory() {
+    return g_asset_override_dir;
+}
+
+bool readAssetFromDisk(const std::string& path, std::string& content) {
+    if (path.find("..") != std::string::npos) {
+        return false;
+    }
+
+    std::ifstream file(g_asset_override_dir + "/" + path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+std::string assetContentType(const std::string& path) {
+    // 与cmake/embed_assets.cmake中的对应关系保持一致
+    static const std::pair<const char*, const char*> types[] = {
+        {".html", "text/html; charset=utf-8"},
+        {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "application/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".ico", "image/x-icon"},
+    };
+
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos) {
+        std::string ext = path.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        for (const auto& type : types) {
+            if (ext == type.first) {
+                return type.second;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
@@ -0,0 +1,87 @@
+#include "../include/loop_mailbox.h"
+#include <iostream>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+LoopMailbox::LoopMailbox(EventLoop* loop) : loop(loop), closed(false) {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        std::cerr << "无法创建事件循环信箱" << std::endl;
+        closed = true;
+        return;
+    }
+    loop->watch(event_fd, EPOLLIN, [this](uint32_t) {
+        drain();
+    });
+}
+
+LoopMailbox::~LoopMailbox() {
+    if (event_fd >= 0) {
+        ::close(event_fd);
+    }
+}
+
+bool LoopMailbox::post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+        return false;
+    }
+    bool wake = tasks.empty();
+    tasks.push_back(std::move(task));
+    // 信箱里已有回调时事件循环一定还会被唤醒，不用再写一次
+    if (wake) {
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            std::cerr << "唤醒事件循环失败" << std::endl;
+        }
+    }
+    return true;
+}
+
+void LoopMailbox::drain() {
+    uint64_t value;
+    while (read(event_fd, &value, sizeof(value)) > 0) {
+    }
+    std::vector<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(tasks);
+    }
+    for (auto& task : batch) {
+        task();
+    }
+}
+
+void LoopMailbox::close() {
+    // 退出前已经投递的回调仍在本线程上执行，之后的投递被拒绝
+    drain();
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    tasks.clear();
+    if (event_fd >= 0) {
+        loop->unwatch(event_fd);
+    }
+}
+
+std::shared_ptr<LoopMailbox> LoopMailbox::forCurrentLoop() {
+    static thread_local std::shared_ptr<LoopMailbox> mailbox;
+
+    EventLoop* loop = EventLoop::current();
+    if (loop == nullptr) {
+        return nullptr;
+    }
+    if (mailbox && mailbox->loop != loop) {
+        mailbox.reset();
+    }
+    if (!mailbox) {
+        mailbox.reset(new LoopMailbox(loop));
+        loop->onClose([] {
+            mailbox->close();
+        });
+    }
+    // 事件循环正在退出（如其他组件的退出回调中）时不再接收投递，调用者改为同步处理；
+    // closed只在事件循环线程上修改，这里读取不需要加锁
+    return mailbox->closed ? nullptr : mailbox;
+}
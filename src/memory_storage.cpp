@@ -0,0 +1,178 @@
+#include "../include/memory_storage.h"
+#include <algorithm>
+#include <ctime>
+
+MemoryStorage::MemoryStorage() : next_room_id(1) {
+}
+
+std::shared_ptr<MemoryStorage::MemoryRoom> MemoryStorage::findRoom(int room_id) {
+    std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+    auto it = rooms.find(room_id);
+    return it != rooms.end() ? it->second : nullptr;
+}
+
+bool MemoryStorage::createUser(const std::string& username, const std::string& password, const std::string& email) {
+    MemoryUser user;
+    user.password = password;
+    user.email = email;
+    return users.insert(username, user);
+}
+
+bool MemoryStorage::checkUserPassword(const std::string& username, const std::string& password) {
+    MemoryUser user;
+    return users.get(username, user) && user.password == password;
+}
+
+bool MemoryStorage::listUsernames(std::vector<std::string>& usernames) {
+    usernames.clear();
+    users.forEachKey([&usernames](const std::string& username) {
+        usernames.push_back(username);
+    });
+    return true;
+}
+
+bool MemoryStorage::saveToken(const std::string& token, const std::string& username) {
+    tokens.set(token, UserTable::intern(username));
+    return true;
+}
+
+bool MemoryStorage::findToken(const std::string& token, std::string& username) {
+    uint32_t user_id;
+    if (!tokens.get(token, user_id)) {
+        return false;
+    }
+    username = UserTable::name(user_id);
+    return true;
+}
+
+bool MemoryStorage::createRoom(const std::string& name, const std::string& description, const std::string& creator,
+                               int& room_id) {
+    auto room = std::make_shared<MemoryRoom>();
+    room->info.id = next_room_id++;
+    room->info.name = name;
+    room->info.description = description;
+    room->info.creator_id = UserTable::intern(creator);
+    room->info.created_at = formatMessageTimestamp(time(nullptr));
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    rooms[room->info.id] = room;
+    room_id = room->info.id;
+    return true;
+}
+
+bool MemoryStorage::getRoom(int room_id, ChatRoom& room) {
+    std::shared_ptr<MemoryRoom> found = findRoom(room_id);
+    if (!found) {
+        return false;
+    }
+    room = found->info;
+    return true;
+}
+
+bool MemoryStorage::deleteRoom(int room_id) {
+    // 正在读写该房间的请求持有shared_ptr，消息数组在它们结束后释放
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    return rooms.erase(room_id) > 0;
+}
+
+std::vector<ChatRoom> MemoryStorage::listRooms() {
+    std::vector<ChatRoom> result;
+    {
+        std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+        result.reserve(rooms.size());
+        for (const auto& entry : rooms) {
+            result.push_back(entry.second->info);
+        }
+    }
+
+    // 按创建顺序倒序，与MySQL的ORDER BY created_at DESC一致
+    std::sort(result.begin(), result.end(), [](const ChatRoom& a, const ChatRoom& b) { return a.id > b.id; });
+    return result;
+}
+
+bool MemoryStorage::appendRoomMessage(int room_id, ChatMessage& message) {
+    std::shared_ptr<MemoryRoom> room = findRoom(room_id);
+    if (!room) {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(room->mutex);
+    message.seq = (int)room->messages.size() + 1;
+    room->messages.push_back(message);
+    return true;
+}
+
+bool MemoryStorage::readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) {
+    std::shared_ptr<MemoryRoom> room = findRoom(room_id);
+    if (!room) {
+        // 与Redis后端一致，不存在的房间视为没有消息
+        int first, last;
+        planMessagePage(0, before_seq, after_seq, limit, page, first, last);
+        return true;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(room->mutex);
+    int first, last;
+    if (!planMessagePage((int)room->messages.size(), before_seq, after_seq, limit, page, first, last)) {
+        return true;
+    }
+    page.messages.assign(room->messages.begin() + (first - 1), room->messages.begin() + last);
+    return true;
+}
+
+bool MemoryStorage::scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) {
+    std::shared_ptr<MemoryRoom> room = findRoom(room_id);
+    if (!room) {
+        return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(room->mutex);
+    for (const auto& message : room->messages) {
+        visit(message);
+    }
+    return true;
+}
+
+bool MemoryStorage::loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) {
+    std::lock_guard<std::mutex> lock(read_cursors_mutex);
+    auto it = read_cursors.find(username);
+    if (it != read_cursors.end()) {
+        cursors = it->second;
+    }
+    return true;
+}
+
+bool MemoryStorage::saveReadCursors(const std::vector<ReadCursor>& cursors) {
+    std::lock_guard<std::mutex> lock(read_cursors_mutex);
+    for (const auto& cursor : cursors) {
+        int& seq = read_cursors[cursor.username][cursor.room_id];
+        seq = std::max(seq, cursor.seq);
+    }
+    return true;
+}
+
+bool MemoryStorage::getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) {
+    heads.assign(room_ids.size(), 0);
+    for (size_t i = 0; i < room_ids.size(); ++i) {
+        std::shared_ptr<MemoryRoom> room = findRoom(room_ids[i]);
+        if (room) {
+            std::shared_lock<std::shared_mutex> lock(room->mutex);
+            heads[i] = (int)room->messages.size();
+        }
+    }
+    return true;
+}
+
+bool MemoryStorage::appendLobbyMessage(const ChatMessage& message) {
+    std::unique_lock<std::shared_mutex> lock(lobby.mutex);
+    lobby.messages.push_back(message);
+    lobby.messages.back().seq = (int)lobby.messages.size();
+    return true;
+}
+
+std::vector<ChatMessage> MemoryStorage::readLobbyMessages(int limit) {
+    std::shared_lock<std::shared_mutex> lock(lobby.mutex);
+    size_t count = std::min(lobby.messages.size(), (size_t)std::max(0, limit));
+    // 新消息在前
+    return std::vector<ChatMessage>(lobby.messages.rbegin(), lobby.messages.rbegin() + count);
+}
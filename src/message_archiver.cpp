@@ -0,0 +1,374 @@
+#include "../include/message_archiver.h"
+#include "../include/redis_mysql_storage.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
+
+// 房间消息键
+static std::string roomMessageKey(int room_id, int seq) {
+    return "room:" + std::to_string(room_id) + ":message:" + std::to_string(seq);
+}
+
+// 读取整数类型的Redis键，不存在时返回0
+static int getIntKey(redisContext* context, const std::string& key) {
+    redisReply* reply = redisCommandTimed(context, "GET %s", key.c_str());
+    int value = 0;
+    if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
+        value = std::stoi(reply->str);
+    }
+    if (reply) {
+        freeReplyObject(reply);
+    }
+    return value;
+}
+
+// 使用一次MGET读取[first, last]区间的原始消息记录，缺失的消息为空字符串
+static bool fetchRecords(redisContext* context, int room_id, int first, int last,
+                         std::vector<std::string>& records) {
+    std::vector<std::string> keys;
+    for (int i = first; i <= last; ++i) {
+        keys.push_back(roomMessageKey(room_id, i));
+    }
+
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.push_back("MGET");
+    argvlen.push_back(4);
+    for (const auto& key : keys) {
+        argv.push_back(key.c_str());
+        argvlen.push_back(key.length());
+    }
+
+    redisReply* reply = redisCommandArgvTimed(context, (int)argv.size(), argv.data(), argvlen.data());
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) {
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return false;
+    }
+
+    records.clear();
+    records.reserve(reply->elements);
+    for (size_t i = 0; i < reply->elements; ++i) {
+        redisReply* element = reply->element[i];
+        if (element != nullptr && element->type == REDIS_REPLY_STRING) {
+            records.emplace_back(element->str, element->len);
+        } else {
+            records.emplace_back();
+        }
+    }
+
+    freeReplyObject(reply);
+    return true;
+}
+
+MessageArchiver::MessageArchiver() : redis_context(nullptr), mysql_connection(nullptr), running(false) {
+}
+
+MessageArchiver::~MessageArchiver() {
+    stop();
+}
+
+bool MessageArchiver::start(const std::string& redis_host, int redis_port,
+                            const std::string& mysql_host, int mysql_port,
+                            const std::string& mysql_user, const std::string& mysql_password,
+                            const std::string& mysql_db, const ArchiveConfig& archive_config) {
+    config = archive_config;
+
+    // 连接Redis
+    redis_context = redisConnect(redis_host.c_str(), redis_port);
+    if (redis_context == nullptr || redis_context->err) {
+        if (redis_context) {
+            std::cerr << "Archiver Redis connection error: " << redis_context->errstr << std::endl;
+            redisFree(redis_context);
+            redis_context = nullptr;
+        }
+        return false;
+    }
+
+    // 连接MySQL
+    mysql_connection = mysql_init(nullptr);
+    if (mysql_connection == nullptr ||
+        mysql_real_connect(mysql_connection, mysql_host.c_str(), mysql_user.c_str(),
+                           mysql_password.c_str(), mysql_db.c_str(), mysql_port, nullptr, 0) == nullptr) {
+        if (mysql_connection) {
+            std::cerr << "Archiver MySQL connection error: " << mysql_error(mysql_connection) << std::endl;
+            mysql_close(mysql_connection);
+            mysql_connection = nullptr;
+        }
+        redisFree(redis_context);
+        redis_context = nullptr;
+        return false;
+    }
+    mysql_set_character_set(mysql_connection, "utf8mb4");
+
+    // 创建归档消息表（如果不存在），按房间ID哈希分区
+    const char* create_messages_table =
+        "CREATE TABLE IF NOT EXISTS messages ("
+        "room_id INT NOT NULL,"
+        "seq INT NOT NULL,"
+        "username VARCHAR(50) NOT NULL,"
+        "content TEXT NOT NULL,"
+        "attachments VARCHAR(1024) NOT NULL DEFAULT '',"
+        "created_at DATETIME NOT NULL,"
+        "PRIMARY KEY (room_id, seq)"
+        ") DEFAULT CHARSET=utf8mb4 "
+        "PARTITION BY HASH(room_id) PARTITIONS 16";
+
+    if (mysqlQueryTimed(mysql_connection, create_messages_table)) {
+        std::cerr << "Failed to create messages table: " << mysql_error(mysql_connection) << std::endl;
+        stop();
+        return false;
+    }
+
+    // 旧版本创建的表没有附件列，补上；列已存在时(ER_DUP_FIELDNAME)忽略
+    const char* add_attachments_column =
+        "ALTER TABLE messages ADD COLUMN attachments VARCHAR(1024) NOT NULL DEFAULT '' AFTER content";
+    if (mysqlQueryTimed(mysql_connection, add_attachments_column) && mysql_errno(mysql_connection) != 1060) {
+        std::cerr << "Failed to add attachments column: " << mysql_error(mysql_connection) << std::endl;
+        stop();
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&MessageArchiver::run, this);
+    std::cout << "消息归档线程已启动，保留窗口 " << config.retention_seconds
+              << " 秒，每房间上限 " << config.max_messages_per_room << " 条" << std::endl;
+    return true;
+}
+
+void MessageArchiver::stop() {
+    if (running) {
+        running = false;
+        wait_cv.notify_all();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    if (redis_context) {
+        redisFree(redis_context);
+        redis_context = nullptr;
+    }
+    if (mysql_connection) {
+        mysql_close(mysql_connection);
+        mysql_connection = nullptr;
+    }
+}
+
+void MessageArchiver::run() {
+    while (running) {
+        int archived = archiveAllRooms();
+        if (archived > 0) {
+            std::cout << "本轮归档消息 " << archived << " 条" << std::endl;
+        }
+
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        wait_cv.wait_for(lock, std::chrono::seconds(config.interval_seconds), [this] { return !running; });
+    }
+}
+
+int MessageArchiver::archiveAllRooms() {
+    if (mysqlQueryTimed(mysql_connection, "SELECT id FROM rooms")) {
+        std::cerr << "归档时获取房间列表失败: " << mysql_error(mysql_connection) << std::endl;
+        return 0;
+    }
+
+    MYSQL_RES* result = mysql_store_result(mysql_connection);
+    if (result == nullptr) {
+        return 0;
+    }
+
+    std::vector<int> room_ids;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        room_ids.push_back(std::stoi(row[0]));
+    }
+    mysql_free_result(result);
+
+    // 丢弃已删除房间的状态
+    std::unordered_set<int> existing(room_ids.begin(), room_ids.end());
+    for (auto it = room_states.begin(); it != room_states.end();) {
+        it = existing.count(it->first) ? std::next(it) : room_states.erase(it);
+    }
+
+    int total = 0;
+    for (int room_id : room_ids) {
+        if (!running) {
+            break;
+        }
+        total += archiveRoom(room_id);
+    }
+    return total;
+}
+
+int MessageArchiver::archiveRoom(int room_id) {
+    std::string prefix = "room:" + std::to_string(room_id);
+    int count = getIntKey(redis_context, prefix + ":message_count");
+    int archived_seq = getIntKey(redis_context, prefix + ":archived_seq");
+
+    int target = computeArchiveTarget(room_id, archived_seq, count);
+    int moved = 0;
+
+    // 按批次迁移，每批一次MGET、一条多行INSERT和一次DEL；批次停在缺失的消息之前时本轮到此为止
+    for (int first = archived_seq + 1; first <= target && running; first += config.batch_size) {
+        int last = std::min(target, first + config.batch_size - 1);
+        int archived_to = first - 1;
+        bool ok = moveBatch(room_id, first, last, archived_to);
+        moved += archived_to - first + 1;
+        if (!ok || archived_to < last) {
+            break;
+        }
+    }
+    return moved;
+}
+
+bool MessageArchiver::missingExpired(int room_id, int seq) {
+    RoomState& state = room_states[room_id];
+    time_t now = time(nullptr);
+    if (state.missing_seq != seq) {
+        state.missing_seq = seq;
+        state.missing_since = now;
+    }
+    return now - state.missing_since >= config.missing_grace_seconds;
+}
+
+int MessageArchiver::computeArchiveTarget(int room_id, int archived_seq, int count) {
+    // 超出房间上限的部分必须归档
+    int target = std::max(archived_seq, count - config.max_messages_per_room);
+
+    // 继续向后扫描，归档早于保留窗口的消息；消息按时间顺序写入，遇到第一条未过期的即可停止。
+    // 上一轮找到的第一条未过期消息到期之前，它之后的消息都不会过期，不必再读取
+    time_t now = time(nullptr);
+    RoomState& state = room_states[room_id];
+    if (now < state.unexpired_until) {
+        return target;
+    }
+
+    time_t cutoff = now - config.retention_seconds;
+    std::vector<std::string> records;
+    for (int first = target + 1; first <= count; first += config.batch_size) {
+        int last = std::min(count, first + config.batch_size - 1);
+        if (!fetchRecords(redis_context, room_id, first, last, records)) {
+            break;
+        }
+
+        for (size_t i = 0; i < records.size(); ++i) {
+            int seq = first + (int)i;
+            ChatMessage message;
+            if (records[i].empty()) {
+                // 尚未写入的消息，停止扫描；长时间缺失的视为写入失败，越过它继续
+                if (!missingExpired(room_id, seq)) {
+                    return target;
+                }
+            } else if (decodeMessageRecord(records[i], message)) {
+                time_t timestamp = parseMessageTimestamp(message.timestamp);
+                if (timestamp >= cutoff) {
+                    state.unexpired_until = timestamp + config.retention_seconds;
+                    return target;
+                }
+            }
+            target = seq;
+        }
+    }
+    return target;
+}
+
+bool MessageArchiver::moveBatch(int room_id, int first, int last, int& archived_to) {
+    archived_to = first - 1;
+    std::vector<std::string> records;
+    if (!fetchRecords(redis_context, room_id, first, last, records)) {
+        std::cerr << "归档读取房间 " << room_id << " 消息失败" << std::endl;
+        return false;
+    }
+
+    // 序号已分配但消息还没写入时不能越过它：读取归档水位以下的消息只查MySQL，之后写入的消息将无法读到
+    int end = last;
+    for (size_t i = 0; i < records.size(); ++i) {
+        int seq = first + (int)i;
+        if (!records[i].empty()) {
+            continue;
+        }
+        if (!missingExpired(room_id, seq)) {
+            end = seq - 1;
+            break;
+        }
+        std::cerr << "房间 " << room_id << " 的消息 " << seq << " 长时间缺失，归档时跳过" << std::endl;
+    }
+    if (end < first) {
+        return true;
+    }
+    records.resize(end - first + 1);
+
+    // 构建多行INSERT；使用INSERT IGNORE使重复归档（例如上次在删除前中断）保持幂等
+    std::string query = "INSERT IGNORE INTO messages (room_id, seq, username, content, attachments, created_at) VALUES ";
+    std::vector<char> escaped;
+    auto appendEscaped = [&](const std::string& value) {
+        escaped.resize(value.length() * 2 + 1);
+        unsigned long len = mysql_real_escape_string(mysql_connection, escaped.data(), value.c_str(), value.length());
+        query += '\'';
+        query.append(escaped.data(), len);
+        query += '\'';
+    };
+
+    int rows = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        ChatMessage message;
+        if (records[i].empty() || !decodeMessageRecord(records[i], message)) {
+            continue;
+        }
+
+        if (rows > 0) {
+            query += ',';
+        }
+        query += '(' + std::to_string(room_id) + ',' + std::to_string(first + (int)i) + ',';
+        appendEscaped(message.username());
+        query += ',';
+        appendEscaped(message.content);
+        query += ',';
+        appendEscaped(joinAttachmentIds(message.attachments));
+        query += ',';
+        appendEscaped(message.timestamp);
+        query += ')';
+        rows++;
+    }
+
+    if (rows > 0 && mysqlRealQueryTimed(mysql_connection, query.c_str(), query.length())) {
+        std::cerr << "归档写入MySQL失败: " << mysql_error(mysql_connection) << std::endl;
+        return false;
+    }
+
+    // 先推进归档水位，读请求随即改为从MySQL读取这部分消息，然后再从Redis删除；
+    // 读请求在读取消息键的同一条MGET中重新读取水位，已删除的键按水位从MySQL补齐，不会出现空洞
+    std::string archived_key = "room:" + std::to_string(room_id) + ":archived_seq";
+    redisReply* reply = redisCommandTimed(redis_context, "SET %s %d", archived_key.c_str(), end);
+    if (reply == nullptr) {
+        std::cerr << "更新归档水位失败" << std::endl;
+        return false;
+    }
+    freeReplyObject(reply);
+
+    std::vector<std::string> keys;
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    for (int i = first; i <= end; ++i) {
+        keys.push_back(roomMessageKey(room_id, i));
+    }
+    argv.push_back("DEL");
+    argvlen.push_back(3);
+    for (const auto& key : keys) {
+        argv.push_back(key.c_str());
+        argvlen.push_back(key.length());
+    }
+
+    reply = redisCommandArgvTimed(redis_context, (int)argv.size(), argv.data(), argvlen.data());
+    if (reply) {
+        freeReplyObject(reply);
+    }
+    archived_to = end;
+    return true;
+}
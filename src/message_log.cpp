@@ -0,0 +1,1066 @@
+#include "../include/message_log.h"
+#include "../include/loop_mailbox.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 日志记录格式: [u32 负载长度][u32 负载CRC32][负载]
+// 负载: [u32 序号][u16 用户名长度][u16 时间戳长度][用户名][时间戳][内容]
+// 序号的最高位置位时表示带附件，时间戳之后插入[u16 附件列表长度][逗号分隔的附件ID]
+static const size_t kRecordHeader = 8;
+static const size_t kPayloadHeader = 8;
+static const uint32_t kMaxPayload = 16u << 20;
+static const uint32_t kAttachmentFlag = 0x80000000u;
+
+static uint32_t crc32(const char* data, size_t len) {
+    static uint32_t table[256];
+    static bool initialized = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)initialized;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static std::string encodeLogRecord(const ChatMessage& message) {
+    uint32_t seq = (uint32_t)message.seq;
+    const std::string& username = message.username();
+    uint16_t username_len = (uint16_t)std::min<size_t>(username.size(), 0xFFFF);
+    uint16_t timestamp_len = (uint16_t)std::min<size_t>(message.timestamp.size(), 0xFFFF);
+    std::string attachments = joinAttachmentIds(message.attachments);
+    uint16_t attachments_len = (uint16_t)std::min<size_t>(attachments.size(), 0xFFFF);
+    size_t attachments_field = 0;
+    if (attachments_len > 0) {
+        seq |= kAttachmentFlag;
+        attachments_field = 2 + attachments_len;
+    }
+    uint32_t payload_len = (uint32_t)(kPayloadHeader + username_len + timestamp_len + attachments_field +
+                                      message.content.size());
+
+    std::string record(kRecordHeader + payload_len, '\0');
+    char* payload = &record[kRecordHeader];
+    memcpy(payload, &seq, 4);
+    memcpy(payload + 4, &username_len, 2);
+    memcpy(payload + 6, &timestamp_len, 2);
+    char* p = payload + kPayloadHeader;
+    memcpy(p, username.data(), username_len);
+    p += username_len;
+    memcpy(p, message.timestamp.data(), timestamp_len);
+    p += timestamp_len;
+    if (attachments_len > 0) {
+        memcpy(p, &attachments_len, 2);
+        memcpy(p + 2, attachments.data(), attachments_len);
+        p += attachments_field;
+    }
+    memcpy(p, message.content.data(), message.content.size());
+
+    uint32_t crc = crc32(payload, payload_len);
+    memcpy(&record[0], &payload_len, 4);
+    memcpy(&record[4], &crc, 4);
+    return record;
+}
+
+// 解码一条记录，校验长度和CRC；成功时返回记录总长度，数据不完整或损坏时返回0
+static size_t decodeLogRecord(const char* data, size_t available, ChatMessage& message) {
+    if (available < kRecordHeader) {
+        return 0;
+    }
+    uint32_t payload_len, crc;
+    memcpy(&payload_len, data, 4);
+    memcpy(&crc, data + 4, 4);
+    if (payload_len < kPayloadHeader || payload_len > kMaxPayload || available - kRecordHeader < payload_len) {
+        return 0;
+    }
+
+    const char* payload = data + kRecordHeader;
+    if (crc32(payload, payload_len) != crc) {
+        return 0;
+    }
+
+    uint32_t seq;
+    uint16_t username_len, timestamp_len;
+    memcpy(&seq, payload, 4);
+    memcpy(&username_len, payload + 4, 2);
+    memcpy(&timestamp_len, payload + 6, 2);
+    if (kPayloadHeader + username_len + timestamp_len > payload_len) {
+        return 0;
+    }
+
+    const char* p = payload + kPayloadHeader;
+    message.seq = (int)(seq & ~kAttachmentFlag);
+    message.user_id = UserTable::intern(std::string(p, username_len));
+    p += username_len;
+    message.timestamp.assign(p, timestamp_len);
+    p += timestamp_len;
+    message.attachments.clear();
+    if (seq & kAttachmentFlag) {
+        uint16_t attachments_len;
+        if (payload + payload_len - p < 2) {
+            return 0;
+        }
+        memcpy(&attachments_len, p, 2);
+        if (payload + payload_len - p < 2 + attachments_len) {
+            return 0;
+        }
+        message.attachments = splitAttachmentIds(std::string(p + 2, attachments_len));
+        p += 2 + attachments_len;
+    }
+    message.content.assign(p, payload + payload_len - p);
+    return kRecordHeader + payload_len;
+}
+
+static bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, std::string& data) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    data.resize(st.st_size);
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = pread(fd, &data[done], data.size() - done, done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            data.resize(done);
+            break;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// 使目录项（新建或删除的文件）落盘；目录已被删除时没有需要落盘的目录项
+static bool syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// 逐级创建目录
+static bool makeDirectories(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); ++pos) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string prefix = path.substr(0, pos);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static std::vector<std::string> listDirectory(const std::string& directory) {
+    std::vector<std::string> names;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+static std::string segmentPath(const std::string& directory, int base_seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%010d", base_seq);
+    return directory + name;
+}
+
+// 从头扫描段数据重建偏移索引，返回有效数据长度（遇到不完整或损坏的记录时停止）
+static uint64_t replaySegment(const std::string& data, int base_seq, std::vector<uint64_t>& offsets) {
+    offsets.clear();
+    uint64_t offset = 0;
+    ChatMessage message;
+    while (offset < data.size()) {
+        size_t len = decodeLogRecord(data.data() + offset, data.size() - offset, message);
+        if (len == 0 || message.seq != base_seq + (int)offsets.size()) {
+            break;
+        }
+        offsets.push_back(offset);
+        offset += len;
+    }
+    return offset;
+}
+
+// 校验封存段从.idx加载的偏移：每条记录的记录头都在映射范围内，负载长度恰好延伸到下一条的偏移
+// （最后一条到数据末尾），序号连续。只读记录头不校验CRC，读取时解码仍会校验每条记录。
+static bool checkSegmentIndex(const LogSegment& segment) {
+    if (segment.offsets.empty() || segment.map == nullptr || segment.offsets[0] != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < segment.offsets.size(); ++i) {
+        uint64_t offset = segment.offsets[i];
+        uint64_t end = i + 1 < segment.offsets.size() ? segment.offsets[i + 1] : segment.size;
+        if (end > segment.map_size || offset >= end || end - offset < kRecordHeader + kPayloadHeader) {
+            return false;
+        }
+        uint32_t payload_len, seq;
+        memcpy(&payload_len, segment.map + offset, 4);
+        memcpy(&seq, segment.map + offset + kRecordHeader, 4);
+        if (kRecordHeader + payload_len != end - offset ||
+            (int)(seq & ~kAttachmentFlag) != segment.base_seq + (int)i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+LogFile::~LogFile() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+LogSegment::~LogSegment() {
+    if (map != nullptr) {
+        munmap((void*)map, map_size);
+    }
+}
+
+void GroupCommitter::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = true;
+    worker = std::thread(&GroupCommitter::run, this);
+}
+
+void GroupCommitter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    work_cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool GroupCommitter::sync(const std::shared_ptr<LogFile>& file) {
+    return sync(std::vector<std::shared_ptr<LogFile>>(1, file));
+}
+
+// 逐个同步文件，全部成功时返回true
+static bool syncFiles(const std::vector<std::shared_ptr<LogFile>>& files) {
+    bool ok = true;
+    for (const auto& file : files) {
+        if (fdatasync(file->fd) != 0) {
+            std::cerr << "fdatasync失败: " << strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool GroupCommitter::sync(const std::vector<std::shared_ptr<LogFile>>& files) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (files.empty()) {
+        return succeeded(submitted + 1);
+    }
+    if (!running) {
+        lock.unlock();
+        bool ok = syncFiles(files);
+        lock.lock();
+        if (!ok && failed_from == 0) {
+            failed_from = submitted + 1;
+        }
+        return succeeded(submitted + 1);
+    }
+
+    dirty.insert(dirty.end(), files.begin(), files.end());
+    uint64_t ticket = ++submitted;
+    work_cv.notify_one();
+    done_cv.wait(lock, [&] { return synced >= ticket; });
+    return succeeded(ticket);
+}
+
+void GroupCommitter::syncAsync(const std::vector<std::shared_ptr<LogFile>>& files, std::function<void(bool ok)> done) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running || files.empty()) {
+        lock.unlock();
+        bool ok = syncFiles(files);
+        lock.lock();
+        if (!ok && failed_from == 0) {
+            failed_from = submitted + 1;
+        }
+        ok = succeeded(submitted + 1);
+        lock.unlock();
+        done(ok);
+        return;
+    }
+
+    dirty.insert(dirty.end(), files.begin(), files.end());
+    callbacks.emplace_back(++submitted, std::move(done));
+    work_cv.notify_one();
+}
+
+void GroupCommitter::submit(std::function<bool()> job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running) {
+        lock.unlock();
+        bool ok = job();
+        lock.lock();
+        if (!ok && failed_from == 0) {
+            failed_from = submitted + 1;
+        }
+        return;
+    }
+
+    jobs.push_back(std::move(job));
+    work_cv.notify_one();
+}
+
+bool GroupCommitter::failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_from != 0;
+}
+
+void GroupCommitter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        work_cv.wait(lock, [this] { return !running || !dirty.empty() || !jobs.empty(); });
+        if (dirty.empty() && jobs.empty()) {
+            break;
+        }
+
+        // 取走当前所有待同步的文件和待执行的工作，同步期间到达的写入留给下一批
+        std::vector<std::shared_ptr<LogFile>> batch;
+        std::vector<std::function<bool()>> batch_jobs;
+        batch.swap(dirty);
+        batch_jobs.swap(jobs);
+        uint64_t target = submitted;
+        lock.unlock();
+
+        // 先执行工作（如新段的目录项落盘），再同步文件，本批的确认依赖两者
+        bool ok = true;
+        for (auto& job : batch_jobs) {
+            if (!job()) {
+                ok = false;
+            }
+        }
+        batch_jobs.clear();
+
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+        if (!syncFiles(batch)) {
+            ok = false;
+        }
+        batch.clear();
+
+        lock.lock();
+        if (!ok && failed_from == 0) {
+            failed_from = synced + 1;
+        }
+        synced = target;
+        done_cv.notify_all();
+
+        // 本批覆盖的异步提交在锁外回调，回调期间到达的写入进入下一批
+        std::vector<std::pair<std::function<void(bool ok)>, bool>> ready;
+        auto pending = std::stable_partition(callbacks.begin(), callbacks.end(),
+            [target](const std::pair<uint64_t, std::function<void(bool ok)>>& entry) { return entry.first > target; });
+        for (auto it = pending; it != callbacks.end(); ++it) {
+            ready.emplace_back(std::move(it->second), succeeded(it->first));
+        }
+        callbacks.erase(pending, callbacks.end());
+        if (!ready.empty()) {
+            lock.unlock();
+            for (auto& entry : ready) {
+                entry.first(entry.second);
+            }
+            lock.lock();
+        }
+    }
+}
+
+MessageLog::MessageLog(const MessageLogConfig& config) : config(config), running(false) {
+}
+
+MessageLog::~MessageLog() {
+    close();
+}
+
+bool MessageLog::open() {
+    if (!makeDirectories(config.directory)) {
+        std::cerr << "无法创建消息日志目录: " << config.directory << std::endl;
+        return false;
+    }
+
+    // 恢复已有房间
+    auto start_time = std::chrono::steady_clock::now();
+    for (const auto& name : listDirectory(config.directory)) {
+        int room_id = 0;
+        if (sscanf(name.c_str(), "room-%d", &room_id) == 1 && room_id > 0) {
+            if (!recoverRoom(room_id, config.directory + "/" + name)) {
+                std::cerr << "恢复房间 " << room_id << " 的消息日志失败" << std::endl;
+                return false;
+            }
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "消息日志已恢复 " << rooms.size() << " 个房间，耗时 " << elapsed.count() << " ms" << std::endl;
+
+    committer.start();
+    running = true;
+    compaction_thread = std::thread(&MessageLog::runCompaction, this);
+    return true;
+}
+
+void MessageLog::close() {
+    if (running) {
+        running = false;
+        compaction_cv.notify_all();
+    }
+    if (compaction_thread.joinable()) {
+        compaction_thread.join();
+    }
+    committer.stop();
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    rooms.clear();
+}
+
+bool MessageLog::recoverRoom(int room_id, const std::string& directory) {
+    auto room = std::make_shared<LogRoom>();
+    room->directory = directory;
+
+    std::vector<int> bases;
+    for (const auto& name : listDirectory(directory)) {
+        int base = 0;
+        char ext[8] = {0};
+        if (sscanf(name.c_str(), "%d.%7s", &base, ext) == 2 && strcmp(ext, "log") == 0 && base > 0) {
+            bases.push_back(base);
+        }
+    }
+    std::sort(bases.begin(), bases.end());
+
+    if (bases.empty()) {
+        if (!openActiveSegment(*room, 1)) {
+            return false;
+        }
+        syncDirectory(directory);
+    }
+
+    for (size_t i = 0; i < bases.size(); ++i) {
+        bool is_tail = i + 1 == bases.size();
+        auto segment = std::unique_ptr<LogSegment>(new LogSegment());
+        segment->base_seq = bases[i];
+        segment->path = segmentPath(directory, bases[i]);
+
+        int fd = ::open((segment->path + ".log").c_str(), is_tail ? (O_RDWR | O_APPEND) : O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        segment->modified = st.st_mtime;
+
+        if (is_tail) {
+            // 活动段逐条校验，截断崩溃时写了一半的记录
+            std::string data;
+            readAll(fd, data);
+            segment->size = replaySegment(data, segment->base_seq, segment->offsets);
+            if (segment->size < (uint64_t)data.size()) {
+                std::cerr << "房间 " << room_id << " 日志尾部有 " << data.size() - segment->size
+                          << " 字节不完整的数据，已截断" << std::endl;
+                if (ftruncate(fd, segment->size) != 0) {
+                    ::close(fd);
+                    return false;
+                }
+            }
+            unlink((segment->path + ".idx").c_str());
+            segment->file = std::make_shared<LogFile>(fd);
+        } else {
+            segment->size = st.st_size;
+            if (segment->size > 0) {
+                void* map = mmap(nullptr, segment->size, PROT_READ, MAP_SHARED, fd, 0);
+                if (map == MAP_FAILED) {
+                    ::close(fd);
+                    return false;
+                }
+                segment->map = (const char*)map;
+                segment->map_size = segment->size;
+            }
+
+            // 封存段直接加载索引；索引缺失、损坏或与数据对不上时从数据重建
+            int idx_fd = ::open((segment->path + ".idx").c_str(), O_RDONLY);
+            std::string index;
+            if (idx_fd >= 0) {
+                readAll(idx_fd, index);
+                ::close(idx_fd);
+            }
+            if (!index.empty() && index.size() % sizeof(uint64_t) == 0) {
+                segment->offsets.resize(index.size() / sizeof(uint64_t));
+                memcpy(segment->offsets.data(), index.data(), index.size());
+            }
+            if (!checkSegmentIndex(*segment)) {
+                if (!index.empty()) {
+                    std::cerr << "房间 " << room_id << " 段 " << segment->base_seq
+                              << " 的索引与数据不符，已从数据重建" << std::endl;
+                }
+                std::string data;
+                readAll(fd, data);
+                segment->size = replaySegment(data, segment->base_seq, segment->offsets);
+            }
+            ::close(fd);
+        }
+
+        room->next_seq = segment->base_seq + (int)segment->offsets.size();
+        room->segments.push_back(std::move(segment));
+    }
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    rooms[room_id] = room;
+    return true;
+}
+
+bool MessageLog::openActiveSegment(LogRoom& room, int base_seq) {
+    auto segment = std::unique_ptr<LogSegment>(new LogSegment());
+    segment->base_seq = base_seq;
+    segment->path = segmentPath(room.directory, base_seq);
+    segment->modified = time(nullptr);
+
+    int fd = ::open((segment->path + ".log").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::cerr << "无法创建日志段: " << segment->path << ".log" << std::endl;
+        return false;
+    }
+    segment->file = std::make_shared<LogFile>(fd);
+
+    room.segments.push_back(std::move(segment));
+    return true;
+}
+
+static LogSegment* findSegment(std::deque<std::unique_ptr<LogSegment>>& segments, int base_seq) {
+    for (auto& segment : segments) {
+        if (segment->base_seq == base_seq) {
+            return segment.get();
+        }
+    }
+    return nullptr;
+}
+
+bool MessageLog::sealActiveSegment(const std::shared_ptr<LogRoom>& room) {
+    LogSegment& segment = *room->segments.back();
+    int base_seq = segment.base_seq;
+    std::shared_ptr<LogFile> file = segment.file;
+    if (!openActiveSegment(*room, room->next_seq)) {
+        return false;
+    }
+
+    // 新段中消息的确认排在这项工作之后，保证其目录项先落盘
+    committer.submit([this, room, base_seq, file] {
+        return finishSeal(room, base_seq, file);
+    });
+    return true;
+}
+
+bool MessageLog::finishSeal(const std::shared_ptr<LogRoom>& room, int base_seq, const std::shared_ptr<LogFile>& file) {
+    if (!syncDirectory(room->directory) || fdatasync(file->fd) != 0) {
+        return false;
+    }
+
+    // 旧段不再追加，复制索引后在锁外写出；期间段可能已被清理或随房间删除
+    std::string path;
+    std::vector<uint64_t> offsets;
+    uint64_t size = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(room->mutex);
+        LogSegment* segment = room->deleted ? nullptr : findSegment(room->segments, base_seq);
+        if (segment == nullptr) {
+            return true;
+        }
+        path = segment->path;
+        offsets = segment->offsets;
+        size = segment->size;
+    }
+
+    // 先同步数据再写出索引；索引写失败时删除，重启后从数据重建
+    int idx_fd = ::open((path + ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool indexed = idx_fd >= 0 &&
+                   writeAll(idx_fd, (const char*)offsets.data(), offsets.size() * sizeof(uint64_t)) &&
+                   fdatasync(idx_fd) == 0;
+    if (idx_fd >= 0) {
+        ::close(idx_fd);
+    }
+    if (!indexed) {
+        std::cerr << "写出日志段索引失败: " << path << ".idx" << std::endl;
+        unlink((path + ".idx").c_str());
+    }
+
+    void* map = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, file->fd, 0) : MAP_FAILED;
+
+    std::unique_lock<std::shared_mutex> lock(room->mutex);
+    LogSegment* segment = room->deleted ? nullptr : findSegment(room->segments, base_seq);
+    if (segment == nullptr) {
+        // 写索引期间段被删除，不留下孤立的索引文件
+        unlink((path + ".idx").c_str());
+    }
+    if (map == MAP_FAILED) {
+        return true;
+    }
+    if (segment == nullptr || segment->file != file) {
+        munmap(map, size);
+        return true;
+    }
+    segment->map = (const char*)map;
+    segment->map_size = size;
+    segment->file.reset();
+    return true;
+}
+
+std::shared_ptr<MessageLog::LogRoom> MessageLog::findRoom(int room_id) {
+    std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+    auto it = rooms.find(room_id);
+    return it != rooms.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<MessageLog::LogRoom> MessageLog::findOrCreateRoom(int room_id) {
+    std::shared_ptr<LogRoom> room = findRoom(room_id);
+    if (room) {
+        return room;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    auto it = rooms.find(room_id);
+    if (it != rooms.end()) {
+        return it->second;
+    }
+
+    room = std::make_shared<LogRoom>();
+    room->directory = config.directory + "/room-" + std::to_string(room_id);
+    if (!makeDirectories(room->directory) || !openActiveSegment(*room, 1)) {
+        return nullptr;
+    }
+    // 房间目录和第一个段的目录项在组提交线程上落盘，先于其中消息的确认
+    std::string room_directory = room->directory;
+    std::string root_directory = config.directory;
+    committer.submit([room_directory, root_directory] {
+        return syncDirectory(room_directory) && syncDirectory(root_directory);
+    });
+    rooms[room_id] = room;
+    return room;
+}
+
+bool MessageLog::append(int room_id, ChatMessage& message) {
+    std::shared_ptr<LogFile> file;
+    if (!appendUnsynced(room_id, message, file)) {
+        return false;
+    }
+
+    // 在房间锁外等待落盘，同一时间段内的追加共享一次fdatasync
+    return committer.sync(file);
+}
+
+bool MessageLog::sync(const std::vector<std::shared_ptr<LogFile>>& files) {
+    return committer.sync(files);
+}
+
+void MessageLog::syncAsync(const std::vector<std::shared_ptr<LogFile>>& files, std::function<void(bool ok)> done) {
+    committer.syncAsync(files, std::move(done));
+}
+
+bool MessageLog::appendUnsynced(int room_id, ChatMessage& message, std::shared_ptr<LogFile>& file) {
+    // 同步失败后无法确定哪些数据已落盘，停止写入，重启时按校验和重放恢复
+    if (committer.failed()) {
+        return false;
+    }
+
+    std::shared_ptr<LogRoom> room = findOrCreateRoom(room_id);
+    if (!room) {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(room->mutex);
+    if (room->deleted) {
+        return false;
+    }
+
+    LogSegment& tail = *room->segments.back();
+    if (tail.size >= config.segment_bytes && !tail.offsets.empty() && !sealActiveSegment(room)) {
+        std::cerr << "封存日志段失败: " << room->segments.back()->path << std::endl;
+        return false;
+    }
+
+    LogSegment& active = *room->segments.back();
+    message.seq = room->next_seq;
+    std::string record = encodeLogRecord(message);
+    if (!writeAll(active.file->fd, record.data(), record.size())) {
+        // 丢弃写了一半的记录
+        if (ftruncate(active.file->fd, active.size) != 0) {
+            std::cerr << "日志截断失败: " << active.path << std::endl;
+        }
+        return false;
+    }
+
+    active.offsets.push_back(active.size);
+    active.size += record.size();
+    active.modified = time(nullptr);
+    room->next_seq++;
+    file = active.file;
+    return true;
+}
+
+// 读取[first, last]区间的消息，每个段只做一次内存访问或pread
+static bool readSegmentRange(const LogSegment& segment, int first, int last,
+                             const std::function<void(const ChatMessage&)>& visit) {
+    size_t begin_index = first - segment.base_seq;
+    size_t end_index = last - segment.base_seq + 1;
+    uint64_t begin = segment.offsets[begin_index];
+    uint64_t end = end_index < segment.offsets.size() ? segment.offsets[end_index] : segment.size;
+
+    const char* data;
+    std::string buffer;
+    if (segment.map != nullptr) {
+        data = segment.map + begin;
+    } else {
+        buffer.resize(end - begin);
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t n = pread(segment.file->fd, &buffer[done], buffer.size() - done, begin + done);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            done += n;
+        }
+        data = buffer.data();
+    }
+
+    uint64_t offset = 0;
+    ChatMessage message;
+    while (offset < end - begin) {
+        size_t len = decodeLogRecord(data + offset, end - begin - offset, message);
+        if (len == 0) {
+            return false;
+        }
+        visit(message);
+        offset += len;
+    }
+    return true;
+}
+
+// 依次读取[first, last]覆盖的各个段，调用者需持有房间锁
+static bool readRange(const std::deque<std::unique_ptr<LogSegment>>& segments, int first, int last,
+                      const std::function<void(const ChatMessage&)>& visit) {
+    auto it = std::upper_bound(segments.begin(), segments.end(), first,
+                               [](int seq, const std::unique_ptr<LogSegment>& segment) {
+                                   return seq < segment->base_seq;
+                               });
+    if (it != segments.begin()) {
+        --it;
+    }
+
+    for (; it != segments.end() && first <= last; ++it) {
+        const LogSegment& segment = **it;
+        int segment_last = std::min(last, segment.base_seq + (int)segment.offsets.size() - 1);
+        if (first < segment.base_seq || segment_last < first) {
+            continue;
+        }
+        if (!readSegmentRange(segment, first, segment_last, visit)) {
+            return false;
+        }
+        first = segment_last + 1;
+    }
+    return true;
+}
+
+bool MessageLog::read(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) {
+    std::shared_ptr<LogRoom> room = findRoom(room_id);
+    int first, last;
+    if (!room) {
+        planMessagePage(0, before_seq, after_seq, limit, page, first, last);
+        return true;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(room->mutex);
+    if (room->deleted) {
+        planMessagePage(0, before_seq, after_seq, limit, page, first, last);
+        return true;
+    }
+
+    // 已被清理的段中的消息不再返回，增量拉取直接跳到最早的可用消息
+    int first_available = room->segments.front()->base_seq;
+    if (after_seq > 0 && after_seq < first_available - 1) {
+        after_seq = first_available - 1;
+    }
+    if (!planMessagePage(room->next_seq - 1, before_seq, after_seq, limit, page, first, last)) {
+        return true;
+    }
+    if (first < first_available) {
+        first = first_available;
+        if (first > last) {
+            page.prev_cursor = 0;
+            return true;
+        }
+    }
+    page.prev_cursor = first > first_available ? first : 0;
+
+    page.messages.reserve(last - first + 1);
+    return readRange(room->segments, first, last, [&](const ChatMessage& message) {
+        page.messages.push_back(message);
+    });
+}
+
+int MessageLog::head(int room_id) {
+    std::shared_ptr<LogRoom> room = findRoom(room_id);
+    if (!room) {
+        return 0;
+    }
+    std::shared_lock<std::shared_mutex> lock(room->mutex);
+    return room->deleted ? 0 : room->next_seq - 1;
+}
+
+bool MessageLog::scan(int room_id, const std::function<void(const ChatMessage&)>& visit) {
+    std::shared_ptr<LogRoom> room = findRoom(room_id);
+    if (!room) {
+        return true;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(room->mutex);
+    if (room->deleted) {
+        return true;
+    }
+    return readRange(room->segments, room->segments.front()->base_seq, room->next_seq - 1, visit);
+}
+
+bool MessageLog::removeRoom(int room_id) {
+    std::shared_ptr<LogRoom> room;
+    {
+        std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+        auto it = rooms.find(room_id);
+        if (it == rooms.end()) {
+            return true;
+        }
+        room = it->second;
+        rooms.erase(it);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(room->mutex);
+    room->deleted = true;
+    for (const auto& segment : room->segments) {
+        unlink((segment->path + ".log").c_str());
+        unlink((segment->path + ".idx").c_str());
+    }
+    room->segments.clear();
+    rmdir(room->directory.c_str());
+    syncDirectory(config.directory);
+    return true;
+}
+
+void MessageLog::compactRoom(LogRoom& room) {
+    std::unique_lock<std::shared_mutex> lock(room.mutex);
+    if (room.deleted) {
+        return;
+    }
+
+    uint64_t total = 0;
+    for (const auto& segment : room.segments) {
+        total += segment->size;
+    }
+
+    // 只删除封存段，按从旧到新的顺序，活动段始终保留
+    time_t cutoff = time(nullptr) - config.retention_seconds;
+    int removed = 0;
+    while (room.segments.size() > 1) {
+        const LogSegment& oldest = *room.segments.front();
+        bool expired = config.retention_seconds > 0 && oldest.modified < cutoff;
+        bool oversize = config.max_room_bytes > 0 && total > config.max_room_bytes;
+        if (!expired && !oversize) {
+            break;
+        }
+        unlink((oldest.path + ".log").c_str());
+        unlink((oldest.path + ".idx").c_str());
+        total -= oldest.size;
+        room.segments.pop_front();
+        removed++;
+    }
+
+    if (removed > 0) {
+        syncDirectory(room.directory);
+        std::cout << "清理日志段 " << removed << " 个: " << room.directory << std::endl;
+    }
+}
+
+void MessageLog::runCompaction() {
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(compaction_mutex);
+            compaction_cv.wait_for(lock, std::chrono::seconds(config.compaction_interval_seconds),
+                                   [this] { return !running; });
+        }
+        if (!running || (config.retention_seconds <= 0 && config.max_room_bytes == 0)) {
+            continue;
+        }
+
+        std::vector<std::shared_ptr<LogRoom>> snapshot;
+        {
+            std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+            for (const auto& entry : rooms) {
+                snapshot.push_back(entry.second);
+            }
+        }
+        for (const auto& room : snapshot) {
+            compactRoom(*room);
+        }
+    }
+}
+
+MessageLogStorage::MessageLogStorage(std::unique_ptr<Storage> inner, const MessageLogConfig& config)
+    : inner(std::move(inner)), log(config) {
+    display_name = std::string(this->inner->name()) + "+log";
+}
+
+bool MessageLogStorage::open() {
+    if (!inner->open() || !log.open()) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+    for (const auto& room : inner->listRooms()) {
+        known_rooms.insert(room.id);
+    }
+    return true;
+}
+
+void MessageLogStorage::close() {
+    log.close();
+    inner->close();
+}
+
+bool MessageLogStorage::createRoom(const std::string& name, const std::string& description,
+                                   const std::string& creator, int& room_id) {
+    if (!inner->createRoom(name, description, creator, room_id)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+    known_rooms.insert(room_id);
+    return true;
+}
+
+bool MessageLogStorage::deleteRoom(int room_id) {
+    {
+        std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+        known_rooms.erase(room_id);
+    }
+    if (!inner->deleteRoom(room_id)) {
+        return false;
+    }
+    return log.removeRoom(room_id);
+}
+
+bool MessageLogStorage::roomExists(int room_id) {
+    {
+        std::shared_lock<std::shared_mutex> lock(known_rooms_mutex);
+        if (known_rooms.count(room_id) > 0) {
+            return true;
+        }
+    }
+
+    // 只有其他实例新建的房间会走到这里，确认存在后加入缓存
+    ChatRoom room;
+    if (!inner->getRoom(room_id, room)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+    known_rooms.insert(room_id);
+    return true;
+}
+
+bool MessageLogStorage::appendRoomMessage(int room_id, ChatMessage& message) {
+    // 房间信息仍由内层后端保存
+    if (!roomExists(room_id)) {
+        return false;
+    }
+    return log.append(room_id, message);
+}
+
+void MessageLogStorage::appendRoomMessagesAsync(std::vector<RoomAppend> batch) {
+    // 整批写入后只等待一次落盘；同一批内每个房间只确认一次是否存在
+    std::unordered_map<int, bool> room_exists;
+    std::vector<std::shared_ptr<LogFile>> files;
+    std::vector<bool> results(batch.size(), false);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        int room_id = batch[i].room_id;
+        auto it = room_exists.find(room_id);
+        if (it == room_exists.end()) {
+            it = room_exists.emplace(room_id, roomExists(room_id)).first;
+        }
+
+        std::shared_ptr<LogFile> file;
+        if (it->second && log.appendUnsynced(room_id, batch[i].message, file)) {
+            results[i] = true;
+            files.push_back(file);
+        }
+    }
+
+    // 在反应器上不等待落盘：组提交线程同步完这一批后把回调交回本事件循环执行
+    std::shared_ptr<LoopMailbox> mailbox = LoopMailbox::forCurrentLoop();
+    // 同步失败时这一批写入的消息都按失败回复
+    if (!mailbox) {
+        bool ok = log.sync(files);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i].done(results[i] && ok, batch[i].message);
+        }
+        return;
+    }
+    auto appends = std::make_shared<std::vector<RoomAppend>>(std::move(batch));
+    log.syncAsync(files, [mailbox, appends, results](bool ok) {
+        mailbox->post([appends, results, ok] {
+            for (size_t i = 0; i < appends->size(); ++i) {
+                (*appends)[i].done(results[i] && ok, (*appends)[i].message);
+            }
+        });
+    });
+}
+
+void MessageLogStorage::appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done) {
+    std::vector<RoomAppend> batch(1);
+    batch[0].room_id = room_id;
+    batch[0].message = message;
+    batch[0].done = done;
+    appendRoomMessagesAsync(std::move(batch));
+}
@@ -0,0 +1,263 @@
+#include "../include/metrics.h"
+#include "../include/trace.h"
+#include <mutex>
+#include <sstream>
+#include <cstring>
+#include <strings.h>
+
+namespace {
+
+// 单个线程分片，按缓存行对齐避免伪共享
+struct alignas(64) MetricsShard {
+    std::atomic<uint64_t> requests[Metrics::kMaxRoutes][Metrics::STATUS_SLOTS];
+    LatencyHistogram route_latency[Metrics::kMaxRoutes];
+    std::atomic<int64_t> connections;
+    std::atomic<uint64_t> backend_calls[Metrics::BACKEND_OPS];
+    std::atomic<uint64_t> backend_errors[Metrics::BACKEND_OPS];
+    LatencyHistogram backend_latency[Metrics::BACKEND_OPS];
+};
+
+// 静态存储，零初始化
+MetricsShard g_shards[Metrics::kShards];
+std::atomic<unsigned> g_next_shard(0);
+
+std::mutex g_routes_mutex;
+std::string g_route_names[Metrics::kMaxRoutes] = {"static", "not_found"};
+int g_route_count = 2;
+
+const char* const kStatusLabels[Metrics::STATUS_SLOTS] = {
+    "200", "206", "304", "400", "401", "404", "413", "429", "500", "503", "504", "other"
+};
+
+const char* const kBackendLabels[Metrics::BACKEND_OPS][2] = {
+    {"redis", "GET"}, {"redis", "SET"}, {"redis", "MGET"}, {"redis", "INCR"}, {"redis", "DEL"},
+    {"redis", "other"}, {"mysql", "SELECT"}, {"mysql", "INSERT"}, {"mysql", "DELETE"}, {"mysql", "other"}
+};
+
+// 追踪中后端调用阶段的名称
+const char* const kBackendSpanNames[Metrics::BACKEND_OPS] = {
+    "redis GET", "redis SET", "redis MGET", "redis INCR", "redis DEL",
+    "redis other", "mysql SELECT", "mysql INSERT", "mysql DELETE", "mysql other"
+};
+
+// 当前线程的分片，首次使用时轮流分配，线程多于分片时共用
+MetricsShard& localShard() {
+    thread_local MetricsShard* shard = &g_shards[g_next_shard.fetch_add(1, std::memory_order_relaxed) % Metrics::kShards];
+    return *shard;
+}
+
+Metrics::StatusSlot statusSlot(int status) {
+    switch (status) {
+        case 200: return Metrics::STATUS_200;
+        case 206: return Metrics::STATUS_206;
+        case 304: return Metrics::STATUS_304;
+        case 400: return Metrics::STATUS_400;
+        case 401: return Metrics::STATUS_401;
+        case 404: return Metrics::STATUS_404;
+        case 413: return Metrics::STATUS_413;
+        case 429: return Metrics::STATUS_429;
+        case 500: return Metrics::STATUS_500;
+        case 503: return Metrics::STATUS_503;
+        case 504: return Metrics::STATUS_504;
+        default: return Metrics::STATUS_OTHER;
+    }
+}
+
+// 比较命令的首个单词（不区分大小写）
+bool firstWordIs(const char* text, const char* word) {
+    while (*text == ' ') {
+        ++text;
+    }
+    size_t len = strlen(word);
+    return strncasecmp(text, word, len) == 0 && (text[len] == ' ' || text[len] == '\0');
+}
+
+// 汇总所有分片中的直方图，按累计桶输出
+template <typename Accessor>
+void writeHistogram(std::ostringstream& out, const std::string& name, const std::string& labels, Accessor get) {
+    uint64_t buckets[LatencyHistogram::kBuckets] = {0};
+    uint64_t count = 0, sum_ns = 0;
+    for (auto& shard : g_shards) {
+        const LatencyHistogram& histogram = get(shard);
+        for (int b = 0; b < LatencyHistogram::kBuckets; ++b) {
+            buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+        }
+        count += histogram.count.load(std::memory_order_relaxed);
+        sum_ns += histogram.sum_ns.load(std::memory_order_relaxed);
+    }
+    if (count == 0) {
+        return;
+    }
+
+    uint64_t cumulative = 0;
+    for (int b = 0; b < LatencyHistogram::kBounds; ++b) {
+        cumulative += buckets[b];
+        out << name << "_bucket{" << labels << ",le=\"" << (double)LatencyHistogram::kBoundsNs[b] / 1e9 << "\"} "
+            << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << count << "\n";
+    out << name << "_sum{" << labels << "} " << (double)sum_ns / 1e9 << "\n";
+    out << name << "_count{" << labels << "} " << count << "\n";
+}
+
+} // namespace
+
+// 导出的直方图边界：100µs到10s
+const uint64_t LatencyHistogram::kBoundsNs[LatencyHistogram::kBounds] = {
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000,
+    50000000, 100000000, 250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000
+};
+
+int LatencyHistogram::bucketFor(uint64_t latency_ns) {
+    // 16个边界的二分查找，只有4次比较
+    int low = 0, high = kBounds;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (kBoundsNs[mid] < latency_ns) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int Metrics::registerRoute(const std::string& route) {
+    std::lock_guard<std::mutex> lock(g_routes_mutex);
+    for (int i = 0; i < g_route_count; ++i) {
+        if (g_route_names[i] == route) {
+            return i;
+        }
+    }
+    if (g_route_count >= kMaxRoutes) {
+        return ROUTE_NOT_FOUND;
+    }
+    g_route_names[g_route_count] = route;
+    return g_route_count++;
+}
+
+void Metrics::recordRequest(int route_id, int status, uint64_t latency_ns) {
+    if (route_id < 0 || route_id >= kMaxRoutes) {
+        route_id = ROUTE_NOT_FOUND;
+    }
+    MetricsShard& shard = localShard();
+    shard.requests[route_id][statusSlot(status)].fetch_add(1, std::memory_order_relaxed);
+    shard.route_latency[route_id].record(latency_ns);
+}
+
+void Metrics::connectionOpened() {
+    localShard().connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::connectionClosed() {
+    localShard().connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+Metrics::BackendOp Metrics::redisOp(const char* command) {
+    if (firstWordIs(command, "GET")) return REDIS_GET;
+    if (firstWordIs(command, "SET")) return REDIS_SET;
+    if (firstWordIs(command, "MGET")) return REDIS_MGET;
+    if (firstWordIs(command, "INCR")) return REDIS_INCR;
+    if (firstWordIs(command, "DEL")) return REDIS_DEL;
+    return REDIS_OTHER;
+}
+
+Metrics::BackendOp Metrics::mysqlOp(const char* query) {
+    if (firstWordIs(query, "SELECT")) return MYSQL_SELECT;
+    if (firstWordIs(query, "INSERT")) return MYSQL_INSERT;
+    if (firstWordIs(query, "DELETE")) return MYSQL_DELETE;
+    return MYSQL_OTHER;
+}
+
+void Metrics::recordBackendCall(BackendOp op, uint64_t latency_ns, bool error) {
+    MetricsShard& shard = localShard();
+    shard.backend_calls[op].fetch_add(1, std::memory_order_relaxed);
+    if (error) {
+        shard.backend_errors[op].fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.backend_latency[op].record(latency_ns);
+
+    // 所有后端调用都经过这里，被追踪的请求在这里记下每次调用
+    uint64_t trace_id = Trace::current();
+    if (trace_id) {
+        uint64_t end_ns = nowNs();
+        Trace::span(trace_id, kBackendSpanNames[op], end_ns - latency_ns, end_ns, error ? "error" : "");
+    }
+}
+
+std::string Metrics::renderPrometheus() {
+    std::ostringstream out;
+
+    std::string routes[kMaxRoutes];
+    int route_count;
+    {
+        std::lock_guard<std::mutex> lock(g_routes_mutex);
+        route_count = g_route_count;
+        for (int i = 0; i < route_count; ++i) {
+            routes[i] = g_route_names[i];
+        }
+    }
+
+    out << "# HELP chat_http_requests_total HTTP requests by route and status code.\n";
+    out << "# TYPE chat_http_requests_total counter\n";
+    for (int r = 0; r < route_count; ++r) {
+        for (int s = 0; s < STATUS_SLOTS; ++s) {
+            uint64_t total = 0;
+            for (auto& shard : g_shards) {
+                total += shard.requests[r][s].load(std::memory_order_relaxed);
+            }
+            if (total > 0) {
+                out << "chat_http_requests_total{route=\"" << routes[r] << "\",code=\"" << kStatusLabels[s]
+                    << "\"} " << total << "\n";
+            }
+        }
+    }
+
+    out << "# HELP chat_http_request_duration_seconds HTTP request latency by route.\n";
+    out << "# TYPE chat_http_request_duration_seconds histogram\n";
+    for (int r = 0; r < route_count; ++r) {
+        writeHistogram(out, "chat_http_request_duration_seconds", "route=\"" + routes[r] + "\"",
+                       [r](const MetricsShard& shard) -> const LatencyHistogram& { return shard.route_latency[r]; });
+    }
+
+    int64_t connections = 0;
+    for (auto& shard : g_shards) {
+        connections += shard.connections.load(std::memory_order_relaxed);
+    }
+    out << "# HELP chat_http_connections_in_flight Connections currently being handled.\n";
+    out << "# TYPE chat_http_connections_in_flight gauge\n";
+    out << "chat_http_connections_in_flight " << connections << "\n";
+
+    out << "# HELP chat_backend_calls_total Redis and MySQL calls by command.\n";
+    out << "# TYPE chat_backend_calls_total counter\n";
+    for (int op = 0; op < BACKEND_OPS; ++op) {
+        uint64_t calls = 0;
+        for (auto& shard : g_shards) {
+            calls += shard.backend_calls[op].load(std::memory_order_relaxed);
+        }
+        out << "chat_backend_calls_total{backend=\"" << kBackendLabels[op][0] << "\",command=\""
+            << kBackendLabels[op][1] << "\"} " << calls << "\n";
+    }
+
+    out << "# HELP chat_backend_errors_total Failed Redis and MySQL calls by command.\n";
+    out << "# TYPE chat_backend_errors_total counter\n";
+    for (int op = 0; op < BACKEND_OPS; ++op) {
+        uint64_t errors = 0;
+        for (auto& shard : g_shards) {
+            errors += shard.backend_errors[op].load(std::memory_order_relaxed);
+        }
+        out << "chat_backend_errors_total{backend=\"" << kBackendLabels[op][0] << "\",command=\""
+            << kBackendLabels[op][1] << "\"} " << errors << "\n";
+    }
+
+    out << "# HELP chat_backend_call_duration_seconds Redis and MySQL call latency by command.\n";
+    out << "# TYPE chat_backend_call_duration_seconds histogram\n";
+    for (int op = 0; op < BACKEND_OPS; ++op) {
+        std::string labels = std::string("backend=\"") + kBackendLabels[op][0] + "\",command=\"" +
+                             kBackendLabels[op][1] + "\"";
+        writeHistogram(out, "chat_backend_call_duration_seconds", labels,
+                       [op](const MetricsShard& shard) -> const LatencyHistogram& { return shard.backend_latency[op]; });
+    }
+
+    return out.str();
+}
@@ -0,0 +1,205 @@
+#include "../include/presence.h"
+#include <algorithm>
+
+PresenceTracker::PresenceTracker() : epoch(Clock::now()), running(false) {
+    for (size_t i = 0; i < kShardCount; ++i) {
+        shards[i].wheel.resize(config.ttl_seconds + 2);
+    }
+}
+
+PresenceTracker::~PresenceTracker() {
+    stop();
+}
+
+void PresenceTracker::start(const PresenceConfig& presence_config) {
+    if (running.exchange(true)) {
+        return;
+    }
+    config = presence_config;
+
+    // 时间轮的槽数比在线时长多两格，新项总是落在尚未处理的槽位上
+    size_t slots = config.ttl_seconds + 2;
+    for (size_t i = 0; i < kShardCount; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.wheel.size() == slots) {
+            continue;
+        }
+        shard.wheel.assign(slots, std::vector<std::pair<int, uint32_t>>());
+        for (const auto& room_pair : shard.rooms) {
+            for (const auto& member : room_pair.second.expires) {
+                shard.wheel[member.second % slots].emplace_back(room_pair.first, member.first);
+            }
+        }
+    }
+
+    ticker = std::thread(&PresenceTracker::run, this);
+}
+
+void PresenceTracker::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+    }
+    wait_cv.notify_all();
+    if (ticker.joinable()) {
+        ticker.join();
+    }
+}
+
+uint32_t PresenceTracker::nowTick() const {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - epoch).count();
+}
+
+void PresenceTracker::touch(int room_id, uint32_t user_id) {
+    if (user_id == UserTable::kNoUser) {
+        return;
+    }
+    uint32_t expires = nowTick() + config.ttl_seconds;
+
+    Shard& shard = shardFor(room_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    RoomMembers& room = shard.rooms[room_id];
+    auto result = room.expires.emplace(user_id, expires);
+    if (result.second) {
+        // 新成员：放入时间轮
+        shard.wheel[expires % shard.wheel.size()].emplace_back(room_id, user_id);
+    } else {
+        // 已在时间轮上：只推后过期时间；离开后尚未清理的成员重新上线
+        bool online = result.first->second != 0;
+        result.first->second = expires;
+        if (online) {
+            return;
+        }
+    }
+
+    size_t word = user_id / 64;
+    if (room.bits.size() <= word) {
+        room.bits.resize(word + 1, 0);
+    }
+    room.bits[word] |= 1ull << (user_id % 64);
+    room.online++;
+}
+
+void PresenceTracker::leave(int room_id, const std::string& username) {
+    uint32_t user_id;
+    if (!UserTable::find(username, user_id)) {
+        return;
+    }
+
+    Shard& shard = shardFor(room_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto room_it = shard.rooms.find(room_id);
+    if (room_it == shard.rooms.end()) {
+        return;
+    }
+    auto it = room_it->second.expires.find(user_id);
+    if (it == room_it->second.expires.end() || it->second == 0) {
+        return;
+    }
+
+    // 过期时间置0表示已离开，时间轮上的项到期时再删除
+    it->second = 0;
+    removeMember(shard, room_id, user_id);
+}
+
+void PresenceTracker::removeMember(Shard& shard, int room_id, uint32_t user_id) {
+    RoomMembers& room = shard.rooms[room_id];
+    room.bits[user_id / 64] &= ~(1ull << (user_id % 64));
+    room.online--;
+}
+
+RoomPresence PresenceTracker::query(int room_id, size_t max_users) {
+    RoomPresence presence;
+    presence.room_id = room_id;
+
+    std::vector<uint32_t> ids;
+    {
+        Shard& shard = shardFor(room_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(room_id);
+        if (it == shard.rooms.end()) {
+            return presence;
+        }
+        const RoomMembers& room = it->second;
+        presence.online = room.online;
+
+        // 按64位逐字扫描位图，只访问置位的编号
+        ids.reserve(std::min(max_users, room.online));
+        for (size_t word = 0; word < room.bits.size() && ids.size() < max_users; ++word) {
+            uint64_t bits = room.bits[word];
+            while (bits != 0 && ids.size() < max_users) {
+                ids.push_back((uint32_t)(word * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    presence.users.reserve(ids.size());
+    for (uint32_t id : ids) {
+        presence.users.push_back(UserTable::name(id));
+    }
+    return presence;
+}
+
+size_t PresenceTracker::onlineCount(int room_id) {
+    Shard& shard = shardFor(room_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.rooms.find(room_id);
+    return it == shard.rooms.end() ? 0 : it->second.online;
+}
+
+void PresenceTracker::advance(Shard& shard, uint32_t now_tick) {
+    size_t slots = shard.wheel.size();
+    while (shard.current_tick < now_tick) {
+        uint32_t tick = ++shard.current_tick;
+        std::vector<std::pair<int, uint32_t>> due;
+        due.swap(shard.wheel[tick % slots]);
+
+        for (const auto& entry : due) {
+            auto room_it = shard.rooms.find(entry.first);
+            if (room_it == shard.rooms.end()) {
+                continue;
+            }
+            RoomMembers& room = room_it->second;
+            auto it = room.expires.find(entry.second);
+            if (it == room.expires.end()) {
+                continue;
+            }
+
+            // 期间有过心跳：移到新的过期时间所在的槽位
+            if (it->second > tick) {
+                shard.wheel[it->second % slots].push_back(entry);
+                continue;
+            }
+
+            if (it->second != 0) {
+                removeMember(shard, entry.first, entry.second);
+            }
+            room.expires.erase(it);
+            if (room.expires.empty()) {
+                shard.rooms.erase(room_it);
+            }
+        }
+    }
+}
+
+void PresenceTracker::run() {
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_cv.wait_for(lock, std::chrono::seconds(1), [this] { return !running; });
+        }
+        if (!running) {
+            break;
+        }
+
+        uint32_t now_tick = nowTick();
+        for (size_t i = 0; i < kShardCount; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            advance(shards[i], now_tick);
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#include "../include/read_cursors.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+ReadCursorTable::ReadCursorTable() : storage(nullptr), running(false) {
+}
+
+ReadCursorTable::~ReadCursorTable() {
+    stop();
+}
+
+void ReadCursorTable::start(Storage* backend, const ReadCursorConfig& cursor_config) {
+    if (running.exchange(true)) {
+        return;
+    }
+    storage = backend;
+    config = cursor_config;
+    flusher = std::thread(&ReadCursorTable::run, this);
+}
+
+void ReadCursorTable::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+    }
+    wait_cv.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    flush();
+}
+
+int ReadCursorTable::markRead(const std::string& username, int room_id, int seq) {
+    Shard& shard = shardFor(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    UserCursors& user = shard.users[username];
+    int& current = user.seqs[room_id];
+    if (seq > current) {
+        current = seq;
+        user.dirty.insert(room_id);
+        shard.dirty_users.insert(username);
+    }
+    return current;
+}
+
+bool ReadCursorTable::getCursors(const std::string& username, std::unordered_map<int, int>& cursors) {
+    Shard& shard = shardFor(username);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.users.find(username);
+        if (it != shard.users.end() && it->second.loaded) {
+            cursors = it->second.seqs;
+            return true;
+        }
+    }
+
+    // 在锁外从存储加载，期间的标记已读与加载结果取较大值合并
+    std::unordered_map<int, int> stored;
+    if (!storage || !storage->loadReadCursors(username, stored)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    UserCursors& user = shard.users[username];
+    if (!user.loaded) {
+        for (const auto& cursor : stored) {
+            int& seq = user.seqs[cursor.first];
+            seq = std::max(seq, cursor.second);
+        }
+        user.loaded = true;
+    }
+    cursors = user.seqs;
+    return true;
+}
+
+void ReadCursorTable::flush() {
+    if (!storage) {
+        return;
+    }
+
+    std::vector<ReadCursor> batch;
+    for (size_t i = 0; i < kShardCount; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& username : shard.dirty_users) {
+            UserCursors& user = shard.users[username];
+            for (int room_id : user.dirty) {
+                ReadCursor cursor;
+                cursor.username = username;
+                cursor.room_id = room_id;
+                cursor.seq = user.seqs[room_id];
+                batch.push_back(cursor);
+            }
+            user.dirty.clear();
+        }
+        shard.dirty_users.clear();
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    if (!storage->saveReadCursors(batch)) {
+        // 下一轮重试；其间若位置又前移，保存较大的值即可
+        std::cerr << "写回" << batch.size() << "个已读位置失败，稍后重试" << std::endl;
+        for (const auto& cursor : batch) {
+            Shard& shard = shardFor(cursor.username);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.users[cursor.username].dirty.insert(cursor.room_id);
+            shard.dirty_users.insert(cursor.username);
+        }
+    }
+}
+
+void ReadCursorTable::run() {
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_cv.wait_for(lock, std::chrono::milliseconds(config.flush_interval_ms), [this] { return !running; });
+        }
+        if (!running) {
+            break;
+        }
+        flush();
+    }
+}
@@ -0,0 +1,161 @@
+#include "../include/redis_async.h"
+#include "../include/metrics.h"
+#include "../include/trace.h"
+#include <iostream>
+#include <cstring>
+#include <sys/epoll.h>
+
+// 一条在途命令
+struct PendingCommand {
+    RedisAsyncClient::ReplyCallback callback;
+    Metrics::BackendOp op;
+    uint64_t start_ns;
+    size_t* in_flight;
+    uint64_t trace_id;   // 发起命令的请求，回复到达时恢复
+};
+
+RedisAsyncClient::RedisAsyncClient(EventLoop* loop, const std::string& host, int port)
+    : loop(loop), host(host), port(port), context(nullptr), fd(-1), events(0), in_flight(0) {
+}
+
+RedisAsyncClient::~RedisAsyncClient() {
+    // 释放连接时hiredis以nullptr回复调用所有在途命令的回调
+    if (context) {
+        redisAsyncFree(context);
+        context = nullptr;
+    }
+}
+
+bool RedisAsyncClient::connect() {
+    context = redisAsyncConnect(host.c_str(), port);
+    if (context == nullptr || context->err) {
+        std::cerr << "异步Redis连接失败: " << (context ? context->errstr : "无法分配连接") << std::endl;
+        if (context) {
+            redisAsyncFree(context);
+            context = nullptr;
+        }
+        return false;
+    }
+
+    context->data = this;
+    fd = context->c.fd;
+    events = 0;
+
+    context->ev.data = this;
+    context->ev.addRead = addRead;
+    context->ev.delRead = delRead;
+    context->ev.addWrite = addWrite;
+    context->ev.delWrite = delWrite;
+    context->ev.cleanup = cleanup;
+    redisAsyncSetConnectCallback(context, onConnect);
+    redisAsyncSetDisconnectCallback(context, onDisconnect);
+    return true;
+}
+
+void RedisAsyncClient::setEvents(uint32_t add, uint32_t remove) {
+    events = (events | add) & ~remove;
+    loop->watch(fd, events, [this](uint32_t ready) {
+        // 读取回复可能导致连接断开并被hiredis释放，每一步之后都要重新检查
+        if (context && (ready & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            redisAsyncHandleRead(context);
+        }
+        if (context && (ready & EPOLLOUT)) {
+            redisAsyncHandleWrite(context);
+        }
+    });
+}
+
+void RedisAsyncClient::addRead(void* privdata) {
+    static_cast<RedisAsyncClient*>(privdata)->setEvents(EPOLLIN, 0);
+}
+
+void RedisAsyncClient::delRead(void* privdata) {
+    static_cast<RedisAsyncClient*>(privdata)->setEvents(0, EPOLLIN);
+}
+
+void RedisAsyncClient::addWrite(void* privdata) {
+    static_cast<RedisAsyncClient*>(privdata)->setEvents(EPOLLOUT, 0);
+}
+
+void RedisAsyncClient::delWrite(void* privdata) {
+    static_cast<RedisAsyncClient*>(privdata)->setEvents(0, EPOLLOUT);
+}
+
+void RedisAsyncClient::cleanup(void* privdata) {
+    RedisAsyncClient* client = static_cast<RedisAsyncClient*>(privdata);
+    if (client->fd != -1) {
+        client->loop->unwatch(client->fd);
+        client->fd = -1;
+    }
+    client->events = 0;
+}
+
+void RedisAsyncClient::onConnect(const redisAsyncContext* context, int status) {
+    if (status != REDIS_OK) {
+        // 连接失败后hiredis会释放上下文，下一条命令重新连接
+        std::cerr << "异步Redis连接失败: " << context->errstr << std::endl;
+        static_cast<RedisAsyncClient*>(context->data)->context = nullptr;
+    }
+}
+
+void RedisAsyncClient::onDisconnect(const redisAsyncContext* context, int status) {
+    if (status != REDIS_OK) {
+        std::cerr << "异步Redis连接断开: " << context->errstr << std::endl;
+    }
+    static_cast<RedisAsyncClient*>(context->data)->context = nullptr;
+}
+
+void RedisAsyncClient::onReply(redisAsyncContext*, void* reply, void* privdata) {
+    PendingCommand* pending = static_cast<PendingCommand*>(privdata);
+    redisReply* r = static_cast<redisReply*>(reply);
+    TraceContext trace_context(pending->trace_id);
+    Metrics::recordBackendCall(pending->op, Metrics::nowNs() - pending->start_ns,
+                               r == nullptr || r->type == REDIS_REPLY_ERROR);
+    (*pending->in_flight)--;
+    pending->callback(r);
+    delete pending;
+}
+
+bool RedisAsyncClient::command(ReplyCallback callback, int argc, const char** argv, const size_t* argvlen) {
+    if (context == nullptr && !connect()) {
+        return false;
+    }
+
+    PendingCommand* pending = new PendingCommand{callback, Metrics::redisOp(argv[0]), Metrics::nowNs(), &in_flight,
+                                                 Trace::current()};
+    if (redisAsyncCommandArgv(context, onReply, pending, argc, argv, argvlen) != REDIS_OK) {
+        delete pending;
+        return false;
+    }
+    in_flight++;
+    return true;
+}
+
+bool RedisAsyncClient::command(ReplyCallback callback, const std::vector<std::string>& args) {
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.length());
+    }
+    return command(callback, (int)argv.size(), argv.data(), argvlen.data());
+}
+
+RedisAsyncClient* RedisAsyncClient::forCurrentLoop(const std::string& host, int port) {
+    static thread_local RedisAsyncClient* client = nullptr;
+
+    EventLoop* loop = EventLoop::current();
+    if (loop == nullptr) {
+        return nullptr;
+    }
+    if (client == nullptr) {
+        client = new RedisAsyncClient(loop, host, port);
+        loop->onClose([] {
+            delete client;
+            client = nullptr;
+        });
+    }
+    return client;
+}
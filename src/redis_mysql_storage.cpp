@@ -0,0 +1,1241 @@
+#include "../include/redis_mysql_storage.h"
+#include "../include/redis_async.h"
+#include "../include/metrics.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+
+// 带耗时统计的Redis命令
+redisReply* redisCommandTimed(redisContext* context, const char* format, ...) {
+    uint64_t start = Metrics::nowNs();
+    va_list ap;
+    va_start(ap, format);
+    redisReply* reply = (redisReply*)redisvCommand(context, format, ap);
+    va_end(ap);
+    Metrics::recordBackendCall(Metrics::redisOp(format), Metrics::nowNs() - start,
+                               reply == nullptr || reply->type == REDIS_REPLY_ERROR);
+    return reply;
+}
+
+redisReply* redisCommandArgvTimed(redisContext* context, int argc, const char** argv, const size_t* argvlen) {
+    uint64_t start = Metrics::nowNs();
+    redisReply* reply = (redisReply*)redisCommandArgv(context, argc, argv, argvlen);
+    Metrics::recordBackendCall(Metrics::redisOp(argv[0]), Metrics::nowNs() - start,
+                               reply == nullptr || reply->type == REDIS_REPLY_ERROR);
+    return reply;
+}
+
+// 带耗时统计的MySQL查询
+int mysqlQueryTimed(MYSQL* mysql, const char* query) {
+    uint64_t start = Metrics::nowNs();
+    int rc = mysql_query(mysql, query);
+    Metrics::recordBackendCall(Metrics::mysqlOp(query), Metrics::nowNs() - start, rc != 0);
+    return rc;
+}
+
+int mysqlRealQueryTimed(MYSQL* mysql, const char* query, unsigned long length) {
+    uint64_t start = Metrics::nowNs();
+    int rc = mysql_real_query(mysql, query, length);
+    Metrics::recordBackendCall(Metrics::mysqlOp(query), Metrics::nowNs() - start, rc != 0);
+    return rc;
+}
+
+// 对一组键执行同一个多键命令（MGET/DEL）
+static redisReply* multiKeyCommand(redisContext* context, const char* command, const std::vector<std::string>& keys) {
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(keys.size() + 1);
+    argvlen.reserve(keys.size() + 1);
+    argv.push_back(command);
+    argvlen.push_back(strlen(command));
+    for (const auto& key : keys) {
+        argv.push_back(key.c_str());
+        argvlen.push_back(key.length());
+    }
+    return redisCommandArgvTimed(context, (int)argv.size(), argv.data(), argvlen.data());
+}
+
+// 房间消息键
+static std::string roomMessageKey(int room_id, int seq) {
+    return "room:" + std::to_string(room_id) + ":message:" + std::to_string(seq);
+}
+
+// 解析"MGET message_count archived_seq"的回复
+static bool parseRoomCounters(redisReply* reply, int& count, int& archived_seq) {
+    count = 0;
+    archived_seq = 0;
+    bool ok = reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements == 2;
+    if (ok) {
+        if (reply->element[0]->type == REDIS_REPLY_STRING) {
+            count = std::stoi(reply->element[0]->str);
+        }
+        if (reply->element[1]->type == REDIS_REPLY_STRING) {
+            archived_seq = std::stoi(reply->element[1]->str);
+        }
+    }
+    return ok;
+}
+
+// 读取房间消息计数和归档水位，序号不大于归档水位的消息已迁移到MySQL
+static bool getRoomCounters(redisContext* context, int room_id, int& count, int& archived_seq) {
+    std::string prefix = "room:" + std::to_string(room_id);
+    redisReply* reply = redisCommandTimed(context, "MGET %s:message_count %s:archived_seq",
+                                          prefix.c_str(), prefix.c_str());
+    bool ok = parseRoomCounters(reply, count, archived_seq);
+    if (reply) {
+        freeReplyObject(reply);
+    }
+    return ok;
+}
+
+// 读取[first, last]区间消息的MGET参数：最前面附带归档水位键，与消息键在同一条命令中原子地读取。
+// 归档器先推进水位再删除消息键，因此MGET中为空、但序号不大于同时读到的水位的消息已迁到MySQL，
+// 应从MySQL补齐，而不是当作尚未写入的消息跳过，否则与归档并发的读取会出现空洞。
+static std::vector<std::string> pageKeys(int room_id, int first, int last) {
+    std::vector<std::string> keys;
+    keys.reserve(last - first + 2);
+    keys.push_back("room:" + std::to_string(room_id) + ":archived_seq");
+    for (int i = first; i <= last; ++i) {
+        keys.push_back(roomMessageKey(room_id, i));
+    }
+    return keys;
+}
+
+// pageKeys的MGET回复中的归档水位
+static int replyArchivedSeq(redisReply* reply) {
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements == 0 || reply->element[0]->type != REDIS_REPLY_STRING) {
+        return 0;
+    }
+    return std::atoi(reply->element[0]->str);
+}
+
+// 把pageKeys(room_id, first, last)的MGET回复中序号从from开始的消息追加到page
+static void appendPageMessages(redisReply* reply, int first, int from, int after_seq, MessagePage& page) {
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        return;
+    }
+    page.messages.reserve(page.messages.size() + reply->elements);
+    for (size_t i = 1 + (from - first); i < reply->elements; ++i) {
+        redisReply* element = reply->element[i];
+        int seq = first + (int)i - 1;
+        if (element == nullptr || element->type != REDIS_REPLY_STRING) {
+            // 计数已递增但消息尚未写入，增量拉取在此处停止，下次从这里继续
+            if (after_seq > 0) {
+                page.next_cursor = seq - 1;
+                break;
+            }
+            continue;
+        }
+
+        ChatMessage message;
+        if (decodeMessageRecord(std::string(element->str, element->len), message)) {
+            message.seq = seq;
+            page.messages.push_back(std::move(message));
+        }
+    }
+}
+
+RedisMysqlStorage::RedisMysqlStorage(const RedisMysqlConfig& config) : config(config) {
+}
+
+RedisMysqlStorage::~RedisMysqlStorage() {
+    close();
+}
+
+bool RedisMysqlStorage::connect(Connection& connection) {
+    // 连接Redis
+    connection.redis = redisConnect(config.redis_host.c_str(), config.redis_port);
+    if (connection.redis == nullptr || connection.redis->err) {
+        if (connection.redis) {
+            std::cerr << "Redis connection error: " << connection.redis->errstr << std::endl;
+        } else {
+            std::cerr << "Redis connection error: can't allocate redis context" << std::endl;
+        }
+        return false;
+    }
+
+    // 连接MySQL
+    connection.mysql = mysql_init(nullptr);
+    if (connection.mysql == nullptr) {
+        std::cerr << "MySQL init failed" << std::endl;
+        return false;
+    }
+
+    if (mysql_real_connect(connection.mysql, config.mysql_host.c_str(), config.mysql_user.c_str(),
+                           config.mysql_password.c_str(), config.mysql_db.c_str(), config.mysql_port,
+                           nullptr, 0) == nullptr) {
+        std::cerr << "MySQL connection error: " << mysql_error(connection.mysql) << std::endl;
+        return false;
+    }
+    mysql_set_character_set(connection.mysql, "utf8mb4");
+    return true;
+}
+
+bool RedisMysqlStorage::open() {
+    connections.resize(std::max(1, config.pool_size));
+    for (auto& connection : connections) {
+        if (!connect(connection)) {
+            close();
+            return false;
+        }
+        idle.push_back(&connection);
+    }
+
+    MYSQL* mysql = connections[0].mysql;
+
+    // 创建用户表（如果不存在）
+    const char* create_users_table =
+        "CREATE TABLE IF NOT EXISTS users ("
+        "id INT AUTO_INCREMENT PRIMARY KEY,"
+        "username VARCHAR(50) NOT NULL UNIQUE,"
+        "password VARCHAR(255) NOT NULL,"
+        "email VARCHAR(100),"
+        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
+        ")";
+
+    if (mysqlQueryTimed(mysql, create_users_table)) {
+        std::cerr << "Failed to create users table: " << mysql_error(mysql) << std::endl;
+        close();
+        return false;
+    }
+
+    // 创建房间表（如果不存在）
+    const char* create_rooms_table =
+        "CREATE TABLE IF NOT EXISTS rooms ("
+        "id INT AUTO_INCREMENT PRIMARY KEY,"
+        "name VARCHAR(100) NOT NULL,"
+        "description TEXT,"
+        "creator VARCHAR(50) NOT NULL,"
+        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
+        ")";
+
+    if (mysqlQueryTimed(mysql, create_rooms_table)) {
+        std::cerr << "创建房间表失败: " << mysql_error(mysql) << std::endl;
+        close();
+        return false;
+    }
+
+    // 预先加载房间ID，发送消息时只有其他实例新建的房间才需要查询MySQL
+    if (mysqlQueryTimed(mysql, "SELECT id FROM rooms") == 0) {
+        MYSQL_RES* result = mysql_store_result(mysql);
+        if (result != nullptr) {
+            std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+            MYSQL_ROW row;
+            while ((row = mysql_fetch_row(result))) {
+                known_rooms.insert(std::atoi(row[0]));
+            }
+            mysql_free_result(result);
+        }
+    }
+
+    blocking.start(config.pool_size);
+    return true;
+}
+
+void RedisMysqlStorage::close() {
+    blocking.stop();
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto& connection : connections) {
+        if (connection.redis) {
+            redisFree(connection.redis);
+        }
+        if (connection.mysql) {
+            mysql_close(connection.mysql);
+        }
+    }
+    connections.clear();
+    idle.clear();
+}
+
+RedisMysqlStorage::Connection* RedisMysqlStorage::acquire() {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    pool_cv.wait(lock, [this] { return !idle.empty(); });
+    Connection* connection = idle.back();
+    idle.pop_back();
+    return connection;
+}
+
+void RedisMysqlStorage::release(Connection* connection) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        idle.push_back(connection);
+    }
+    pool_cv.notify_one();
+}
+
+bool RedisMysqlStorage::createUser(const std::string& username, const std::string& password, const std::string& email) {
+    Lease lease(*this);
+
+    // 简单的密码加密（实际应用中应使用更安全的方式）
+    // 在这里就简单使用明文密码作为示例
+    std::string query = "INSERT INTO users (username, password, email) VALUES ('" +
+                        username + "', '" + password + "', '" + email + "')";
+
+    if (mysqlQueryTimed(lease.mysql(), query.c_str())) {
+        std::cerr << "User registration failed: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool RedisMysqlStorage::checkUserPassword(const std::string& username, const std::string& password) {
+    Lease lease(*this);
+
+    std::string query = "SELECT id FROM users WHERE username = '" + username + "' AND password = '" + password + "'";
+
+    if (mysqlQueryTimed(lease.mysql(), query.c_str())) {
+        std::cerr << "Login query failed: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    MYSQL_RES* result = mysql_store_result(lease.mysql());
+    if (result == nullptr) {
+        std::cerr << "No result from login query" << std::endl;
+        return false;
+    }
+
+    bool found = mysql_num_rows(result) > 0;
+    mysql_free_result(result);
+    return found;
+}
+
+bool RedisMysqlStorage::listUsernames(std::vector<std::string>& usernames) {
+    usernames.clear();
+    Lease lease(*this);
+
+    // 按注册顺序登记，早注册的用户编号较小
+    const char* query = "SELECT username FROM users ORDER BY id";
+    if (mysqlQueryTimed(lease.mysql(), query)) {
+        std::cerr << "获取用户列表失败: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    MYSQL_RES* result = mysql_store_result(lease.mysql());
+    if (result == nullptr) {
+        std::cerr << "无法获取用户结果集" << std::endl;
+        return false;
+    }
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        usernames.emplace_back(row[0], lengths[0]);
+    }
+
+    mysql_free_result(result);
+    return true;
+}
+
+bool RedisMysqlStorage::saveToken(const std::string& token, const std::string& username) {
+    Lease lease(*this);
+
+    // 在Redis中缓存令牌，不设置过期时间
+    std::string key = "token:" + token;
+    redisReply* reply = redisCommandTimed(lease.redis(), "SET %s %s", key.c_str(), username.c_str());
+    if (reply == nullptr) {
+        std::cerr << "Failed to set token in Redis" << std::endl;
+        return false;
+    }
+
+    freeReplyObject(reply);
+    return true;
+}
+
+bool RedisMysqlStorage::findToken(const std::string& token, std::string& username) {
+    Lease lease(*this);
+
+    std::string key = "token:" + token;
+    redisReply* reply = redisCommandTimed(lease.redis(), "GET %s", key.c_str());
+    if (reply == nullptr || reply->type != REDIS_REPLY_STRING) {
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return false;
+    }
+
+    username.assign(reply->str, reply->len);
+    freeReplyObject(reply);
+    return true;
+}
+
+bool RedisMysqlStorage::createRoom(const std::string& name, const std::string& description,
+                                   const std::string& creator, int& room_id) {
+    Lease lease(*this);
+
+    // 插入新房间
+    std::stringstream ss;
+    ss << "INSERT INTO rooms (name, description, creator) VALUES ('"
+       << name << "', '" << description << "', '" << creator << "')";
+
+    std::string query = ss.str();
+    std::cout << "执行SQL: " << query << std::endl;
+
+    if (mysqlQueryTimed(lease.mysql(), query.c_str())) {
+        std::cerr << "创建房间失败: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    // 获取新房间ID
+    room_id = mysql_insert_id(lease.mysql());
+
+    std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+    known_rooms.insert(room_id);
+    return true;
+}
+
+bool RedisMysqlStorage::getRoom(int room_id, ChatRoom& room) {
+    Lease lease(*this);
+
+    std::stringstream ss;
+    ss << "SELECT id, name, description, creator, created_at FROM rooms WHERE id = " << room_id;
+
+    if (mysqlQueryTimed(lease.mysql(), ss.str().c_str())) {
+        std::cerr << "查询房间失败: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    MYSQL_RES* result = mysql_store_result(lease.mysql());
+    if (result == nullptr) {
+        std::cerr << "无法获取房间信息" << std::endl;
+        return false;
+    }
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row == nullptr) {
+        mysql_free_result(result);
+        return false;
+    }
+
+    room.id = std::stoi(row[0]);
+    room.name = row[1];
+    room.description = row[2] ? row[2] : "";
+    room.creator_id = UserTable::intern(row[3]);
+    room.created_at = row[4] ? row[4] : "";
+    mysql_free_result(result);
+    return true;
+}
+
+bool RedisMysqlStorage::deleteRoom(int room_id) {
+    Lease lease(*this);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+        known_rooms.erase(room_id);
+    }
+
+    // 删除房间
+    std::stringstream delete_ss;
+    delete_ss << "DELETE FROM rooms WHERE id = " << room_id;
+
+    if (mysqlQueryTimed(lease.mysql(), delete_ss.str().c_str())) {
+        std::cerr << "删除房间失败: " << mysql_error(lease.mysql()) << std::endl;
+        return false;
+    }
+
+    // 删除房间消息：Redis中的消息键按批删除，已归档的消息从MySQL删除
+    int count = 0, archived_seq = 0;
+    getRoomCounters(lease.redis(), room_id, count, archived_seq);
+
+    const int delete_batch = 500;
+    for (int first = 1; first <= count; first += delete_batch) {
+        std::vector<std::string> keys;
+        for (int i = first; i <= std::min(count, first + delete_batch - 1); ++i) {
+            keys.push_back(roomMessageKey(room_id, i));
+        }
+        redisReply* reply = multiKeyCommand(lease.redis(), "DEL", keys);
+        if (reply) {
+            freeReplyObject(reply);
+        }
+    }
+
+    std::string prefix = "room:" + std::to_string(room_id);
+    redisReply* reply = redisCommandTimed(lease.redis(), "DEL %s:message_count %s:archived_seq",
+                                          prefix.c_str(), prefix.c_str());
+    if (reply) {
+        freeReplyObject(reply);
+    }
+
+    std::stringstream delete_messages_ss;
+    delete_messages_ss << "DELETE FROM messages WHERE room_id = " << room_id;
+    if (mysqlQueryTimed(lease.mysql(), delete_messages_ss.str().c_str())) {
+        // 归档功能未启用时messages表可能不存在
+        std::cerr << "删除归档消息失败: " << mysql_error(lease.mysql()) << std::endl;
+    }
+
+    return true;
+}
+
+std::vector<ChatRoom> RedisMysqlStorage::listRooms() {
+    std::vector<ChatRoom> rooms;
+    Lease lease(*this);
+
+    // 查询所有房间
+    const char* query = "SELECT id, name, description, creator, created_at FROM rooms ORDER BY created_at DESC";
+
+    if (mysqlQueryTimed(lease.mysql(), query)) {
+        std::cerr << "获取房间列表失败: " << mysql_error(lease.mysql()) << std::endl;
+        return rooms;
+    }
+
+    MYSQL_RES* result = mysql_store_result(lease.mysql());
+    if (result == nullptr) {
+        std::cerr << "无法获取房间结果集" << std::endl;
+        return rooms;
+    }
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        ChatRoom room;
+        room.id = std::stoi(row[0]);
+        room.name = row[1];
+        room.description = row[2] ? row[2] : "";
+        room.creator_id = UserTable::intern(row[3]);
+        room.created_at = row[4];
+
+        rooms.push_back(room);
+    }
+
+    mysql_free_result(result);
+    return rooms;
+}
+
+bool RedisMysqlStorage::isKnownRoom(int room_id) {
+    std::shared_lock<std::shared_mutex> lock(known_rooms_mutex);
+    return known_rooms.count(room_id) > 0;
+}
+
+bool RedisMysqlStorage::roomExists(MYSQL* mysql, int room_id) {
+    if (isKnownRoom(room_id)) {
+        return true;
+    }
+
+    std::stringstream check_ss;
+    check_ss << "SELECT id FROM rooms WHERE id = " << room_id;
+
+    if (mysqlQueryTimed(mysql, check_ss.str().c_str())) {
+        std::cerr << "查询房间失败: " << mysql_error(mysql) << std::endl;
+        return false;
+    }
+
+    MYSQL_RES* check_result = mysql_store_result(mysql);
+    if (check_result == nullptr || mysql_num_rows(check_result) == 0) {
+        if (check_result) mysql_free_result(check_result);
+        std::cerr << "房间不存在" << std::endl;
+        return false;
+    }
+
+    mysql_free_result(check_result);
+
+    std::unique_lock<std::shared_mutex> lock(known_rooms_mutex);
+    known_rooms.insert(room_id);
+    return true;
+}
+
+bool RedisMysqlStorage::appendRoomMessage(int room_id, ChatMessage& message) {
+    Lease lease(*this);
+
+    // 检查房间是否存在
+    if (!roomExists(lease.mysql(), room_id)) {
+        return false;
+    }
+
+    // 原子递增房间消息计数，得到本条消息的序号
+    std::string room_count_key = "room:" + std::to_string(room_id) + ":message_count";
+    redisReply* count_reply = redisCommandTimed(lease.redis(), "INCR %s", room_count_key.c_str());
+    if (count_reply == nullptr || count_reply->type != REDIS_REPLY_INTEGER) {
+        if (count_reply) {
+            freeReplyObject(count_reply);
+        }
+        std::cerr << "更新房间消息计数失败" << std::endl;
+        return false;
+    }
+    message.seq = (int)count_reply->integer;
+    freeReplyObject(count_reply);
+
+    // 保存消息
+    std::string message_data = encodeMessageRecord(message);
+    std::string room_message_key = roomMessageKey(room_id, message.seq);
+    redisReply* reply = redisCommandTimed(lease.redis(), "SET %s %b", room_message_key.c_str(),
+                                          message_data.data(), message_data.size());
+
+    if (reply == nullptr) {
+        std::cerr << "保存房间消息失败" << std::endl;
+        return false;
+    }
+
+    freeReplyObject(reply);
+    return true;
+}
+
+bool RedisMysqlStorage::readRoomMessages(int room_id, int before_seq, int after_seq, int limit, MessagePage& page) {
+    Lease lease(*this);
+
+    // 一次MGET获取当前房间消息计数（即最新消息序号）和归档水位
+    int count = 0, archived_seq = 0;
+    getRoomCounters(lease.redis(), room_id, count, archived_seq);
+
+    // 根据游标计算本页的序号区间[first, last]，只访问本页涉及的键
+    int first, last;
+    if (!planMessagePage(count, before_seq, after_seq, limit, page, first, last)) {
+        return true;
+    }
+
+    // 已归档的部分从MySQL读取
+    if (first <= archived_seq) {
+        int archived_last = std::min(last, archived_seq);
+        if (!getArchivedMessages(lease.mysql(), room_id, first, archived_last, page.messages)) {
+            return false;
+        }
+        if (archived_last == last) {
+            return true;
+        }
+        first = archived_last + 1;
+    }
+
+    // 其余部分使用一次MGET从Redis获取，同时重新读取归档水位
+    redisReply* reply = multiKeyCommand(lease.redis(), "MGET", pageKeys(room_id, first, last));
+    if (reply == nullptr) {
+        std::cerr << "获取房间消息失败" << std::endl;
+        return false;
+    }
+
+    // 读取计数之后归档器迁走的消息从MySQL补齐
+    int from = first;
+    int fresh_archived = replyArchivedSeq(reply);
+    if (fresh_archived >= first) {
+        int archived_last = std::min(last, fresh_archived);
+        if (!getArchivedMessages(lease.mysql(), room_id, first, archived_last, page.messages)) {
+            freeReplyObject(reply);
+            return false;
+        }
+        from = archived_last + 1;
+    }
+
+    appendPageMessages(reply, first, from, after_seq, page);
+    freeReplyObject(reply);
+    return true;
+}
+
+// 从MySQL读取已归档的房间消息，按主键(room_id, seq)范围查询
+bool RedisMysqlStorage::getArchivedMessages(MYSQL* mysql, int room_id, int first, int last,
+                                            std::vector<ChatMessage>& messages) {
+    std::stringstream ss;
+    ss << "SELECT seq, username, content, DATE_FORMAT(created_at, '%Y-%m-%d %H:%i:%s'), attachments FROM messages "
+       << "WHERE room_id = " << room_id << " AND seq BETWEEN " << first << " AND " << last
+       << " ORDER BY seq";
+    return queryArchivedMessages(mysql, ss.str(), messages);
+}
+
+// 按主键(room_id, seq)点查询一组已归档的消息
+bool RedisMysqlStorage::getArchivedMessages(MYSQL* mysql, int room_id, const std::vector<int>& seqs,
+                                            std::vector<ChatMessage>& messages) {
+    if (seqs.empty()) {
+        return true;
+    }
+    std::stringstream ss;
+    ss << "SELECT seq, username, content, DATE_FORMAT(created_at, '%Y-%m-%d %H:%i:%s'), attachments FROM messages "
+       << "WHERE room_id = " << room_id << " AND seq IN (";
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        ss << (i > 0 ? "," : "") << seqs[i];
+    }
+    ss << ") ORDER BY seq";
+    return queryArchivedMessages(mysql, ss.str(), messages);
+}
+
+bool RedisMysqlStorage::queryArchivedMessages(MYSQL* mysql, const std::string& query,
+                                              std::vector<ChatMessage>& messages) {
+    if (mysqlQueryTimed(mysql, query.c_str())) {
+        std::cerr << "查询归档消息失败: " << mysql_error(mysql) << std::endl;
+        return false;
+    }
+
+    MYSQL_RES* result = mysql_store_result(mysql);
+    if (result == nullptr) {
+        std::cerr << "无法获取归档消息结果集" << std::endl;
+        return false;
+    }
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        ChatMessage message;
+        message.seq = std::stoi(row[0]);
+        message.user_id = UserTable::intern(std::string(row[1], lengths[1]));
+        message.content.assign(row[2], lengths[2]);
+        message.timestamp.assign(row[3], lengths[3]);
+        message.attachments = splitAttachmentIds(std::string(row[4], lengths[4]));
+        messages.push_back(std::move(message));
+    }
+
+    mysql_free_result(result);
+    return true;
+}
+
+// 搜索结果的消息内容：一次MGET取得计数和归档水位，已归档的部分一次IN查询，其余一次MGET
+bool RedisMysqlStorage::readRoomMessagesBySeq(int room_id, const std::vector<int>& seqs,
+                                              std::vector<ChatMessage>& messages) {
+    if (seqs.empty()) {
+        return true;
+    }
+    Lease lease(*this);
+
+    int count = 0, archived_seq = 0;
+    if (!getRoomCounters(lease.redis(), room_id, count, archived_seq)) {
+        return false;
+    }
+
+    std::vector<int> archived;
+    std::vector<int> live;
+    for (int seq : seqs) {
+        if (seq <= archived_seq) {
+            archived.push_back(seq);
+        } else if (seq <= count) {
+            live.push_back(seq);
+        }
+    }
+
+    if (!getArchivedMessages(lease.mysql(), room_id, archived, messages)) {
+        return false;
+    }
+    if (live.empty()) {
+        return true;
+    }
+
+    // 与消息键一起重新读取归档水位，期间被归档器迁走的消息从MySQL补齐，见pageKeys
+    std::vector<std::string> keys;
+    keys.reserve(live.size() + 1);
+    keys.push_back("room:" + std::to_string(room_id) + ":archived_seq");
+    for (int seq : live) {
+        keys.push_back(roomMessageKey(room_id, seq));
+    }
+    redisReply* reply = multiKeyCommand(lease.redis(), "MGET", keys);
+    if (reply == nullptr) {
+        std::cerr << "获取房间消息失败" << std::endl;
+        return false;
+    }
+    int fresh_archived = replyArchivedSeq(reply);
+    std::vector<int> moved;
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        for (size_t i = 1; i < reply->elements && i <= live.size(); ++i) {
+            redisReply* element = reply->element[i];
+            ChatMessage message;
+            if (element != nullptr && element->type == REDIS_REPLY_STRING &&
+                decodeMessageRecord(std::string(element->str, element->len), message)) {
+                message.seq = live[i - 1];
+                messages.push_back(std::move(message));
+            } else if (live[i - 1] <= fresh_archived) {
+                moved.push_back(live[i - 1]);
+            }
+        }
+    }
+    freeReplyObject(reply);
+
+    if (!moved.empty()) {
+        if (!getArchivedMessages(lease.mysql(), room_id, moved, messages)) {
+            return false;
+        }
+        std::sort(messages.begin(), messages.end(),
+                  [](const ChatMessage& a, const ChatMessage& b) { return a.seq < b.seq; });
+    }
+    return true;
+}
+
+// 先读取MySQL中的归档部分，再按批读取Redis中的部分
+bool RedisMysqlStorage::scanRoomMessages(int room_id, const std::function<void(const ChatMessage&)>& visit) {
+    Lease lease(*this);
+
+    int count = 0, archived_seq = 0;
+    if (!getRoomCounters(lease.redis(), room_id, count, archived_seq)) {
+        return false;
+    }
+
+    const int batch = 2000;
+
+    // 归档部分，按主键分批读取
+    for (int first = 1; first <= archived_seq; first += batch) {
+        std::vector<ChatMessage> messages;
+        if (!getArchivedMessages(lease.mysql(), room_id, first, std::min(archived_seq, first + batch - 1), messages)) {
+            return false;
+        }
+        for (const auto& message : messages) {
+            visit(message);
+        }
+    }
+
+    // Redis部分，每批重新读取归档水位，期间被归档器迁走的消息从MySQL补齐，见pageKeys
+    for (int first = archived_seq + 1; first <= count; first += batch) {
+        int last = std::min(count, first + batch - 1);
+        redisReply* reply = multiKeyCommand(lease.redis(), "MGET", pageKeys(room_id, first, last));
+        if (reply == nullptr) {
+            return false;
+        }
+
+        MessagePage page;
+        int from = first;
+        int fresh_archived = replyArchivedSeq(reply);
+        if (fresh_archived >= first) {
+            int archived_last = std::min(last, fresh_archived);
+            if (!getArchivedMessages(lease.mysql(), room_id, first, archived_last, page.messages)) {
+                freeReplyObject(reply);
+                return false;
+            }
+            from = archived_last + 1;
+        }
+        appendPageMessages(reply, first, from, 0, page);
+        freeReplyObject(reply);
+
+        for (const auto& message : page.messages) {
+            visit(message);
+        }
+    }
+
+    return true;
+}
+
+bool RedisMysqlStorage::loadReadCursors(const std::string& username, std::unordered_map<int, int>& cursors) {
+    Lease lease(*this);
+
+    std::string key = "user:" + username + ":read_cursors";
+    redisReply* reply = redisCommandTimed(lease.redis(), "HGETALL %s", key.c_str());
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) {
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return false;
+    }
+
+    // 回复为 字段1 值1 字段2 值2 ...
+    for (size_t i = 0; i + 1 < reply->elements; i += 2) {
+        cursors[std::atoi(reply->element[i]->str)] = std::atoi(reply->element[i + 1]->str);
+    }
+    freeReplyObject(reply);
+    return true;
+}
+
+// 批量保存已读位置的Lua脚本，只在新位置更大时写入，多个实例并发保存时不会后退
+// ARGV: 依次为 用户名, 房间ID, 序号
+static const char* kSaveReadCursorsScript =
+    "for i = 1, #ARGV, 3 do\n"
+    "  local key = 'user:' .. ARGV[i] .. ':read_cursors'\n"
+    "  local current = tonumber(redis.call('HGET', key, ARGV[i + 1]) or '0')\n"
+    "  if tonumber(ARGV[i + 2]) > current then\n"
+    "    redis.call('HSET', key, ARGV[i + 1], ARGV[i + 2])\n"
+    "  end\n"
+    "end\n"
+    "return #ARGV / 3\n";
+
+bool RedisMysqlStorage::saveReadCursors(const std::vector<ReadCursor>& cursors) {
+    if (cursors.empty()) {
+        return true;
+    }
+
+    std::vector<std::string> args;
+    args.reserve(3 + cursors.size() * 3);
+    args.push_back("EVAL");
+    args.push_back(kSaveReadCursorsScript);
+    args.push_back("0");
+    for (const auto& cursor : cursors) {
+        args.push_back(cursor.username);
+        args.push_back(std::to_string(cursor.room_id));
+        args.push_back(std::to_string(cursor.seq));
+    }
+
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.length());
+    }
+
+    Lease lease(*this);
+    redisReply* reply = redisCommandArgvTimed(lease.redis(), (int)argv.size(), argv.data(), argvlen.data());
+    bool ok = reply != nullptr && reply->type == REDIS_REPLY_INTEGER;
+    if (!ok) {
+        std::cerr << "保存已读位置失败" << (reply && reply->type == REDIS_REPLY_ERROR ? std::string(": ") + reply->str : "")
+                  << std::endl;
+    }
+    if (reply) {
+        freeReplyObject(reply);
+    }
+    return ok;
+}
+
+bool RedisMysqlStorage::getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) {
+    heads.assign(room_ids.size(), 0);
+    if (room_ids.empty()) {
+        return true;
+    }
+
+    std::vector<std::string> keys;
+    keys.reserve(room_ids.size());
+    for (int room_id : room_ids) {
+        keys.push_back("room:" + std::to_string(room_id) + ":message_count");
+    }
+
+    Lease lease(*this);
+    redisReply* reply = multiKeyCommand(lease.redis(), "MGET", keys);
+    bool ok = reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements == room_ids.size();
+    if (ok) {
+        for (size_t i = 0; i < reply->elements; ++i) {
+            if (reply->element[i]->type == REDIS_REPLY_STRING) {
+                heads[i] = std::atoi(reply->element[i]->str);
+            }
+        }
+    }
+    if (reply) {
+        freeReplyObject(reply);
+    }
+    return ok;
+}
+
+bool RedisMysqlStorage::appendLobbyMessage(const ChatMessage& message) {
+    Lease lease(*this);
+
+    // 原子递增消息计数
+    redisReply* count_reply = redisCommandTimed(lease.redis(), "INCR chat_message_count");
+    if (count_reply == nullptr || count_reply->type != REDIS_REPLY_INTEGER) {
+        if (count_reply) {
+            freeReplyObject(count_reply);
+        }
+        std::cerr << "Failed to update message count" << std::endl;
+        return false;
+    }
+    long long count = count_reply->integer;
+    freeReplyObject(count_reply);
+
+    // 保存消息
+    std::string message_data = encodeMessageRecord(message);
+    std::string message_key = "chat_message:" + std::to_string(count);
+    redisReply* reply = redisCommandTimed(lease.redis(), "SET %s %b", message_key.c_str(),
+                                          message_data.data(), message_data.size());
+
+    if (reply == nullptr) {
+        std::cerr << "Failed to save message" << std::endl;
+        return false;
+    }
+
+    freeReplyObject(reply);
+    return true;
+}
+
+std::vector<ChatMessage> RedisMysqlStorage::readLobbyMessages(int limit) {
+    std::vector<ChatMessage> messages;
+    Lease lease(*this);
+
+    // 从Redis中获取消息计数
+    redisReply* count_reply = redisCommandTimed(lease.redis(), "GET chat_message_count");
+    int total_messages = 0;
+    if (count_reply != nullptr && count_reply->type == REDIS_REPLY_STRING) {
+        total_messages = std::stoi(count_reply->str);
+        freeReplyObject(count_reply);
+    } else {
+        if (count_reply) {
+            freeReplyObject(count_reply);
+        }
+        return messages;
+    }
+
+    // 计算开始索引，确保不超出范围
+    int start = std::max(1, total_messages - limit + 1);
+    int end = total_messages;
+    if (start > end) {
+        return messages;
+    }
+
+    std::vector<std::string> keys;
+    for (int i = start; i <= end; ++i) {
+        keys.push_back("chat_message:" + std::to_string(i));
+    }
+
+    redisReply* reply = multiKeyCommand(lease.redis(), "MGET", keys);
+    if (reply == nullptr) {
+        return messages;
+    }
+
+    // 逆序返回消息，以便最新的消息在前面
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        for (size_t i = reply->elements; i-- > 0;) {
+            redisReply* element = reply->element[i];
+            ChatMessage msg;
+            if (element->type == REDIS_REPLY_STRING &&
+                decodeMessageRecord(std::string(element->str, element->len), msg)) {
+                msg.seq = start + (int)i;
+                messages.push_back(msg);
+            }
+        }
+    }
+
+    freeReplyObject(reply);
+    return messages;
+}
+
+void RedisMysqlStorage::findTokenAsync(const std::string& token, TokenCallback done) {
+    RedisAsyncClient* client = RedisAsyncClient::forCurrentLoop(config.redis_host, config.redis_port);
+    bool sent = client && client->command([done](redisReply* reply) {
+        if (reply == nullptr || reply->type != REDIS_REPLY_STRING) {
+            done(false, std::string());
+            return;
+        }
+        done(true, std::string(reply->str, reply->len));
+    }, {"GET", "token:" + token});
+
+    // 不在事件循环线程上或异步连接不可用时退回同步实现
+    if (!sent) {
+        Storage::findTokenAsync(token, done);
+    }
+}
+
+void RedisMysqlStorage::getRoomHeadsAsync(const std::vector<int>& room_ids, HeadsCallback done) {
+    RedisAsyncClient* client = RedisAsyncClient::forCurrentLoop(config.redis_host, config.redis_port);
+    if (client == nullptr || room_ids.empty()) {
+        Storage::getRoomHeadsAsync(room_ids, done);
+        return;
+    }
+
+    std::vector<std::string> args;
+    args.reserve(room_ids.size() + 1);
+    args.push_back("MGET");
+    for (int room_id : room_ids) {
+        args.push_back("room:" + std::to_string(room_id) + ":message_count");
+    }
+    size_t count = room_ids.size();
+    bool sent = client->command([count, done](redisReply* reply) {
+        std::vector<int> heads(count, 0);
+        if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements != count) {
+            done(false, heads);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (reply->element[i]->type == REDIS_REPLY_STRING) {
+                heads[i] = std::atoi(reply->element[i]->str);
+            }
+        }
+        done(true, heads);
+    }, args);
+
+    if (!sent) {
+        Storage::getRoomHeadsAsync(room_ids, done);
+    }
+}
+
+void RedisMysqlStorage::appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done) {
+    std::vector<RoomAppend> batch(1);
+    batch[0].room_id = room_id;
+    batch[0].message = message;
+    batch[0].done = done;
+    appendRoomMessagesAsync(std::move(batch));
+}
+
+void RedisMysqlStorage::readRoomMessagesAsync(int room_id, int before_seq, int after_seq, int limit,
+                                              PageCallback done) {
+    RedisAsyncClient* client = RedisAsyncClient::forCurrentLoop(config.redis_host, config.redis_port);
+    if (client == nullptr) {
+        Storage::readRoomMessagesAsync(room_id, before_seq, after_seq, limit, done);
+        return;
+    }
+
+    std::string prefix = "room:" + std::to_string(room_id);
+    bool sent = client->command([this, client, room_id, before_seq, after_seq, limit, done](redisReply* reply) {
+        MessagePage page;
+        int count = 0, archived_seq = 0;
+        parseRoomCounters(reply, count, archived_seq);
+
+        int first, last;
+        if (!planMessagePage(count, before_seq, after_seq, limit, page, first, last)) {
+            done(true, page);
+            return;
+        }
+
+        // 翻到已归档的消息较少见，这部分在后台线程上从MySQL读取
+        if (first <= archived_seq) {
+            std::shared_ptr<MessagePage> archived_page = std::make_shared<MessagePage>();
+            std::shared_ptr<bool> ok = std::make_shared<bool>(false);
+            blocking.execute([this, room_id, before_seq, after_seq, limit, archived_page, ok] {
+                *ok = readRoomMessages(room_id, before_seq, after_seq, limit, *archived_page);
+            }, [done, archived_page, ok] {
+                done(*ok, *archived_page);
+            });
+            return;
+        }
+
+        std::vector<std::string> args = pageKeys(room_id, first, last);
+        args.insert(args.begin(), "MGET");
+
+        std::shared_ptr<MessagePage> result = std::make_shared<MessagePage>(std::move(page));
+        bool mget_sent = client->command([this, room_id, result, first, last, after_seq, done](redisReply* reply) {
+            if (reply == nullptr) {
+                std::cerr << "获取房间消息失败" << std::endl;
+                done(false, *result);
+                return;
+            }
+            int fresh_archived = replyArchivedSeq(reply);
+            if (fresh_archived < first) {
+                appendPageMessages(reply, first, first, after_seq, *result);
+                done(true, *result);
+                return;
+            }
+
+            // 读取计数之后归档器迁走了本页开头的消息，这部分在后台线程上从MySQL补齐
+            int archived_last = std::min(last, fresh_archived);
+            appendPageMessages(reply, first, archived_last + 1, after_seq, *result);
+            std::shared_ptr<std::vector<ChatMessage>> archived = std::make_shared<std::vector<ChatMessage>>();
+            std::shared_ptr<bool> ok = std::make_shared<bool>(false);
+            blocking.execute([this, room_id, first, archived_last, archived, ok] {
+                Lease lease(*this);
+                *ok = getArchivedMessages(lease.mysql(), room_id, first, archived_last, *archived);
+            }, [result, archived, ok, done] {
+                result->messages.insert(result->messages.begin(), archived->begin(), archived->end());
+                done(*ok, *result);
+            });
+        }, args);
+        if (!mget_sent) {
+            done(false, *result);
+        }
+    }, {"MGET", prefix + ":message_count", prefix + ":archived_seq"});
+
+    if (!sent) {
+        Storage::readRoomMessagesAsync(room_id, before_seq, after_seq, limit, done);
+    }
+}
+
+// 批量写入房间消息的Lua脚本，整批消息在Redis中原子地分配序号并写入，只需一次往返
+// ARGV: 房间数, 然后每个房间依次为 room_id, 消息条数, 各条消息记录
+// 返回每个房间本批第一条消息的序号
+static const char* kAppendBatchScript =
+    "local pos = 2\n"
+    "local result = {}\n"
+    "for r = 1, tonumber(ARGV[1]) do\n"
+    "  local room = ARGV[pos]\n"
+    "  local count = tonumber(ARGV[pos + 1])\n"
+    "  pos = pos + 2\n"
+    "  local first = redis.call('INCRBY', 'room:' .. room .. ':message_count', count) - count + 1\n"
+    "  for i = 0, count - 1 do\n"
+    "    redis.call('SET', 'room:' .. room .. ':message:' .. (first + i), ARGV[pos + i])\n"
+    "  end\n"
+    "  pos = pos + count\n"
+    "  result[r] = first\n"
+    "end\n"
+    "return result\n";
+
+void RedisMysqlStorage::appendRoomMessagesAsync(std::vector<RoomAppend> batch) {
+    if (batch.empty()) {
+        return;
+    }
+    RedisAsyncClient* client = RedisAsyncClient::forCurrentLoop(config.redis_host, config.redis_port);
+    if (client == nullptr) {
+        for (auto& append : batch) {
+            Storage::appendRoomMessageAsync(append.room_id, append.message, append.done);
+        }
+        return;
+    }
+
+    std::vector<int> unknown;
+    for (const auto& append : batch) {
+        if (!isKnownRoom(append.room_id) &&
+            std::find(unknown.begin(), unknown.end(), append.room_id) == unknown.end()) {
+            unknown.push_back(append.room_id);
+        }
+    }
+    if (unknown.empty()) {
+        appendKnownRoomMessages(std::move(batch));
+        return;
+    }
+
+    // 缓存中没有的房间在后台线程上查询MySQL，每个房间只查询一次；不存在的房间的消息直接失败
+    std::shared_ptr<std::vector<RoomAppend>> pending = std::make_shared<std::vector<RoomAppend>>(std::move(batch));
+    std::shared_ptr<std::unordered_set<int>> missing = std::make_shared<std::unordered_set<int>>();
+    blocking.execute([this, unknown, missing] {
+        Lease lease(*this);
+        for (int room_id : unknown) {
+            if (!roomExists(lease.mysql(), room_id)) {
+                missing->insert(room_id);
+            }
+        }
+    }, [this, pending, missing] {
+        std::vector<RoomAppend> known;
+        for (auto& append : *pending) {
+            if (missing->count(append.room_id) > 0) {
+                append.done(false, append.message);
+            } else {
+                known.push_back(std::move(append));
+            }
+        }
+        if (!known.empty()) {
+            appendKnownRoomMessages(std::move(known));
+        }
+    });
+}
+
+void RedisMysqlStorage::appendKnownRoomMessages(std::vector<RoomAppend> batch) {
+    RedisAsyncClient* client = RedisAsyncClient::forCurrentLoop(config.redis_host, config.redis_port);
+    if (client == nullptr) {
+        for (auto& append : batch) {
+            Storage::appendRoomMessageAsync(append.room_id, append.message, append.done);
+        }
+        return;
+    }
+
+    // 按房间分组，组内保持到达顺序
+    std::vector<int> room_ids;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        int room_id = batch[i].room_id;
+        auto it = std::find(room_ids.begin(), room_ids.end(), room_id);
+        if (it == room_ids.end()) {
+            room_ids.push_back(room_id);
+            groups.push_back(std::vector<size_t>());
+            it = room_ids.end() - 1;
+        }
+        groups[it - room_ids.begin()].push_back(i);
+    }
+    std::vector<std::string> args;
+    args.reserve(4 + room_ids.size() * 2 + batch.size());
+    args.push_back("EVAL");
+    args.push_back(kAppendBatchScript);
+    args.push_back("0");
+    args.push_back(std::to_string(room_ids.size()));
+    for (size_t g = 0; g < room_ids.size(); ++g) {
+        args.push_back(std::to_string(room_ids[g]));
+        args.push_back(std::to_string(groups[g].size()));
+        for (size_t index : groups[g]) {
+            args.push_back(encodeMessageRecord(batch[index].message));
+        }
+    }
+
+    std::shared_ptr<std::vector<RoomAppend>> entries = std::make_shared<std::vector<RoomAppend>>(std::move(batch));
+    bool sent = client->command([entries, groups](redisReply* reply) {
+        bool ok = reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements == groups.size();
+        if (!ok) {
+            std::cerr << "批量保存房间消息失败" << (reply && reply->type == REDIS_REPLY_ERROR ? std::string(": ") + reply->str : "")
+                      << std::endl;
+        }
+        for (size_t g = 0; g < groups.size(); ++g) {
+            long long first = ok ? reply->element[g]->integer : 0;
+            for (size_t k = 0; k < groups[g].size(); ++k) {
+                RoomAppend& append = (*entries)[groups[g][k]];
+                if (ok) {
+                    append.message.seq = (int)(first + k);
+                }
+                append.done(ok, append.message);
+            }
+        }
+    }, args);
+
+    if (!sent) {
+        // 异步连接不可用，逐条同步写入
+        for (const auto& group : groups) {
+            for (size_t index : group) {
+                RoomAppend& append = (*entries)[index];
+                Storage::appendRoomMessageAsync(append.room_id, append.message, append.done);
+            }
+        }
+    }
+}
@@ -0,0 +1,343 @@
+#include "../include/redis_pubsub.h"
+#include "../include/metrics.h"
+#include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// 待发布消息的上限，Redis不可用时超出部分直接丢弃（等待者超时后会重新读取存储）
+static const size_t kMaxOutbox = 10000;
+
+// 房间频道名
+static std::string roomChannel(int room_id) {
+    return "room:" + std::to_string(room_id) + ":live";
+}
+
+RedisPubSub::RedisPubSub(const std::string& host, int port)
+    : host(host), port(port), wanted_changed(false), subscriber(nullptr), publisher(nullptr),
+      running(false), wake_fd(-1) {
+    // 随机生成本实例的标识
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dis(0, 15);
+    const char* hex = "0123456789abcdef";
+    for (int i = 0; i < 16; ++i) {
+        origin += hex[dis(gen)];
+    }
+}
+
+RedisPubSub::~RedisPubSub() {
+    stop();
+}
+
+bool RedisPubSub::start(MessageCallback on_message) {
+    callback = on_message;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        std::cerr << "创建eventfd失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // 启动时Redis不可用也继续运行，后台线程会不断重连
+    if (!connectSubscriber()) {
+        std::cerr << "Redis订阅连接失败，稍后重试" << std::endl;
+    }
+
+    running = true;
+    worker = std::thread(&RedisPubSub::run, this);
+    std::cout << "Redis消息推送已启动，实例标识: " << origin << std::endl;
+    return true;
+}
+
+void RedisPubSub::stop() {
+    if (running.exchange(false)) {
+        wake();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    if (subscriber) {
+        redisFree(subscriber);
+        subscriber = nullptr;
+    }
+    if (publisher) {
+        redisFree(publisher);
+        publisher = nullptr;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+void RedisPubSub::publish(int room_id, const ChatMessage& message) {
+    std::string payload = origin + ":" + std::to_string(message.seq) + ":" + encodeMessageRecord(message);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (outbox.size() >= kMaxOutbox) {
+            return;
+        }
+        outbox.emplace_back(room_id, std::move(payload));
+    }
+    wake();
+}
+
+void RedisPubSub::subscribe(int room_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!wanted.insert(room_id).second) {
+            return;
+        }
+        wanted_changed = true;
+    }
+    wake();
+}
+
+void RedisPubSub::unsubscribe(int room_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (wanted.erase(room_id) == 0) {
+            return;
+        }
+        wanted_changed = true;
+    }
+    wake();
+}
+
+void RedisPubSub::wake() {
+    uint64_t one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cerr << "唤醒Redis推送线程失败: " << strerror(errno) << std::endl;
+    }
+}
+
+bool RedisPubSub::connectSubscriber() {
+    struct timeval timeout = {1, 0};
+    subscriber = redisConnectWithTimeout(host.c_str(), port, timeout);
+    if (subscriber == nullptr || subscriber->err) {
+        if (subscriber) {
+            redisFree(subscriber);
+            subscriber = nullptr;
+        }
+        return false;
+    }
+
+    // 新连接上没有任何订阅，下一轮全部重新订阅
+    subscribed.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    wanted_changed = true;
+    return true;
+}
+
+void RedisPubSub::run() {
+    bool reported = false;
+    while (running) {
+        if (subscriber == nullptr && !connectSubscriber()) {
+            if (!reported) {
+                std::cerr << "Redis订阅连接断开，正在重连" << std::endl;
+                reported = true;
+            }
+        } else {
+            reported = false;
+        }
+
+        if (subscriber) {
+            syncSubscriptions();
+        }
+        flushOutbox();
+
+        struct pollfd fds[2];
+        fds[0].fd = wake_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        int count = 1;
+        if (subscriber) {
+            fds[1].fd = subscriber->fd;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            count = 2;
+        }
+
+        int ready = poll(fds, count, 1000);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                std::cerr << "Redis推送线程poll失败: " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            while (read(wake_fd, &value, sizeof(value)) > 0) {
+            }
+        }
+        if (count == 2 && (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) && !readSubscriber()) {
+            redisFree(subscriber);
+            subscriber = nullptr;
+        }
+    }
+}
+
+void RedisPubSub::syncSubscriptions() {
+    std::unordered_set<int> target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!wanted_changed) {
+            return;
+        }
+        target = wanted;
+        wanted_changed = false;
+    }
+
+    // 只发送新增和移除的频道
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    for (int room_id : target) {
+        if (subscribed.count(room_id) == 0) {
+            added.push_back(roomChannel(room_id));
+        }
+    }
+    for (int room_id : subscribed) {
+        if (target.count(room_id) == 0) {
+            removed.push_back(roomChannel(room_id));
+        }
+    }
+
+    // 空的UNSUBSCRIBE会退订全部频道，只在有变化时发送
+    const char* commands[2] = {"SUBSCRIBE", "UNSUBSCRIBE"};
+    std::vector<std::string>* channels[2] = {&added, &removed};
+    for (int i = 0; i < 2; ++i) {
+        if (channels[i]->empty()) {
+            continue;
+        }
+        std::vector<const char*> argv;
+        std::vector<size_t> argvlen;
+        argv.push_back(commands[i]);
+        argvlen.push_back(strlen(commands[i]));
+        for (const auto& channel : *channels[i]) {
+            argv.push_back(channel.c_str());
+            argvlen.push_back(channel.length());
+        }
+        redisAppendCommandArgv(subscriber, (int)argv.size(), argv.data(), argvlen.data());
+    }
+
+    // 订阅连接上的回复由readSubscriber异步读取，这里只负责写出
+    int done = 0;
+    while (!done) {
+        if (redisBufferWrite(subscriber, &done) != REDIS_OK) {
+            std::cerr << "Redis订阅失败: " << subscriber->errstr << std::endl;
+            redisFree(subscriber);
+            subscriber = nullptr;
+            return;
+        }
+    }
+    subscribed.swap(target);
+}
+
+bool RedisPubSub::readSubscriber() {
+    if (redisBufferRead(subscriber) != REDIS_OK) {
+        std::cerr << "Redis订阅连接读取失败: " << subscriber->errstr << std::endl;
+        return false;
+    }
+
+    // 一次读取可能包含多条完整的推送
+    while (true) {
+        void* reply = nullptr;
+        if (redisGetReplyFromReader(subscriber, &reply) != REDIS_OK) {
+            std::cerr << "Redis订阅回复解析失败: " << subscriber->errstr << std::endl;
+            return false;
+        }
+        if (reply == nullptr) {
+            return true;
+        }
+        handleReply(static_cast<redisReply*>(reply));
+        freeReplyObject(reply);
+    }
+}
+
+void RedisPubSub::handleReply(redisReply* reply) {
+    // 推送格式: ["message", 频道, 内容]，订阅/退订的确认忽略
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 3 ||
+        reply->element[0]->type != REDIS_REPLY_STRING || strcmp(reply->element[0]->str, "message") != 0 ||
+        reply->element[1]->type != REDIS_REPLY_STRING || reply->element[2]->type != REDIS_REPLY_STRING) {
+        return;
+    }
+
+    const char* channel = reply->element[1]->str;
+    if (strncmp(channel, "room:", 5) != 0) {
+        return;
+    }
+    int room_id = std::atoi(channel + 5);
+
+    // 内容格式: 实例标识:序号:消息记录
+    std::string payload(reply->element[2]->str, reply->element[2]->len);
+    size_t origin_end = payload.find(':');
+    if (origin_end == std::string::npos || payload.compare(0, origin_end, origin) == 0) {
+        return;
+    }
+    size_t seq_end = payload.find(':', origin_end + 1);
+    if (seq_end == std::string::npos) {
+        return;
+    }
+
+    ChatMessage message;
+    if (!decodeMessageRecord(payload.substr(seq_end + 1), message)) {
+        return;
+    }
+    message.seq = std::atoi(payload.c_str() + origin_end + 1);
+    if (room_id > 0 && message.seq > 0) {
+        callback(room_id, message);
+    }
+}
+
+void RedisPubSub::flushOutbox() {
+    std::vector<std::pair<int, std::string>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(outbox);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    if (publisher == nullptr) {
+        struct timeval timeout = {1, 0};
+        publisher = redisConnectWithTimeout(host.c_str(), port, timeout);
+        if (publisher == nullptr || publisher->err) {
+            if (publisher) {
+                redisFree(publisher);
+                publisher = nullptr;
+            }
+            return;
+        }
+        redisSetTimeout(publisher, timeout);
+    }
+
+    // 整批PUBLISH一次写出，再依次读取回复
+    uint64_t start = Metrics::nowNs();
+    for (const auto& item : batch) {
+        std::string channel = roomChannel(item.first);
+        redisAppendCommand(publisher, "PUBLISH %b %b", channel.data(), channel.length(),
+                           item.second.data(), item.second.length());
+    }
+    bool failed = false;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        void* reply = nullptr;
+        if (redisGetReply(publisher, &reply) != REDIS_OK) {
+            failed = true;
+            break;
+        }
+        freeReplyObject(reply);
+    }
+    Metrics::recordBackendCall(Metrics::REDIS_OTHER, Metrics::nowNs() - start, failed);
+
+    if (failed) {
+        std::cerr << "Redis发布消息失败: " << publisher->errstr << std::endl;
+        redisFree(publisher);
+        publisher = nullptr;
+    }
+}
@@ -0,0 +1,96 @@
+#include "../include/request_coalescer.h"
+
+RequestCoalescer::RequestCoalescer(int cache_window_ms)
+    : cache_window_ms(cache_window_ms), fetches(0), shared(0) {
+}
+
+void RequestCoalescer::setCacheWindow(int window_ms) {
+    cache_window_ms.store(window_ms > 0 ? window_ms : 0, std::memory_order_relaxed);
+}
+
+void RequestCoalescer::run(int group, const std::string& key, Fetch fetch, Callback done) {
+    std::shared_ptr<Entry> entry;
+    {
+        Shard& shard = shardFor(group);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        Group& entries = shard.groups[group];
+        Clock::time_point now = Clock::now();
+
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            Entry& existing = *it->second;
+            if (!existing.completed) {
+                // 相同的读取在途，等它完成
+                existing.waiters.push_back(std::move(done));
+                shared.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (now < existing.expires) {
+                Result result = existing.result;
+                lock.unlock();
+                shared.fetch_add(1, std::memory_order_relaxed);
+                done(true, result);
+                return;
+            }
+            entries.erase(it);
+        }
+
+        // 顺便清理分组中已过期的结果，分组的大小只与缓存窗口内出现过的键数有关
+        for (auto expired = entries.begin(); expired != entries.end();) {
+            if (expired->second->completed && expired->second->expires <= now) {
+                expired = entries.erase(expired);
+            } else {
+                ++expired;
+            }
+        }
+
+        entry = std::make_shared<Entry>();
+        entry->waiters.push_back(std::move(done));
+        entries[key] = entry;
+    }
+
+    fetches.fetch_add(1, std::memory_order_relaxed);
+    fetch([this, group, key, entry](bool ok, Result result) {
+        complete(group, key, entry, ok, result);
+    });
+}
+
+void RequestCoalescer::invalidate(int group) {
+    // 在途的读取仍会唤醒已经挂在上面的等待者，但之后的请求会重新读取
+    Shard& shard = shardFor(group);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.groups.erase(group);
+}
+
+void RequestCoalescer::complete(int group, const std::string& key, const std::shared_ptr<Entry>& entry,
+                                bool ok, Result result) {
+    std::vector<Callback> waiters;
+    {
+        Shard& shard = shardFor(group);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        waiters.swap(entry->waiters);
+
+        // 分组在读取期间失效或键已被新的读取替换时，结果不再保留
+        auto group_it = shard.groups.find(group);
+        if (group_it != shard.groups.end()) {
+            auto it = group_it->second.find(key);
+            if (it != group_it->second.end() && it->second == entry) {
+                int window_ms = cache_window_ms.load(std::memory_order_relaxed);
+                if (ok && window_ms > 0) {
+                    entry->completed = true;
+                    entry->result = result;
+                    entry->expires = Clock::now() + std::chrono::milliseconds(window_ms);
+                } else {
+                    group_it->second.erase(it);
+                }
+            }
+            if (group_it->second.empty()) {
+                shard.groups.erase(group_it);
+            }
+        }
+    }
+
+    for (const auto& waiter : waiters) {
+        waiter(ok, result);
+    }
+}
@@ -0,0 +1,272 @@
+#include "../include/room_fanout.h"
+#include <iostream>
+#include <algorithm>
+
+// 一个等待中的长轮询请求
+struct RoomFanout::Waiter {
+    int room_id = 0;
+    int after_seq = 0;
+    TimerWheel::TimerId timer = 0;   // 超时定时器，由timer_mutex保护
+    WaitCallback done;
+    std::atomic<bool> finished{false};
+};
+
+// 等待超时时间轮的刻度（毫秒）
+static const uint64_t kTimerTickMs = 10;
+
+RoomFanout::RoomFanout() : waiter_count(0), timers(kTimerTickMs, TimerWheel::nowMs()), running(false) {
+}
+
+RoomFanout::~RoomFanout() {
+    stop();
+}
+
+void RoomFanout::start(const FanoutConfig& fanout_config) {
+    if (running.exchange(true)) {
+        return;
+    }
+    config = fanout_config;
+    sweeper = std::thread(&RoomFanout::run, this);
+}
+
+void RoomFanout::stop() {
+    if (running.exchange(false)) {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+        }
+        wait_cv.notify_all();
+        if (sweeper.joinable()) {
+            sweeper.join();
+        }
+    }
+
+    if (transport) {
+        transport->stop();
+        transport.reset();
+    }
+
+    // 剩余的等待者以空结果结束，连接不会一直挂起
+    std::vector<WaitHandle> remaining;
+    for (size_t i = 0; i < kShardCount; ++i) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        for (auto& room_pair : shards[i].rooms) {
+            for (auto& waiter : room_pair.second.waiters) {
+                remaining.push_back(waiter);
+            }
+            room_pair.second.waiters.clear();
+        }
+    }
+    for (const auto& waiter : remaining) {
+        finish(waiter, std::vector<ChatMessage>());
+    }
+}
+
+bool RoomFanout::setTransport(std::unique_ptr<FanoutTransport> fanout_transport) {
+    if (!fanout_transport) {
+        return false;
+    }
+    bool started = fanout_transport->start([this](int room_id, const ChatMessage& message) {
+        if (remote_callback) {
+            remote_callback(room_id, message);
+        }
+        deliver(room_id, message);
+    });
+    if (!started) {
+        std::cerr << "消息推送通道启动失败，只在本实例内推送" << std::endl;
+        return false;
+    }
+    transport = std::move(fanout_transport);
+    return true;
+}
+
+void RoomFanout::setRemoteMessageCallback(FanoutTransport::MessageCallback callback) {
+    remote_callback = callback;
+}
+
+void RoomFanout::publish(int room_id, const ChatMessage& message) {
+    deliver(room_id, message);
+    if (transport) {
+        transport->publish(room_id, message);
+    }
+}
+
+RoomFanout::WaitHandle RoomFanout::wait(int room_id, int after_seq, int timeout_ms, WaitCallback done) {
+    WaitHandle waiter = std::make_shared<Waiter>();
+    waiter->room_id = room_id;
+    waiter->after_seq = after_seq;
+    waiter->done = std::move(done);
+
+    Shard& shard = shardFor(room_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    RoomWatch& room = shard.rooms[room_id];
+    room.waiters.push_back(waiter);
+    room.active++;
+    waiter_count.fetch_add(1, std::memory_order_relaxed);
+
+    // 房间出现第一个等待者时开始接收其他实例的消息；在锁内调用，保证订阅和退订按顺序到达通道
+    if (!room.subscribed && transport) {
+        room.subscribed = true;
+        transport->subscribe(room_id);
+    }
+
+    // 在房间锁内设置定时器，其他线程能结束这个等待者时它的定时器编号已经确定
+    {
+        std::lock_guard<std::mutex> timer_lock(timer_mutex);
+        // 时间轮由检查线程推进，这里按绝对时间设置
+        uint64_t deadline_ms = TimerWheel::nowMs() + (uint64_t)std::max(timeout_ms, 0);
+        waiter->timer = timers.scheduleAt(deadline_ms, [this, waiter]() {
+            expired.push_back(waiter);
+        });
+    }
+    return waiter;
+}
+
+bool RoomFanout::cancel(const WaitHandle& handle) {
+    if (!release(handle)) {
+        return false;
+    }
+    handle->done = nullptr;
+    return true;
+}
+
+void RoomFanout::deliver(int room_id, const ChatMessage& message) {
+    std::vector<WaitHandle> woken;
+    {
+        Shard& shard = shardFor(room_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.rooms.find(room_id);
+        if (it == shard.rooms.end()) {
+            return;
+        }
+
+        std::vector<WaitHandle>& waiters = it->second.waiters;
+        size_t kept = 0;
+        for (size_t i = 0; i < waiters.size(); ++i) {
+            if (waiters[i]->finished.load(std::memory_order_acquire)) {
+                continue;
+            }
+            if (waiters[i]->after_seq < message.seq) {
+                woken.push_back(waiters[i]);
+            } else {
+                waiters[kept++] = waiters[i];
+            }
+        }
+        waiters.resize(kept);
+    }
+
+    std::vector<ChatMessage> next(1, message);
+    for (const auto& waiter : woken) {
+        // 新消息与等待者已有的消息之间有空缺时不直接推送，由调用者重新读取存储
+        finish(waiter, message.seq == waiter->after_seq + 1 ? next : std::vector<ChatMessage>());
+    }
+}
+
+void RoomFanout::finish(const WaitHandle& handle, const std::vector<ChatMessage>& messages) {
+    if (!release(handle)) {
+        return;
+    }
+    WaitCallback done = std::move(handle->done);
+    done(messages);
+}
+
+bool RoomFanout::release(const WaitHandle& handle) {
+    if (handle->finished.exchange(true, std::memory_order_acq_rel)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> timer_lock(timer_mutex);
+        timers.cancel(handle->timer);
+        handle->timer = 0;
+    }
+
+    Shard& shard = shardFor(handle->room_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    RoomWatch& room = shard.rooms[handle->room_id];
+    if (--room.active == 0) {
+        room.idle_since = Clock::now();
+    }
+    waiter_count.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+void RoomFanout::run() {
+    Clock::time_point last_idle_sweep = Clock::now();
+    while (running) {
+        // 睡到下一个等待者超时，最长为一个检查间隔
+        int timeout_ms = config.sweep_interval_ms;
+        {
+            std::lock_guard<std::mutex> timer_lock(timer_mutex);
+            int next_timer = timers.nextTimeoutMs();
+            if (next_timer >= 0 && next_timer < timeout_ms) {
+                timeout_ms = next_timer;
+            }
+        }
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return !running; });
+        }
+        if (!running) {
+            break;
+        }
+        expireWaiters();
+
+        Clock::time_point now = Clock::now();
+        if (now - last_idle_sweep >= std::chrono::milliseconds(config.sweep_interval_ms)) {
+            last_idle_sweep = now;
+            sweepIdleRooms();
+        }
+    }
+}
+
+void RoomFanout::expireWaiters() {
+    // 定时器回调只收集到期的等待者，在timer_mutex外结束它们（release需要再次加锁）
+    std::vector<WaitHandle> due;
+    {
+        std::lock_guard<std::mutex> timer_lock(timer_mutex);
+        expired.clear();
+        timers.advance(TimerWheel::nowMs());
+        due.swap(expired);
+    }
+    for (const auto& waiter : due) {
+        finish(waiter, std::vector<ChatMessage>());
+    }
+}
+
+void RoomFanout::sweepIdleRooms() {
+    Clock::time_point now = Clock::now();
+    std::chrono::seconds idle_limit(config.idle_unsubscribe_seconds);
+
+    for (size_t i = 0; i < kShardCount; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.rooms.begin(); it != shard.rooms.end();) {
+            RoomWatch& room = it->second;
+
+            // 清理已结束（超时或取消）的等待者
+            std::vector<WaitHandle>& waiters = room.waiters;
+            size_t kept = 0;
+            for (size_t j = 0; j < waiters.size(); ++j) {
+                if (!waiters[j]->finished.load(std::memory_order_acquire)) {
+                    waiters[kept++] = waiters[j];
+                }
+            }
+            waiters.resize(kept);
+
+            // 没有等待者的房间：空闲超过idle_unsubscribe_seconds后退订并删除
+            if (room.active > 0 || !room.waiters.empty()) {
+                ++it;
+                continue;
+            }
+            if (room.subscribed) {
+                if (now - room.idle_since < idle_limit) {
+                    ++it;
+                    continue;
+                }
+                if (transport) {
+                    transport->unsubscribe(it->first);
+                }
+            }
+            it = shard.rooms.erase(it);
+        }
+    }
+}
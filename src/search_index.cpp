@@ -0,0 +1,308 @@
+#include "../include/search_index.h"
+#include <algorithm>
+#include <iterator>
+#include <cctype>
+
+// 写入varint
+static void appendVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+void PostingList::seal() {
+    // 保留少量最新序号在尾部，容忍并发写入造成的轻微乱序
+    const size_t keep = 8;
+    if (tail.size() <= keep) {
+        return;
+    }
+    size_t n = tail.size() - keep;
+    for (size_t i = 0; i < n; ++i) {
+        appendVarint(data, (uint32_t)(tail[i] - last_sealed));
+        last_sealed = tail[i];
+    }
+    sealed_count += (int)n;
+    tail.erase(tail.begin(), tail.begin() + n);
+}
+
+void PostingList::add(int seq) {
+    if (seq <= last_sealed) {
+        // 极少发生：比已封存部分还早的序号，解码后重新编码
+        std::vector<int> all;
+        decode(all);
+        auto it = std::lower_bound(all.begin(), all.end(), seq);
+        if (it != all.end() && *it == seq) {
+            return;
+        }
+        all.insert(it, seq);
+        data.clear();
+        last_sealed = 0;
+        sealed_count = 0;
+        tail = std::move(all);
+        seal();
+        return;
+    }
+
+    if (tail.empty() || seq > tail.back()) {
+        tail.push_back(seq);
+    } else {
+        auto it = std::lower_bound(tail.begin(), tail.end(), seq);
+        if (it != tail.end() && *it == seq) {
+            return;
+        }
+        tail.insert(it, seq);
+    }
+
+    if (tail.size() >= kTailLimit) {
+        seal();
+    }
+}
+
+void PostingList::decode(std::vector<int>& out) const {
+    out.clear();
+    out.reserve(size());
+
+    int value = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    for (unsigned char c : data) {
+        delta |= (uint32_t)(c & 0x7f) << shift;
+        if (c & 0x80) {
+            shift += 7;
+            continue;
+        }
+        value += (int)delta;
+        out.push_back(value);
+        delta = 0;
+        shift = 0;
+    }
+    out.insert(out.end(), tail.begin(), tail.end());
+}
+
+// 解码一个UTF-8字符，返回码点，len返回字节数；非法字节按单字节处理
+static uint32_t decodeUtf8(const std::string& text, size_t pos, size_t& len) {
+    unsigned char c = text[pos];
+    if (c < 0x80) {
+        len = 1;
+        return c;
+    }
+    size_t need = (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 1;
+    if (need == 1 || pos + need > text.size()) {
+        len = 1;
+        return 0xfffd;
+    }
+    uint32_t cp = c & (0xff >> (need + 1));
+    for (size_t i = 1; i < need; ++i) {
+        unsigned char cc = text[pos + i];
+        if ((cc & 0xc0) != 0x80) {
+            len = 1;
+            return 0xfffd;
+        }
+        cp = (cp << 6) | (cc & 0x3f);
+    }
+    len = need;
+    return cp;
+}
+
+// 是否为中日韩文字（汉字、假名、谚文）
+static bool isCjk(uint32_t cp) {
+    return (cp >= 0x4e00 && cp <= 0x9fff) ||
+           (cp >= 0x3400 && cp <= 0x4dbf) ||
+           (cp >= 0xf900 && cp <= 0xfaff) ||
+           (cp >= 0x3040 && cp <= 0x30ff) ||
+           (cp >= 0xac00 && cp <= 0xd7af) ||
+           (cp >= 0x20000 && cp <= 0x2a6df);
+}
+
+// 切分文本，bigram_only为true时长度大于1的CJK片段只输出两字词项
+static std::vector<std::string> splitTokens(const std::string& text, bool bigram_only) {
+    std::vector<std::string> tokens;
+    std::string word;
+    std::vector<std::string> cjk_run;
+
+    auto flushWord = [&]() {
+        if (!word.empty()) {
+            tokens.push_back(word);
+            word.clear();
+        }
+    };
+    auto flushCjk = [&]() {
+        if (cjk_run.empty()) {
+            return;
+        }
+        if (!bigram_only || cjk_run.size() == 1) {
+            tokens.insert(tokens.end(), cjk_run.begin(), cjk_run.end());
+        }
+        for (size_t i = 0; i + 1 < cjk_run.size(); ++i) {
+            tokens.push_back(cjk_run[i] + cjk_run[i + 1]);
+        }
+        cjk_run.clear();
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t len;
+        uint32_t cp = decodeUtf8(text, pos, len);
+
+        if (cp < 0x80) {
+            flushCjk();
+            if (std::isalnum((unsigned char)cp)) {
+                word.push_back((char)std::tolower((unsigned char)cp));
+            } else {
+                flushWord();
+            }
+        } else if (isCjk(cp)) {
+            flushWord();
+            cjk_run.push_back(text.substr(pos, len));
+        } else if (cp == 0xfffd || (cp >= 0x2000 && cp <= 0x206f) || (cp >= 0x3000 && cp <= 0x303f) ||
+                   (cp >= 0xff00 && cp <= 0xffef)) {
+            // 标点（含全角标点）作为分隔符
+            flushWord();
+            flushCjk();
+        } else {
+            // 其他字母（如带重音的拉丁字母）并入当前单词
+            flushCjk();
+            word.append(text, pos, len);
+        }
+        pos += len;
+    }
+    flushWord();
+    flushCjk();
+    return tokens;
+}
+
+std::vector<std::string> SearchIndex::tokenize(const std::string& text) {
+    return splitTokens(text, false);
+}
+
+std::vector<std::string> SearchIndex::tokenizeQuery(const std::string& query) {
+    std::vector<std::string> terms = splitTokens(query, true);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    return terms;
+}
+
+std::shared_ptr<SearchIndex::RoomIndex> SearchIndex::getRoom(int room_id, bool create) {
+    {
+        std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+        auto it = rooms.find(room_id);
+        if (it != rooms.end()) {
+            return it->second;
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    auto& room = rooms[room_id];
+    if (!room) {
+        room = std::make_shared<RoomIndex>();
+    }
+    return room;
+}
+
+void SearchIndex::addMessage(int room_id, int seq, const std::string& content, time_t time) {
+    if (seq <= 0) {
+        return;
+    }
+
+    std::vector<std::string> tokens = tokenize(content);
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    std::shared_ptr<RoomIndex> room = getRoom(room_id, true);
+    std::lock_guard<std::mutex> lock(room->mutex);
+    for (const auto& token : tokens) {
+        room->postings[token].add(seq);
+    }
+    if (room->times.size() <= (size_t)seq) {
+        room->times.resize(seq + 1, 0);
+    }
+    room->times[seq] = (uint32_t)time;
+}
+
+void SearchIndex::removeRoom(int room_id) {
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex);
+    rooms.erase(room_id);
+}
+
+size_t SearchIndex::roomCount() const {
+    std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+    return rooms.size();
+}
+
+void SearchIndex::searchRoom(int room_id, RoomIndex& room, const std::vector<std::string>& terms,
+                             size_t top_k, std::vector<SearchHit>& hits) {
+    std::lock_guard<std::mutex> lock(room.mutex);
+
+    // 从最短的倒排列表开始求交集
+    std::vector<const PostingList*> lists;
+    for (const auto& term : terms) {
+        auto it = room.postings.find(term);
+        if (it == room.postings.end()) {
+            return;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) {
+        return a->size() < b->size();
+    });
+
+    std::vector<int> result, other, merged;
+    lists[0]->decode(result);
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        lists[i]->decode(other);
+        merged.clear();
+        std::set_intersection(result.begin(), result.end(), other.begin(), other.end(),
+                              std::back_inserter(merged));
+        result.swap(merged);
+    }
+
+    // 序号越大消息越新，取末尾的top_k条
+    size_t begin = result.size() > top_k ? result.size() - top_k : 0;
+    for (size_t i = result.size(); i > begin; --i) {
+        int seq = result[i - 1];
+        time_t time = (size_t)seq < room.times.size() ? room.times[seq] : 0;
+        hits.push_back({room_id, seq, time});
+    }
+}
+
+std::vector<SearchHit> SearchIndex::search(const std::string& query, int room_id, size_t top_k) {
+    std::vector<SearchHit> hits;
+    std::vector<std::string> terms = tokenizeQuery(query);
+    if (terms.empty() || top_k == 0) {
+        return hits;
+    }
+
+    if (room_id > 0) {
+        std::shared_ptr<RoomIndex> room = getRoom(room_id, false);
+        if (room) {
+            searchRoom(room_id, *room, terms, top_k, hits);
+        }
+        return hits;
+    }
+
+    // 搜索所有房间：先复制房间列表，避免持有全局锁进行求交
+    std::vector<std::pair<int, std::shared_ptr<RoomIndex>>> snapshot;
+    {
+        std::shared_lock<std::shared_mutex> lock(rooms_mutex);
+        snapshot.assign(rooms.begin(), rooms.end());
+    }
+    for (auto& entry : snapshot) {
+        searchRoom(entry.first, *entry.second, terms, top_k, hits);
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const SearchHit& a, const SearchHit& b) {
+        if (a.time != b.time) {
+            return a.time > b.time;
+        }
+        return a.seq > b.seq;
+    });
+    if (hits.size() > top_k) {
+        hits.resize(top_k);
+    }
+    return hits;
+}
@@ -0,0 +1,47 @@
+#include "../include/send_pipeline.h"
+
+SendPipeline::SendPipeline(EventLoop* loop, Storage* storage, size_t max_batch)
+    : loop(loop), storage(storage), max_batch(max_batch), flush_scheduled(false) {
+}
+
+void SendPipeline::submit(RoomAppend append) {
+    pending.push_back(std::move(append));
+    if (pending.size() >= max_batch) {
+        flush();
+        return;
+    }
+    if (!flush_scheduled) {
+        flush_scheduled = true;
+        loop->post([this] {
+            flush_scheduled = false;
+            flush();
+        });
+    }
+}
+
+void SendPipeline::flush() {
+    if (pending.empty()) {
+        return;
+    }
+    std::vector<RoomAppend> batch;
+    batch.swap(pending);
+    storage->appendRoomMessagesAsync(std::move(batch));
+}
+
+SendPipeline* SendPipeline::forCurrentLoop(Storage* storage, size_t max_batch) {
+    static thread_local SendPipeline* pipeline = nullptr;
+
+    EventLoop* loop = EventLoop::current();
+    if (loop == nullptr) {
+        return nullptr;
+    }
+    if (pipeline == nullptr) {
+        pipeline = new SendPipeline(loop, storage, max_batch);
+        loop->onClose([] {
+            pipeline->flush();
+            delete pipeline;
+            pipeline = nullptr;
+        });
+    }
+    return pipeline->storage == storage ? pipeline : nullptr;
+}
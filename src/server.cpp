@@ -1,16 +1,28 @@
 #include "../include/server.h"
+#include "../include/metrics.h"
+#include "../include/event_loop.h"
+#include "../include/timer_wheel.h"
+#include "../include/trace.h"
+#include "../include/embedded_assets.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <cerrno>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
-#include <fstream>
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <netinet/in.h>
 #include <iomanip>
@@ -19,15 +31,187 @@
 // 在main.cpp中声明的函数，用于去除查询参数
 extern std::string removeQueryParams(const std::string& path);
 
-// 检查字符串是否以指定后缀结尾的辅助函数
-bool endsWith(const std::string& str, const std::string& suffix) {
-    if (str.length() < suffix.length()) {
+// 单个请求的最大长度（请求头加请求体）
+static const size_t kMaxRequestBytes = 1 << 20;
+
+// 单次sendfile发送的最大字节数，避免一个大文件长时间占用反应器
+static const size_t kSendfileChunk = 1 << 20;
+
+// 反应器时间轮的刻度（毫秒）
+static const uint64_t kTimerTickMs = 10;
+
+// 当前线程所在的反应器，不在反应器线程上时为-1
+static thread_local int t_current_reactor = -1;
+
+// 一个已解析的请求，在接收它的反应器上执行；异步处理器可能在其他线程上给出响应，结果交回该反应器写出
+struct RequestTask {
+    int origin = 0;            // 接收连接的反应器
+    int conn_fd = -1;
+    uint64_t conn_id = 0;
+    std::string client_ip;
+    std::unordered_map<std::string, std::string> headers;
+    std::string path;
+    std::string body;
+    bool found = false;
+    AsyncHttpHandler handler;
+    std::string content_type;
+    int route_id = Metrics::ROUTE_NOT_FOUND;
+    RequestPriority priority = PRIORITY_NORMAL;
+    bool long_poll = false;
+    std::string asset_path;    // 未匹配处理器时用于响应的资源
+    FileHttpHandler file_handler;
+    std::string response;
+    int file_fd = -1;          // 响应头之后要发送的文件，随响应一起交给连接
+    uint64_t file_offset = 0;
+    uint64_t file_length = 0;
+    uint64_t trace_id = 0;     // 被采样追踪的请求，0表示不追踪
+    uint64_t admission_ns = 0; // 开始准入控制的时间，仅追踪的请求记录
+    uint64_t queue_timer = 0;  // 等待执行名额期间的排队期限
+    bool rate_checked = false; // 已经过限流（上传在接收请求体之前限流）
+    RequestTask* next = nullptr; // 完成栈中的链接
+
+    ~RequestTask() {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+    }
+};
+
+// 一个客户端连接，只由接受它的反应器访问
+struct HttpConnection {
+    int fd;
+    uint64_t id;
+    std::string client_ip;
+    std::string input;
+    std::string output;
+    size_t written = 0;
+    bool dispatched = false;   // 请求已交给处理器，等待结果期间不再读取
+    bool awaiting_response = false;       // 处理器尚未给出响应，超时后到达的响应被丢弃
+    int route_id = Metrics::ROUTE_NOT_FOUND;
+    uint64_t start_ns = 0;
+    bool headers_checked = false;         // 已检查过是否为上传路由
+    TimerWheel::TimerId deadline = 0;     // 当前阶段的超时
+
+    // 处理器占用的执行名额，处理器超时时由连接归还（与处理器的响应只归还一次）
+    std::shared_ptr<std::atomic<bool>> admission_slot;
+
+    // 被采样追踪的请求：追踪编号、请求行摘要和开始写出响应的时间
+    uint64_t trace_id = 0;
+    std::string trace_detail;
+    uint64_t write_start_ns = 0;
+
+    // 流式上传：请求体直接交给接收器，upload_task保存已解析的请求头，接收完毕后执行
+    std::unique_ptr<UploadSink> upload;
+    std::unique_ptr<RequestTask> upload_task;
+    uint64_t upload_remaining = 0;
+
+    // 响应头之后用sendfile发送的文件内容
+    int file_fd = -1;
+    uint64_t file_offset = 0;
+    uint64_t file_remaining = 0;
+
+    ~HttpConnection() {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+    }
+};
+
+struct HttpServer::Reactor : public EventLoop {
+    int index = 0;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int event_fd = -1;   // 其他线程交回结果后写入，唤醒epoll_wait
+    std::thread thread;
+
+    // 本反应器接收、在其他线程上给出响应的请求；多个线程并发压栈，本反应器一次取走整条链
+    std::atomic<RequestTask*> completions{nullptr};
+
+    // 等待执行名额的请求，每个优先级一个队列；queued为队列中的请求总数，其他线程归还名额时据此决定是否唤醒本反应器
+    std::deque<RequestTask*> admission_queues[PRIORITY_LEVELS];
+    std::atomic<int> queued{0};
+
+    std::unordered_map<int, std::unique_ptr<HttpConnection>> connections;
+    uint64_t next_conn_id = 1;
+
+    // 其他组件注册的文件描述符，如异步Redis连接
+    std::unordered_map<int, IoCallback> watchers;
+    std::vector<std::function<void()>> posted;
+    std::vector<std::function<void()>> close_hooks;
+
+    // 连接超时和其他组件的定时器
+    TimerWheel timers{kTimerTickMs, TimerWheel::nowMs()};
+
+    void watch(int fd, uint32_t events, IoCallback callback) override {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.fd = fd;
+        int op = watchers.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        epoll_ctl(epoll_fd, op, fd, &ev);
+        watchers[fd] = callback;
+    }
+
+    void unwatch(int fd) override {
+        if (watchers.erase(fd)) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+    }
+
+    void post(std::function<void()> task) override {
+        posted.push_back(task);
+    }
+
+    uint64_t runAfter(uint64_t delay_ms, std::function<void()> task) override {
+        return timers.schedule(delay_ms, std::move(task));
+    }
+
+    void cancelTimer(uint64_t id) override {
+        timers.cancel(id);
+    }
+
+    void onClose(std::function<void()> hook) override {
+        close_hooks.push_back(hook);
+    }
+
+    void runPosted() {
+        std::vector<std::function<void()>> tasks;
+        tasks.swap(posted);
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+};
+
+// Authorization请求头中的Bearer令牌，没有时为空，供按用户限流
+static std::string bearerToken(const std::unordered_map<std::string, std::string>& headers) {
+    auto it = headers.find("Authorization");
+    if (it != headers.end() && it->second.compare(0, 7, "Bearer ") == 0) {
+        return it->second.substr(7);
+    }
+    return std::string();
+}
+
+// 请求头和请求体是否已经完整接收
+static bool requestComplete(const std::string& input) {
+    size_t header_end = input.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
         return false;
     }
-    return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+    size_t content_length = 0;
+    size_t pos = input.find("Content-Length:");
+    if (pos == std::string::npos) {
+        pos = input.find("content-length:");
+    }
+    if (pos != std::string::npos && pos < header_end) {
+        content_length = std::strtoul(input.c_str() + pos + 15, nullptr, 10);
+    }
+    return input.length() >= header_end + 4 + content_length;
 }
 
-HttpServer::HttpServer(int port) : port(port), running(false), server_fd(-1) {
+HttpServer::HttpServer(int port, int reactors) : port(port), reactor_count(reactors), running(false) {
+    if (reactor_count <= 0) {
+        reactor_count = std::max(1u, std::thread::hardware_concurrency());
+    }
 }
 
 HttpServer::~HttpServer() {
@@ -37,54 +221,244 @@ HttpServer::~HttpServer() {
 }
 
 bool HttpServer::start() {
-    // 创建套接字
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return false;
+    // 每个反应器一个监听套接字，都绑定同一端口，由内核在它们之间分配新连接
+    for (int i = 0; i < reactor_count; ++i) {
+        std::unique_ptr<Reactor> reactor(new Reactor());
+        reactor->index = i;
+
+        reactor->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (reactor->listen_fd == -1) {
+            std::cerr << "Failed to create socket" << std::endl;
+            return false;
+        }
+
+        // 设置套接字选项，允许端口重用
+        int opt = 1;
+        if (setsockopt(reactor->listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+            setsockopt(reactor->listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+            std::cerr << "Failed to set socket options" << std::endl;
+            close(reactor->listen_fd);
+            return false;
+        }
+
+        // 绑定地址和端口
+        struct sockaddr_in address;
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;  // 监听所有网络接口
+        address.sin_port = htons(port);
+
+        if (bind(reactor->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            std::cerr << "Failed to bind to port " << port << std::endl;
+            close(reactor->listen_fd);
+            return false;
+        }
+
+        // 积压队列取系统上限，突发连接由准入控制快速拒绝而不是在内核中被丢弃
+        if (listen(reactor->listen_fd, SOMAXCONN) < 0) {
+            std::cerr << "Failed to listen on socket" << std::endl;
+            close(reactor->listen_fd);
+            return false;
+        }
+
+        reactor->epoll_fd = epoll_create1(0);
+        reactor->event_fd = eventfd(0, EFD_NONBLOCK);
+        if (reactor->epoll_fd == -1 || reactor->event_fd == -1) {
+            std::cerr << "Failed to create epoll instance" << std::endl;
+            return false;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = reactor->listen_fd;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &ev);
+        ev.data.fd = reactor->event_fd;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->event_fd, &ev);
+        reactors.push_back(std::move(reactor));
     }
 
-    // 设置套接字选项，允许端口重用
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        std::cerr << "Failed to set socket options" << std::endl;
-        close(server_fd);
-        return false;
+    std::cout << "Binding to all interfaces (0.0.0.0:" << port << ")" << std::endl;
+
+    running = true;
+    std::cout << "Server started on port " << port << " with " << reactor_count << " reactors" << std::endl;
+
+    // 反应器0在当前线程运行，其余各自一个线程
+    for (int i = 1; i < reactor_count; ++i) {
+        reactors[i]->thread = std::thread(&HttpServer::runReactor, this, std::ref(*reactors[i]));
     }
+    runReactor(*reactors[0]);
 
-    // 绑定地址和端口
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;  // 监听所有网络接口
-    address.sin_port = htons(port);
+    for (auto& reactor : reactors) {
+        if (reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
+    }
+    for (auto& reactor : reactors) {
+        for (auto& entry : reactor->connections) {
+            close(entry.first);
+        }
+        for (auto& queue : reactor->admission_queues) {
+            for (RequestTask* task : queue) {
+                delete task;
+            }
+        }
+        RequestTask* task = reactor->completions.exchange(nullptr);
+        while (task) {
+            RequestTask* next = task->next;
+            delete task;
+            task = next;
+        }
+        close(reactor->listen_fd);
+        close(reactor->epoll_fd);
+        close(reactor->event_fd);
+    }
+    reactors.clear();
+    return true;
+}
 
-    std::cout << "Binding to all interfaces (0.0.0.0:" << port << ")" << std::endl;
+void HttpServer::stop() {
+    running = false;
+    for (auto& reactor : reactors) {
+        wakeReactor(*reactor);
+    }
+}
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        std::cerr << "Failed to bind to port " << port << std::endl;
-        close(server_fd);
-        return false;
+void HttpServer::addHandler(const std::string& path, HttpHandler handler, const std::string& content_type) {
+    addAsyncHandler(path, [handler](const std::unordered_map<std::string, std::string>& headers,
+                                    const std::string& body, HttpResponder respond) {
+        respond(handler(headers, body));
+    }, content_type);
+}
+
+void HttpServer::addAsyncHandler(const std::string& path, AsyncHttpHandler handler, const std::string& content_type) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    handlers[path] = handler;
+    route_ids[path] = Metrics::registerRoute(path);
+    if (!content_type.empty()) {
+        content_types[path] = content_type;
     }
+}
 
-    // 监听连接
-    if (listen(server_fd, 10) < 0) {
-        std::cerr << "Failed to listen on socket" << std::endl;
-        close(server_fd);
-        return false;
+void HttpServer::addAssetRoute(const std::string& path, const std::string& asset_path) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    asset_routes[path] = asset_path;
+    route_ids[path] = Metrics::registerRoute(path);
+}
+
+void HttpServer::addUploadHandler(const std::string& path, UploadHandler handler, uint64_t max_body_bytes) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    UploadRoute& route = upload_routes[path];
+    route.handler = handler;
+    route.max_body_bytes = max_body_bytes;
+    route_ids[path] = Metrics::registerRoute(path);
+}
+
+void HttpServer::addFileHandler(const std::string& path, FileHttpHandler handler) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    file_routes[path] = handler;
+    route_ids[path] = Metrics::registerRoute(path);
+}
+
+void HttpServer::setRoutePriority(const std::string& path, RequestPriority priority) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    priorities[path] = priority;
+}
+
+void HttpServer::setRouteLongPoll(const std::string& path) {
+    std::lock_guard<std::mutex> lock(handlers_mutex);
+    long_poll_routes.insert(path);
+}
+
+void HttpServer::setTimeouts(const ConnectionTimeouts& connection_timeouts) {
+    timeouts = connection_timeouts;
+}
+
+void HttpServer::enableAdmission(const AdmissionConfig& config) {
+    admission.reset(new AdmissionController(config));
+    max_connections = config.max_connections;
+}
+
+void HttpServer::wakeReactor(Reactor& reactor) {
+    uint64_t one = 1;
+    if (write(reactor.event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cerr << "Failed to wake reactor " << reactor.index << std::endl;
     }
+}
 
-    running = true;
-    std::cout << "Server started on port " << port << std::endl;
+void HttpServer::runReactor(Reactor& reactor) {
+    t_current_reactor = reactor.index;
+    EventLoop::setCurrent(&reactor);
 
-    // 接受连接
+    // 绑定到固定的CPU核心，反应器的连接和时间轮留在该核心的缓存中
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(reactor.index % cores, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    struct epoll_event events[64];
     while (running) {
+        // 有待执行的投递任务时不阻塞，否则最多等到下一个定时器到期
+        int timeout = 1000;
+        int next_timer = reactor.timers.nextTimeoutMs();
+        if (!reactor.posted.empty()) {
+            timeout = 0;
+        } else if (next_timer >= 0 && next_timer < timeout) {
+            timeout = next_timer;
+        }
+        int n = epoll_wait(reactor.epoll_fd, events, 64, timeout);
+
+        // 先推进时间轮，本轮处理事件时添加的定时器从醒来的时间算起
+        reactor.timers.advance(TimerWheel::nowMs());
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == reactor.listen_fd) {
+                acceptConnections(reactor);
+            } else if (fd == reactor.event_fd) {
+                uint64_t value;
+                while (read(reactor.event_fd, &value, sizeof(value)) > 0) {
+                }
+                drainCompletions(reactor);
+                drainAdmissionQueue(reactor);
+            } else if (reactor.watchers.count(fd)) {
+                // 回调可能取消自己的注册，先拷贝一份再调用
+                EventLoop::IoCallback callback = reactor.watchers[fd];
+                callback(events[i].events);
+            } else {
+                auto it = reactor.connections.find(fd);
+                if (it == reactor.connections.end()) {
+                    continue;
+                }
+                HttpConnection& conn = *it->second;
+                if (events[i].events & EPOLLOUT) {
+                    writeConnection(reactor, conn);
+                } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readConnection(reactor, conn);
+                }
+            }
+        }
+        reactor.runPosted();
+    }
+    
+    // 释放绑定在本反应器上的资源，其在途请求的回调在此期间完成
+    reactor.runPosted();
+    for (auto it = reactor.close_hooks.rbegin(); it != reactor.close_hooks.rend(); ++it) {
+        (*it)();
+    }
+    reactor.close_hooks.clear();
+    EventLoop::setCurrent(nullptr);
+    t_current_reactor = -1;
+}
+
+void HttpServer::acceptConnections(Reactor& reactor) {
+    for (;;) {
         struct sockaddr_in client_addr;
         socklen_t addrlen = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-        
+        int client_fd = accept4(reactor.listen_fd, (struct sockaddr *)&client_addr, &addrlen, SOCK_NONBLOCK);
         if (client_fd < 0) {
-            std::cerr << "Failed to accept connection" << std::endl;
-            continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Failed to accept connection" << std::endl;
+            }
+            return;
         }
 
         // 打印客户端信息
@@ -92,136 +466,726 @@ bool HttpServer::start() {
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
         std::cout << "New connection from " << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
 
-        // 创建新线程处理连接
-        worker_threads.push_back(std::thread(&HttpServer::handleClient, this, client_fd));
+        // 连接数超出上限时直接拒绝
+        if (max_connections > 0 && active_connections.load() >= max_connections) {
+            std::string response = buildRejectResponse(503, 1, "服务器繁忙，请稍后重试");
+            if (write(client_fd, response.c_str(), response.length()) < 0) {
+                std::cerr << "Failed to send rejection to " << client_ip << std::endl;
+            }
+            close(client_fd);
+            Metrics::recordRequest(Metrics::ROUTE_NOT_FOUND, 503, 0);
+            continue;
+        }
+        active_connections++;
+        Metrics::connectionOpened();
+
+        std::unique_ptr<HttpConnection> conn(new HttpConnection());
+        conn->fd = client_fd;
+        conn->id = reactor.next_conn_id++;
+        conn->client_ip = client_ip;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = client_fd;
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+        HttpConnection& added = *conn;
+        reactor.connections[client_fd] = std::move(conn);
+
+        // 请求头的超时从建立连接算起，之后收到数据也不延长
+        setDeadline(reactor, added, timeouts.header_ms);
     }
+}
 
-    return true;
+void HttpServer::closeConnection(Reactor& reactor, int fd) {
+    auto it = reactor.connections.find(fd);
+    if (it != reactor.connections.end() && it->second->deadline) {
+        reactor.timers.cancel(it->second->deadline);
+    }
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    reactor.connections.erase(fd);
+    active_connections--;
+    Metrics::connectionClosed();
 }
 
-void HttpServer::stop() {
-    running = false;
-    if (server_fd != -1) {
-        close(server_fd);
-        server_fd = -1;
+void HttpServer::setDeadline(Reactor& reactor, HttpConnection& conn, int timeout_ms) {
+    if (conn.deadline) {
+        reactor.timers.cancel(conn.deadline);
+        conn.deadline = 0;
+    }
+    if (timeout_ms <= 0) {
+        return;
+    }
+    // 连接可能先被关闭，fd又被新连接复用，触发时按连接编号核对
+    int fd = conn.fd;
+    uint64_t conn_id = conn.id;
+    conn.deadline = reactor.timers.schedule((uint64_t)timeout_ms, [this, &reactor, fd, conn_id]() {
+        expireConnection(reactor, fd, conn_id);
+    });
+}
+
+void HttpServer::expireConnection(Reactor& reactor, int fd, uint64_t conn_id) {
+    auto it = reactor.connections.find(fd);
+    if (it == reactor.connections.end() || it->second->id != conn_id) {
+        return;
+    }
+    HttpConnection& conn = *it->second;
+    conn.deadline = 0;
+
+    // 处理器没有在期限内给出响应：返回504并归还执行名额，之后到达的响应被丢弃
+    if (conn.awaiting_response) {
+        conn.awaiting_response = false;
+        if (conn.admission_slot && conn.admission_slot->exchange(false)) {
+            releaseAdmission();
+        }
+        conn.admission_slot.reset();
+        std::cout << "Request from " << conn.client_ip << " timed out in handler" << std::endl;
+        conn.output = buildHttpResponse("application/json",
+                                        "{\"success\":false,\"message\":\"处理超时，请稍后重试\"}", 504);
+        if (conn.trace_id) {
+            conn.write_start_ns = Metrics::nowNs();
+        }
+        writeConnection(reactor, conn);
+        return;
     }
 
-    // 等待所有工作线程结束
-    for (auto& thread : worker_threads) {
-        if (thread.joinable()) {
-            thread.join();
+    // 还在接收请求时尽量告知客户端超时；正在发送响应时客户端不读取，直接关闭
+    if (!conn.dispatched) {
+        std::string response = buildHttpResponse("application/json",
+                                                  "{\"success\":false,\"message\":\"请求超时\"}", 408);
+        if (write(conn.fd, response.c_str(), response.length()) < 0) {
+            std::cerr << "Failed to send timeout response to " << conn.client_ip << std::endl;
         }
+        conn.start_ns = Metrics::nowNs();
     }
-    worker_threads.clear();
+    std::cout << "Connection from " << conn.client_ip << " timed out" << std::endl;
+    Metrics::recordRequest(conn.route_id, 408, Metrics::nowNs() - conn.start_ns);
+    closeConnection(reactor, fd);
 }
 
-void HttpServer::addHandler(const std::string& path, HttpHandler handler) {
-    std::lock_guard<std::mutex> lock(handlers_mutex);
-    handlers[path] = handler;
+void HttpServer::readConnection(Reactor& reactor, HttpConnection& conn) {
+    char buffer[8192];
+    for (;;) {
+        ssize_t bytes_read = read(conn.fd, buffer, sizeof(buffer));
+        if (bytes_read > 0) {
+            // 上传的请求体不进入输入缓冲区，读到多少交给接收器多少
+            if (conn.upload) {
+                if (!feedUpload(reactor, conn, buffer, bytes_read)) {
+                    return;
+                }
+                continue;
+            }
+            conn.input.append(buffer, bytes_read);
+            if (!conn.headers_checked && conn.input.find("\r\n\r\n") != std::string::npos) {
+                conn.headers_checked = true;
+                if (!beginUpload(reactor, conn)) {
+                    return;
+                }
+                if (conn.upload) {
+                    continue;
+                }
+            }
+            if (conn.input.length() > kMaxRequestBytes) {
+                closeConnection(reactor, conn.fd);
+                return;
+            }
+            continue;
+        }
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        // 对端关闭或出错，请求不完整时直接关闭
+        if (conn.upload || !requestComplete(conn.input)) {
+            closeConnection(reactor, conn.fd);
+            return;
+        }
+        break;
+    }
+
+    if (!conn.upload && requestComplete(conn.input)) {
+        dispatchRequest(reactor, conn);
+    } else if (conn.headers_checked) {
+        // 请求头已完整，之后只限制请求体两次到达之间的间隔
+        setDeadline(reactor, conn, timeouts.body_idle_ms);
+    }
+}
+
+bool HttpServer::beginUpload(Reactor& reactor, HttpConnection& conn) {
+    // 先只看请求行，普通请求不在这里解析请求头
+    size_t path_end = conn.input.find(' ', 5);
+    if (conn.input.compare(0, 5, "POST ") != 0 || path_end == std::string::npos) {
+        return true;
+    }
+    std::string clean_path = removeQueryParams(conn.input.substr(5, path_end - 5));
+
+    std::unique_ptr<RequestTask> task(new RequestTask());
+    UploadRoute route;
+    {
+        std::lock_guard<std::mutex> lock(handlers_mutex);
+        auto it = upload_routes.find(clean_path);
+        if (it == upload_routes.end()) {
+            return true;
+        }
+        route = it->second;
+        task->route_id = route_ids[clean_path];
+        auto priority_it = priorities.find(clean_path);
+        if (priority_it != priorities.end()) {
+            task->priority = priority_it->second;
+        }
+    }
+
+    size_t header_end = conn.input.find("\r\n\r\n");
+    std::string ignored_body;
+    task->headers = parseHttpRequest(conn.input.substr(0, header_end + 4), task->path, ignored_body);
+    task->headers["remote_addr"] = conn.client_ip;
+    conn.route_id = task->route_id;
+
+    auto length_it = task->headers.find("Content-Length");
+    if (length_it == task->headers.end()) {
+        length_it = task->headers.find("content-length");
+    }
+    if (length_it == task->headers.end()) {
+        respondNow(reactor, conn, buildHttpResponse("application/json",
+                   "{\"success\":false,\"message\":\"上传请求必须带Content-Length\"}", 411));
+        return false;
+    }
+    uint64_t content_length = std::strtoull(length_it->second.c_str(), nullptr, 10);
+    if (content_length > route.max_body_bytes) {
+        respondNow(reactor, conn, buildHttpResponse("application/json",
+                   "{\"success\":false,\"message\":\"上传内容超过大小上限\"}", 413));
+        return false;
+    }
+
+    // 与普通请求一样按IP和用户限流，在创建接收器、读取请求体之前拒绝
+    if (admission) {
+        int retry_after = 0;
+        if (!admission->allowRequest(conn.client_ip, bearerToken(task->headers), retry_after)) {
+            respondNow(reactor, conn, buildRejectResponse(429, retry_after, "请求过于频繁，请稍后重试"));
+            return false;
+        }
+        task->rate_checked = true;
+    }
+
+    std::string error;
+    std::unique_ptr<UploadSink> sink = route.handler(task->headers, error);
+    if (!sink) {
+        respondNow(reactor, conn, buildHttpResponse("application/json", error));
+        return false;
+    }
+
+    task->origin = reactor.index;
+    task->conn_fd = conn.fd;
+    task->conn_id = conn.id;
+    task->client_ip = conn.client_ip;
+    task->content_type = "application/json";
+    task->found = true;
+    conn.upload = std::move(sink);
+    conn.upload_task = std::move(task);
+    conn.upload_remaining = content_length;
+
+    // 与请求头一起读到的那部分请求体
+    std::string body = conn.input.substr(header_end + 4);
+    conn.input.clear();
+    conn.input.shrink_to_fit();
+    return feedUpload(reactor, conn, body.data(), body.length());
+}
+
+bool HttpServer::feedUpload(Reactor& reactor, HttpConnection& conn, const char* data, size_t len) {
+    size_t take = (size_t)std::min<uint64_t>(len, conn.upload_remaining);
+    if (take > 0 && !conn.upload->write(data, take)) {
+        std::string error = conn.upload->abortResponse();
+        conn.upload.reset();
+        respondNow(reactor, conn, error.empty()
+                   ? buildHttpResponse("application/json", "{\"success\":false,\"message\":\"保存上传内容失败\"}", 500)
+                   : buildHttpResponse("application/json", error));
+        return false;
+    }
+    conn.upload_remaining -= take;
+    if (conn.upload_remaining > 0) {
+        return true;
+    }
+
+    // 请求体接收完毕，与普通请求一样经过准入控制后由接收器给出响应
+    conn.dispatched = true;
+    conn.awaiting_response = true;
+    conn.start_ns = Metrics::nowNs();
+    setDeadline(reactor, conn, timeouts.handler_ms);
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.fd = conn.fd;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+
+    std::shared_ptr<UploadSink> sink(std::move(conn.upload));
+    RequestTask* task = conn.upload_task.release();
+    task->trace_id = conn.trace_id = Trace::sampleRequest();
+    if (task->trace_id) {
+        conn.trace_detail = "POST " + removeQueryParams(task->path);
+    }
+    task->handler = [sink](const std::unordered_map<std::string, std::string>&, const std::string&,
+                           HttpResponder respond) {
+        sink->finish(respond);
+    };
+    executeTask(task);
+    return false;
+}
+
+void HttpServer::respondNow(Reactor& reactor, HttpConnection& conn, const std::string& response) {
+    conn.dispatched = true;
+    conn.start_ns = Metrics::nowNs();
+    setDeadline(reactor, conn, 0);
+    conn.output = response;
+    writeConnection(reactor, conn);
+}
+
+void HttpServer::dispatchRequest(Reactor& reactor, HttpConnection& conn) {
+    // 等待结果期间不再关注可读事件，连接（和fd）保持到响应写完或处理器超时
+    conn.dispatched = true;
+    conn.awaiting_response = true;
+    conn.start_ns = Metrics::nowNs();
+    setDeadline(reactor, conn, 0);
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.fd = conn.fd;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+
+    RequestTask* task = new RequestTask();
+    task->origin = reactor.index;
+    task->conn_fd = conn.fd;
+    task->conn_id = conn.id;
+    task->client_ip = conn.client_ip;
+    task->headers = parseHttpRequest(conn.input, task->path, task->body);
+    task->headers["remote_addr"] = conn.client_ip;
+    conn.input.clear();
+    task->trace_id = conn.trace_id = Trace::sampleRequest();
+    uint64_t parsed_ns = 0;
+    if (task->trace_id) {
+        parsed_ns = Metrics::nowNs();
+        conn.trace_detail = task->headers["method"] + " " + removeQueryParams(task->path);
+        Trace::span(task->trace_id, "parse", conn.start_ns, parsed_ns);
+    }
+
+    // 只在查找路由时持有锁，处理器在锁外执行
+    {
+        std::lock_guard<std::mutex> lock(handlers_mutex);
+        RouteMatch match;
+        if (resolveRoute(task->headers["method"], task->path, match)) {
+            task->handler = *match.handler;
+            task->content_type = match.content_type;
+            task->route_id = match.route_id;
+            task->priority = match.priority;
+            task->long_poll = match.long_poll;
+            task->found = true;
+        } else {
+            std::string clean_path = removeQueryParams(task->path);
+            auto file_it = file_routes.find(clean_path);
+            auto asset_it = asset_routes.find(clean_path);
+            if (file_it != file_routes.end() && task->headers["method"] == "GET") {
+                task->file_handler = file_it->second;
+                task->route_id = route_ids[clean_path];
+                auto priority_it = priorities.find(clean_path);
+                if (priority_it != priorities.end()) {
+                    task->priority = priority_it->second;
+                }
+                task->found = true;
+            } else if (asset_it != asset_routes.end()) {
+                task->asset_path = asset_it->second;
+                task->route_id = route_ids[clean_path];
+            } else {
+                task->asset_path = "static" + clean_path;
+                task->route_id = Metrics::ROUTE_STATIC;
+            }
+        }
+    }
+    if (task->trace_id) {
+        Trace::span(task->trace_id, "route", parsed_ns, Metrics::nowNs());
+    }
+    conn.route_id = task->route_id;
+    setDeadline(reactor, conn, task->long_poll ? timeouts.long_poll_ms : timeouts.handler_ms);
+
+    executeTask(task);
 }
 
-void HttpServer::handleClient(int client_fd) {
-    // 接收请求数据
-    char buffer[8192] = {0};  // 增大缓冲区，防止大请求被截断
-    int bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-    if (bytes_read <= 0) {
-        close(client_fd);
+void HttpServer::finishTask(RequestTask* task) {
+    Reactor& origin = *reactors[task->origin];
+    if (task->origin == t_current_reactor) {
+        completeTask(origin, task);
         return;
     }
 
-    std::string request(buffer);
-    std::string path, body;
-    auto headers = parseHttpRequest(request, path, body);
+    // 结果压入来源反应器的完成栈
+    RequestTask* head = origin.completions.load(std::memory_order_relaxed);
+    do {
+        task->next = head;
+    } while (!origin.completions.compare_exchange_weak(head, task, std::memory_order_release,
+                                                       std::memory_order_relaxed));
+    wakeReactor(origin);
+}
+
+void HttpServer::drainCompletions(Reactor& reactor) {
+    RequestTask* task = reactor.completions.exchange(nullptr, std::memory_order_acquire);
 
-    // 获取请求方法
-    std::string method = headers["method"];
-    
-    // 处理请求
-    std::string response;
-    bool found = false;
+    // 栈是后进先出，反转后按完成顺序处理
+    RequestTask* ordered = nullptr;
+    while (task) {
+        RequestTask* next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+    while (ordered) {
+        RequestTask* next = ordered->next;
+        completeTask(reactor, ordered);
+        ordered = next;
+    }
+}
+
+void HttpServer::completeTask(Reactor& reactor, RequestTask* task) {
+    std::unique_ptr<RequestTask> owned(task);
+    auto it = reactor.connections.find(task->conn_fd);
+    if (it == reactor.connections.end() || it->second->id != task->conn_id) {
+        return;
+    }
+    HttpConnection& conn = *it->second;
+    if (!conn.awaiting_response) {
+        return;
+    }
+    conn.awaiting_response = false;
+    conn.admission_slot.reset();
+    setDeadline(reactor, conn, 0);
+    conn.output = std::move(task->response);
+    conn.route_id = task->route_id;
+    if (conn.trace_id) {
+        conn.write_start_ns = Metrics::nowNs();
+    }
+    if (task->file_length > 0) {
+        conn.file_fd = task->file_fd;
+        conn.file_offset = task->file_offset;
+        conn.file_remaining = task->file_length;
+        task->file_fd = -1;
+    }
+    writeConnection(reactor, conn);
+}
+
+void HttpServer::writeConnection(Reactor& reactor, HttpConnection& conn) {
+    while (conn.written < conn.output.length()) {
+        ssize_t n = write(conn.fd, conn.output.data() + conn.written, conn.output.length() - conn.written);
+        if (n > 0) {
+            conn.written += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // 发送缓冲区已满，等待可写后继续；每次写出数据后重新计时
+            struct epoll_event ev;
+            ev.events = EPOLLOUT;
+            ev.data.fd = conn.fd;
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+            setDeadline(reactor, conn, timeouts.write_idle_ms);
+            return;
+        }
+        break;
+    }
+
+    // 响应头写完后发送文件内容，由内核直接从页缓存拷贝到套接字
+    while (conn.written >= conn.output.length() && conn.file_remaining > 0) {
+        off_t offset = (off_t)conn.file_offset;
+        ssize_t n = sendfile(conn.fd, conn.file_fd, &offset,
+                             (size_t)std::min<uint64_t>(conn.file_remaining, kSendfileChunk));
+        if (n > 0) {
+            conn.file_offset = (uint64_t)offset;
+            conn.file_remaining -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct epoll_event ev;
+            ev.events = EPOLLOUT;
+            ev.data.fd = conn.fd;
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+            setDeadline(reactor, conn, timeouts.write_idle_ms);
+            return;
+        }
+        // 出错或文件被截断，客户端会发现内容长度不足
+        break;
+    }
+
+    // 状态码取自响应行 "HTTP/1.1 XXX"
+    int status = conn.output.length() > 12 ? std::atoi(conn.output.c_str() + 9) : 0;
+    uint64_t end_ns = Metrics::nowNs();
+    Metrics::recordRequest(conn.route_id, status, end_ns - conn.start_ns);
+    if (conn.trace_id) {
+        Trace::span(conn.trace_id, "write", conn.write_start_ns, end_ns);
+        Trace::span(conn.trace_id, "request", conn.start_ns, end_ns,
+                    conn.trace_detail + " " + std::to_string(status));
+    }
+    closeConnection(reactor, conn.fd);
+}
+
+void HttpServer::executeTask(RequestTask* task) {
+    if (!task->found || !admission) {
+        runTask(task, false);
+        return;
+    }
+
+    // 准入控制：先按IP和用户限流，再获取执行名额；被拒绝的请求不进入处理器
+    TraceContext trace_context(task->trace_id);
+    task->admission_ns = task->trace_id ? Metrics::nowNs() : 0;
+    int retry_after = 0;
+    if (!task->rate_checked && !admission->allowRequest(task->client_ip, bearerToken(task->headers), retry_after)) {
+        if (task->trace_id) {
+            Trace::span(task->trace_id, "admission", task->admission_ns, Metrics::nowNs());
+        }
+        task->response = buildRejectResponse(429, retry_after, "请求过于频繁，请稍后重试");
+        finishTask(task);
+        return;
+    }
+    if (admission->acquire(task->priority)) {
+        admitTask(task);
+        return;
+    }
+
+    // 名额已满：在本反应器上排队而不阻塞线程，名额归还时按优先级重试，超过排队期限返回503
+    Reactor& reactor = *reactors[task->origin];
+    reactor.queued++;
+    admission->enqueue(task->priority);
+    reactor.admission_queues[task->priority].push_back(task);
+    task->queue_timer = reactor.timers.schedule((uint64_t)admission->queueTimeoutMs(task->priority),
+                                                [this, &reactor, task]() {
+        expireQueuedTask(reactor, task);
+    });
+
+    // 入队之前归还的名额不会唤醒本反应器，入队后立即重试一次
+    drainAdmissionQueue(reactor);
+}
+
+void HttpServer::admitTask(RequestTask* task) {
+    if (task->trace_id) {
+        Trace::span(task->trace_id, "admission", task->admission_ns, Metrics::nowNs());
+    }
+    runTask(task, true);
+}
+
+void HttpServer::drainAdmissionQueue(Reactor& reactor) {
+    for (int priority = 0; priority < PRIORITY_LEVELS; ++priority) {
+        std::deque<RequestTask*>& queue = reactor.admission_queues[priority];
+        while (!queue.empty() && admission->acquireQueued((RequestPriority)priority)) {
+            RequestTask* task = queue.front();
+            queue.pop_front();
+            reactor.timers.cancel(task->queue_timer);
+            task->queue_timer = 0;
+            reactor.queued--;
+            admission->dequeue((RequestPriority)priority);
+            admitTask(task);
+        }
+    }
+}
+
+void HttpServer::expireQueuedTask(Reactor& reactor, RequestTask* task) {
+    std::deque<RequestTask*>& queue = reactor.admission_queues[task->priority];
+    queue.erase(std::find(queue.begin(), queue.end(), task));
+    task->queue_timer = 0;
+    reactor.queued--;
+    admission->dequeue(task->priority);
+    if (task->trace_id) {
+        Trace::span(task->trace_id, "admission", task->admission_ns, Metrics::nowNs());
+    }
+    task->response = buildRejectResponse(503, 1, "服务器繁忙，请稍后重试");
+    finishTask(task);
+
+    // 排在前面的高优先级请求离开后，其他反应器上较低优先级的请求可能可以执行了
+    notifyAdmissionQueues();
+}
+
+void HttpServer::releaseAdmission() {
+    if (admission->release()) {
+        notifyAdmissionQueues();
+    }
+}
+
+void HttpServer::notifyAdmissionQueues() {
+    for (auto& reactor : reactors) {
+        if (reactor->queued.load() > 0) {
+            wakeReactor(*reactor);
+        }
+    }
+}
+
+void HttpServer::runTask(RequestTask* task, bool holds_slot) {
+    const std::string& path = task->path;
+    uint64_t trace_id = task->trace_id;
+
+    // 处理器和它发起的后端调用都记在这个请求下，异步回调由发起方各自恢复
+    TraceContext trace_context(trace_id);
+
+    if (task->file_handler) {
+        FileResponse file;
+        try {
+            TraceScope handler_scope("handler");
+            task->file_handler(task->headers, file);
+        } catch (const std::exception& e) {
+            std::cerr << "处理请求 " << path << " 时出错: " << e.what() << std::endl;
+            file = FileResponse();
+            file.status = 500;
+            file.body = "{\"success\":false,\"message\":\"服务器内部错误\"}";
+        }
+        if (file.content_type.empty()) {
+            file.content_type = "application/json";
+        }
+        task->response = buildFileResponse(file, task->headers, task->file_offset, task->file_length);
+        if (task->file_length > 0) {
+            task->file_fd = file.fd;
+        } else if (file.fd >= 0) {
+            close(file.fd);
+        }
+        if (holds_slot) {
+            releaseAdmission();
+        }
+        finishTask(task);
+        return;
+    }
     
-    // 标准化API路径 - 处理可能的斜杠差异和查询参数
-    std::string normalized_path = removeQueryParams(path);
-    // 移除结尾的斜杠
-    while (normalized_path.length() > 1 && normalized_path.back() == '/') {
-        normalized_path.pop_back();
+    if (task->found) {
+        // 响应后task即被释放，处理器和请求内容先移出
+        AsyncHttpHandler handler = std::move(task->handler);
+        std::unordered_map<std::string, std::string> headers = std::move(task->headers);
+        std::string body = std::move(task->body);
+        std::string request_path = task->path;
+        
+        // 执行名额保持到处理器给出响应为止；长轮询的响应可能在其他线程上给出
+        std::shared_ptr<std::atomic<bool>> slot = std::make_shared<std::atomic<bool>>(holds_slot);
+        std::shared_ptr<std::atomic<bool>> responded = std::make_shared<std::atomic<bool>>(false);
+        auto releaseSlot = [this, slot] {
+            if (slot->exchange(false)) {
+                releaseAdmission();
+            }
+        };
+        if (holds_slot) {
+            auto conn_it = reactors[task->origin]->connections.find(task->conn_fd);
+            if (conn_it != reactors[task->origin]->connections.end() && conn_it->second->id == task->conn_id) {
+                conn_it->second->admission_slot = slot;
+            }
+        }
+        uint64_t handler_start_ns = trace_id ? Metrics::nowNs() : 0;
+        auto respondWith = [this, task, releaseSlot, responded, handler_start_ns](std::string response) {
+            if (responded->exchange(true)) {
+                return;
+            }
+            releaseSlot();
+            if (task->trace_id) {
+                // 从调用处理器到给出响应，包括异步处理器等待后端的时间
+                Trace::span(task->trace_id, "handler", handler_start_ns, Metrics::nowNs());
+            }
+            task->response = std::move(response);
+            finishTask(task);
+        };
+        std::string content_type = task->content_type;
+        bool long_poll = task->long_poll;
+        
+        // 处理器在反应器线程上执行，异常不能逃出事件循环
+        try {
+            handler(headers, body, [this, content_type, respondWith](const std::string& content) {
+                respondWith(buildHttpResponse(content_type, content));
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "处理请求 " << request_path << " 时出错: " << e.what() << std::endl;
+            respondWith(buildHttpResponse("application/json", "{\"success\":false,\"message\":\"服务器内部错误\"}", 500));
+        }
+        
+        // 长轮询请求开始等待后不再占用执行名额（此时task可能已被释放，不能再访问）
+        if (long_poll) {
+            releaseSlot();
+        }
+        return;
     }
 
+    // 返回页面或静态资源
+    {
+        TraceScope asset_scope("asset");
+        task->response = buildAssetResponse(task->asset_path, task->headers);
+    }
+    if (task->response.empty()) {
+        // 返回404
+        std::cerr << "404错误: 路径 " << path << " 不存在" << std::endl;
+        task->response = buildHttpResponse("text/html", "<html><body><h1>404 Not Found</h1><p>The requested URL " + path + " was not found on this server.</p></body></html>", 404);
+    }
+    finishTask(task);
+}
+
+bool HttpServer::resolveRoute(const std::string& method, const std::string& path, RouteMatch& match) {
     // 处理路由匹配
     if (method == "POST") {
+        // 标准化API路径 - 处理可能的斜杠差异和查询参数
+        std::string normalized_path = removeQueryParams(path);
+        // 移除结尾的斜杠
+        while (normalized_path.length() > 1 && normalized_path.back() == '/') {
+            normalized_path.pop_back();
+        }
+        
         // 尝试查找完全匹配的处理函数
-        {
-            std::lock_guard<std::mutex> lock(handlers_mutex);
-            auto it = handlers.find(normalized_path);
-            if (it != handlers.end()) {
-                std::string content = it->second(headers, body);
-                response = buildHttpResponse("application/json", content);
-                found = true;
+        auto it = handlers.find(normalized_path);
+        if (it != handlers.end()) {
+            match.handler = &it->second;
+            match.route_id = route_ids[it->first];
+            match.content_type = "application/json";
+            auto priority_it = priorities.find(it->first);
+            if (priority_it != priorities.end()) {
+                match.priority = priority_it->second;
             }
+            match.long_poll = long_poll_routes.count(it->first) > 0;
+            return true;
         }
         
         // 如果未找到匹配，尝试进行API前缀匹配
-        if (!found && normalized_path.find("/api/") == 0) {
-            std::lock_guard<std::mutex> lock(handlers_mutex);
-            
+        if (normalized_path.find("/api/") == 0) {
             for (const auto& handler_pair : handlers) {
                 if (normalized_path.find(handler_pair.first) == 0 || handler_pair.first.find(normalized_path) == 0) {
-                    std::string content = handler_pair.second(headers, body);
-                    response = buildHttpResponse("application/json", content);
-                    found = true;
-                    break;
+                    match.handler = &handler_pair.second;
+                    match.route_id = route_ids[handler_pair.first];
+                    match.content_type = "application/json";
+                    auto priority_it = priorities.find(handler_pair.first);
+                    if (priority_it != priorities.end()) {
+                        match.priority = priority_it->second;
+                    }
+                    match.long_poll = long_poll_routes.count(handler_pair.first) > 0;
+                    return true;
                 }
             }
         }
-    } else {
-        // 处理非POST请求
-        {
-            std::lock_guard<std::mutex> lock(handlers_mutex);
-            // 去除查询参数
-            std::string clean_path = removeQueryParams(path);
-            
-            auto it = handlers.find(clean_path);
-            if (it != handlers.end()) {
-                // 找到处理函数，调用处理函数
-                std::string content = it->second(headers, body);
-                
-                // 根据内容类型设置响应头
-                std::string contentType = "text/html";
-                if (path.find("/api/") == 0) {
-                    contentType = "application/json";
-                }
-                
-                response = buildHttpResponse(contentType, content);
-                found = true;
-            }
-        }
+        return false;
     }
-
-    if (!found) {
-        // 尝试返回静态文件
-        std::string content = handleStaticFile(path);
-        if (!content.empty()) {
-            std::string content_type = "text/html";
-            if (endsWith(path, ".css")) {
-                content_type = "text/css";
-            } else if (endsWith(path, ".js")) {
-                content_type = "application/javascript";
-            } else if (endsWith(path, ".jpg") || endsWith(path, ".jpeg")) {
-                content_type = "image/jpeg";
-            } else if (endsWith(path, ".png")) {
-                content_type = "image/png";
-            }
-            response = buildHttpResponse(content_type, content);
-        } else {
-            // 返回404
-            std::cerr << "404错误: 路径 " << path << " 不存在" << std::endl;
-            response = buildHttpResponse("text/html", "<html><body><h1>404 Not Found</h1><p>The requested URL " + path + " was not found on this server.</p></body></html>");
-        }
+    
+    // 处理非POST请求，去除查询参数
+    std::string clean_path = removeQueryParams(path);
+    auto it = handlers.find(clean_path);
+    if (it == handlers.end()) {
+        return false;
     }
-
-    // 发送响应
-    write(client_fd, response.c_str(), response.length());
-    close(client_fd);
+    
+    match.handler = &it->second;
+    match.route_id = route_ids[clean_path];
+    auto priority_it = priorities.find(clean_path);
+    if (priority_it != priorities.end()) {
+        match.priority = priority_it->second;
+    }
+    match.long_poll = long_poll_routes.count(clean_path) > 0;
+    
+    // 根据内容类型设置响应头
+    auto type_it = content_types.find(clean_path);
+    if (type_it != content_types.end()) {
+        match.content_type = type_it->second;
+    } else if (path.find("/api/") == 0) {
+        match.content_type = "application/json";
+    } else {
+        match.content_type = "text/html";
+    }
+    return true;
 }
 
 std::unordered_map<std::string, std::string> HttpServer::parseHttpRequest(
@@ -239,8 +1203,9 @@ std::unordered_map<std::string, std::string> HttpServer::parseHttpRequest(
     // 输出HTTP请求方法和路径信息
     std::cout << "收到HTTP请求: " << method << " " << path << " " << http_version << std::endl;
     
-    // 将请求方法添加到请求头中
+    // 将请求方法和完整路径（含查询参数）添加到请求头中
     headers["method"] = method;
+    headers["path"] = path;
 
     // 解析请求头
     while (std::getline(stream, line) && line != "\r") {
@@ -281,25 +1246,154 @@ std::unordered_map<std::string, std::string> HttpServer::parseHttpRequest(
     return headers;
 }
 
-std::string HttpServer::buildHttpResponse(const std::string& content_type, const std::string& body) {
+std::string HttpServer::buildHttpResponse(const std::string& content_type, const std::string& body,
+                                          int status, const std::string& extra_headers) {
+    return buildHttpHeader(content_type, body.length(), status, extra_headers) + body;
+}
+
+std::string HttpServer::buildHttpHeader(const std::string& content_type, uint64_t content_length,
+                                        int status, const std::string& extra_headers) {
+    const char* reason = "OK";
+    switch (status) {
+        case 206: reason = "Partial Content"; break;
+        case 304: reason = "Not Modified"; break;
+        case 401: reason = "Unauthorized"; break;
+        case 404: reason = "Not Found"; break;
+        case 408: reason = "Request Timeout"; break;
+        case 411: reason = "Length Required"; break;
+        case 413: reason = "Payload Too Large"; break;
+        case 416: reason = "Range Not Satisfiable"; break;
+        case 500: reason = "Internal Server Error"; break;
+        case 429: reason = "Too Many Requests"; break;
+        case 503: reason = "Service Unavailable"; break;
+        case 504: reason = "Gateway Timeout"; break;
+    }
+    
     std::stringstream response;
-    response << "HTTP/1.1 200 OK\r\n"
+    response << "HTTP/1.1 " << status << " " << reason << "\r\n"
              << "Content-Type: " << content_type << "\r\n"
-             << "Content-Length: " << body.length() << "\r\n"
+             << "Content-Length: " << content_length << "\r\n"
+             << extra_headers
              << "Connection: close\r\n"
-             << "\r\n"
-             << body;
+             << "\r\n";
     return response.str();
 }
 
-std::string HttpServer::handleStaticFile(const std::string& path) {
-    std::string file_path = "./static" + (path == "/" ? "/index.html" : path);
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
+// 解析"bytes=first-last"、"bytes=first-"或"bytes=-suffix"形式的单个区间
+// 返回1表示区间有效，0表示无法满足，-1表示无法识别（按普通请求返回整个文件）
+static int parseByteRange(const std::string& value, uint64_t size, uint64_t& first, uint64_t& last) {
+    if (value.compare(0, 6, "bytes=") != 0 || value.find(',') != std::string::npos) {
+        return -1;
+    }
+    std::string spec = value.substr(6);
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return -1;
+    }
+    std::string start_text = spec.substr(0, dash);
+    std::string end_text = spec.substr(dash + 1);
+    auto isNumber = [](const std::string& text) {
+        return !text.empty() && text.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if ((!start_text.empty() && !isNumber(start_text)) || (!end_text.empty() && !isNumber(end_text)) ||
+        (start_text.empty() && end_text.empty())) {
+        return -1;
+    }
+
+    if (start_text.empty()) {
+        // 最后suffix个字节
+        uint64_t suffix = std::strtoull(end_text.c_str(), nullptr, 10);
+        if (suffix == 0 || size == 0) {
+            return 0;
+        }
+        first = size > suffix ? size - suffix : 0;
+        last = size - 1;
+        return 1;
+    }
+
+    first = std::strtoull(start_text.c_str(), nullptr, 10);
+    last = end_text.empty() ? size - 1 : std::strtoull(end_text.c_str(), nullptr, 10);
+    if (first >= size || last < first) {
+        return 0;
+    }
+    last = std::min(last, size - 1);
+    return 1;
+}
+
+std::string HttpServer::buildFileResponse(const FileResponse& file,
+                                          const std::unordered_map<std::string, std::string>& headers,
+                                          uint64_t& offset, uint64_t& length) {
+    offset = 0;
+    length = 0;
+    if (file.fd < 0) {
+        return buildHttpResponse(file.content_type, file.body, file.status, file.extra_headers);
+    }
+
+    std::string extra_headers = file.extra_headers + "Accept-Ranges: bytes\r\n";
+    if (!file.etag.empty()) {
+        extra_headers += "ETag: " + file.etag + "\r\n";
+        auto match_it = headers.find("If-None-Match");
+        if (match_it != headers.end() && match_it->second == file.etag) {
+            return buildHttpResponse(file.content_type, "", 304, extra_headers);
+        }
+    }
+
+    auto range_it = headers.find("Range");
+    if (range_it != headers.end()) {
+        uint64_t first = 0, last = 0;
+        int range = parseByteRange(range_it->second, file.size, first, last);
+        if (range == 0) {
+            return buildHttpResponse(file.content_type, "", 416,
+                                     extra_headers + "Content-Range: bytes */" + std::to_string(file.size) + "\r\n");
+        }
+        if (range > 0) {
+            offset = first;
+            length = last - first + 1;
+            return buildHttpHeader(file.content_type, length, 206,
+                                   extra_headers + "Content-Range: bytes " + std::to_string(first) + "-" +
+                                   std::to_string(last) + "/" + std::to_string(file.size) + "\r\n");
+        }
+    }
+
+    length = file.size;
+    return buildHttpHeader(file.content_type, length, 200, extra_headers);
+}
+
+std::string HttpServer::buildRejectResponse(int status, int retry_after_seconds, const std::string& message) {
+    std::string body = "{\"success\":false,\"message\":\"" + message + "\"}";
+    return buildHttpResponse("application/json", body, status,
+                             "Retry-After: " + std::to_string(retry_after_seconds) + "\r\n");
+}
+
+std::string HttpServer::buildAssetResponse(const std::string& asset_path,
+                                           const std::unordered_map<std::string, std::string>& headers) {
+    // 开发时从覆盖目录读取，每次请求都读最新的文件，不做缓存协商
+    if (!assetOverrideDirectory().empty()) {
+        std::string content;
+        if (!readAssetFromDisk(asset_path, content)) {
+            return "";
+        }
+        return buildHttpResponse(assetContentType(asset_path), content, 200, "Cache-Control: no-cache\r\n");
+    }
+
+    const EmbeddedAsset* asset = findEmbeddedAsset(asset_path);
+    if (asset == nullptr) {
         return "";
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    // 资源随程序一起更新，客户端每次用ETag验证缓存是否仍然有效
+    std::string cache_headers = std::string("ETag: ") + asset->etag + "\r\nCache-Control: no-cache\r\n";
+    auto match_it = headers.find("If-None-Match");
+    if (match_it != headers.end() && match_it->second == asset->etag) {
+        return buildHttpResponse(asset->content_type, "", 304, cache_headers);
+    }
+
+    cache_headers += "Vary: Accept-Encoding\r\n";
+    auto encoding_it = headers.find("Accept-Encoding");
+    if (asset->gzip_data && encoding_it != headers.end() && encoding_it->second.find("gzip") != std::string::npos) {
+        std::string body(reinterpret_cast<const char*>(asset->gzip_data), asset->gzip_size);
+        return buildHttpResponse(asset->content_type, body, 200, cache_headers + "Content-Encoding: gzip\r\n");
+    }
+    std::string body(reinterpret_cast<const char*>(asset->data), asset->size);
+    return buildHttpResponse(asset->content_type, body, 200, cache_headers);
 }
@@ -0,0 +1,205 @@
+#include "../include/storage.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+static const char kAttachmentMarker = '\x02';
+
+// 消息记录编码
+std::string encodeMessageRecord(const ChatMessage& message) {
+    std::string record;
+    if (!message.attachments.empty()) {
+        record += kAttachmentMarker;
+        record += joinAttachmentIds(message.attachments);
+        record += kAttachmentMarker;
+    }
+    record += message.username() + ":" + message.content + ":" + message.timestamp;
+    return record;
+}
+
+// 消息记录解码
+bool decodeMessageRecord(const std::string& record, ChatMessage& message) {
+    std::string data = record;
+    message.attachments.clear();
+    if (!record.empty() && record[0] == kAttachmentMarker) {
+        size_t end = record.find(kAttachmentMarker, 1);
+        if (end == std::string::npos) {
+            return false;
+        }
+        message.attachments = splitAttachmentIds(record.substr(1, end - 1));
+        data = record.substr(end + 1);
+    }
+
+    size_t first_colon = data.find(':');
+    if (first_colon == std::string::npos) {
+        return false;
+    }
+
+    size_t second_colon = data.find(':', first_colon + 1);
+    if (second_colon == std::string::npos) {
+        return false;
+    }
+
+    message.user_id = UserTable::intern(data.substr(0, first_colon));
+    message.content = data.substr(first_colon + 1, second_colon - first_colon - 1);
+    message.timestamp = data.substr(second_colon + 1);
+    return true;
+}
+
+std::string joinAttachmentIds(const std::vector<std::string>& attachments) {
+    std::string joined;
+    for (size_t i = 0; i < attachments.size(); ++i) {
+        if (i > 0) {
+            joined += ',';
+        }
+        joined += attachments[i];
+    }
+    return joined;
+}
+
+std::vector<std::string> splitAttachmentIds(const std::string& joined) {
+    std::vector<std::string> attachments;
+    size_t start = 0;
+    while (start < joined.size()) {
+        size_t comma = joined.find(',', start);
+        if (comma == std::string::npos) {
+            comma = joined.size();
+        }
+        if (comma > start) {
+            attachments.push_back(joined.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return attachments;
+}
+
+// 格式化消息时间戳，使用localtime_r以便多个请求线程同时调用
+std::string formatMessageTimestamp(time_t time) {
+    std::tm tm = {};
+    localtime_r(&time, &tm);
+    char buffer[32];
+    size_t len = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string(buffer, len);
+}
+
+// 解析消息时间戳
+time_t parseMessageTimestamp(const std::string& timestamp) {
+    std::tm tm = {};
+    std::istringstream ss(timestamp);
+    ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+    if (ss.fail()) {
+        return 0;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// 计算分页区间
+bool planMessagePage(int count, int before_seq, int after_seq, int limit, MessagePage& page, int& first, int& last) {
+    if (limit <= 0) {
+        limit = 50;
+    }
+
+    // 按64位计算，游标和条数接近INT_MAX时不会溢出；结果总在[1, count]或为空区间，可以放回int
+    int64_t lo;
+    int64_t hi;
+    if (after_seq > 0) {
+        lo = (int64_t)after_seq + 1;
+        hi = std::min<int64_t>(count, (int64_t)after_seq + limit);
+    } else if (before_seq > 0) {
+        hi = std::min<int64_t>(count, (int64_t)before_seq - 1);
+        lo = std::max<int64_t>(1, hi - limit + 1);
+    } else {
+        hi = count;
+        lo = std::max<int64_t>(1, (int64_t)count - limit + 1);
+    }
+
+    page.next_cursor = (int)std::max<int64_t>(after_seq, hi);
+    page.has_more = after_seq > 0 && hi < count;
+
+    if (lo > hi) {
+        page.prev_cursor = 0;
+        first = 1;
+        last = 0;
+        return false;
+    }
+    first = (int)lo;
+    last = (int)hi;
+    page.prev_cursor = first > 1 ? first : 0;
+    return true;
+}
+
+bool Storage::listUsernames(std::vector<std::string>& usernames) {
+    usernames.clear();
+    return false;
+}
+
+bool Storage::readRoomMessagesBySeq(int room_id, const std::vector<int>& seqs, std::vector<ChatMessage>& messages) {
+    // 间隔不超过kMaxGap的序号放在同一个区间里读取，区间内不需要的消息丢弃
+    const int kMaxGap = 64;
+    size_t begin = 0;
+    while (begin < seqs.size()) {
+        size_t end = begin + 1;
+        while (end < seqs.size() && seqs[end] - seqs[end - 1] <= kMaxGap) {
+            ++end;
+        }
+        int first = seqs[begin];
+        int last = seqs[end - 1];
+        MessagePage page;
+        if (!readRoomMessages(room_id, last + 1, 0, last - first + 1, page)) {
+            return false;
+        }
+        size_t next = begin;
+        for (auto& message : page.messages) {
+            while (next < end && seqs[next] < message.seq) {
+                ++next;
+            }
+            if (next < end && seqs[next] == message.seq) {
+                messages.push_back(std::move(message));
+            }
+        }
+        begin = end;
+    }
+    return true;
+}
+
+bool Storage::getRoomHeads(const std::vector<int>& room_ids, std::vector<int>& heads) {
+    heads.assign(room_ids.size(), 0);
+    for (size_t i = 0; i < room_ids.size(); ++i) {
+        MessagePage page;
+        if (readRoomMessages(room_ids[i], 0, 0, 1, page) && !page.messages.empty()) {
+            heads[i] = page.messages.back().seq;
+        }
+    }
+    return true;
+}
+
+void Storage::findTokenAsync(const std::string& token, TokenCallback done) {
+    std::string username;
+    bool ok = findToken(token, username);
+    done(ok, username);
+}
+
+void Storage::appendRoomMessageAsync(int room_id, const ChatMessage& message, AppendCallback done) {
+    ChatMessage record = message;
+    bool ok = appendRoomMessage(room_id, record);
+    done(ok, record);
+}
+
+void Storage::readRoomMessagesAsync(int room_id, int before_seq, int after_seq, int limit, PageCallback done) {
+    MessagePage page;
+    bool ok = readRoomMessages(room_id, before_seq, after_seq, limit, page);
+    done(ok, page);
+}
+
+void Storage::getRoomHeadsAsync(const std::vector<int>& room_ids, HeadsCallback done) {
+    std::vector<int> heads;
+    bool ok = getRoomHeads(room_ids, heads);
+    done(ok, heads);
+}
+
+void Storage::appendRoomMessagesAsync(std::vector<RoomAppend> batch) {
+    for (auto& append : batch) {
+        appendRoomMessageAsync(append.room_id, append.message, append.done);
+    }
+}
@@ -0,0 +1,125 @@
+#include "../include/template_engine.h"
+#include "../include/embedded_assets.h"
+#include <iostream>
+#include <mutex>
+
+bool PageTemplate::compile(const std::string& text) {
+    segments.clear();
+    text_bytes = 0;
+
+    size_t pos = 0;
+    while (pos < text.length()) {
+        size_t open = text.find("{{", pos);
+        if (open == std::string::npos) {
+            open = text.length();
+        }
+        if (open > pos) {
+            segments.push_back({Segment::TEXT, text.substr(pos, open - pos)});
+            text_bytes += open - pos;
+        }
+        if (open == text.length()) {
+            break;
+        }
+
+        bool raw = text.compare(open, 3, "{{{") == 0;
+        const char* close_tag = raw ? "}}}" : "}}";
+        size_t name_start = open + (raw ? 3 : 2);
+        size_t close = text.find(close_tag, name_start);
+        if (close == std::string::npos) {
+            return false;
+        }
+
+        // 变量名两侧允许空白
+        size_t first = text.find_first_not_of(" \t", name_start);
+        size_t last = text.find_last_not_of(" \t", close - 1);
+        if (first == std::string::npos || first >= close || last < first) {
+            return false;
+        }
+        segments.push_back({raw ? Segment::RAW : Segment::ESCAPED, text.substr(first, last - first + 1)});
+        pos = close + (raw ? 3 : 2);
+    }
+    return true;
+}
+
+std::string PageTemplate::render(const Values& values) const {
+    std::string out;
+    out.reserve(text_bytes + 4096);
+    for (const auto& segment : segments) {
+        if (segment.kind == Segment::TEXT) {
+            out += segment.text;
+            continue;
+        }
+        auto it = values.find(segment.text);
+        if (it == values.end()) {
+            continue;
+        }
+        out += segment.kind == Segment::RAW ? it->second : escapeHtml(it->second);
+    }
+    return out;
+}
+
+std::shared_ptr<const PageTemplate> PageTemplate::load(const std::string& asset_path) {
+    // 开发模式：每次从磁盘读取，不缓存
+    if (!assetOverrideDirectory().empty()) {
+        std::string text;
+        std::shared_ptr<PageTemplate> page = std::make_shared<PageTemplate>();
+        if (!readAssetFromDisk(asset_path, text) || !page->compile(text)) {
+            std::cerr << "加载页面模板失败: " << asset_path << std::endl;
+            return nullptr;
+        }
+        return page;
+    }
+
+    static std::mutex cache_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const PageTemplate>> cache;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(asset_path);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    const EmbeddedAsset* asset = findEmbeddedAsset(asset_path);
+    std::shared_ptr<PageTemplate> page = std::make_shared<PageTemplate>();
+    if (asset == nullptr ||
+        !page->compile(std::string(reinterpret_cast<const char*>(asset->data), asset->size))) {
+        std::cerr << "加载页面模板失败: " << asset_path << std::endl;
+        page.reset();
+    }
+    cache[asset_path] = page;
+    return page;
+}
+
+std::string escapeHtml(const std::string& text) {
+    std::string out;
+    out.reserve(text.length());
+    for (char c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+std::string escapeScriptJson(const std::string& json) {
+    std::string out;
+    out.reserve(json.length());
+    for (size_t i = 0; i < json.length(); ++i) {
+        char c = json[i];
+        if (c == '<') {
+            out += "\\u003c";
+        } else if (c == '\xe2' && i + 2 < json.length() && json[i + 1] == '\x80' &&
+                   (json[i + 2] == '\xa8' || json[i + 2] == '\xa9')) {
+            // U+2028/U+2029的UTF-8编码为E2 80 A8/A9
+            out += json[i + 2] == '\xa8' ? "\\u2028" : "\\u2029";
+            i += 2;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
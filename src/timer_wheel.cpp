@@ -0,0 +1,175 @@
+#include "../include/timer_wheel.h"
+#include <chrono>
+#include <algorithm>
+
+TimerWheel::TimerWheel(uint64_t tick_ms, uint64_t now_ms)
+    : tick_ms(tick_ms > 0 ? tick_ms : 1), current_tick(now_ms / (tick_ms > 0 ? tick_ms : 1)), current_ms(now_ms),
+      count(0) {
+    // 各槽的链表头和正在触发的链表头，都是指向自己的空循环链表
+    nodes.resize(kLevels * kSlots + 1);
+    expiring = kLevels * kSlots;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        nodes[i].prev = i;
+        nodes[i].next = i;
+    }
+}
+
+uint64_t TimerWheel::nowMs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t delay_ms, std::function<void()> callback) {
+    return scheduleAt(current_ms + delay_ms, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::scheduleAt(uint64_t deadline_ms, std::function<void()> callback) {
+    uint32_t index;
+    if (!free_nodes.empty()) {
+        index = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        index = (uint32_t)nodes.size();
+        nodes.emplace_back();
+    }
+
+    Node& node = nodes[index];
+    node.generation++;
+    node.active = true;
+    // 向上取整，定时器不会早于deadline_ms触发；当前刻度的槽已经处理过，最早放到下一个刻度
+    node.expires = std::max(current_tick + 1, (deadline_ms + tick_ms - 1) / tick_ms);
+    node.callback = std::move(callback);
+    insert(index);
+    count++;
+    return ((TimerId)node.generation << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    uint32_t index = (uint32_t)id;
+    if (id == 0 || index < expiring + 1 || index >= nodes.size()) {
+        return false;
+    }
+    Node& node = nodes[index];
+    if (!node.active || node.generation != (uint32_t)(id >> 32)) {
+        return false;
+    }
+    unlink(index);
+    node.active = false;
+    node.callback = nullptr;
+    free_nodes.push_back(index);
+    count--;
+    return true;
+}
+
+void TimerWheel::advance(uint64_t now_ms) {
+    uint64_t target = now_ms / tick_ms;
+    current_ms = std::max(current_ms, now_ms);
+    if (count == 0) {
+        current_tick = std::max(current_tick, target);
+        return;
+    }
+
+    while (current_tick < target) {
+        current_tick++;
+        uint32_t index = (uint32_t)(current_tick & kSlotMask);
+        if (index == 0) {
+            cascade(1);
+        }
+
+        // 先把整个槽移到触发链表，回调中取消同一槽的其他定时器时直接从触发链表摘除
+        uint32_t head = slotHead(0, index);
+        while (nodes[head].next != head) {
+            uint32_t node = nodes[head].next;
+            unlink(node);
+            link(expiring, node);
+        }
+        while (nodes[expiring].next != expiring) {
+            uint32_t node = nodes[expiring].next;
+            unlink(node);
+            std::function<void()> callback = std::move(nodes[node].callback);
+            nodes[node].active = false;
+            nodes[node].callback = nullptr;
+            free_nodes.push_back(node);
+            count--;
+            callback();
+        }
+
+        if (count == 0) {
+            current_tick = target;
+            break;
+        }
+    }
+}
+
+int TimerWheel::nextTimeoutMs() const {
+    if (count == 0) {
+        return -1;
+    }
+    // 第0层中下一个非空的槽；都为空时在下一次上层分散时再检查
+    uint32_t start = (uint32_t)(current_tick & kSlotMask);
+    uint32_t ticks = kSlots;
+    for (uint32_t i = 1; i <= kSlots; ++i) {
+        uint32_t index = (start + i) & kSlotMask;
+        uint32_t head = slotHead(0, index);
+        if (nodes[head].next != head || index == 0) {
+            ticks = i;
+            break;
+        }
+    }
+    // 从最近一次推进的时间算到该刻度的起点，而不是从当前刻度的起点算整数个刻度，否则最多晚一个刻度
+    uint64_t edge_ms = (current_tick + ticks) * tick_ms;
+    return edge_ms > current_ms ? (int)(edge_ms - current_ms) : 0;
+}
+
+void TimerWheel::link(uint32_t head, uint32_t node) {
+    uint32_t last = nodes[head].prev;
+    nodes[node].prev = last;
+    nodes[node].next = head;
+    nodes[last].next = node;
+    nodes[head].prev = node;
+}
+
+void TimerWheel::unlink(uint32_t node) {
+    uint32_t prev = nodes[node].prev;
+    uint32_t next = nodes[node].next;
+    nodes[prev].next = next;
+    nodes[next].prev = prev;
+    nodes[node].prev = node;
+    nodes[node].next = node;
+}
+
+void TimerWheel::insert(uint32_t node) {
+    // 分散上层的槽时当前刻度的第0层槽尚未处理，到期刻度等于当前刻度的定时器放在该槽中随即触发
+    uint64_t expires = std::max(nodes[node].expires, current_tick);
+    uint64_t delta = expires - current_tick;
+
+    // 剩余时间落在哪一层，就放在该层中到期刻度对应的槽
+    int level = 0;
+    while (level < kLevels - 1 && delta >= ((uint64_t)1 << (kSlotBits * (level + 1)))) {
+        level++;
+    }
+    if (level == kLevels - 1 && delta >= ((uint64_t)1 << (kSlotBits * kLevels))) {
+        // 超出时间轮范围，先放在最远的位置，分散时再重新计算
+        expires = current_tick + ((uint64_t)1 << (kSlotBits * kLevels)) - 1;
+    }
+    uint32_t index = (uint32_t)((expires >> (kSlotBits * level)) & kSlotMask);
+    link(slotHead(level, index), node);
+}
+
+void TimerWheel::cascade(int level) {
+    uint32_t index = (uint32_t)((current_tick >> (kSlotBits * level)) & kSlotMask);
+    if (index == 0 && level + 1 < kLevels) {
+        cascade(level + 1);
+    }
+
+    uint32_t head = slotHead(level, index);
+    std::vector<uint32_t> moved;
+    while (nodes[head].next != head) {
+        uint32_t node = nodes[head].next;
+        unlink(node);
+        moved.push_back(node);
+    }
+    for (uint32_t node : moved) {
+        insert(node);
+    }
+}
@@ -0,0 +1,207 @@
+#include "../include/trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+
+std::atomic<uint32_t> Trace::sample_every(0);
+thread_local uint64_t Trace::t_current = 0;
+
+namespace {
+
+// 每个线程保留的最近事件数，单个事件约80字节，16个线程约占20MB
+const size_t kEventsPerThread = 16384;
+
+struct TraceEvent {
+    uint64_t trace_id;
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    std::string detail;
+};
+
+// 一个线程的环形缓冲区，只有本线程写入；锁只在导出时才有竞争
+struct ThreadBuffer {
+    int tid;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t next = 0;   // 下一个写入位置，写满后从头覆盖最旧的事件
+};
+
+std::mutex g_buffers_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;   // 线程退出后缓冲区保留，已记录的事件仍可导出
+std::atomic<uint64_t> g_request_counter(0);
+std::atomic<uint64_t> g_next_trace_id(1);
+
+// 当前线程的缓冲区，首次记录时创建并登记
+ThreadBuffer& localBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.reserve(256);
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        buffer->tid = (int)g_buffers.size() + 1;
+        g_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void writeEscaped(std::ostringstream& out, const std::string& text) {
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\u%04x", c);
+                    out << hex;
+                } else {
+                    out << (char)c;
+                }
+        }
+    }
+}
+
+// 时间戳以微秒为单位，保留纳秒精度
+void writeMicros(std::ostringstream& out, uint64_t ns) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%llu.%03u", (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+    out << buffer;
+}
+
+} // namespace
+
+void Trace::setSampleEvery(uint32_t every) {
+    sample_every.store(every, std::memory_order_relaxed);
+}
+
+uint64_t Trace::nextSample(uint32_t every) {
+    if (g_request_counter.fetch_add(1, std::memory_order_relaxed) % every != 0) {
+        return 0;
+    }
+    return g_next_trace_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::span(uint64_t trace_id, const char* name, uint64_t start_ns, uint64_t end_ns,
+                 const std::string& detail) {
+    ThreadBuffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() < kEventsPerThread) {
+        buffer.events.push_back(TraceEvent{trace_id, name, start_ns, std::max(start_ns, end_ns), detail});
+        return;
+    }
+    TraceEvent& event = buffer.events[buffer.next];
+    event.trace_id = trace_id;
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = std::max(start_ns, end_ns);
+    event.detail = detail;
+    buffer.next = (buffer.next + 1) % kEventsPerThread;
+}
+
+std::string Trace::renderChromeTrace() {
+    struct Exported {
+        int tid;
+        TraceEvent event;
+    };
+    std::vector<Exported> all;
+
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        buffers = g_buffers;
+    }
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        for (const auto& event : buffer->events) {
+            all.push_back(Exported{buffer->tid, event});
+        }
+    }
+
+    // 同一请求的阶段按开始时间排列，开始时间相同时外层（结束更晚）在前，嵌套关系才能正确显示
+    std::sort(all.begin(), all.end(), [](const Exported& a, const Exported& b) {
+        if (a.event.trace_id != b.event.trace_id) {
+            return a.event.trace_id < b.event.trace_id;
+        }
+        if (a.event.start_ns != b.event.start_ns) {
+            return a.event.start_ns < b.event.start_ns;
+        }
+        return a.event.end_ns > b.event.end_ns;
+    });
+
+    // 每个阶段导出为一对嵌套异步事件（b/e），id为追踪编号，同一请求跨线程的阶段显示在同一条轨道上
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& item : all) {
+        const TraceEvent& event = item.event;
+        for (int phase = 0; phase < 2; ++phase) {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "{\"name\":\"";
+            writeEscaped(out, event.name);
+            out << "\",\"cat\":\"request\",\"ph\":\"" << (phase == 0 ? 'b' : 'e')
+                << "\",\"id\":\"0x" << std::hex << event.trace_id << std::dec
+                << "\",\"pid\":1,\"tid\":" << item.tid << ",\"ts\":";
+            writeMicros(out, phase == 0 ? event.start_ns : event.end_ns);
+            if (phase == 0) {
+                out << ",\"args\":{\"thread\":" << item.tid;
+                if (!event.detail.empty()) {
+                    out << ",\"detail\":\"";
+                    writeEscaped(out, event.detail);
+                    out << "\"";
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+bool Trace::dumpToFile(const std::string& path) {
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        std::cerr << "无法写入追踪文件: " << path << std::endl;
+        return false;
+    }
+    file << renderChromeTrace();
+    return (bool)file;
+}
+
+bool Trace::installDumpSignal(int signo, const std::string& path) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    // 之后创建的线程都继承这个屏蔽字，信号只由下面的线程接收
+    if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) {
+        std::cerr << "无法屏蔽追踪导出信号" << std::endl;
+        return false;
+    }
+
+    std::thread([set, path]() {
+        while (true) {
+            int received = 0;
+            if (sigwait(&set, &received) != 0) {
+                continue;
+            }
+            std::string file = path + "." + std::to_string((long long)time(nullptr)) + ".json";
+            if (dumpToFile(file)) {
+                std::cout << "追踪已导出到 " << file << std::endl;
+            }
+        }
+    }).detach();
+    return true;
+}
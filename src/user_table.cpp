@@ -0,0 +1,155 @@
+#include "../include/user_table.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <iostream>
+
+namespace {
+
+// 名称按编号分块存放，块一旦分配就不再移动，已发布的名称不再修改
+const uint32_t kChunkBits = 12;
+const uint32_t kChunkSize = 1u << kChunkBits;
+const uint32_t kMaxChunks = 1u << 16;
+
+struct NameChunk {
+    std::string names[kChunkSize];
+};
+
+// 开放寻址表，槽位保存用户编号，0表示空槽；用户名从编号取得后比较
+struct NameIndex {
+    explicit NameIndex(size_t capacity) : mask(capacity - 1), slots(new std::atomic<uint32_t>[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+};
+
+// 静态存储，零初始化，不依赖其他编译单元的初始化顺序
+std::atomic<NameChunk*> g_chunks[kMaxChunks];
+std::atomic<uint32_t> g_count(1);   // 下一个分配的编号，0保留给空用户名
+std::atomic<NameIndex*> g_index(nullptr);
+const std::string g_empty;
+
+// 只有登记新用户名时使用
+struct WriterState {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<NameIndex>> indexes;   // 扩容后旧表仍可能被读者使用，保留到进程退出
+};
+
+WriterState& writerState() {
+    static WriterState state;
+    return state;
+}
+
+const std::string& nameOf(uint32_t user_id) {
+    return g_chunks[user_id >> kChunkBits].load(std::memory_order_acquire)->names[user_id & (kChunkSize - 1)];
+}
+
+bool lookup(const NameIndex* index, const std::string& username, size_t hash, uint32_t& user_id) {
+    for (size_t slot = hash & index->mask;; slot = (slot + 1) & index->mask) {
+        uint32_t id = index->slots[slot].load(std::memory_order_acquire);
+        if (id == 0) {
+            return false;
+        }
+        if (nameOf(id) == username) {
+            user_id = id;
+            return true;
+        }
+    }
+}
+
+void insert(NameIndex* index, uint32_t user_id, size_t hash) {
+    size_t slot = hash & index->mask;
+    while (index->slots[slot].load(std::memory_order_relaxed) != 0) {
+        slot = (slot + 1) & index->mask;
+    }
+    index->slots[slot].store(user_id, std::memory_order_release);
+}
+
+} // namespace
+
+uint32_t UserTable::intern(const std::string& username) {
+    if (username.empty()) {
+        return kNoUser;
+    }
+    size_t hash = std::hash<std::string>()(username);
+    uint32_t user_id;
+    NameIndex* index = g_index.load(std::memory_order_acquire);
+    if (index && lookup(index, username, hash, user_id)) {
+        return user_id;
+    }
+
+    WriterState& state = writerState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    index = g_index.load(std::memory_order_relaxed);
+    if (index && lookup(index, username, hash, user_id)) {
+        return user_id;
+    }
+
+    user_id = g_count.load(std::memory_order_relaxed);
+    if (user_id >= kMaxChunks * kChunkSize - 1) {
+        std::cerr << "用户编号已用尽，无法登记用户名: " << username << std::endl;
+        return kNoUser;
+    }
+    NameChunk* chunk = g_chunks[user_id >> kChunkBits].load(std::memory_order_relaxed);
+    if (chunk == nullptr) {
+        chunk = new NameChunk();
+        g_chunks[user_id >> kChunkBits].store(chunk, std::memory_order_release);
+    }
+    chunk->names[user_id & (kChunkSize - 1)] = username;
+    g_count.store(user_id + 1, std::memory_order_release);
+
+    // 装载率超过1/2时换成四倍容量的新表，读者拿到的旧表仍然有效，只是看不到之后登记的用户名
+    size_t needed = (size_t)user_id * 2;
+    if (index == nullptr || needed > index->mask + 1) {
+        size_t capacity = 1024;
+        while (capacity < needed * 2) {
+            capacity *= 2;
+        }
+        std::unique_ptr<NameIndex> grown(new NameIndex(capacity));
+        for (uint32_t id = 1; id <= user_id; ++id) {
+            insert(grown.get(), id, std::hash<std::string>()(nameOf(id)));
+        }
+        g_index.store(grown.get(), std::memory_order_release);
+        state.indexes.push_back(std::move(grown));
+    } else {
+        insert(index, user_id, hash);
+    }
+    return user_id;
+}
+
+bool UserTable::find(const std::string& username, uint32_t& user_id) {
+    if (username.empty()) {
+        return false;
+    }
+    size_t hash = std::hash<std::string>()(username);
+    NameIndex* index = g_index.load(std::memory_order_acquire);
+    while (index) {
+        if (lookup(index, username, hash, user_id)) {
+            return true;
+        }
+        // 查找期间表被替换时在新表中再找一次
+        NameIndex* current = g_index.load(std::memory_order_acquire);
+        if (current == index) {
+            return false;
+        }
+        index = current;
+    }
+    return false;
+}
+
+const std::string& UserTable::name(uint32_t user_id) {
+    if (user_id == kNoUser || user_id >= g_count.load(std::memory_order_acquire)) {
+        return g_empty;
+    }
+    return nameOf(user_id);
+}
+
+size_t UserTable::size() {
+    return g_count.load(std::memory_order_acquire) - 1;
+}
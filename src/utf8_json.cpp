@@ -0,0 +1,389 @@
+#include "../include/utf8_json.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTF8_JSON_X86 1
+#endif
+
+namespace {
+
+// ---------------- 逐字节实现 ----------------
+
+// 从s[i]开始校验一个非ASCII字符，成功时返回其字节数，失败返回0
+size_t checkMultibyte(const unsigned char* s, size_t n, size_t i) {
+    unsigned char c = s[i];
+    size_t len;
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+        len = 3;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+    } else {
+        return 0;
+    }
+    if (n - i < len) {
+        return 0;
+    }
+    for (size_t k = 1; k < len; ++k) {
+        if ((s[i + k] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    if (len == 3) {
+        uint32_t cp = ((c & 0x0Fu) << 12) | ((s[i + 1] & 0x3Fu) << 6) | (s[i + 2] & 0x3Fu);
+        if (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return 0;
+        }
+    } else if (len == 4) {
+        uint32_t cp = ((c & 0x07u) << 18) | ((s[i + 1] & 0x3Fu) << 12) | ((s[i + 2] & 0x3Fu) << 6) | (s[i + 3] & 0x3Fu);
+        if (cp < 0x10000 || cp > 0x10FFFF) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+bool validateScalar(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (s[i] < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t len = checkMultibyte(s, n, i);
+        if (len == 0) {
+            return false;
+        }
+        i += len;
+    }
+    return true;
+}
+
+inline bool needsEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+size_t findEscapeScalar(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    while (i < n && !needsEscape(s[i])) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef UTF8_JSON_X86
+
+// ---------------- SSE2 ----------------
+
+// 16字节一组跳过ASCII，遇到非ASCII字符时逐个校验
+__attribute__((target("sse2")))
+bool validateSse2(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (i + 16 <= n) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            if (_mm_movemask_epi8(block) == 0) {
+                i += 16;
+                continue;
+            }
+        }
+        if (s[i] < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t len = checkMultibyte(s, n, i);
+        if (len == 0) {
+            return false;
+        }
+        i += len;
+    }
+    return true;
+}
+
+// 一组中需要转义的字节的位掩码：引号、反斜杠和小于0x20的字节（无符号比较）
+__attribute__((target("sse2")))
+inline int escapeMask16(__m128i block) {
+    __m128i quote = _mm_cmpeq_epi8(block, _mm_set1_epi8('"'));
+    __m128i backslash = _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'));
+    __m128i limit = _mm_set1_epi8(0x1F);
+    __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(block, limit), limit);
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), control));
+}
+
+__attribute__((target("sse2")))
+size_t findEscapeSse2(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int mask = escapeMask16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + findEscapeScalar(s + i, n - i);
+}
+
+// ---------------- AVX2 ----------------
+// UTF-8校验使用Keiser与Lemire的查表算法：每个字节与前一个字节的高低半字节经三次查表得到
+// 可能的错误类型，再与"前两三个字节是3/4字节字符的首字节"的要求比对，整组没有分支。
+
+// 错误类型，每位一种；TOO_LARGE_1000与OVERLONG_4共用一位，由首字节的低半字节区分
+const uint8_t TOO_SHORT = 1 << 0;       // 首字节之后不是后续字节
+const uint8_t TOO_LONG = 1 << 1;        // ASCII之后是后续字节
+const uint8_t OVERLONG_3 = 1 << 2;
+const uint8_t TOO_LARGE = 1 << 3;       // 大于U+10FFFF
+const uint8_t SURROGATE = 1 << 4;
+const uint8_t OVERLONG_2 = 1 << 5;
+const uint8_t TOO_LARGE_1000 = 1 << 6;
+const uint8_t OVERLONG_4 = 1 << 6;
+const uint8_t TWO_CONTS = 1 << 7;       // 后续字节之后又是后续字节（须由长度检查确认）
+const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// 按前一字节的高半字节
+const uint8_t kByte1High[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+// 按前一字节的低半字节
+const uint8_t kByte1Low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+// 按当前字节的高半字节
+const uint8_t kByte2High[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// 一组末尾允许的最大字节：最后3个字节不能是尚未结束的多字节字符的首字节
+const uint8_t kIncompleteMax[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+__attribute__((target("avx2")))
+inline __m256i loadTable(const uint8_t table[16]) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i highNibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+// input的每个字节前第N个字节，跨越组边界时取自上一组
+template <int N>
+__attribute__((target("avx2")))
+inline __m256i previousBytes(__m256i input, __m256i prev_input) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+inline __m256i checkBlock(__m256i input, __m256i prev_input) {
+    __m256i prev1 = previousBytes<1>(input, prev_input);
+    __m256i byte_1_high = _mm256_shuffle_epi8(loadTable(kByte1High), highNibbles(prev1));
+    __m256i byte_1_low = _mm256_shuffle_epi8(loadTable(kByte1Low), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+    __m256i byte_2_high = _mm256_shuffle_epi8(loadTable(kByte2High), highNibbles(input));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // 前两个字节是3/4字节首字节，或前三个字节是4字节首字节时，当前字节必须是后续字节
+    __m256i prev2 = previousBytes<2>(input, prev_input);
+    __m256i prev3 = previousBytes<3>(input, prev_input);
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23_80 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23_80, special_cases);
+}
+
+// 处理一组32字节，error累积发现的错误
+__attribute__((target("avx2")))
+inline void validateBlock(__m256i input, __m256i& error, __m256i& prev_input, __m256i& prev_incomplete) {
+    if (_mm256_movemask_epi8(input) == 0) {
+        // 全是ASCII：只需确认上一组没有以未结束的多字节字符结尾
+        error = _mm256_or_si256(error, prev_incomplete);
+    } else {
+        error = _mm256_or_si256(error, checkBlock(input, prev_input));
+        prev_incomplete = _mm256_subs_epu8(input, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kIncompleteMax)));
+    }
+    prev_input = input;
+}
+
+__attribute__((target("avx2")))
+bool validateAvx2(const unsigned char* s, size_t n) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        validateBlock(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)), error, prev_input, prev_incomplete);
+    }
+    if (i < n) {
+        // 不足一组的尾部补0（ASCII）后同样处理，未结束的字符会在补齐的位置被发现
+        alignas(32) unsigned char tail[32] = {0};
+        memcpy(tail, s + i, n - i);
+        validateBlock(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)), error, prev_input, prev_incomplete);
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+__attribute__((target("avx2")))
+size_t findEscapeAvx2(const unsigned char* s, size_t n) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i limit = _mm256_set1_epi8(0x1F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+                                       _mm256_cmpeq_epi8(_mm256_max_epu8(block, limit), limit));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + findEscapeSse2(s + i, n - i);
+}
+
+#endif // UTF8_JSON_X86
+
+// ---------------- 运行时选择 ----------------
+
+struct Implementation {
+    const char* isa;
+    bool (*validate)(const unsigned char* s, size_t n);
+    size_t (*find_escape)(const unsigned char* s, size_t n);   // 第一个需要转义的字节的位置，没有时为n
+};
+
+const Implementation kScalar = {"scalar", validateScalar, findEscapeScalar};
+#ifdef UTF8_JSON_X86
+const Implementation kSse2 = {"sse2", validateSse2, findEscapeSse2};
+const Implementation kAvx2 = {"avx2", validateAvx2, findEscapeAvx2};
+#endif
+
+bool cpuSupports(const Implementation* candidate) {
+#ifdef UTF8_JSON_X86
+    __builtin_cpu_init();
+    if (candidate == &kAvx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (candidate == &kSse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return candidate == &kScalar;
+}
+
+const Implementation* detect() {
+#ifdef UTF8_JSON_X86
+    if (cpuSupports(&kAvx2)) {
+        return &kAvx2;
+    }
+    if (cpuSupports(&kSse2)) {
+        return &kSse2;
+    }
+#endif
+    return &kScalar;
+}
+
+std::atomic<const Implementation*> g_implementation(nullptr);
+
+const Implementation& implementation() {
+    const Implementation* selected = g_implementation.load(std::memory_order_relaxed);
+    if (selected == nullptr) {
+        selected = detect();
+        g_implementation.store(selected, std::memory_order_relaxed);
+    }
+    return *selected;
+}
+
+void appendEscaped(std::string& out, unsigned char c) {
+    static const char kHex[] = "0123456789abcdef";
+    switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: {
+            char escaped[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0x0F]};
+            out.append(escaped, 6);
+        }
+    }
+}
+
+} // namespace
+
+bool isValidUtf8(const char* data, size_t length) {
+    return implementation().validate(reinterpret_cast<const unsigned char*>(data), length);
+}
+
+void appendJsonString(std::string& out, const std::string& text) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(text.data());
+    size_t n = text.length();
+    auto find_escape = implementation().find_escape;
+
+    out.reserve(out.length() + n + 2);
+    out += '"';
+    size_t pos = 0;
+    while (pos < n) {
+        size_t run = find_escape(s + pos, n - pos);
+        out.append(text, pos, run);
+        pos += run;
+        if (pos < n) {
+            appendEscaped(out, s[pos]);
+            ++pos;
+        }
+    }
+    out += '"';
+}
+
+const char* utf8JsonIsa() {
+    return implementation().isa;
+}
+
+bool setUtf8JsonIsa(const char* isa) {
+    const Implementation* candidates[] = {
+#ifdef UTF8_JSON_X86
+        &kAvx2, &kSse2,
+#endif
+        &kScalar
+    };
+    for (const Implementation* candidate : candidates) {
+        if (strcmp(candidate->isa, isa) == 0 && cpuSupports(candidate)) {
+            g_implementation.store(candidate, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
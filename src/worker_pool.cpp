@@ -0,0 +1,69 @@
+#include "../include/worker_pool.h"
+#include "../include/loop_mailbox.h"
+#include <algorithm>
+#include <memory>
+
+WorkerPool::WorkerPool() : running(false) {
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::start(int threads) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return;
+    }
+    running = true;
+    for (int i = 0; i < std::max(1, threads); ++i) {
+        workers.push_back(std::thread(&WorkerPool::run, this));
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void WorkerPool::execute(std::function<void()> work, std::function<void()> done) {
+    std::shared_ptr<LoopMailbox> mailbox = LoopMailbox::forCurrentLoop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running && mailbox) {
+            // 事件循环已退出时mailbox拒绝投递，done不再执行
+            tasks.push_back([work, done, mailbox] {
+                work();
+                mailbox->post(done);
+            });
+            cv.notify_one();
+            return;
+        }
+    }
+    work();
+    done();
+}
+
+void WorkerPool::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        cv.wait(lock, [this] { return !running || !tasks.empty(); });
+        if (tasks.empty()) {
+            break;
+        }
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -52,6 +52,8 @@ loginForm.addEventListener('submit', function(event) {
             // 将token存储在sessionStorage而不是localStorage
             sessionStorage.setItem('token', data.token);
             sessionStorage.setItem('username', username);
+            // 页面请求由浏览器直接发起，服务器从Cookie中取令牌渲染首屏数据
+            document.cookie = 'token=' + encodeURIComponent(data.token) + '; path=/; SameSite=Strict';
             
             // 跳转到聊天页面
             setTimeout(() => {
@@ -125,6 +127,7 @@ window.addEventListener('DOMContentLoaded', function() {
     // 先清除任何现有的令牌，禁用自动登录
     sessionStorage.removeItem('token');
     sessionStorage.removeItem('username');
+    document.cookie = 'token=; path=/; max-age=0';
     
     // 可以在此处添加其他初始化代码
 }); 
\ No newline at end of file
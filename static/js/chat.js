@@ -30,6 +30,8 @@ function safeAddEventListener(element, event, handler) {
 
 // 全局变量
 let currentRoomId = null;
+let lastSeq = 0;  // 已加载的最新消息序号，用于增量拉取
+let roomsVersion = '';  // 房间列表的版本，同步时服务器据此判断是否需要返回新的房间列表
 
 // 检查用户是否已登录
 const token = sessionStorage.getItem('token');
@@ -106,82 +108,90 @@ function loadRooms() {
         }
         return response.json();
     })
-    .then(data => {
-        // 移除加载指示器
-        const loadingElement = roomsList.querySelector('.loading-rooms');
-        if (loadingElement) {
-            loadingElement.remove();
+    .then(renderRoomList)
+    .catch(error => {
+        // 处理错误
+        roomsList.innerHTML = '<div class="error-message">加载房间失败: ' + error.message + '</div>';
+    });
+}
+
+// 显示房间列表，data与/api/rooms的响应格式相同
+function renderRoomList(data) {
+    // 移除加载指示器
+    const loadingElement = roomsList.querySelector('.loading-rooms');
+    if (loadingElement) {
+        loadingElement.remove();
+    }
+    
+    if (data.success) {
+        if (data.rooms_version) {
+            roomsVersion = data.rooms_version;
         }
         
-        if (data.success) {
-            // 只有在确定获取了有效数据后才清空房间列表
-            // 获取当前活动的房间，以便保持其激活状态
-            const activeRoomId = currentRoomId;
-            
-            roomsList.innerHTML = '';
+        // 只有在确定获取了有效数据后才清空房间列表
+        // 获取当前活动的房间，以便保持其激活状态
+        const activeRoomId = currentRoomId;
+        
+        roomsList.innerHTML = '';
+        
+        // 添加房间到列表
+        if (data.rooms && data.rooms.length > 0) {
+            console.log('加载到房间列表:', data.rooms);
             
-            // 添加房间到列表
-            if (data.rooms && data.rooms.length > 0) {
-                console.log('加载到房间列表:', data.rooms);
+            data.rooms.forEach(room => {
+                // 在这里记录房间是否是当前用户创建的
+                console.log(`房间ID ${room.id}, 名称: ${room.name}, 创建者: ${room.creator}, 是否为创建者: ${room.is_creator}`);
                 
-                data.rooms.forEach(room => {
-                    // 在这里记录房间是否是当前用户创建的
-                    console.log(`房间ID ${room.id}, 名称: ${room.name}, 创建者: ${room.creator}, 是否为创建者: ${room.is_creator}`);
-                    
-                    const roomItem = document.createElement('div');
-                    roomItem.className = `room-item ${room.is_creator ? 'is-creator' : ''}`;
-                    if (room.id == activeRoomId) {
-                        roomItem.classList.add('active');
-                    }
-                    roomItem.dataset.id = room.id;
-                    roomItem.dataset.name = room.name;
-                    roomItem.dataset.description = room.description;
-                    roomItem.dataset.creator = room.creator;
-                    roomItem.dataset.isCreator = room.is_creator;
-                    
-                    const roomName = document.createElement('div');
-                    roomName.className = 'room-name';
-                    roomName.textContent = room.name;
-                    
-                    const roomDescription = document.createElement('div');
-                    roomDescription.className = 'room-description';
-                    roomDescription.textContent = room.description;
-                    
-                    const roomCreator = document.createElement('div');
-                    roomCreator.className = 'room-creator';
-                    roomCreator.textContent = `创建者: ${room.creator} · ${formatDate(room.created_at)}`;
-                    
-                    roomItem.appendChild(roomName);
-                    roomItem.appendChild(roomDescription);
-                    roomItem.appendChild(roomCreator);
-                    
-                    // 点击房间切换到该房间
-                    roomItem.addEventListener('click', () => {
-                        // 确保将is_creator作为布尔值传递，而不是字符串
-                        const isCreator = room.is_creator === true || room.is_creator === "true";
-                        console.log(`点击切换房间，房间ID: ${room.id}, 是否为创建者: ${isCreator}`);
-                        switchRoom(room.id, room.name, room.description, isCreator);
-                    });
-                    
-                    roomsList.appendChild(roomItem);
+                const roomItem = document.createElement('div');
+                roomItem.className = `room-item ${room.is_creator ? 'is-creator' : ''}`;
+                if (room.id == activeRoomId) {
+                    roomItem.classList.add('active');
+                }
+                roomItem.dataset.id = room.id;
+                roomItem.dataset.name = room.name;
+                roomItem.dataset.description = room.description;
+                roomItem.dataset.creator = room.creator;
+                roomItem.dataset.isCreator = room.is_creator;
+                
+                const roomName = document.createElement('div');
+                roomName.className = 'room-name';
+                roomName.textContent = room.name;
+                
+                const roomDescription = document.createElement('div');
+                roomDescription.className = 'room-description';
+                roomDescription.textContent = room.description;
+                
+                const roomCreator = document.createElement('div');
+                roomCreator.className = 'room-creator';
+                roomCreator.textContent = `创建者: ${room.creator} · ${formatDate(room.created_at)}`;
+                
+                roomItem.appendChild(roomName);
+                roomItem.appendChild(roomDescription);
+                roomItem.appendChild(roomCreator);
+                
+                // 点击房间切换到该房间
+                roomItem.addEventListener('click', () => {
+                    // 确保将is_creator作为布尔值传递，而不是字符串
+                    const isCreator = room.is_creator === true || room.is_creator === "true";
+                    console.log(`点击切换房间，房间ID: ${room.id}, 是否为创建者: ${isCreator}`);
+                    switchRoom(room.id, room.name, room.description, isCreator);
                 });
-            } else {
-                // 没有房间，显示提示
-                roomsList.innerHTML = '<div class="no-room-message">没有可用聊天室，点击"创建房间"按钮创建一个吧！</div>';
-            }
+                
+                roomsList.appendChild(roomItem);
+            });
         } else {
-            // 加载房间列表失败
-            roomsList.innerHTML = '<div class="error-message">加载房间失败: ' + (data.message || '未知错误') + '</div>';
+            // 没有房间，显示提示
+            roomsList.innerHTML = '<div class="no-room-message">没有可用聊天室，点击"创建房间"按钮创建一个吧！</div>';
         }
-    })
-    .catch(error => {
-        // 处理错误
-        roomsList.innerHTML = '<div class="error-message">加载房间失败: ' + error.message + '</div>';
-    });
+    } else {
+        // 加载房间列表失败
+        roomsList.innerHTML = '<div class="error-message">加载房间失败: ' + (data.message || '未知错误') + '</div>';
+    }
 }
 
 // 切换到选中的房间
-function switchRoom(roomId, roomName, roomDescription, isCreator) {
+// initialPage为页面内联的该房间消息，给出时不再请求/api/rooms/messages
+function switchRoom(roomId, roomName, roomDescription, isCreator, initialPage) {
     console.log('switchRoom被调用:', {
         roomId, 
         roomName, 
@@ -235,7 +245,11 @@ function switchRoom(roomId, roomName, roomDescription, isCreator) {
     messagesContainer.innerHTML = '<div class="loading-messages">正在加载聊天记录...</div>';
     
     // 加载房间消息
-    loadRoomMessages();
+    if (initialPage) {
+        renderRoomMessages(initialPage);
+    } else {
+        loadRoomMessages();
+    }
 }
 
 // 加载房间消息
@@ -258,30 +272,122 @@ function loadRoomMessages() {
     .then(response => {
         return response.json();
     })
+    .then(renderRoomMessages)
+    .catch(error => {
+        console.error('加载房间消息请求错误:', error);
+        messagesContainer.innerHTML = '<div class="error-message">加载消息出错，请稍后重试</div>';
+    });
+}
+
+// 显示房间消息，data与/api/rooms/messages的响应格式相同
+function renderRoomMessages(data) {
+    if (data.success) {
+        // 清空消息容器
+        messagesContainer.innerHTML = '';
+        
+        lastSeq = data.next_cursor || 0;
+        
+        // 添加消息到容器
+        if (data.messages && data.messages.length > 0) {
+            data.messages.forEach(message => {
+                appendMessage(message.username, message.content, message.timestamp, message.attachments);
+            });
+            // 滚动到底部
+            scrollToBottom();
+        } else {
+            // 无消息时显示提示
+            messagesContainer.innerHTML = '<div class="no-messages">暂无消息记录</div>';
+        }
+    } else {
+        console.error('加载房间消息失败:', data.message);
+        messagesContainer.innerHTML = `<div class="error-message">加载失败: ${data.message || '未知错误'}</div>`;
+    }
+}
+
+// 增量拉取新消息，只获取序号大于lastSeq的消息
+function pollNewMessages() {
+    if (!currentRoomId) return;
+    const roomId = currentRoomId;
+    
+    fetch('/api/rooms/messages', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json',
+            'Authorization': `Bearer ${token}`
+        },
+        body: JSON.stringify({
+            room_id: roomId,
+            after_seq: lastSeq
+        })
+    })
+    .then(response => response.json())
     .then(data => {
-        if (data.success) {
-            // 清空消息容器
-            messagesContainer.innerHTML = '';
-            
-            // 添加消息到容器
-            if (data.messages && data.messages.length > 0) {
-                data.messages.forEach(message => {
-                    appendMessage(message.username, message.content, message.timestamp);
-                });
-                // 滚动到底部
-                scrollToBottom();
-            } else {
-                // 无消息时显示提示
-                messagesContainer.innerHTML = '<div class="no-messages">暂无消息记录</div>';
+        if (!data.success || roomId !== currentRoomId) return;
+        
+        if (data.messages.length > 0) {
+            // 移除"暂无消息记录"提示
+            const placeholder = messagesContainer.querySelector('.no-messages');
+            if (placeholder) {
+                placeholder.remove();
             }
-        } else {
-            console.error('加载房间消息失败:', data.message);
-            messagesContainer.innerHTML = `<div class="error-message">加载失败: ${data.message || '未知错误'}</div>`;
+            data.messages.forEach(message => {
+                appendMessage(message.username, message.content, message.timestamp, message.attachments);
+            });
+            scrollToBottom();
         }
+        lastSeq = data.next_cursor || lastSeq;
     })
     .catch(error => {
-        console.error('加载房间消息请求错误:', error);
-        messagesContainer.innerHTML = '<div class="error-message">加载消息出错，请稍后重试</div>';
+        console.error('拉取新消息请求错误:', error);
+    });
+}
+
+// 同步新消息和房间列表：一次请求代替分别拉取当前房间的新消息和房间列表
+function syncRooms() {
+    const roomId = currentRoomId;
+    const rooms = {};
+    if (roomId) {
+        rooms[roomId] = lastSeq;
+    }
+    
+    fetch('/api/sync', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json',
+            'Authorization': `Bearer ${token}`
+        },
+        body: JSON.stringify({
+            rooms: rooms,
+            rooms_version: roomsVersion
+        })
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (!data.success) return;
+        
+        // 房间列表有变化时服务器附上完整的新列表
+        if (data.room_list) {
+            renderRoomList({ success: true, rooms: data.room_list, rooms_version: data.rooms_version });
+        }
+        
+        const room = roomId ? data.rooms[roomId] : null;
+        if (!room || roomId !== currentRoomId) return;
+        
+        const placeholder = messagesContainer.querySelector('.no-messages');
+        if (placeholder) {
+            placeholder.remove();
+        }
+        room.messages.forEach(message => {
+            appendMessage(message.username, message.content, message.timestamp, message.attachments);
+        });
+        scrollToBottom();
+        lastSeq = room.next_cursor || lastSeq;
+        if (room.has_more) {
+            syncRooms();
+        }
+    })
+    .catch(error => {
+        console.error('同步请求错误:', error);
     });
 }
 
@@ -301,7 +407,7 @@ function loadMessages() {
             
             // 添加消息到容器
             data.messages.forEach(message => {
-                appendMessage(message.username, message.content, message.timestamp);
+                appendMessage(message.username, message.content, message.timestamp, message.attachments);
             });
             
             // 滚动到底部
@@ -316,7 +422,7 @@ function loadMessages() {
 }
 
 // 添加消息到聊天界面
-function appendMessage(sender, content, timestamp) {
+function appendMessage(sender, content, timestamp, attachments) {
     const messageItem = document.createElement('div');
     messageItem.className = `message-item ${sender === username ? 'self' : 'other'}`;
     
@@ -341,6 +447,16 @@ function appendMessage(sender, content, timestamp) {
     messageItem.appendChild(messageHeader);
     messageItem.appendChild(messageContent);
     
+    // 附件链接，下载时用登录时写入的Cookie验证身份
+    (attachments || []).forEach(id => {
+        const link = document.createElement('a');
+        link.className = 'message-attachment';
+        link.href = `/api/attachments?id=${encodeURIComponent(id)}`;
+        link.target = '_blank';
+        link.textContent = `附件 ${id.substring(0, 8)}`;
+        messageItem.appendChild(link);
+    });
+    
     messagesContainer.appendChild(messageItem);
 }
 
@@ -376,8 +492,8 @@ messageForm.addEventListener('submit', function(event) {
                 // 清空输入框
                 messageInput.value = '';
                 
-                // 重新加载消息
-                loadRoomMessages();
+                // 拉取新消息
+                pollNewMessages();
             } else {
                 console.error('发送消息失败:', data.message);
             }
@@ -680,6 +796,7 @@ function setupLogoutButton() {
             if (confirm('您确定要退出吗？')) {
     sessionStorage.removeItem('token');
     sessionStorage.removeItem('username');
+    document.cookie = 'token=; path=/; max-age=0';
     window.location.href = '/';
             }
         });
@@ -729,17 +846,8 @@ function setupMessageRefresh() {
         clearInterval(window.roomsRefreshTimer);
     }
     
-    // 每30秒刷新一次消息
-    window.messageRefreshTimer = setInterval(function() {
-        if(currentRoomId) {
-            loadRoomMessages(currentRoomId);
-        }
-    }, 30000);
-    
-    // 每60秒刷新一次房间列表
-    window.roomsRefreshTimer = setInterval(function() {
-        loadRooms();
-    }, 60000);
+    // 每30秒同步一次当前房间的新消息和房间列表的变化
+    window.messageRefreshTimer = setInterval(syncRooms, 30000);
 }
 
 // 紧急添加删除按钮的修复函数
@@ -1029,8 +1137,19 @@ document.addEventListener('DOMContentLoaded', function() {
     window._roomCreatedHandler = roomCreatedHandler;
     document.addEventListener('roomCreated', roomCreatedHandler);
     
-    // 初始化页面
-    loadRooms();
+    // 初始化页面：优先使用服务器内联的房间列表和消息，省去首屏的API请求
+    const bootstrap = window.__BOOTSTRAP__;
+    if (bootstrap && bootstrap.username === username) {
+        renderRoomList({ success: true, rooms: bootstrap.rooms, rooms_version: bootstrap.rooms_version });
+        if (bootstrap.room) {
+            const room = bootstrap.rooms.find(r => r.id === bootstrap.room.id);
+            if (room) {
+                switchRoom(room.id, room.name, room.description, room.is_creator, bootstrap.room);
+            }
+        }
+    } else {
+        loadRooms();
+    }
     setupMessageRefresh();
     setupCreateRoomButton();
     setupLogoutButton();
@@ -12,13 +12,18 @@ const confirmDelete = document.getElementById('confirm-delete');
 const messagesContainer = document.getElementById('messages');
 const messageForm = document.getElementById('message-form');
 const messageInput = document.getElementById('message-input');
+const attachmentInput = document.getElementById('attachment-input');
 const backBtn = document.getElementById('back-btn');
 const logoutBtn = document.getElementById('logout-btn');
 const currentRoomName = document.getElementById('current-room-name');
 const currentRoomDescription = document.getElementById('current-room-description');
+const usernameSpan = document.getElementById('username');
 
 // 全局变量
 let currentRoomId = null;
+let lastSeq = 0;        // 已加载的最新消息序号，用于增量拉取
+let prevCursor = 0;     // 向前翻页的游标，0表示没有更早的消息
+let loadingEarlier = false;
 
 // 检查用户是否已登录
 const token = sessionStorage.getItem('token');
@@ -53,58 +58,62 @@ function loadRooms() {
         console.log('API响应状态:', response.status);
         return response.json();
     })
-    .then(data => {
-        console.log('API返回数据:', data);
-        if (data.success) {
-            // 清空房间列表
-            roomList.innerHTML = '';
-            
-            // 添加房间到列表
-            if (data.rooms && data.rooms.length > 0) {
-                console.log(`加载了 ${data.rooms.length} 个房间`);
-                data.rooms.forEach(room => {
-                const roomItem = document.createElement('div');
-                roomItem.className = `room-item ${room.is_creator ? 'is-creator' : ''}`;
-                roomItem.dataset.id = room.id;
-                roomItem.dataset.name = room.name;
-                roomItem.dataset.description = room.description;
-                roomItem.dataset.creator = room.creator;
-                
-                const roomName = document.createElement('div');
-                roomName.className = 'room-name';
-                roomName.textContent = room.name;
-                
-                const roomDescription = document.createElement('div');
-                roomDescription.className = 'room-description';
-                roomDescription.textContent = room.description;
-                
-                const roomCreator = document.createElement('div');
-                roomCreator.className = 'room-creator';
-                roomCreator.textContent = `创建者: ${room.creator} · ${formatDate(room.created_at)}`;
-                
-                roomItem.appendChild(roomName);
-                roomItem.appendChild(roomDescription);
-                roomItem.appendChild(roomCreator);
-                
-                // 点击房间切换到该房间
-                roomItem.addEventListener('click', () => {
-                    switchRoom(room.id, room.name, room.description, room.is_creator);
-                });
-                
-                roomList.appendChild(roomItem);
-            });
-            }
-        } else {
-            console.error('加载房间失败:', data.message);
-        }
-    })
+    .then(renderRoomList)
     .catch(error => {
         console.error('加载房间请求错误:', error);
     });
 }
 
+// 显示房间列表，data与/api/rooms的响应格式相同
+function renderRoomList(data) {
+    console.log('API返回数据:', data);
+    if (data.success) {
+        // 清空房间列表
+        roomList.innerHTML = '';
+        
+        // 添加房间到列表
+        if (data.rooms && data.rooms.length > 0) {
+            console.log(`加载了 ${data.rooms.length} 个房间`);
+            data.rooms.forEach(room => {
+            const roomItem = document.createElement('div');
+            roomItem.className = `room-item ${room.is_creator ? 'is-creator' : ''}`;
+            roomItem.dataset.id = room.id;
+            roomItem.dataset.name = room.name;
+            roomItem.dataset.description = room.description;
+            roomItem.dataset.creator = room.creator;
+            
+            const roomName = document.createElement('div');
+            roomName.className = 'room-name';
+            roomName.textContent = room.name;
+            
+            const roomDescription = document.createElement('div');
+            roomDescription.className = 'room-description';
+            roomDescription.textContent = room.description;
+            
+            const roomCreator = document.createElement('div');
+            roomCreator.className = 'room-creator';
+            roomCreator.textContent = `创建者: ${room.creator} · ${formatDate(room.created_at)}`;
+            
+            roomItem.appendChild(roomName);
+            roomItem.appendChild(roomDescription);
+            roomItem.appendChild(roomCreator);
+            
+            // 点击房间切换到该房间
+            roomItem.addEventListener('click', () => {
+                switchRoom(room.id, room.name, room.description, room.is_creator);
+            });
+            
+            roomList.appendChild(roomItem);
+        });
+        }
+    } else {
+        console.error('加载房间失败:', data.message);
+    }
+}
+
 // 切换到选中的房间
-function switchRoom(roomId, roomName, roomDescription, isCreator) {
+// initialPage为页面内联的该房间消息，给出时不再请求/api/rooms/messages
+function switchRoom(roomId, roomName, roomDescription, isCreator, initialPage) {
     // 取消之前选中的房间
     const activeRoom = document.querySelector('.room-item.active');
     if (activeRoom) {
@@ -124,9 +133,15 @@ function switchRoom(roomId, roomName, roomDescription, isCreator) {
     
     // 清空消息容器
     messagesContainer.innerHTML = '';
+    lastSeq = 0;
+    prevCursor = 0;
     
     // 加载房间消息
-    loadRoomMessages();
+    if (initialPage) {
+        renderRoomMessages(initialPage);
+    } else {
+        loadRoomMessages();
+    }
 }
 
 // 加载房间消息
@@ -144,29 +159,121 @@ function loadRoomMessages() {
         })
     })
     .then(response => response.json())
+    .then(renderRoomMessages)
+    .catch(error => {
+        console.error('加载房间消息请求错误:', error);
+    });
+}
+
+// 显示房间消息，data与/api/rooms/messages的响应格式相同
+function renderRoomMessages(data) {
+    if (data.success) {
+        // 清空消息容器
+        messagesContainer.innerHTML = '';
+        
+        // 添加消息到容器
+        data.messages.forEach(message => {
+            appendMessage(message.username, message.content, message.timestamp, message.attachments);
+        });
+        lastSeq = data.next_cursor || 0;
+        prevCursor = data.prev_cursor || 0;
+        
+        // 滚动到底部
+        scrollToBottom();
+    } else {
+        console.error('加载房间消息失败:', data.message);
+    }
+}
+
+// 增量拉取新消息，只获取序号大于lastSeq的消息
+function pollNewMessages() {
+    if (!currentRoomId) return;
+    const roomId = currentRoomId;
+    
+    fetch('/api/rooms/messages', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json',
+            'Authorization': `Bearer ${token}`
+        },
+        body: JSON.stringify({
+            room_id: roomId,
+            after_seq: lastSeq
+        })
+    })
+    .then(response => response.json())
     .then(data => {
-        if (data.success) {
-            // 清空消息容器
-            messagesContainer.innerHTML = '';
-            
-            // 添加消息到容器
-            data.messages.forEach(message => {
-                appendMessage(message.username, message.content, message.timestamp);
-            });
-            
-            // 滚动到底部
+        if (!data.success || roomId !== currentRoomId) return;
+        
+        data.messages.forEach(message => {
+            appendMessage(message.username, message.content, message.timestamp, message.attachments);
+        });
+        lastSeq = data.next_cursor || lastSeq;
+        
+        if (data.messages.length > 0) {
             scrollToBottom();
-        } else {
-            console.error('加载房间消息失败:', data.message);
+        }
+        if (data.has_more) {
+            pollNewMessages();
         }
     })
     .catch(error => {
-        console.error('加载房间消息请求错误:', error);
+        console.error('拉取新消息请求错误:', error);
+    });
+}
+
+// 滚动到顶部时加载更早的消息
+function loadEarlierMessages() {
+    if (!currentRoomId || !prevCursor || loadingEarlier) return;
+    const roomId = currentRoomId;
+    loadingEarlier = true;
+    
+    fetch('/api/rooms/messages', {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json',
+            'Authorization': `Bearer ${token}`
+        },
+        body: JSON.stringify({
+            room_id: roomId,
+            before_seq: prevCursor
+        })
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (!data.success || roomId !== currentRoomId) return;
+        
+        // 插入到顶部并保持当前可见位置
+        const previousHeight = messagesContainer.scrollHeight;
+        const firstChild = messagesContainer.firstChild;
+        data.messages.forEach(message => {
+            const item = createMessageItem(message.username, message.content, message.timestamp, message.attachments);
+            messagesContainer.insertBefore(item, firstChild);
+        });
+        messagesContainer.scrollTop += messagesContainer.scrollHeight - previousHeight;
+        prevCursor = data.prev_cursor || 0;
+    })
+    .catch(error => {
+        console.error('加载更早消息请求错误:', error);
+    })
+    .finally(() => {
+        loadingEarlier = false;
     });
 }
 
+messagesContainer.addEventListener('scroll', () => {
+    if (messagesContainer.scrollTop === 0) {
+        loadEarlierMessages();
+    }
+});
+
 // 添加消息到聊天界面
-function appendMessage(sender, content, timestamp) {
+function appendMessage(sender, content, timestamp, attachments) {
+    messagesContainer.appendChild(createMessageItem(sender, content, timestamp, attachments));
+}
+
+// 创建消息元素
+function createMessageItem(sender, content, timestamp, attachments) {
     const messageItem = document.createElement('div');
     messageItem.className = `message-item ${sender === username ? 'self' : 'other'}`;
     
@@ -191,7 +298,17 @@ function appendMessage(sender, content, timestamp) {
     messageItem.appendChild(messageHeader);
     messageItem.appendChild(messageContent);
     
-    messagesContainer.appendChild(messageItem);
+    // 附件链接，下载时用登录时写入的Cookie验证身份
+    (attachments || []).forEach(id => {
+        const link = document.createElement('a');
+        link.className = 'message-attachment';
+        link.href = `/api/attachments?id=${encodeURIComponent(id)}`;
+        link.target = '_blank';
+        link.textContent = `附件 ${id.substring(0, 8)}`;
+        messageItem.appendChild(link);
+    });
+    
+    return messageItem;
 }
 
 // 滚动到底部
@@ -209,27 +326,48 @@ messageForm.addEventListener('submit', function(event) {
     }
     
     const message = messageInput.value.trim();
-    if (!message) return;
+    const file = attachmentInput.files[0];
+    if (!message && !file) return;
     
-    fetch('/api/rooms/send', {
-        method: 'POST',
-        headers: {
-            'Content-Type': 'application/json',
-            'Authorization': `Bearer ${token}`
-        },
-        body: JSON.stringify({
-            room_id: currentRoomId,
-            message: message
-        })
+    // 先上传附件（请求体直接是文件内容），再发送引用附件ID的消息
+    const upload = file
+        ? fetch('/api/attachments/upload', {
+              method: 'POST',
+              headers: {
+                  'Content-Type': file.type || 'application/octet-stream',
+                  'Authorization': `Bearer ${token}`
+              },
+              body: file
+          }).then(response => response.json())
+        : Promise.resolve(null);
+    
+    upload
+    .then(uploaded => {
+        if (uploaded && !uploaded.success) {
+            throw new Error(uploaded.message);
+        }
+        return fetch('/api/rooms/send', {
+            method: 'POST',
+            headers: {
+                'Content-Type': 'application/json',
+                'Authorization': `Bearer ${token}`
+            },
+            body: JSON.stringify({
+                room_id: currentRoomId,
+                message: message,
+                attachments: uploaded ? [uploaded.id] : []
+            })
+        });
     })
     .then(response => response.json())
     .then(data => {
         if (data.success) {
             // 清空输入框
             messageInput.value = '';
+            attachmentInput.value = '';
             
-            // 重新加载消息
-            loadRoomMessages();
+            // 拉取新消息
+            pollNewMessages();
         } else {
             console.error('发送消息失败:', data.message);
         }
@@ -316,6 +454,7 @@ logoutBtn.addEventListener('click', function() {
     // 清除本地存储
     sessionStorage.removeItem('token');
     sessionStorage.removeItem('username');
+    document.cookie = 'token=; path=/; max-age=0';
     
     // 重定向到登录页面
     window.location.href = '/';
@@ -348,7 +487,7 @@ function setupRefresh() {
     // 每5秒刷新一次消息
     setInterval(() => {
         if (currentRoomId) {
-            loadRoomMessages();
+            pollNewMessages();
         }
     }, 5000);
     
@@ -392,6 +531,18 @@ function deleteRoom(roomId) {
 
 // 页面加载完成后执行
 window.addEventListener('DOMContentLoaded', function() {
-    loadRooms();
+    // 优先使用服务器内联的房间列表和消息，省去首屏的API请求
+    const bootstrap = window.__BOOTSTRAP__;
+    if (bootstrap && bootstrap.username === username) {
+        renderRoomList({ success: true, rooms: bootstrap.rooms });
+        if (bootstrap.room) {
+            const room = bootstrap.rooms.find(r => r.id === bootstrap.room.id);
+            if (room) {
+                switchRoom(room.id, room.name, room.description, room.is_creator, bootstrap.room);
+            }
+        }
+    } else {
+        loadRooms();
+    }
     setupRefresh();
 });
@@ -0,0 +1,38 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <iostream>
+
+// 测试用的最小断言：失败时打印位置并计数，main()返回失败数，ctest据此判断结果
+static int check_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #cond << std::endl; \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        auto check_actual = (actual); \
+        auto check_expected = (expected); \
+        if (!(check_actual == check_expected)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": 检查失败: " #actual " == " #expected \
+                      << "（实际为 " << check_actual << "）" << std::endl; \
+            check_failures++; \
+        } \
+    } while (0)
+
+// 在main()末尾返回
+inline int checkResult(const char* name) {
+    if (check_failures == 0) {
+        std::cout << name << ": 全部通过" << std::endl;
+        return 0;
+    }
+    std::cerr << name << ": " << check_failures << " 项检查失败" << std::endl;
+    return 1;
+}
+
+#endif // TESTS_CHECK_H
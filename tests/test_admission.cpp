@@ -0,0 +1,86 @@
+#include "../include/admission.h"
+#include "check.h"
+#include <string>
+
+// 同一令牌用完突发量后被限流，其他令牌不受影响；不需要把令牌解析为用户名
+static void testPerTokenLimit() {
+    AdmissionConfig config;
+    config.per_user = {1, 3};
+    config.per_ip = {0, 0};
+    AdmissionController admission(config);
+
+    int retry_after = 0;
+    for (int i = 0; i < 3; ++i) {
+        CHECK(admission.allowRequest("10.0.0.1", "token-a", retry_after));
+    }
+    CHECK(!admission.allowRequest("10.0.0.1", "token-a", retry_after));
+    CHECK_EQ(retry_after, 1);
+    CHECK(admission.allowRequest("10.0.0.1", "token-b", retry_after));
+    // 没有令牌的请求只按IP限流
+    CHECK(admission.allowRequest("10.0.0.1", "", retry_after));
+}
+
+// 大量随机令牌的请求由按IP的配额限制
+static void testRandomTokensLimitedByIp() {
+    AdmissionConfig config;
+    config.per_user = {1, 1};
+    config.per_ip = {1, 10};
+    AdmissionController admission(config);
+
+    int allowed = 0;
+    int retry_after = 0;
+    for (int i = 0; i < 5000; ++i) {
+        if (admission.allowRequest("10.0.0.2", "random-" + std::to_string(i), retry_after)) {
+            allowed++;
+        }
+    }
+    CHECK_EQ(allowed, 10);
+    CHECK(admission.allowRequest("10.0.0.3", "another-token", retry_after));
+}
+
+// 桶表按需清理已回满的桶，大量一次性的键不会使每次插入都扫描整个分片
+static void testBucketSweep() {
+    TokenBucketTable table(RateLimit{1000, 1});
+    uint64_t retry_after_ms = 0;
+    uint64_t now_ns = 1000000000ull;
+    for (int i = 0; i < 200000; ++i) {
+        CHECK(table.take("key-" + std::to_string(i), now_ns, retry_after_ms));
+        now_ns += 10000;   // 每个桶1毫秒后回满
+    }
+    CHECK(table.take("key-0", now_ns, retry_after_ms));
+    CHECK(!table.take("key-0", now_ns, retry_after_ms));
+}
+
+// 饱和后新请求不插队，排队的请求按优先级获得名额
+static void testConcurrencyLimiter() {
+    AdmissionConfig config;
+    config.max_concurrent = 2;
+    config.low_priority_share = 0.5;
+    AdmissionController admission(config);
+
+    CHECK(admission.acquire(PRIORITY_LOW));
+    CHECK(!admission.acquire(PRIORITY_LOW));   // 低优先级最多占一半
+    CHECK(admission.acquire(PRIORITY_HIGH));
+    CHECK(!admission.acquire(PRIORITY_HIGH));
+
+    admission.enqueue(PRIORITY_LOW);
+    admission.enqueue(PRIORITY_HIGH);
+    CHECK(admission.release());
+    // 有排队者时新到达的请求不插队，高优先级的排队者先于低优先级
+    CHECK(!admission.acquire(PRIORITY_HIGH));
+    CHECK(!admission.acquireQueued(PRIORITY_LOW));
+    CHECK(admission.acquireQueued(PRIORITY_HIGH));
+    admission.dequeue(PRIORITY_HIGH);
+    admission.dequeue(PRIORITY_LOW);
+    CHECK(!admission.release());
+    CHECK(!admission.release());
+    CHECK(admission.acquire(PRIORITY_NORMAL));
+}
+
+int main() {
+    testPerTokenLimit();
+    testRandomTokensLimitedByIp();
+    testBucketSweep();
+    testConcurrencyLimiter();
+    return checkResult("test_admission");
+}
@@ -0,0 +1,218 @@
+#include "../include/content_filter.h"
+#include "check.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static std::string masked(const WordAutomaton& automaton, const std::string& text) {
+    std::string result = text;
+    automaton.mask(text, result);
+    return result;
+}
+
+static std::string lower(const std::string& text) {
+    std::string result = text;
+    for (char& c : result) {
+        if (c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+    }
+    return result;
+}
+
+// 逐个词逐个位置比较的参考实现：被任何词覆盖的字符替换为'*'
+static std::string referenceMask(const std::vector<std::string>& words, const std::string& text) {
+    std::string folded = lower(text);
+    std::vector<bool> covered(text.size(), false);
+    for (const std::string& word : words) {
+        if (word.empty()) {
+            continue;
+        }
+        std::string folded_word = lower(word);
+        for (size_t pos = folded.find(folded_word); pos != std::string::npos; pos = folded.find(folded_word, pos + 1)) {
+            for (size_t i = pos; i < pos + word.size(); ++i) {
+                covered[i] = true;
+            }
+        }
+    }
+    std::string result;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (!covered[i]) {
+            result += text[i];
+        } else if (((unsigned char)text[i] & 0xC0) != 0x80) {
+            result += '*';
+        }
+    }
+    return result;
+}
+
+// 重叠、嵌套和相邻的命中合并后按字符替换
+static void testOverlappingMatches() {
+    WordAutomaton overlap({"ab", "bc"});
+    CHECK_EQ(masked(overlap, "abcd"), std::string("***d"));
+    CHECK_EQ(masked(overlap, "xabxbcx"), std::string("x**x**x"));
+
+    WordAutomaton nested({"abc", "b"});
+    CHECK_EQ(masked(nested, "xabcx"), std::string("x***x"));
+    CHECK_EQ(masked(nested, "xbx"), std::string("x*x"));
+
+    // 经典的失配链例子：she、he、hers、his
+    WordAutomaton classic({"he", "she", "his", "hers"});
+    CHECK_EQ(masked(classic, "ushers"), std::string("u*****"));
+    CHECK_EQ(masked(classic, "ahishe"), std::string("a*****"));
+
+    // 较短的词在较长的词之后结束
+    WordAutomaton suffix({"abcd", "cdef"});
+    CHECK_EQ(masked(suffix, "abcdefg"), std::string("******g"));
+
+    WordAutomaton adjacent({"ab", "cd"});
+    CHECK_EQ(masked(adjacent, "abcd"), std::string("****"));
+
+    std::string unchanged = "untouched";
+    CHECK(!overlap.mask("nothing here", unchanged));
+    CHECK_EQ(unchanged, std::string("untouched"));
+}
+
+// 中文词按UTF-8字节匹配，每个汉字替换为一个'*'
+static void testChineseWords() {
+    WordAutomaton automaton({"敏感", "感词", "违禁品"});
+    CHECK_EQ(masked(automaton, "这是敏感词汇"), std::string("这是***汇"));
+    CHECK_EQ(masked(automaton, "出售违禁品和敏感信息"), std::string("出售***和**信息"));
+    CHECK(automaton.contains("带有感词的句子"));
+    CHECK(!automaton.contains("正常的消息"));
+    // 与某个词有相同前缀字节的其他汉字不会被误判
+    CHECK(!automaton.contains("敏捷"));
+
+    WordAutomaton mixed({"bad词"});
+    CHECK_EQ(masked(mixed, "a BAD词!"), std::string("a ****!"));
+}
+
+// ASCII字母不区分大小写，替换时不改变未命中的部分
+static void testCaseFolding() {
+    WordAutomaton automaton({"Spam", "FOO"});
+    CHECK(automaton.contains("no SPAM please"));
+    CHECK(automaton.contains("foo"));
+    CHECK_EQ(masked(automaton, "Buy sPaM and Foo Now"), std::string("Buy **** and *** Now"));
+    CHECK(!automaton.contains("sp am"));
+}
+
+// 重复的词和空词被忽略
+static void testWordCount() {
+    WordAutomaton automaton({"a", "", "a", "A", "ab"});
+    CHECK_EQ(automaton.wordCount(), (size_t)2);
+
+    WordAutomaton empty({});
+    CHECK_EQ(empty.wordCount(), (size_t)0);
+    CHECK(!empty.contains("anything"));
+}
+
+// 随机词表和文本（含大量共享前缀，迫使双数组多次扩容）与参考实现对比
+static void testRandomAgainstReference() {
+    std::mt19937 random(11);
+    const char* alphabet[] = {"a", "b", "c", "A", "中", "文"};
+    auto randomText = [&](size_t max_chars) {
+        std::string text;
+        size_t chars = 1 + random() % max_chars;
+        for (size_t i = 0; i < chars; ++i) {
+            text += alphabet[random() % 6];
+        }
+        return text;
+    };
+
+    int mismatches = 0;
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::string> words;
+        size_t count = 1 + random() % (round < 190 ? 12 : 3000);
+        for (size_t i = 0; i < count; ++i) {
+            words.push_back(randomText(6));
+        }
+        WordAutomaton automaton(words);
+        for (int k = 0; k < 50; ++k) {
+            std::string text = randomText(40);
+            std::string expected = referenceMask(words, text);
+            if (masked(automaton, text) != expected || automaton.contains(text) != (expected != text)) {
+                if (mismatches++ == 0) {
+                    std::cerr << "不一致的文本: " << text << "，期望 " << expected
+                              << "，实际 " << masked(automaton, text) << std::endl;
+                }
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+// 过滤器按配置拒绝或替换，未启用时不修改消息
+static void testContentFilter() {
+    ContentFilter filter;
+    CHECK(!filter.enabled());
+    std::string text = "bad word";
+    CHECK(filter.apply(text));
+    CHECK_EQ(text, std::string("bad word"));
+
+    filter.setWords({"bad", "敏感"}, FILTER_MASK);
+    CHECK(filter.enabled());
+    CHECK(filter.apply(text));
+    CHECK_EQ(text, std::string("*** word"));
+
+    filter.setWords({"bad", "敏感"}, FILTER_REJECT);
+    std::string rejected = "这很敏感";
+    CHECK(!filter.apply(rejected));
+    CHECK_EQ(rejected, std::string("这很敏感"));
+    std::string clean = "一切正常";
+    CHECK(filter.apply(clean));
+}
+
+// 从词表文件加载：忽略空行、注释和不是合法UTF-8的行；reload()换用修改后的词表
+static void testWordsFile() {
+    char path[] = "/tmp/test_content_filter_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    {
+        std::ofstream file(path);
+        file << "# 注释\n\n  spam \r\n敏感\n\xE4\xB8\n";
+    }
+
+    ContentFilterConfig config;
+    config.words_path = path;
+    config.reload_interval_seconds = 0;
+    ContentFilter filter;
+    CHECK(filter.start(config));
+
+    std::string text = "SPAM 敏感 # 注释";
+    CHECK(filter.apply(text));
+    CHECK_EQ(text, std::string("**** ** # 注释"));
+
+    {
+        std::ofstream file(path);
+        file << "eggs\n";
+    }
+    CHECK(filter.reload());
+    std::string after = "spam and eggs";
+    CHECK(filter.apply(after));
+    CHECK_EQ(after, std::string("spam and ****"));
+
+    unlink(path);
+    CHECK(!filter.reload());
+    std::string kept = "eggs";
+    CHECK(filter.apply(kept));
+    CHECK_EQ(kept, std::string("****"));
+    filter.stop();
+}
+
+int main() {
+    testOverlappingMatches();
+    testChineseWords();
+    testCaseFolding();
+    testWordCount();
+    testRandomAgainstReference();
+    testContentFilter();
+    testWordsFile();
+    return checkResult("test_content_filter");
+}
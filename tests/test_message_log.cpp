@@ -0,0 +1,260 @@
+#include "../include/message_log.h"
+#include "check.h"
+#include <cstdlib>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static std::string makeTempDirectory() {
+    char path[] = "/tmp/test_message_log_XXXXXX";
+    const char* created = mkdtemp(path);
+    return created ? created : "";
+}
+
+static void removeDirectory(const std::string& path) {
+    std::string command = "rm -rf '" + path + "'";
+    if (system(command.c_str()) != 0) {
+        std::cerr << "无法删除临时目录: " << path << std::endl;
+    }
+}
+
+static std::string segmentFile(const std::string& directory, int room_id, int base_seq, const char* ext) {
+    char name[64];
+    snprintf(name, sizeof(name), "/room-%d/%010d.%s", room_id, base_seq, ext);
+    return directory + name;
+}
+
+static off_t fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static bool appendBytes(const std::string& path, const std::string& bytes) {
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size();
+    close(fd);
+    return ok;
+}
+
+static bool overwriteBytes(const std::string& path, off_t offset, const std::string& bytes) {
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pwrite(fd, bytes.data(), bytes.size(), offset) == (ssize_t)bytes.size();
+    close(fd);
+    return ok;
+}
+
+static bool appendMessages(MessageLog& log, int room_id, int count, int first) {
+    for (int i = 0; i < count; ++i) {
+        ChatMessage message;
+        message.user_id = UserTable::intern("alice");
+        message.content = "message " + std::to_string(first + i);
+        message.timestamp = "2024-01-01 00:00:00";
+        if (!log.append(room_id, message) || message.seq != first + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 房间的全部消息内容，按序号排列且序号连续时才返回true
+static bool readAll(MessageLog& log, int room_id, std::vector<std::string>& contents) {
+    contents.clear();
+    bool ordered = true;
+    log.scan(room_id, [&](const ChatMessage& message) {
+        if (message.seq != (int)contents.size() + 1) {
+            ordered = false;
+        }
+        contents.push_back(message.content);
+    });
+    return ordered;
+}
+
+static MessageLogConfig makeConfig(const std::string& directory, uint64_t segment_bytes) {
+    MessageLogConfig config;
+    config.directory = directory;
+    config.segment_bytes = segment_bytes;
+    return config;
+}
+
+// 崩溃时写了一半的尾部记录在恢复时被截断，之后的追加接着最后一条完整的消息
+static void testTornTailRecord() {
+    std::string directory = makeTempDirectory();
+    MessageLogConfig config = makeConfig(directory, 1 << 20);
+    std::string active = segmentFile(directory, 1, 1, "log");
+
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        CHECK(appendMessages(log, 1, 5, 1));
+        log.close();
+    }
+    off_t intact = fileSize(active);
+    CHECK(intact > 0);
+
+    // 只有记录头、负载没写完的记录
+    std::string torn("\x40\x00\x00\x00\x12\x34\x56\x78partial", 15);
+    CHECK(appendBytes(active, torn));
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        CHECK_EQ(log.head(1), 5);
+        CHECK_EQ(fileSize(active), intact);
+
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 1, contents));
+        CHECK_EQ(contents.size(), (size_t)5);
+        CHECK(appendMessages(log, 1, 1, 6));
+        log.close();
+    }
+
+    // 长度完整但CRC不符的最后一条记录同样被丢弃
+    off_t before_corrupt = fileSize(active);
+    CHECK(overwriteBytes(active, before_corrupt - 1, "#"));
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        CHECK_EQ(log.head(1), 5);
+
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 1, contents));
+        CHECK_EQ(contents.size(), (size_t)5);
+        CHECK(appendMessages(log, 1, 2, 6));
+        log.close();
+    }
+
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 1, contents));
+        CHECK_EQ(contents.size(), (size_t)7);
+        CHECK_EQ(contents.back(), std::string("message 7"));
+        log.close();
+    }
+    removeDirectory(directory);
+}
+
+// 封存段的索引缺失或与数据不符时从数据重建，不返回错位的消息
+static void testSealedIndexFallback() {
+    std::string directory = makeTempDirectory();
+    MessageLogConfig config = makeConfig(directory, 512);
+
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        CHECK(appendMessages(log, 2, 60, 1));
+        log.close();
+    }
+
+    std::string first_index = segmentFile(directory, 2, 1, "idx");
+    off_t index_size = fileSize(first_index);
+    CHECK(index_size >= 16);
+
+    // 第二条消息的偏移指向记录中间
+    uint64_t bad_offset = 3;
+    CHECK(overwriteBytes(first_index, 8, std::string((const char*)&bad_offset, sizeof(bad_offset))));
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        CHECK_EQ(log.head(2), 60);
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 2, contents));
+        CHECK_EQ(contents.size(), (size_t)60);
+        CHECK_EQ(contents[1], std::string("message 2"));
+
+        MessagePage page;
+        CHECK(log.read(2, 0, 0, 60, page));
+        CHECK_EQ(page.messages.size(), (size_t)60);
+        log.close();
+    }
+
+    // 索引被截断（条数少于数据中的记录）
+    CHECK(truncate(first_index.c_str(), 8) == 0);
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 2, contents));
+        CHECK_EQ(contents.size(), (size_t)60);
+        log.close();
+    }
+
+    // 索引缺失
+    CHECK(unlink(first_index.c_str()) == 0);
+    {
+        MessageLog log(config);
+        CHECK(log.open());
+        std::vector<std::string> contents;
+        CHECK(readAll(log, 2, contents));
+        CHECK_EQ(contents.size(), (size_t)60);
+        CHECK(appendMessages(log, 2, 1, 61));
+        log.close();
+    }
+    removeDirectory(directory);
+}
+
+// fdatasync失败时同步报告失败，且之后的提交也都报告失败
+static void testSyncFailure() {
+    std::string directory = makeTempDirectory();
+    int fd = ::open((directory + "/data").c_str(), O_RDWR | O_CREAT, 0644);
+    CHECK(fd >= 0);
+    auto good = std::make_shared<LogFile>(fd);
+    auto bad = std::make_shared<LogFile>(-1);
+
+    GroupCommitter committer;
+    committer.start();
+    CHECK(committer.sync(good));
+    CHECK(!committer.failed());
+    CHECK(!committer.sync(bad));
+    CHECK(committer.failed());
+    CHECK(!committer.sync(good));
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int calls = 0;
+    bool result = true;
+    committer.syncAsync(std::vector<std::shared_ptr<LogFile>>(1, good), [&](bool ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = ok;
+        calls++;
+        cv.notify_all();
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return calls == 1; });
+    }
+    CHECK(!result);
+    committer.stop();
+
+    // 日志在同步失败后拒绝新的追加
+    MessageLog log(makeConfig(directory + "/log", 512));
+    CHECK(log.open());
+    CHECK(appendMessages(log, 1, 1, 1));
+    std::vector<std::shared_ptr<LogFile>> files(1, bad);
+    CHECK(!log.sync(files));
+    ChatMessage message;
+    message.user_id = UserTable::intern("alice");
+    message.content = "after failure";
+    message.timestamp = "2024-01-01 00:00:00";
+    std::shared_ptr<LogFile> file;
+    CHECK(!log.appendUnsynced(1, message, file));
+    log.close();
+    removeDirectory(directory);
+}
+
+int main() {
+    testTornTailRecord();
+    testSealedIndexFallback();
+    testSyncFailure();
+    return checkResult("test_message_log");
+}
@@ -0,0 +1,41 @@
+#include "../include/metrics.h"
+#include "check.h"
+#include <string>
+
+// 导出中某一行的值，没有该行时返回-1
+static long long exportedValue(const std::string& text, const std::string& series) {
+    size_t pos = text.find(series + " ");
+    if (pos == std::string::npos) {
+        return -1;
+    }
+    return std::stoll(text.substr(pos + series.size() + 1));
+}
+
+// 恰好落在边界上的延迟计入该边界，超过边界一纳秒的不计入；每个累计桶都是精确计数
+static void testBucketBounds() {
+    CHECK_EQ(LatencyHistogram::bucketFor(0), 0);
+    CHECK_EQ(LatencyHistogram::bucketFor(100000), 0);
+    CHECK_EQ(LatencyHistogram::bucketFor(100001), 1);
+    CHECK_EQ(LatencyHistogram::bucketFor(10000000000ull), LatencyHistogram::kBounds - 1);
+    CHECK_EQ(LatencyHistogram::bucketFor(10000000001ull), LatencyHistogram::kBounds);
+
+    int route = Metrics::registerRoute("/test/latency");
+    Metrics::recordRequest(route, 200, 96000);      // 96µs
+    Metrics::recordRequest(route, 200, 100000);     // 100µs
+    Metrics::recordRequest(route, 200, 104000);     // 104µs
+    Metrics::recordRequest(route, 200, 250000);     // 250µs
+    Metrics::recordRequest(route, 200, 20000000000ull);
+
+    std::string text = Metrics::renderPrometheus();
+    std::string prefix = "chat_http_request_duration_seconds_bucket{route=\"/test/latency\",le=";
+    CHECK_EQ(exportedValue(text, prefix + "\"0.0001\"}"), 2LL);
+    CHECK_EQ(exportedValue(text, prefix + "\"0.00025\"}"), 4LL);
+    CHECK_EQ(exportedValue(text, prefix + "\"10\"}"), 4LL);
+    CHECK_EQ(exportedValue(text, prefix + "\"+Inf\"}"), 5LL);
+    CHECK_EQ(exportedValue(text, "chat_http_requests_total{route=\"/test/latency\",code=\"200\"}"), 5LL);
+}
+
+int main() {
+    testBucketBounds();
+    return checkResult("test_metrics");
+}
@@ -0,0 +1,193 @@
+#include "../include/request_coalescer.h"
+#include "check.h"
+#include <thread>
+#include <vector>
+#include <string>
+
+// 记录fetch但不立即完成，用于模拟在途的读取
+struct PendingFetches {
+    std::vector<RequestCoalescer::FetchDone> pending;
+
+    RequestCoalescer::Fetch fetch() {
+        return [this](RequestCoalescer::FetchDone finish) { pending.push_back(finish); };
+    }
+    void finish(size_t i, bool ok, const std::string& value) {
+        pending[i](ok, std::make_shared<const std::string>(value));
+    }
+};
+
+// 记录回调收到的结果
+struct Results {
+    std::vector<std::string> values;
+    int failures = 0;
+
+    RequestCoalescer::Callback callback() {
+        return [this](bool ok, const RequestCoalescer::Result& result) {
+            if (ok && result) {
+                values.push_back(*result);
+            } else {
+                failures++;
+            }
+        };
+    }
+};
+
+static RequestCoalescer::Fetch immediate(const std::string& value) {
+    return [value](RequestCoalescer::FetchDone finish) { finish(true, std::make_shared<const std::string>(value)); };
+}
+
+// 在途的相同读取合并为一次，不同的键和分组各自读取
+static void testInflightSharing() {
+    RequestCoalescer coalescer;
+    PendingFetches fetches;
+    Results results;
+
+    coalescer.run(1, "page", fetches.fetch(), results.callback());
+    coalescer.run(1, "page", fetches.fetch(), results.callback());
+    coalescer.run(1, "page", fetches.fetch(), results.callback());
+    coalescer.run(1, "other", fetches.fetch(), results.callback());
+    coalescer.run(2, "page", fetches.fetch(), results.callback());
+    CHECK_EQ(fetches.pending.size(), (size_t)3);
+    CHECK_EQ(coalescer.fetchCount(), (uint64_t)3);
+    CHECK_EQ(coalescer.sharedCount(), (uint64_t)2);
+
+    fetches.finish(0, true, "v1");
+    CHECK_EQ(results.values.size(), (size_t)3);
+    fetches.finish(1, true, "other");
+    fetches.finish(2, true, "room2");
+    CHECK_EQ(results.values.size(), (size_t)5);
+
+    // 没有缓存窗口时完成的结果不保留
+    coalescer.run(1, "page", fetches.fetch(), results.callback());
+    CHECK_EQ(fetches.pending.size(), (size_t)4);
+    fetches.finish(3, true, "v2");
+}
+
+// 缓存窗口内直接使用结果，过期后重新读取；失败的读取不缓存
+static void testCacheWindow() {
+    RequestCoalescer coalescer(100);
+    Results results;
+
+    coalescer.run(1, "page", immediate("v1"), results.callback());
+    coalescer.run(1, "page", immediate("v2"), results.callback());
+    CHECK_EQ(coalescer.fetchCount(), (uint64_t)1);
+    CHECK_EQ(results.values.size(), (size_t)2);
+    CHECK_EQ(results.values.back(), std::string("v1"));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    coalescer.run(1, "page", immediate("v3"), results.callback());
+    CHECK_EQ(coalescer.fetchCount(), (uint64_t)2);
+    CHECK_EQ(results.values.back(), std::string("v3"));
+
+    PendingFetches fetches;
+    coalescer.run(1, "failing", fetches.fetch(), results.callback());
+    coalescer.run(1, "failing", fetches.fetch(), results.callback());
+    fetches.finish(0, false, "");
+    CHECK_EQ(results.failures, 2);
+    coalescer.run(1, "failing", immediate("ok"), results.callback());
+    CHECK_EQ(results.values.back(), std::string("ok"));
+}
+
+// 失效后不再使用缓存的结果，只影响被失效的分组
+static void testInvalidateCachedResult() {
+    RequestCoalescer coalescer(60000);
+    Results results;
+
+    coalescer.run(1, "page", immediate("old"), results.callback());
+    coalescer.run(2, "page", immediate("room2"), results.callback());
+    coalescer.invalidate(1);
+
+    coalescer.run(1, "page", immediate("new"), results.callback());
+    coalescer.run(2, "page", immediate("room2-refetched"), results.callback());
+    CHECK_EQ(results.values.size(), (size_t)4);
+    CHECK_EQ(results.values[2], std::string("new"));
+    CHECK_EQ(results.values[3], std::string("room2"));
+    CHECK_EQ(coalescer.fetchCount(), (uint64_t)3);
+}
+
+// 失效前开始的读取：已经挂在上面的等待者得到它的结果，之后的请求重新读取，
+// 它晚于新读取完成时也不会覆盖新读取缓存的结果
+static void testInvalidateInflight() {
+    RequestCoalescer coalescer(60000);
+    PendingFetches fetches;
+    Results before, after, later;
+
+    coalescer.run(1, "page", fetches.fetch(), before.callback());
+    coalescer.invalidate(1);
+    coalescer.run(1, "page", fetches.fetch(), after.callback());
+    CHECK_EQ(fetches.pending.size(), (size_t)2);
+
+    fetches.finish(1, true, "new");
+    fetches.finish(0, true, "old");
+    CHECK_EQ(before.values.size(), (size_t)1);
+    CHECK_EQ(before.values[0], std::string("old"));
+    CHECK_EQ(after.values.size(), (size_t)1);
+    CHECK_EQ(after.values[0], std::string("new"));
+
+    coalescer.run(1, "page", fetches.fetch(), later.callback());
+    CHECK_EQ(fetches.pending.size(), (size_t)2);
+    CHECK_EQ(later.values.size(), (size_t)1);
+    CHECK_EQ(later.values[0], std::string("new"));
+
+    // 读取期间失效且没有新的读取：结果不缓存
+    coalescer.invalidate(1);
+    coalescer.run(1, "page", fetches.fetch(), later.callback());
+    coalescer.invalidate(1);
+    fetches.finish(2, true, "stale");
+    coalescer.run(1, "page", fetches.fetch(), later.callback());
+    CHECK_EQ(fetches.pending.size(), (size_t)4);
+    fetches.finish(3, true, "fresh");
+    CHECK_EQ(later.values.back(), std::string("fresh"));
+}
+
+// 并发读取与失效：invalidate()返回之后开始的请求不会得到失效之前的数据
+static void testConcurrentInvalidation() {
+    RequestCoalescer coalescer(60000);
+    std::atomic<int> version(0);
+    std::atomic<int> published(0);
+    std::atomic<bool> stop(false);
+    std::atomic<int> stale(0);
+    std::atomic<int> completed(0);
+
+    std::thread writer([&] {
+        for (int i = 0; i < 200; ++i) {
+            int current = ++version;
+            coalescer.invalidate(1);
+            published.store(current);
+            std::this_thread::yield();
+        }
+        stop = true;
+    });
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                int floor = published.load();
+                coalescer.run(1, "page", [&version](RequestCoalescer::FetchDone finish) {
+                    finish(true, std::make_shared<const std::string>(std::to_string(version.load())));
+                }, [floor, &stale, &completed](bool ok, const RequestCoalescer::Result& result) {
+                    if (!ok || std::stoi(*result) < floor) {
+                        stale++;
+                    }
+                    completed++;
+                });
+            }
+        });
+    }
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    CHECK_EQ(stale.load(), 0);
+    CHECK(completed.load() > 0);
+}
+
+int main() {
+    testInflightSharing();
+    testCacheWindow();
+    testInvalidateCachedResult();
+    testInvalidateInflight();
+    testConcurrentInvalidation();
+    return checkResult("test_request_coalescer");
+}
@@ -0,0 +1,184 @@
+#include "../include/room_fanout.h"
+#include "check.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <map>
+
+// 记录订阅和发布的通道，remote()模拟其他实例发布的消息
+class FakeTransport : public FanoutTransport {
+public:
+    std::mutex mutex;
+    std::map<int, int> subscribes;
+    std::map<int, int> unsubscribes;
+    int published = 0;
+    MessageCallback on_message;
+
+    bool start(MessageCallback callback) override { on_message = callback; return true; }
+    void stop() override {}
+    void publish(int, const ChatMessage&) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        published++;
+    }
+    void subscribe(int room_id) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscribes[room_id]++;
+    }
+    void unsubscribe(int room_id) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        unsubscribes[room_id]++;
+    }
+    void remote(int room_id, const ChatMessage& message) { on_message(room_id, message); }
+
+    int subscribeCount(int room_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return subscribes[room_id];
+    }
+    int unsubscribeCount(int room_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return unsubscribes[room_id];
+    }
+};
+
+// 记录一次等待的结果，可以在其他线程上等它结束
+struct WaitResult {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int calls = 0;
+    std::vector<ChatMessage> messages;
+
+    RoomFanout::WaitCallback callback() {
+        return [this](const std::vector<ChatMessage>& result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            calls++;
+            messages = result;
+            cv.notify_all();
+        };
+    }
+    bool waitDone(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return calls > 0; });
+    }
+};
+
+static ChatMessage makeMessage(int seq, const std::string& content) {
+    ChatMessage message;
+    message.seq = seq;
+    message.user_id = UserTable::intern("alice");
+    message.content = content;
+    return message;
+}
+
+// 本实例发送的消息直接唤醒等待者并广播，同一房间只订阅一次
+static void testLocalPublish() {
+    RoomFanout fanout;
+    fanout.start(FanoutConfig());
+    FakeTransport* transport = new FakeTransport();
+    CHECK(fanout.setTransport(std::unique_ptr<FanoutTransport>(transport)));
+
+    WaitResult first, second, other_room;
+    fanout.wait(1, 4, 5000, first.callback());
+    fanout.wait(1, 4, 5000, second.callback());
+    fanout.wait(2, 0, 5000, other_room.callback());
+    CHECK_EQ(transport->subscribeCount(1), 1);
+    CHECK_EQ(transport->subscribeCount(2), 1);
+    CHECK_EQ(fanout.waiterCount(), (size_t)3);
+
+    fanout.publish(1, makeMessage(5, "hello"));
+    CHECK_EQ(first.calls, 1);
+    CHECK_EQ(second.calls, 1);
+    CHECK_EQ(first.messages.size(), (size_t)1);
+    CHECK_EQ(first.messages[0].content, std::string("hello"));
+    CHECK_EQ(other_room.calls, 0);
+    CHECK_EQ(transport->published, 1);
+    CHECK_EQ(fanout.waiterCount(), (size_t)1);
+
+    fanout.stop();
+    // 停止时剩余的等待者以空结果结束
+    CHECK_EQ(other_room.calls, 1);
+    CHECK(other_room.messages.empty());
+}
+
+// 其他实例的消息经通道到达；与等待者已有的序号不连续时返回空结果，由调用者重新读取
+static void testRemoteDeliveryAndGap() {
+    RoomFanout fanout;
+    fanout.start(FanoutConfig());
+    FakeTransport* transport = new FakeTransport();
+    fanout.setTransport(std::unique_ptr<FanoutTransport>(transport));
+    int remote_seen = 0;
+    fanout.setRemoteMessageCallback([&remote_seen](int, const ChatMessage&) { remote_seen++; });
+
+    WaitResult next, behind, ahead;
+    fanout.wait(7, 9, 5000, next.callback());
+    fanout.wait(7, 8, 5000, behind.callback());
+    fanout.wait(7, 10, 5000, ahead.callback());
+
+    transport->remote(7, makeMessage(10, "remote"));
+    CHECK_EQ(remote_seen, 1);
+    CHECK_EQ(next.calls, 1);
+    CHECK_EQ(next.messages.size(), (size_t)1);
+    CHECK_EQ(behind.calls, 1);
+    CHECK(behind.messages.empty());
+    // 已经看到第10条的等待者不被唤醒
+    CHECK_EQ(ahead.calls, 0);
+    CHECK_EQ(transport->published, 0);
+
+    fanout.stop();
+}
+
+// 超时的等待者以空结果结束；取消后不再调用done
+static void testTimeoutAndCancel() {
+    RoomFanout fanout;
+    FanoutConfig config;
+    config.sweep_interval_ms = 20;
+    fanout.start(config);
+
+    WaitResult timed_out, cancelled;
+    fanout.wait(3, 0, 50, timed_out.callback());
+    RoomFanout::WaitHandle handle = fanout.wait(3, 0, 50, cancelled.callback());
+    CHECK(fanout.cancel(handle));
+    CHECK(!fanout.cancel(handle));
+
+    CHECK(timed_out.waitDone(2000));
+    CHECK(timed_out.messages.empty());
+    CHECK_EQ(cancelled.calls, 0);
+    CHECK_EQ(fanout.waiterCount(), (size_t)0);
+
+    fanout.stop();
+    CHECK_EQ(cancelled.calls, 0);
+}
+
+// 房间的最后一个等待者离开并空闲超过配置时间后退订，再有等待者时重新订阅
+static void testIdleUnsubscribe() {
+    RoomFanout fanout;
+    FanoutConfig config;
+    config.idle_unsubscribe_seconds = 0;
+    config.sweep_interval_ms = 10;
+    fanout.start(config);
+    FakeTransport* transport = new FakeTransport();
+    fanout.setTransport(std::unique_ptr<FanoutTransport>(transport));
+
+    WaitResult result;
+    fanout.wait(4, 0, 5000, result.callback());
+    fanout.publish(4, makeMessage(1, "x"));
+    CHECK_EQ(result.calls, 1);
+
+    for (int i = 0; i < 200 && transport->unsubscribeCount(4) == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK_EQ(transport->unsubscribeCount(4), 1);
+
+    WaitResult again;
+    fanout.wait(4, 1, 5000, again.callback());
+    CHECK_EQ(transport->subscribeCount(4), 2);
+
+    fanout.stop();
+}
+
+int main() {
+    testLocalPublish();
+    testRemoteDeliveryAndGap();
+    testTimeoutAndCancel();
+    testIdleUnsubscribe();
+    return checkResult("test_room_fanout");
+}
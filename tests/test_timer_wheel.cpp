@@ -0,0 +1,166 @@
+#include "../include/timer_wheel.h"
+#include "check.h"
+#include <random>
+#include <algorithm>
+#include <vector>
+
+// 刻度为1毫秒，延迟覆盖时间轮的4层：第0层不超过255个刻度，第1层到65535，第2层到16777215，之后为第3层
+static const uint64_t kStart = 1000003;
+static const uint64_t kDelays[] = {
+    0, 1, 2, 255, 256, 257, 511, 1000, 65535, 65536, 65537, 70000,
+    16777215, 16777216, 16777217, 20000000,
+};
+
+// 每个定时器在第一次推进到不早于它到期时间的advance()中触发（当前刻度已处理，最早在下一个刻度）
+static void testCascadeAcrossLevels() {
+    std::mt19937_64 random(42);
+    TimerWheel wheel(1, kStart);
+
+    struct Expected {
+        uint64_t deadline;
+        uint64_t fired_at = 0;
+        int fired = 0;
+    };
+    std::vector<Expected> timers;
+    uint64_t now = kStart;
+
+    for (uint64_t delay : kDelays) {
+        timers.push_back(Expected{kStart + delay});
+    }
+    for (int i = 0; i < 2000; ++i) {
+        int bits = (int)(random() % 25);
+        timers.push_back(Expected{kStart + (random() & ((1ull << bits) - 1))});
+    }
+    for (size_t i = 0; i < timers.size(); ++i) {
+        uint64_t deadline = timers[i].deadline;
+        timers[i].deadline = std::max(deadline, kStart + 1);
+        wheel.scheduleAt(deadline, [&timers, &now, i] {
+            timers[i].fired++;
+            timers[i].fired_at = now;
+        });
+    }
+    CHECK_EQ(wheel.size(), timers.size());
+
+    // 按不规则的步长推进，步长跨过第0层的整圈时要分散上层的槽
+    uint64_t previous = now;
+    size_t early = 0, late = 0;
+    while (wheel.size() > 0 && now < kStart + (1ull << 26)) {
+        previous = now;
+        now += 1 + random() % 3000;
+        wheel.advance(now);
+        for (const auto& timer : timers) {
+            if (timer.fired_at == now && (timer.deadline > now || timer.deadline <= previous)) {
+                timer.deadline > now ? early++ : late++;
+            }
+        }
+    }
+    CHECK_EQ(early, (size_t)0);
+    CHECK_EQ(late, (size_t)0);
+    CHECK_EQ(wheel.size(), (size_t)0);
+
+    size_t fired_once = 0;
+    for (const auto& timer : timers) {
+        if (timer.fired == 1) {
+            fired_once++;
+        }
+    }
+    CHECK_EQ(fired_once, timers.size());
+}
+
+// 逐个刻度推进时，分散到下层的定时器恰好在到期的刻度触发
+static void testExactTickAfterCascade() {
+    TimerWheel wheel(10, 0);
+    std::vector<uint64_t> fired;
+    uint64_t now = 0;
+    const uint64_t delays[] = {2560, 2570, 655360, 655370, 700000};
+    for (uint64_t delay : delays) {
+        wheel.schedule(delay, [&fired, &now] { fired.push_back(now); });
+    }
+    while (wheel.size() > 0) {
+        now += 10;
+        wheel.advance(now);
+    }
+    CHECK_EQ(fired.size(), (size_t)5);
+    for (size_t i = 0; i < fired.size() && i < 5; ++i) {
+        CHECK_EQ(fired[i], delays[i]);
+    }
+}
+
+// 取消上层中和已经分散到下层的定时器；旧编号在节点复用后失效
+static void testCancel() {
+    TimerWheel wheel(1, 0);
+    int fired = 0;
+    TimerWheel::TimerId upper = wheel.schedule(70000, [&fired] { fired++; });
+    TimerWheel::TimerId cascaded = wheel.schedule(300, [&fired] { fired++; });
+    TimerWheel::TimerId kept = wheel.schedule(400, [&fired] { fired++; });
+    CHECK(kept != 0);
+
+    CHECK(wheel.cancel(upper));
+    CHECK(!wheel.cancel(upper));
+    wheel.advance(260);   // 第1层的槽已分散到第0层
+    CHECK(wheel.cancel(cascaded));
+    CHECK_EQ(wheel.size(), (size_t)1);
+
+    TimerWheel::TimerId reused = wheel.schedule(10, [&fired] { fired += 100; });
+    CHECK(!wheel.cancel(upper));
+    CHECK(!wheel.cancel(cascaded));
+
+    wheel.advance(100000);
+    CHECK_EQ(fired, 101);
+    CHECK(!wheel.cancel(reused));
+    CHECK_EQ(wheel.size(), (size_t)0);
+}
+
+// 回调中添加和取消定时器；同一刻度触发的定时器在回调中被取消时不再触发
+static void testReentrantCallbacks() {
+    TimerWheel wheel(1, 0);
+    std::vector<int> order;
+    TimerWheel::TimerId victim = 0;
+    wheel.schedule(5, [&] {
+        order.push_back(1);
+        wheel.cancel(victim);
+        wheel.schedule(300, [&order] { order.push_back(3); });
+    });
+    victim = wheel.schedule(5, [&order] { order.push_back(2); });
+
+    wheel.advance(5);
+    CHECK_EQ(order.size(), (size_t)1);
+    wheel.advance(304);
+    CHECK_EQ(order.size(), (size_t)1);
+    wheel.advance(305);
+    CHECK_EQ(order.size(), (size_t)2);
+    if (order.size() == 2) {
+        CHECK_EQ(order[1], 3);
+    }
+}
+
+// nextTimeoutMs()可以提前但不会晚于最近的到期时间
+static void testNextTimeout() {
+    TimerWheel wheel(10, 0);
+    CHECK_EQ(wheel.nextTimeoutMs(), -1);
+    wheel.schedule(45, [] {});
+    CHECK_EQ(wheel.nextTimeoutMs(), 50);
+
+    // 推进到刻度中间时从推进的时间算起，按超时等待后推进即可触发
+    TimerWheel mid(10, 0);
+    int fired = 0;
+    mid.advance(9);
+    mid.schedule(1, [&fired] { fired++; });
+    CHECK_EQ(mid.nextTimeoutMs(), 1);
+    mid.advance(9 + (uint64_t)mid.nextTimeoutMs());
+    CHECK_EQ(fired, 1);
+
+    TimerWheel far(10, 0);
+    far.schedule(100000, [] {});
+    int next = far.nextTimeoutMs();
+    CHECK(next > 0 && next <= 100000);
+}
+
+int main() {
+    testCascadeAcrossLevels();
+    testExactTickAfterCascade();
+    testCancel();
+    testReentrantCallbacks();
+    testNextTimeout();
+    return checkResult("test_timer_wheel");
+}
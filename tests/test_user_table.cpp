@@ -0,0 +1,113 @@
+#include "../include/user_table.h"
+#include "check.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 编号从1开始按首次出现的顺序分配，空用户名为0
+static void testBasics() {
+    size_t before = UserTable::size();
+    CHECK_EQ(UserTable::intern(""), UserTable::kNoUser);
+    CHECK_EQ(UserTable::name(UserTable::kNoUser), std::string());
+
+    uint32_t alice = UserTable::intern("basic-alice");
+    uint32_t bob = UserTable::intern("basic-bob");
+    CHECK(alice != UserTable::kNoUser);
+    CHECK_EQ(bob, alice + 1);
+    CHECK_EQ(UserTable::intern("basic-alice"), alice);
+    CHECK_EQ(UserTable::name(alice), std::string("basic-alice"));
+    CHECK_EQ(UserTable::size(), before + 2);
+
+    uint32_t found = 0;
+    CHECK(UserTable::find("basic-bob", found));
+    CHECK_EQ(found, bob);
+    CHECK(!UserTable::find("basic-nobody", found));
+    CHECK(!UserTable::find("", found));
+    CHECK_EQ(UserTable::size(), before + 2);
+    CHECK_EQ(UserTable::name(bob + 1000000), std::string());
+
+    // 中文用户名和只有大小写不同的用户名是不同的用户
+    uint32_t chinese = UserTable::intern("张三");
+    CHECK(chinese != UserTable::intern("basic-Alice"));
+    CHECK_EQ(UserTable::name(chinese), std::string("张三"));
+}
+
+// 多个线程以不同顺序同时登记同一批用户名（期间查找表多次扩容）：
+// 每个用户名只分配一个编号，所有线程得到相同的编号，编号与用户名互相对应
+static void testConcurrentIntern() {
+    const int kThreads = 8;
+    const int kNames = 20000;
+    size_t before = UserTable::size();
+
+    std::vector<std::string> names;
+    for (int i = 0; i < kNames; ++i) {
+        names.push_back("race-user-" + std::to_string(i));
+    }
+
+    std::vector<std::vector<uint32_t>> ids(kThreads, std::vector<uint32_t>(kNames, 0));
+    std::atomic<int> ready(0);
+    std::atomic<int> mismatched(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            std::vector<int> order(kNames);
+            for (int i = 0; i < kNames; ++i) {
+                order[i] = i;
+            }
+            std::mt19937 random(t);
+            std::shuffle(order.begin(), order.end(), random);
+
+            ready++;
+            while (ready.load() < kThreads) {
+                std::this_thread::yield();
+            }
+            for (int i : order) {
+                uint32_t id = UserTable::intern(names[i]);
+                ids[t][i] = id;
+                // 刚登记的编号立即可以换回用户名、按用户名找到
+                uint32_t found = 0;
+                if (UserTable::name(id) != names[i] || !UserTable::find(names[i], found) || found != id) {
+                    mismatched++;
+                }
+                // 其他线程可能正在登记的用户名：找到时编号必须对应这个用户名
+                const std::string& other = names[(i + 1) % kNames];
+                if (UserTable::find(other, found) && UserTable::name(found) != other) {
+                    mismatched++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    CHECK_EQ(mismatched.load(), 0);
+    CHECK_EQ(UserTable::size(), before + kNames);
+
+    int differing = 0;
+    std::set<uint32_t> distinct;
+    for (int i = 0; i < kNames; ++i) {
+        for (int t = 1; t < kThreads; ++t) {
+            if (ids[t][i] != ids[0][i]) {
+                differing++;
+            }
+        }
+        distinct.insert(ids[0][i]);
+        if (UserTable::name(ids[0][i]) != names[i]) {
+            differing++;
+        }
+    }
+    CHECK_EQ(differing, 0);
+    CHECK_EQ(distinct.size(), (size_t)kNames);
+    CHECK(distinct.count((uint32_t)UserTable::kNoUser) == 0);
+}
+
+int main() {
+    testBasics();
+    testConcurrentIntern();
+    return checkResult("test_user_table");
+}
@@ -0,0 +1,231 @@
+#include "../include/utf8_json.h"
+#include "check.h"
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// 按码点解码的参考实现，与被测的各个实现分别对比
+static bool referenceValid(const std::string& text) {
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = text[i];
+        size_t length;
+        uint32_t code_point;
+        if (c < 0x80) {
+            i++;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            length = 2;
+            code_point = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            length = 3;
+            code_point = c & 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            length = 4;
+            code_point = c & 0x07;
+        } else {
+            return false;
+        }
+        if (i + length > text.size()) {
+            return false;
+        }
+        for (size_t k = 1; k < length; ++k) {
+            unsigned char next = text[i + k];
+            if ((next & 0xC0) != 0x80) {
+                return false;
+            }
+            code_point = (code_point << 6) | (next & 0x3F);
+        }
+        static const uint32_t kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (code_point < kMinimum[length] || code_point > 0x10FFFF ||
+            (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+static const char* const kValid[] = {
+    "",
+    "hello, world",
+    "你好，世界",
+    "\xC2\x80",                 // U+0080
+    "\xDF\xBF",                 // U+07FF
+    "\xE0\xA0\x80",             // U+0800
+    "\xED\x9F\xBF",             // U+D7FF，代理项之前
+    "\xEE\x80\x80",             // U+E000，代理项之后
+    "\xEF\xBF\xBF",             // U+FFFF
+    "\xF0\x90\x80\x80",         // U+10000
+    "\xF0\x9F\x98\x80",         // 😀
+    "\xF4\x8F\xBF\xBF",         // U+10FFFF
+};
+
+static const char* const kInvalid[] = {
+    "\x80",                     // 单独的后续字节
+    "\xBF",
+    "\xC0\x80",                 // 过长编码的U+0000
+    "\xC1\xBF",                 // 过长编码的U+007F
+    "\xE0\x80\x80",             // 过长编码的三字节
+    "\xE0\x9F\xBF",             // 过长编码的U+07FF
+    "\xF0\x80\x80\x80",         // 过长编码的四字节
+    "\xF0\x8F\xBF\xBF",         // 过长编码的U+FFFF
+    "\xED\xA0\x80",             // U+D800，代理项
+    "\xED\xAF\xBF",             // U+DBFF
+    "\xED\xB0\x80",             // U+DC00
+    "\xED\xBF\xBF",             // U+DFFF
+    "\xED\xA0\xBD\xED\xB8\x80", // CESU-8编码的😀（代理对）
+    "\xF4\x90\x80\x80",         // U+110000
+    "\xF5\x80\x80\x80",
+    "\xF8\x88\x80\x80\x80",     // 五字节
+    "\xFE",
+    "\xFF",
+    "\xC2",                     // 截断
+    "\xE4\xB8",
+    "\xF0\x9F\x98",
+    "\xC2\x41",                 // 后续字节位置上是ASCII
+    "\xE4\x41\xAD",
+    "\xF0\x9F\x41\x80",
+};
+
+static std::vector<std::string> availableIsas() {
+    std::vector<std::string> isas;
+    for (const char* isa : {"scalar", "sse2", "avx2"}) {
+        if (setUtf8JsonIsa(isa)) {
+            isas.push_back(isa);
+        }
+    }
+    return isas;
+}
+
+// 单个字符和错误序列，以及把它们放在长缓冲区中不同位置（跨过16/32字节的分块边界）
+static void testValidation(const std::string& isa) {
+    int failures_before = check_failures;
+
+    for (const char* text : kValid) {
+        CHECK(referenceValid(text));
+        CHECK(isValidUtf8(text));
+    }
+    for (const char* text : kInvalid) {
+        CHECK(!referenceValid(text));
+        CHECK(!isValidUtf8(text));
+    }
+    CHECK(isValidUtf8(std::string("a\0b", 3)));
+
+    std::string filler = "中文消息abc";
+    for (size_t prefix = 0; prefix < 70; ++prefix) {
+        std::string head;
+        while (head.size() < prefix) {
+            head += 'x';
+        }
+        for (const char* text : kValid) {
+            CHECK(isValidUtf8(head + text + filler + filler));
+            CHECK(isValidUtf8(head + text));
+        }
+        for (const char* text : kInvalid) {
+            CHECK(!isValidUtf8(head + text + filler + filler));
+            // 截断的字符在缓冲区末尾
+            CHECK(!isValidUtf8(head + text));
+        }
+        // 多字节字符跨过分块边界
+        CHECK(isValidUtf8(head + "\xF0\x9F\x98\x80" "\xE4\xB8\xAD" + head));
+    }
+
+    if (check_failures != failures_before) {
+        std::cerr << "以上失败出现在 " << isa << " 实现中" << std::endl;
+    }
+}
+
+// 随机拼接合法字符和错误序列，与参考实现对比
+static void testRandomAgainstReference(const std::string& isa) {
+    std::mt19937 random(7);
+    std::vector<std::string> fragments;
+    for (const char* text : kValid) {
+        fragments.push_back(text);
+    }
+    for (const char* text : {"a", "abcdefgh", "\"", "\\", "\n", "\x01", "\x7F", "中"}) {
+        for (int k = 0; k < 4; ++k) {
+            fragments.push_back(text);
+        }
+    }
+    std::vector<std::string> broken(std::begin(kInvalid), std::end(kInvalid));
+
+    int mismatches = 0;
+    for (int round = 0; round < 20000; ++round) {
+        std::string text;
+        size_t pieces = random() % 40;
+        for (size_t i = 0; i < pieces; ++i) {
+            text += fragments[random() % fragments.size()];
+        }
+        if (random() % 3 == 0) {
+            text.insert(random() % (text.size() + 1), broken[random() % broken.size()]);
+        }
+        if (random() % 5 == 0 && !text.empty()) {
+            text.resize(random() % text.size());
+        }
+        if (isValidUtf8(text) != referenceValid(text)) {
+            mismatches++;
+        }
+    }
+    if (mismatches != 0) {
+        std::cerr << isa << " 实现与参考实现不一致" << std::endl;
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+// 转义结果与nlohmann::json::dump()逐字节一致
+static void testEscapingMatchesJsonLibrary(const std::string& isa) {
+    std::vector<std::string> samples = {
+        "",
+        "plain ascii",
+        "引号\"和反斜杠\\",
+        "控制字符\b\f\n\r\t",
+        std::string("\x00\x01\x1F\x7F", 4),
+        "</script>",
+        "😀 emoji 和中文混排",
+    };
+    std::string all_controls;
+    for (int c = 0; c < 0x20; ++c) {
+        all_controls += (char)c;
+    }
+    samples.push_back(all_controls);
+
+    // 需要转义的字符出现在分块内的每个位置
+    for (size_t position = 0; position < 70; ++position) {
+        std::string text(70, 'a');
+        text[position] = '"';
+        samples.push_back(text);
+        text[position] = '\x1F';
+        samples.push_back(text);
+        samples.push_back(std::string(position, 'b') + "中文" + std::string(70 - position, '\\'));
+    }
+
+    int mismatches = 0;
+    for (const std::string& text : samples) {
+        std::string out = "prefix:";
+        appendJsonString(out, text);
+        if (out != "prefix:" + nlohmann::json(text).dump()) {
+            std::cerr << isa << " 转义结果不一致: " << out << std::endl;
+            mismatches++;
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+int main() {
+    std::string detected = utf8JsonIsa();
+    CHECK(!setUtf8JsonIsa("neon"));
+    CHECK_EQ(std::string(utf8JsonIsa()), detected);
+
+    std::vector<std::string> isas = availableIsas();
+    CHECK(!isas.empty());
+    for (const std::string& isa : isas) {
+        CHECK(setUtf8JsonIsa(isa.c_str()));
+        testValidation(isa);
+        testRandomAgainstReference(isa);
+        testEscapingMatchesJsonLibrary(isa);
+    }
+    setUtf8JsonIsa(detected.c_str());
+    return checkResult("test_utf8_json");
+}